@@ -0,0 +1,52 @@
+/*
+Partial refresh for the SSD1306 OLED.
+
+display.display() sends the whole 1 KB framebuffer over I2C, which is the
+same bus the DS3231 is on. push() keeps a copy of what the panel is showing
+and, for each 8 pixel high page, only sends the run of columns that changed.
+Anything that calls display.display() directly must call invalidate() so the
+next push() sends the whole screen again.
+*/
+#ifndef DISPLAY_REFRESH_H
+#define DISPLAY_REFRESH_H
+
+#include <Arduino.h>
+#include <Wire.h>
+#include <Adafruit_SSD1306.h>
+
+#define DISPLAY_WIDTH 128
+#define DISPLAY_HEIGHT 64
+#define DISPLAY_PAGES (DISPLAY_HEIGHT / 8)
+#define DISPLAY_I2C_CHUNK 32        // bytes per I2C transaction, control byte included
+#define DISPLAY_I2C_CLOCK 400000    // same clocks Adafruit_SSD1306 uses during / after a refresh
+#define DISPLAY_I2C_CLOCK_AFTER 100000
+
+class DisplayRefresh {
+ public:
+  DisplayRefresh(Adafruit_SSD1306 &display, TwoWire &wire, uint8_t address);
+
+  // Send the changed part of the framebuffer to the panel
+  void push();
+  // The panel no longer matches our copy, the next push sends everything
+  void invalidate() { stale = true; }
+  bool isStale() const { return stale; }
+
+  uint32_t pushCount() const { return pushes; }
+  uint32_t pagesSent() const { return pages; }
+  uint32_t bytesSent() const { return bytes; }
+
+ private:
+  void command(const uint8_t *commands, uint8_t count);
+  void data(const uint8_t *bytes, uint16_t count);
+
+  Adafruit_SSD1306 &display;
+  TwoWire &wire;
+  uint8_t address;
+  volatile bool stale;
+  uint8_t shown[DISPLAY_WIDTH * DISPLAY_PAGES];
+  uint32_t pushes;
+  uint32_t pages;
+  uint32_t bytes;
+};
+
+#endif
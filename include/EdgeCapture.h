@@ -0,0 +1,29 @@
+/*
+Interrupt driven edge capture for the vehicle sensor and the optical beams.
+The ISR timestamps every level change with micros() and pushes it into a
+lock-free ring, so capture latency no longer depends on what loop() is doing.
+All inputs share the ring, each edge carries the input number it came from.
+*/
+#ifndef EDGE_CAPTURE_H
+#define EDGE_CAPTURE_H
+
+#include <Arduino.h>
+#include "EdgeRing.h"
+
+#define EDGE_RING_SIZE 256 // ~40 bounces per car, so this holds several cars of backlog
+#define EDGE_MAX_INPUTS 4
+
+// Attach the interrupt for one input, it is serviced on the core that calls this.
+// Call it for every input from the same task so the ring keeps a single producer.
+void edgeCaptureBegin(uint8_t pin, uint8_t input = 0);
+// Wake this task (ulTaskNotifyTake) whenever an edge is captured
+void edgeCaptureNotify(TaskHandle_t task);
+bool edgeCapturePop(SensorEdge &edge);
+uint16_t edgeCaptureAvailable();
+uint32_t edgeCaptureDropped();
+uint16_t edgeCaptureHighWater();
+
+// Convert a recent micros() timestamp into the millis() timeline (wrap safe)
+unsigned long microsToMillis(uint32_t edgeMicros);
+
+#endif
@@ -0,0 +1,108 @@
+/*
+The ESP32 side of Hal.h, what GateApp runs on in the gate.
+
+  EspClock     TimeService, cached RTC time and temperature
+  EspSensors   EdgeCapture interrupts and digitalRead()
+  EspDisplay   the SSD1306 main screen, sent with DisplayRefresh
+  EspMqtt      PubSubClient, or the SD card outbox while the broker is down
+  EspQueue     a FreeRTOS queue
+  EspFileStore a file on the SD card, kept open for update
+  LogWriter    (LogWriter.h) is the HalLog
+
+Each one only wraps what main.cpp already sets up, begin() calls and
+connecting stay there.
+*/
+#ifndef ESP32_HAL_H
+#define ESP32_HAL_H
+
+#include <Arduino.h>
+#include <Adafruit_SSD1306.h>
+#include <FS.h>
+#include <PubSubClient.h>
+#include "DisplayRefresh.h"
+#include "Hal.h"
+#include "MqttOutbox.h"
+#include "TimeService.h"
+
+class EspClock : public HalClock {
+ public:
+  explicit EspClock(TimeService &timeService) : timeService(timeService) {}
+  uint32_t micros() { return ::micros(); }
+  uint32_t millis() { return ::millis(); }
+  uint32_t unixtimeAt(uint32_t micros) { return timeService.unixtimeAt(micros); }
+  int16_t temperature() { return timeService.temperature(); }
+
+ private:
+  TimeService &timeService;
+};
+
+// pins[] in the order of the EdgeCapture inputs
+class EspSensors : public HalSensors {
+ public:
+  EspSensors(const uint8_t *pins, uint8_t count) : pins(pins), count(count) {}
+  bool pop(SensorEdge &edge);
+  uint8_t read(uint8_t input);
+
+ private:
+  const uint8_t *pins;
+  uint8_t count;
+};
+
+class EspDisplay : public HalDisplay {
+ public:
+  EspDisplay(Adafruit_SSD1306 &display, DisplayRefresh &refresh);
+  // Only redraws when something shown has changed, and then only sends the changed pages
+  void show(const DisplayValues &values);
+
+ private:
+  void drawMainScreen(const DisplayValues &values);
+
+  Adafruit_SSD1306 &display;
+  DisplayRefresh &refresh;
+  DisplayValues shown;
+};
+
+class EspMqtt : public HalMqtt {
+ public:
+  EspMqtt(PubSubClient &client, MqttOutbox &outbox) : client(client), outbox(outbox) {}
+  // Retained messages are state (the active config), they go now or not at all.
+  // Everything else is published now if we can, otherwise kept on the SD card until
+  // the broker is back. Once anything is queued new messages queue behind it so they stay in order.
+  bool publish(const char *topic, const char *payload, bool retained = false);
+  // Catch up on anything that was queued while we were offline
+  uint16_t replay(unsigned long nowMillis);
+
+ private:
+  static bool publishToBroker(const char *topic, const char *payload, void *context);
+
+  PubSubClient &client;
+  MqttOutbox &outbox;
+};
+
+class EspFileStore : public HalStore {
+ public:
+  explicit EspFileStore(const char *path) : path(path) {}
+  // Opens the file, making it if it isn't there. Before the task that uses it starts.
+  bool begin(fs::FS &fs);
+  bool read(uint32_t offset, void *data, size_t length);
+  bool write(uint32_t offset, const void *data, size_t length);
+  bool flush();
+
+ private:
+  const char *path;
+  File file;
+};
+
+template <class T>
+class EspQueue : public HalQueue<T> {
+ public:
+  EspQueue() : handle(NULL) {}
+  void begin(UBaseType_t length) { handle = xQueueCreate(length, sizeof(T)); }
+  bool send(const T &item) { return xQueueSend(handle, &item, 0) == pdTRUE; }
+  bool receive(T &item, uint32_t waitMs) { return xQueueReceive(handle, &item, pdMS_TO_TICKS(waitMs)) == pdTRUE; }
+
+ private:
+  QueueHandle_t handle;
+};
+
+#endif
@@ -0,0 +1,107 @@
+/*
+How a GateEvent is written out: the CSV rows on the SD card, the GateLog.bin
+record and the JSON on the events topic.
+
+Kept apart from GateApp.cpp with no Arduino calls so the bench host tool
+(src/host/bench) times exactly what the logging and network tasks run.
+The CSV rows stay printf formats because LogWriter formats them straight
+into its sector buffer:
+
+    gateCountLog.printf(GATE_COUNT_ROW_FORMAT, GATE_COUNT_ROW_ARGS(event, sensorBounceFlag));
+*/
+#ifndef EVENT_FORMAT_H
+#define EVENT_FORMAT_H
+
+#include <stdio.h>
+#include <string.h>
+
+#include "BinLog.h"
+#include "GateEvent.h"
+
+// GateCount.csv, one row per counted car
+#define GATE_COUNT_HEADER \
+  "Date Time,Pass Timer,NoCar Timer,Bounces,Car#,Cars In Park,Temp,Last Car Millis, This Car Millis,Bounce Flag,Millis,Seq,Class"
+// The casts keep %u / %d right where uint32_t is unsigned long (newer ESP32 toolchains)
+#define GATE_COUNT_ROW_FORMAT "%s, %u, %u, %u, %d, %d, %d , %u , %u, %d, %u, %u, %s\r\n"
+#define GATE_COUNT_ROW_ARGS(event, bounceFlag)                                                        \
+  (event).timestamp, (unsigned)(event).passMs, (unsigned)(event).noCarMs, (unsigned)(event).bounces, \
+      (int)(event).carNumber, (int)(event).carsInPark, (int)(event).temp,                           \
+      (unsigned)(event).lastCarDetectedMillis, (unsigned)(event).carDetectedMillis, (int)(bounceFlag), \
+      (unsigned)(event).millis, (unsigned)(event).seq,                                              \
+      (event).vehicle < PASS_CLASSES ? passClassName((event).vehicle) : ""
+
+// GateCorrections.csv, one row per confirm or retract of an earlier count
+#define CORRECTION_HEADER "Date Time,Seq,Event,Reason,Car#,Cars In Park"
+#define CORRECTION_ROW_FORMAT "%s, %u, %s, %s, %d, %d\r\n"
+#define CORRECTION_ROW_ARGS(event)                                                               \
+  (event).timestamp, (unsigned)(event).seq, (event).type == GATE_COUNT_CONFIRMED ? "confirm" : "retract", \
+      countReasonName((event).reason), (int)(event).carNumber, (int)(event).carsInPark
+
+// SensorBounces.csv, one row per bounce
+#define BOUNCE_HEADER "Time,Pass Timer,Last High,Diff,No Car Timer,Low Millis,Last Low,Diff,Bounce#,Curent State,Car#,Millis"
+#define BOUNCE_ROW_FORMAT "%s, %u, %u, %u, %u, %u, %u, %u , %u , %u , %d , %u , %u , %u\r\n"
+#define BOUNCE_ROW_ARGS(event)                                                                      \
+  (event).timestamp, (unsigned)(event).passMs, (unsigned)(event).lastHighMs,                      \
+      (unsigned)((event).passMs - (event).lastHighMs), (unsigned)(event).noCarMs,                 \
+      (unsigned)(event).lowMs, (unsigned)(event).lastLowMs, (unsigned)((event).lowMs - (event).lastLowMs), \
+      (unsigned)(event).bounces, (unsigned)(event).level, (int)(event).carNumber,                 \
+      (unsigned)(event).lastCarDetectedMillis, (unsigned)(event).carDetectedMillis, (unsigned)(event).millis
+
+// GateLog.bin record for the event, everything but the time (BinLogEncoder::stamp)
+inline void binLogEventRecord(BinLogRecord &record, const GateEvent &event) {
+  memset(&record, 0, sizeof(record));
+  record.level = event.level;
+  record.bounces = event.bounces;
+  switch (event.type) {
+    case GATE_CAR_START: record.type = BINLOG_CAR_START; break;
+    case GATE_BOUNCE:    record.type = BINLOG_BOUNCE;    break;
+    case GATE_CAR_COUNTED: record.type = BINLOG_CAR;     break;
+    case GATE_TIMEOUT:   record.type = BINLOG_TIMEOUT;   break;
+    case GATE_COUNT_CONFIRMED: record.type = BINLOG_CONFIRM; break;
+    case GATE_COUNT_RETRACTED: record.type = BINLOG_RETRACT; break;
+    default:             record.type = BINLOG_DAY_RESET; break;
+  }
+  if (record.type == BINLOG_CONFIRM || record.type == BINLOG_RETRACT) {
+    record.count.seq = event.seq;
+    record.count.carNumber = event.carNumber;
+    record.count.reason = event.reason;
+  } else if (event.type == GATE_CAR_START || event.type == GATE_BOUNCE) {
+    record.bounce.passMs = binLogMs(event.passMs);
+    record.bounce.lastHighMs = binLogMs(event.lastHighMs);
+    record.bounce.lowGapMs = binLogMs(event.lowMs - event.lastLowMs);
+    record.bounce.carNumber = event.carNumber;
+  } else {
+    record.car.passMs = binLogMs(event.passMs);
+    record.car.noCarMs = binLogMs(event.noCarMs);
+    record.car.carNumber = event.carNumber;
+    record.car.carsInPark = event.carsInPark;
+  }
+}
+
+// One entry of the events topic array, e.g.
+// {"event":"car","seq":310,"class":"car","count":125,"inpark":40,"temp":71,"time":"2024-05-04 17:02:11"}
+// Returns what snprintf does, the length it needed.
+inline int formatEventJson(char *out, size_t size, const GateEvent &event) {
+  if (event.type == GATE_COUNT_CONFIRMED || event.type == GATE_COUNT_RETRACTED) {
+    return snprintf(out, size,
+        "{\"event\":\"%s\",\"seq\":%u,\"reason\":\"%s\",\"count\":%d,\"inpark\":%d,\"time\":\"%s\"}",
+        event.type == GATE_COUNT_CONFIRMED ? "confirm" : "retract", (unsigned)event.seq,
+        countReasonName(event.reason), (int)event.carNumber, (int)event.carsInPark, event.timestamp);
+  }
+  if (event.type == GATE_CAR_COUNTED && event.vehicle < PASS_CLASSES) {
+    return snprintf(out, size,
+        "{\"event\":\"car\",\"seq\":%u,\"class\":\"%s\",\"count\":%d,\"inpark\":%d,\"temp\":%d,\"time\":\"%s\"}",
+        (unsigned)event.seq, passClassName(event.vehicle), (int)event.carNumber, (int)event.carsInPark, event.temp,
+        event.timestamp);
+  }
+  if (event.type == GATE_CAR_COUNTED) {
+    return snprintf(out, size,
+        "{\"event\":\"car\",\"seq\":%u,\"count\":%d,\"inpark\":%d,\"temp\":%d,\"time\":\"%s\"}",
+        (unsigned)event.seq, (int)event.carNumber, (int)event.carsInPark, event.temp, event.timestamp);
+  }
+  return snprintf(out, size,
+      "{\"event\":\"%s\",\"count\":%d,\"inpark\":%d,\"temp\":%d,\"time\":\"%s\"}",
+      fusionPassName(event.pass), (int)event.carNumber, (int)event.carsInPark, event.temp, event.timestamp);
+}
+
+#endif
@@ -0,0 +1,256 @@
+/*
+The gate counter itself: counting, logging, publishing and the display,
+on top of the interfaces in Hal.h instead of Arduino.
+
+main.cpp gives it the ESP32 hardware (Esp32Hal.h) and runs each part in
+its own FreeRTOS task, the host simulator (src/host/sim) gives it a
+scripted sensor and files and runs the same parts in turn.
+
+  setup()        restoreCounters() once, before any of the tasks
+  sensing task   sensingBegin() once, then sensingPass() on every edge
+                 interrupt and every SENSING_POLL_MS
+  logging task   logEvent() for each event off hal.logQueue, serviceLogs()
+  network task   rollupBegin() once, then publishGateEvent() for each event
+                 off hal.netQueue, publishEvents() and serviceRollup()
+  loop()         scheduleBegin() once, then displayPass() every
+                 DISPLAY_REFRESH_MS, which also runs the timed jobs (the
+                 daily reset)
+
+Counters are written by the sensing task only, everyone else asks for a
+change with a command (sendCommand(), handleMessage()).
+*/
+#ifndef GATE_APP_H
+#define GATE_APP_H
+
+#include <stdint.h>
+
+#include "BinLog.h"
+#include "CountLedger.h"
+#include "CountRollup.h"
+#include "CounterJournal.h"
+#include "GateDetector.h"
+#include "GateEvent.h"
+#include "GateFusion.h"
+#include "Hal.h"
+#include "JobScheduler.h"
+#include "PassFeatures.h"
+
+#define SENSING_POLL_MS 10      // sensing runs at least this often for the no car / stuck timers
+#define DISPLAY_REFRESH_MS 250  // fastest the clock is read and the screen redrawn
+#define DAILY_RESET_HOUR 17     // daily count is reset at 17:00:00
+
+// Count with the magnetometer and both optical beams together (lib/GateCore/src/GateFusion.h),
+// so cars that back up or turn around are not counted. Needs the beams wired.
+#ifndef FUSION_ENABLED
+#define FUSION_ENABLED 0
+#endif
+// EdgeCapture inputs, in the order of FUSION_GATE_CONFIG
+#define SENSOR_INPUT_MAGNETOMETER 0
+#define SENSOR_INPUT_BEAM_PARK 1
+#define SENSOR_INPUT_BEAM_ROAD 2
+
+// Every bounce and car goes to GateLog.bin (16 bytes each, see lib/GateCore/src/BinLog.h)
+// and to SensorBounces.csv as before (about 120 bytes per bounce), which replay and classify
+// read. Build with -DLOG_BOUNCES_CSV=0 to write GateLog.bin only.
+#ifndef LOG_BOUNCES_CSV
+#define LOG_BOUNCES_CSV 1
+#endif
+
+// Counting algorithm, see lib/GateCore/src/GateDetector.h
+// Thresholds start from the GATE_PROFILE this env was built with (lib/GateCore/src/DetectorProfiles.h)
+// and can be tuned over MQTT. Build with -DDETECTOR_FIXED=1 to make them compile time constants.
+#ifndef DETECTOR_FIXED
+#define DETECTOR_FIXED 0
+#endif
+
+// Every count goes out provisional with a sequence number and is confirmed or retracted
+// later (lib/GateCore/src/CountLedger.h), on the SD card and on the events topic.
+// With the beams the pass decides, with the magnetometer alone a count nothing came
+// against in COUNT_CONFIRM_MS stays, and a car back over the sensor within the profile's
+// reversalMs of a count that never clears it means that car backed up. Profiles with
+// reversalMs 0 have nothing to wait for, their counts are final as they are counted and
+// get no confirm.
+#define COUNT_CONFIRM_MS 15000
+#define COUNT_REVERSAL_MS GATE_PROFILE::reversalMs
+
+// Experimental: build with -DCOUNT_CLASSIFY=1 to class each counted car as car, trailer,
+// bus or noise from the shape of its pass on the magnetometer (lib/GateCore/src/PassClassifier.h).
+// The tree in PassTree.h is trained on synthetic passes until there are labelled ones from
+// the gate, so it is off by default and the class is left out of the events topic and
+// GateCount.csv. Set COUNT_RETRACT_NOISE to 1 as well to take a count straight back when
+// the class is noise, it is only reported otherwise.
+#ifndef COUNT_CLASSIFY
+#define COUNT_CLASSIFY 0
+#endif
+#ifndef COUNT_RETRACT_NOISE
+#define COUNT_RETRACT_NOISE 0
+#endif
+#if COUNT_RETRACT_NOISE && !COUNT_CLASSIFY
+#error "COUNT_RETRACT_NOISE needs COUNT_CLASSIFY"
+#endif
+
+#define MSG_BUFFER_SIZE (500)
+#define ROLLUP_MSG_SIZE (768)  // a rollup late in the day, see CountRollup::json()
+
+#define MQTT_PUB_TOPIC0  "msb/traffic/exit/hello"
+#define MQTT_PUB_TOPIC1  "msb/traffic/exit/temp"
+#define MQTT_PUB_TOPIC2  "msb/traffic/exit/time"
+#define MQTT_PUB_TOPIC3  "msb/traffic/exit/count"
+#define MQTT_PUB_TOPIC4  "msb/traffic/exit/inpark"
+#define MQTT_PUB_TOPIC5  "msb/traffic/exit/timeout"
+#define MQTT_PUB_TOPIC6  "msb/traffic/exit/events"  // one JSON message per car / timeout
+
+#ifndef MQTT_LEGACY_TOPICS
+#define MQTT_LEGACY_TOPICS 0   // 1 = also publish temp, time, count, inpark and timeout on their old topics
+#endif
+#ifndef MQTT_COALESCE_EVENTS
+#define MQTT_COALESCE_EVENTS 1 // 1 = cars queued up during a burst go out together in one message
+#endif
+
+#define MQTT_SUB_TOPIC0  "msb/traffic/enter/count"
+#define MQTT_SUB_TOPIC1  "msb/traffic/exit/resetcount"
+#define MQTT_SUB_TOPIC2  "msb/traffic/exit/config"         // detector settings, see include/GateSettings.h
+#define MQTT_PUB_TOPIC7  "msb/traffic/exit/config/active"  // settings in use, after every change
+#define MQTT_PUB_TOPIC8  "msb/traffic/exit/link"           // WiFi and broker connection counters
+#define MQTT_PUB_TOPIC9  "msb/traffic/exit/rollup"         // exits per minute / 15 min / hour, retained
+
+class GateApp {
+ public:
+  typedef void (*EdgeObserver)(uint32_t micros, uint8_t level);
+  typedef void (*EventObserver)(const GateEvent &event);
+
+  explicit GateApp(const GateHal &hal);
+
+  // Magnetometer edges and sensing events as they happen (the /live stream), sensing task
+  void setEdgeObserver(EdgeObserver observer) { edgeObserver = observer; }
+  void setEventObserver(EventObserver observer) { eventObserver = observer; }
+
+  // setup(), before the tasks start. Takes up today's counts after a reboot from the
+  // journal in hal.counterStore, or from gateCountTail (the last GateCount.csv row, NULL
+  // if there is none) when that has a car the journal hasn't. Returns a CounterSource (CounterJournal.h).
+  uint8_t restoreCounters(const char *gateCountTail);
+
+  // Sensing task
+  void sensingBegin(const DetectorConfig &config);
+  void sensingPass();
+
+  // Any task, the sensing task picks them up on its next pass. False if the queue is full.
+  bool sendCommand(uint8_t type, int32_t value);
+  bool sendDetectorConfig(const DetectorConfig &config);
+  // Counts from msb/traffic/enter/count and msb/traffic/exit/resetcount, false for other topics
+  bool handleMessage(const char *topic, const char *payload);
+
+  // Logging task
+  void logEvent(const GateEvent &event);
+  void serviceLogs(unsigned long nowMillis);
+  void flushLogs();
+
+  // Network task, events are collected and go out together with publishEvents()
+  void publishGateEvent(const GateEvent &event);
+  void publishEvents();
+  // Network task, exits per minute / 15 minutes / hour. rollupBegin() takes up today's
+  // rollup from hal.rollupStore after a reboot. serviceRollup() every pass stores each
+  // minute as it closes and publishes each quarter as it closes; publishRollup() sends
+  // the last closed quarter again, for after a reconnect.
+  void rollupBegin();
+  void serviceRollup();
+  void publishRollup();
+
+  // loop(). scheduleBegin() puts the daily reset on schedule(), main.cpp adds its own
+  // jobs there, displayPass() runs whatever is due off the cached clock.
+  void scheduleBegin();
+  JobScheduler &schedule() { return loopJobs; }
+  void displayPass();
+
+  const char *profileName() const { return gateDetector.profileName(); }
+  const DetectorConfig &activeConfig() const { return activeDetectorConfig; }
+  int32_t dailyCars() const { return totalDailyCars; }
+  int32_t carsInPark() const { return carCounterCars - totalDailyCars; }
+  uint32_t retractions() const { return countLedger.retractions(); }
+  uint32_t logQueueDrops() const { return logDrops; }
+  uint32_t netQueueDrops() const { return netDrops; }
+  const CountRollup &countRollup() const { return rollup; }
+
+ private:
+  static void onDetectorEvent(const DetectorEvent &event, void *context);
+  static void onCountEvent(const CountEvent &event, void *context);
+  void detectorEvent(const DetectorEvent &event);
+  void countEvent(const CountEvent &event);
+#if FUSION_ENABLED
+  static void onFusionPass(const FusionPass &pass, void *context);
+  void fusionPass(const FusionPass &pass);
+  void queuePassEvent(const FusionPass &pass, uint8_t type, uint32_t seq);
+#endif
+  void queueGateEvent(HalQueue<GateEvent> *queue, const GateEvent &event, uint32_t &drops);
+  void stampGateEvent(GateEvent &gateEvent, uint32_t eventMicros);
+#if COUNT_CLASSIFY
+  uint8_t classifyCar(uint32_t endUs);
+#endif
+  void feedDetector();
+  void applyDetectorConfig(const DetectorConfig &config);
+  void applyGateCommands();
+  void queueCountersSet();
+
+  void recordCar(const GateEvent &event);
+  void recordBounce(const GateEvent &event);
+  void recordCorrection(const GateEvent &event);
+  void recordBinary(const GateEvent &event);
+  static bool readJournalSlot(uint16_t slot, JournalRecord &record, void *context);
+  void journalEvent(const GateEvent &event);
+  void writeJournal(uint16_t slot, const JournalRecord &record);
+#if MQTT_LEGACY_TOPICS
+  void publishLegacyTopics(const GateEvent &event);
+#endif
+  void rollupEvent(const GateEvent &event);
+  void startRollupDay(uint32_t unixtime);
+  void publishRollup(uint16_t quarter);
+  static bool dailyResetJob(uint32_t due, void *context);
+
+  GateHal hal;
+  EdgeObserver edgeObserver;
+  EventObserver eventObserver;
+
+  // sensing task
+#if DETECTOR_FIXED
+  GateProfileDetector gateDetector;
+#else
+  GateDetector gateDetector;
+#endif
+#if FUSION_ENABLED
+  GateFusion gateFusion;
+  uint32_t fusionSeq;  // count of the pass in progress
+#endif
+  CountLedger countLedger;
+#if COUNT_CLASSIFY
+  PassFeatureExtractor passFeatures;
+#endif
+  DetectorConfig activeDetectorConfig;  // what the detector uses
+  DetectorConfig pendingDetectorConfig;
+  bool detectorConfigPending;
+  volatile int32_t totalDailyCars;
+  volatile int32_t carCounterCars;
+  volatile bool sensorBounceFlag;
+  uint32_t carDetectedMillis;      // when the sensor 1st tripped for this car
+  uint32_t lastcarDetectedMillis;  // and for the car before
+  uint32_t lastCountSeq;           // newest magnetometer count
+  uint32_t logDrops;
+  uint32_t netDrops;
+
+  // logging task
+  BinLogEncoder binLogEncoder;
+  CounterJournal counterJournal;
+
+  // network task, events are collected into msg[] as a JSON array
+  char msg[MSG_BUFFER_SIZE];
+  size_t msgLength;
+  CountRollup rollup;
+  uint16_t rollupMinute;      // minute of the last pass
+  uint16_t rollupClosed;      // last closed quarter, ROLLUP_NONE before the first
+  bool rollupDirty;           // written since the last flush
+  char rollupMsg[ROLLUP_MSG_SIZE];
+
+  // loop()
+  JobScheduler loopJobs;
+};
+
+#endif
@@ -0,0 +1,67 @@
+/*
+Fixed size messages passed through the FreeRTOS queues between tasks.
+
+  sensing task (core 1) --GateEvent--> logging task (core 0, owns the SD card)
+                        --GateEvent--> network task (core 0, owns WiFi and MQTT)
+  network task / loop() --GateCommand--> sensing task (owns the counters)
+*/
+#ifndef GATE_EVENT_H
+#define GATE_EVENT_H
+
+#include <stdint.h>
+#include "GateDetector.h"
+#include "GateFusion.h"
+#include "CountLedger.h"
+#include "PassClassifier.h"
+
+enum GateEventType : uint8_t {
+  GATE_CAR_START,    // sensor tripped
+  GATE_BOUNCE,       // sensor went LOW again while the car is passing
+  GATE_CAR_COUNTED,  // car cleared the sensor and was counted
+  GATE_TIMEOUT,      // car did not clear in time or did not leave (pass says which), not counted
+  GATE_DAY_RESET,    // daily count was reset at 17:00
+  GATE_CONFIG_APPLIED,  // detector is using new settings (network task only)
+  GATE_COUNT_CONFIRMED, // car counted earlier (seq) stays counted
+  GATE_COUNT_RETRACTED, // car counted earlier (seq) was taken back off the count
+  GATE_COUNTERS_SET     // daily count or Car Counter set outright (logging task only, for the journal)
+};
+#define GATE_EVENT_TYPES 9
+
+struct GateEvent {
+  uint8_t type;                    // GateEventType
+  uint8_t level;                   // sensor level
+  uint16_t bounces;
+  int32_t carNumber;               // totalDailyCars once counted, the car being counted before that
+  int32_t carsInPark;
+  int16_t temp;
+  uint32_t passMs;                 // time since the car tripped the sensor
+  uint32_t lastHighMs;
+  uint32_t noCarMs;
+  uint32_t lowMs;
+  uint32_t lastLowMs;
+  uint32_t carDetectedMillis;
+  uint32_t lastCarDetectedMillis;
+  uint32_t millis;                 // millis() when the event was queued
+  uint32_t micros;                 // when it happened, edge timestamp clock
+  uint32_t unixtime;               // RTC time of the event
+  char timestamp[20];              // "YYYY-MM-DD hh:mm:ss"
+  uint8_t pass;                    // FusionPassType of a counted or dropped car
+  uint8_t reason;                  // CountReason of a confirm or retract
+  uint32_t seq;                    // count sequence number, see CountLedger.h
+  uint8_t vehicle;                 // PassClass of a counted car, PASS_CLASSES if not classed
+};
+
+enum GateCommandType : uint8_t {
+  GATE_SET_DAILY_COUNT,  // msb/traffic/exit/resetcount or the daily reset
+  GATE_SET_CAR_COUNTER,  // cars counted in by the Car Counter
+  GATE_DAILY_RESET,      // start of a new counting day
+  GATE_SET_DETECTOR      // new thresholds from msb/traffic/exit/config
+};
+
+struct GateCommand {
+  uint8_t type;  // GateCommandType
+  int32_t value;
+  DetectorConfig config;  // GATE_SET_DETECTOR only
+};
+
+#endif
@@ -0,0 +1,23 @@
+/*
+Settings that can be changed while the gate is running, over MQTT.
+
+A message on msb/traffic/exit/config sets any of
+  {"nocar":900,"gap":2000,"stuck":10000,"bounces":2,"verbosity":1}
+or {"defaults":1} to go back to the profile the firmware was built with.
+Missing keys keep their value. The whole message is checked before any
+of it is used (lib/GateCore/src/SettingsMessage.h), saved to NVS
+(Preferences) so it survives a reboot, and echoed on
+msb/traffic/exit/config/active once the detector uses it.
+*/
+#ifndef GATE_SETTINGS_H
+#define GATE_SETTINGS_H
+
+#include <Arduino.h>
+#include "SettingsMessage.h"  // GateSettings, settingsParse(), settingsCheck(), settingsJson()
+
+// Compiled in profile, then whatever was saved in NVS
+void settingsLoad(GateSettings &settings, const DetectorConfig &defaults, uint8_t defaultVerbosity);
+bool settingsSave(const GateSettings &settings);
+void settingsClear();
+
+#endif
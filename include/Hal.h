@@ -0,0 +1,133 @@
+/*
+The hardware the gate logic (GateApp) runs on, as thin interfaces.
+
+  HalClock     micros(), millis(), RTC time and temperature
+  HalSensors   GPIO: captured sensor edges and the pin levels
+  HalLog       storage: one log file on the SD card
+  HalStore     storage: a small file of fixed layout, updated in place
+  HalDisplay   the OLED, gets the values to show
+  HalMqtt      publishing to the broker
+  HalQueue     a queue between two tasks
+
+The ESP32 side is in Esp32Hal.h (Arduino, EdgeCapture, LogWriter, the
+SSD1306, PubSubClient and FreeRTOS queues). src/host/sim has a host side
+with a scripted sensor, log files in a directory, a text framebuffer and
+a broker stand-in, so GateApp can run on a PC faster than real time.
+Nothing here knows about Arduino.
+*/
+#ifndef HAL_H
+#define HAL_H
+
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#include "EdgeRing.h"
+#include "GateEvent.h"
+
+class HalClock {
+ public:
+  virtual ~HalClock() {}
+  virtual uint32_t micros() = 0;
+  virtual uint32_t millis() = 0;
+  // RTC time of a micros() timestamp
+  virtual uint32_t unixtimeAt(uint32_t micros) = 0;
+  // Temperature in F, as shown on the display
+  virtual int16_t temperature() = 0;
+};
+
+class HalSensors {
+ public:
+  virtual ~HalSensors() {}
+  // Oldest captured edge, false when there is none
+  virtual bool pop(SensorEdge &edge) = 0;
+  // Level of an input right now
+  virtual uint8_t read(uint8_t input) = 0;
+};
+
+class HalLog {
+ public:
+  virtual ~HalLog() {}
+  // The next row belongs to this day
+  virtual void indexDay(uint32_t day) = 0;
+  // Format one row, the caller adds the line ending
+  virtual bool vprintf(const char *format, va_list args) = 0;
+  bool printf(const char *format, ...) __attribute__((format(printf, 2, 3))) {
+    va_list args;
+    va_start(args, format);
+    bool ok = vprintf(format, args);
+    va_end(args);
+    return ok;
+  }
+  // Raw bytes, for binary records
+  virtual bool append(const void *data, size_t length) = 0;
+  // Write out what is due
+  virtual void service(unsigned long nowMillis) = 0;
+  virtual bool flush() = 0;
+};
+
+class HalStore {
+ public:
+  virtual ~HalStore() {}
+  // False if the file is shorter than offset + length
+  virtual bool read(uint32_t offset, void *data, size_t length) = 0;
+  virtual bool write(uint32_t offset, const void *data, size_t length) = 0;
+  // Get what was written onto the card
+  virtual bool flush() = 0;
+};
+
+// Everything shown on the main screen
+struct DisplayValues {
+  uint8_t dayOfWeek;
+  uint8_t month;
+  uint8_t day;
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint16_t year;
+  int16_t temp;
+  int32_t exiting;
+  int32_t inPark;
+};
+
+class HalDisplay {
+ public:
+  virtual ~HalDisplay() {}
+  // Called every DISPLAY_REFRESH_MS, only redraw when something changed
+  virtual void show(const DisplayValues &values) = 0;
+};
+
+class HalMqtt {
+ public:
+  virtual ~HalMqtt() {}
+  // Publish now, or keep it until the broker is back. False if it was lost.
+  virtual bool publish(const char *topic, const char *payload, bool retained = false) = 0;
+};
+
+template <class T>
+class HalQueue {
+ public:
+  virtual ~HalQueue() {}
+  // Never waits, false when full
+  virtual bool send(const T &item) = 0;
+  // Waits up to waitMs for an item
+  virtual bool receive(T &item, uint32_t waitMs) = 0;
+};
+
+struct GateHal {
+  HalClock *clock;
+  HalSensors *sensors;
+  HalLog *gateCountLog;   // GateCount.csv
+  HalLog *correctionLog;  // GateCorrections.csv
+  HalLog *bounceLog;      // SensorBounces.csv, unless LOG_BOUNCES_CSV is 0
+  HalLog *binLog;         // GateLog.bin
+  HalStore *rollupStore;  // Rollup.bin, see GateApp::rollupBegin()
+  HalStore *counterStore; // Counters.jnl, see GateApp::restoreCounters()
+  HalDisplay *display;
+  HalMqtt *mqtt;
+  HalQueue<GateEvent> *logQueue;     // sensing -> logging
+  HalQueue<GateEvent> *netQueue;     // sensing -> network
+  HalQueue<GateCommand> *commandQueue;  // anyone -> sensing
+};
+
+#endif
@@ -0,0 +1,31 @@
+/*
+Live view of the sensor for a browser, as Server-Sent Events on /live.
+
+The sensing task hands every edge and detector event over through a ring
+(edges) and a queue (events), never waiting on either and only while a
+browser is connected. The network task turns them into SSE messages:
+  edges  {"edges":[[micros,level],...],"dropped":n}
+  event  {"event":"car","count":125,"inpark":40,"bounces":12,"micros":123456789}
+/live.html is a small page that shows the stream.
+*/
+#ifndef LIVE_STREAM_H
+#define LIVE_STREAM_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "GateEvent.h"
+
+#define LIVE_EDGE_RING_SIZE 256
+#define LIVE_EVENT_QUEUE_LENGTH 32
+#define LIVE_MAX_WAITING 8  // skip sending while browsers have this many messages backed up
+
+// Add /live and /live.html to the web server
+void liveStreamBegin(AsyncWebServer &server);
+// Sensing task: copy an edge / event into the stream if anyone is watching
+void liveStreamEdge(uint32_t micros, uint8_t level);
+void liveStreamEvent(const GateEvent &event);
+// Network task: send whatever has been collected
+void liveStreamService();
+uint32_t liveStreamDropped();
+
+#endif
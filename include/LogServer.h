@@ -0,0 +1,30 @@
+/*
+Log downloads straight from the SD card, no need to pull the card.
+
+  GET /logs                     the log files on the card and their sizes (JSON)
+  GET /logs/GateCount.csv       the whole file, read from the card a TCP packet at a time
+      Range: bytes=a-b          part of it (206), to resume or to tail a download
+  GET /logs/GateCount.csv?from=2024-05-04&to=2024-05-05
+                                only those days, found with one seek using the
+                                day index next to the log (GateCount.idx)
+
+Days from before a log had an index come back from the start of the file.
+Rows still in a LogWriter buffer (up to LOG_FLUSH_INTERVAL_MS old) are not
+on the card yet and are not sent.
+*/
+#ifndef LOG_SERVER_H
+#define LOG_SERVER_H
+
+#include <Arduino.h>
+#include <ESPAsyncWebServer.h>
+#include "FS.h"
+
+void logServerBegin(AsyncWebServer &server, fs::FS &fs);
+
+// Byte range [start, end) of the days fromDay..toDay of a log with this day index
+bool logDayRange(fs::FS &fs, const char *indexPath, uint32_t fromDay, uint32_t toDay,
+                 uint32_t fileSize, uint32_t &start, uint32_t &end);
+// "YYYY-MM-DD" as days since 1970-01-01, the same numbering as the day index. 0 if not a date
+uint32_t logDayNumber(const char *date);
+
+#endif
@@ -0,0 +1,88 @@
+/*
+Buffered append-only log file on the SD card.
+
+The file is opened once and kept open. Rows are formatted straight into a
+RAM buffer and written out in whole 512 byte sectors once the buffer is half
+full, so the FAT only ever sees full sector writes. Whatever is left is
+written and flushed at least every LOG_FLUSH_INTERVAL_MS, which is the most
+data a power cut can lose. flush() also runs on the daily reset and before a
+restart (OTA).
+
+A log can keep a day index next to it: one LogDayIndex per day, holding
+the file offset of that day's first row, appended when the day changes.
+The web server uses it to send one day (or a range of days) of a season
+long file with a single seek.
+
+LogWriter is the ESP32 HalLog (Hal.h), GateApp writes its rows through that.
+*/
+#ifndef LOG_WRITER_H
+#define LOG_WRITER_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "Hal.h"
+
+#define LOG_BUFFER_SIZE 4096
+#define LOG_SECTOR_SIZE 512
+#define LOG_FLUSH_INTERVAL_MS 5000 // durability window
+
+struct LogDayIndex {
+  uint32_t day;     // RTC unixtime / 86400
+  uint32_t offset;  // first row of that day in the log file
+};
+
+class LogWriter : public HalLog {
+ public:
+  // Text log, header is the first line of the file
+  LogWriter(const char *path, const char *header);
+  // Binary log, header is written as is when the file is created
+  LogWriter(const char *path, const void *header, size_t headerLength);
+
+  // Keep a day index in this file, call before begin()
+  void useDayIndex(const char *indexPath) { dayIndexPath = indexPath; }
+  // Create the file with its header if it is missing and open it for append.
+  // A text log with another header is moved to <path>.1 (.2, ...) and started again.
+  bool begin(fs::FS &fs);
+  // The next row belongs to this day, adds an index entry when the day changes
+  void indexDay(uint32_t day);
+  // Format one row into the buffer, the caller adds the line ending (printf() is in HalLog)
+  bool vprintf(const char *format, va_list args);
+  // Add raw bytes, for binary records
+  bool append(const void *data, size_t length);
+  // Write out full sectors when the buffer is filling, everything once the interval is up
+  void service(unsigned long nowMillis);
+  // Write everything and flush the file
+  bool flush();
+  void close();
+
+  const char *path() const { return filePath; }
+  const char *indexPath() const { return dayIndexPath; }
+  uint32_t bytesWritten() const { return written; }
+  uint32_t flushCount() const { return flushes; }
+  uint32_t droppedRows() const { return dropped; }
+
+ private:
+  bool open();
+  bool headerMatches();
+  bool writeOut(size_t count);
+  void loadDayIndex(bool created);
+
+  fs::FS *fs;
+  const char *filePath;
+  const uint8_t *header;
+  size_t headerLength;
+  bool textHeader;
+  const char *dayIndexPath;
+  uint32_t indexedDay;     // last day in the index
+  File file;
+  SemaphoreHandle_t lock;  // logging task and the restart handler
+  size_t fileSize;         // where the next write lands, for sector alignment
+  char buffer[LOG_BUFFER_SIZE];
+  size_t used;
+  unsigned long oldestMillis;  // when the oldest unwritten row was added
+  uint32_t written;
+  uint32_t flushes;
+  uint32_t dropped;
+};
+
+#endif
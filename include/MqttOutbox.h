@@ -0,0 +1,49 @@
+/*
+The MQTT outbox (lib/GateCore/src/Outbox.h) kept on the SD card.
+
+Segments are numbered files in a directory, /outbox/00000001.seg and so on,
+next to a small cursor file. One handle stays open for appending and one
+for reading, so a car costs one write and a flush, not an open and close.
+*/
+#ifndef MQTT_OUTBOX_H
+#define MQTT_OUTBOX_H
+
+#include <Arduino.h>
+#include "FS.h"
+#include "Outbox.h"
+
+class SdOutboxFiles : public OutboxFiles {
+ public:
+  explicit SdOutboxFiles(const char *dir);
+  void begin(fs::FS &fs);
+
+  bool segments(uint32_t &first, uint32_t &last) override;
+  uint32_t size(uint32_t segment) override;
+  bool read(uint32_t segment, uint32_t offset, void *data, size_t length) override;
+  bool append(uint32_t segment, const void *data, size_t length) override;
+  bool remove(uint32_t segment) override;
+  bool readCursor(void *data, size_t length) override;
+  bool writeCursor(const void *data, size_t length) override;
+
+ private:
+  void segmentPath(uint32_t segment, char *path, size_t size) const;
+
+  fs::FS *fs;
+  const char *dir;
+  File writeFile;
+  File readFile;
+  uint32_t writeSegment;  // what the handles have open, 0 for none
+  uint32_t readSegment;
+};
+
+class MqttOutbox : public Outbox {
+ public:
+  explicit MqttOutbox(const char *dir) : files(dir) {}
+  // Pick up whatever was left on the card before a reboot
+  void begin(fs::FS &fs);
+
+ private:
+  SdOutboxFiles files;
+};
+
+#endif
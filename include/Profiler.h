@@ -0,0 +1,101 @@
+/*
+Where the time goes, in production.
+
+Each stage of the tasks is timed with the CPU cycle counter and recorded
+in a LatencyHistogram (microseconds). Pass counters give the rate each
+task loop runs at. Boot milestones keep millis() at the first time each
+step of bringing the gate up happened. profileJson() writes it all out for
+the /stats page.
+
+    uint32_t start = profileStart();
+    ... stage ...
+    profileEnd(STAGE_DISPLAY, start);
+
+The cycle counter wraps after 17.9 s at 240 MHz, a stage longer than that
+is recorded short. Set PROFILE_ENABLED to 0 to compile all of it out, it
+is off in the host builds (src/host/sim) where there is no cycle counter.
+*/
+#ifndef PROFILER_H
+#define PROFILER_H
+
+#ifdef ARDUINO
+#include <Arduino.h>
+#endif
+#include <stddef.h>
+#include "LatencyHistogram.h"
+
+#ifndef PROFILE_ENABLED
+#ifdef ARDUINO
+#define PROFILE_ENABLED 1
+#else
+#define PROFILE_ENABLED 0
+#endif
+#endif
+
+enum ProfileStage : uint8_t {
+  STAGE_EDGE_LATENCY,   // ISR timestamp to the detector seeing the edge
+  STAGE_DETECT,         // sensing task, one wake up
+  STAGE_LOG_EVENT,      // logging task, one event to the CSV / binary buffers
+  STAGE_LOG_SERVICE,    // logging task, sector writes and flushes
+  STAGE_WIFI_RUN,       // WiFi and NTP state machines
+  STAGE_MQTT_CONNECT,   // one broker connection attempt
+  STAGE_MQTT_LOOP,      // mqtt_client.loop()
+  STAGE_MQTT_PUBLISH,   // publishing what was in the network queue
+  STAGE_OUTBOX_REPLAY,  // replaying queued messages
+  STAGE_TIME_SERVICE,   // RTC reads
+  STAGE_DISPLAY,        // drawing and sending the OLED
+  STAGE_CLASSIFY,       // features and tree for one counted car
+  STAGE_COUNT
+};
+
+enum ProfileCounter : uint8_t {
+  COUNT_LOOP,      // loop() passes
+  COUNT_SENSING,   // sensing task wake ups
+  COUNT_LOGGING,   // logging task passes
+  COUNT_NETWORK,   // network task passes
+  COUNT_EDGES,     // edges fed to the detector
+  COUNTER_COUNT
+};
+
+// Counting must not wait for the network, these show it doesn't
+enum ProfileMilestone : uint8_t {
+  BOOT_COUNTING,   // sensing task running
+  BOOT_FIRST_CAR,  // first car on the sensor
+  BOOT_WIFI,       // first WiFi connection
+  BOOT_NTP,        // RTC set from NTP
+  BOOT_MQTT,       // first broker connection
+  MILESTONE_COUNT
+};
+
+#if PROFILE_ENABLED
+extern LatencyHistogram profileStages[STAGE_COUNT];
+extern uint32_t profileCounters[COUNTER_COUNT];
+extern uint32_t profileCyclesPerUs;
+extern uint32_t profileMilestones[MILESTONE_COUNT];
+
+inline uint32_t profileStart() { return ESP.getCycleCount(); }
+inline void profileEnd(ProfileStage stage, uint32_t start) {
+  profileStages[stage].record((ESP.getCycleCount() - start) / profileCyclesPerUs);
+}
+inline void profileRecord(ProfileStage stage, uint32_t us) { profileStages[stage].record(us); }
+inline void profileCount(ProfileCounter counter) { profileCounters[counter]++; }
+// Only the first time counts, millis() is well past 0 by the time anything here happens
+inline void profileMilestone(ProfileMilestone milestone, uint32_t ms) {
+  if (!profileMilestones[milestone]) profileMilestones[milestone] = ms;
+}
+#else
+inline uint32_t profileStart() { return 0; }
+inline void profileEnd(ProfileStage, uint32_t) {}
+inline void profileRecord(ProfileStage, uint32_t) {}
+inline void profileCount(ProfileCounter) {}
+inline void profileMilestone(ProfileMilestone, uint32_t) {}
+#endif
+
+void profileBegin();
+// Clear the histograms, counters keep running
+void profileReset();
+// JSON with every stage (n, min, p50, p99, max in us), the pass rates since the last call
+// and the boot milestones (ms, null until reached)
+size_t profileJson(char *out, size_t size);
+
+#endif
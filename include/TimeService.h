@@ -0,0 +1,72 @@
+/*
+Cached DS3231 time and temperature.
+
+Every rtc.now() is an I2C transaction on the bus the OLED also uses. The
+time service reads the RTC in the background and hands out time from an
+anchor (RTC second, micros() when that second started), so a timestamp is
+a subtraction instead of a bus round trip and any task can ask for one.
+
+To find where a second starts the RTC is polled every TIME_LOCK_POLL_MS
+until the seconds register ticks over. Once locked it is only read once a
+second, half way between ticks, to check the software clock still agrees.
+The ESP32 crystal drifts against the DS3231 so the tick is found again
+every TIME_RELOCK_MS. loop() reads the temperature every TIME_TEMP_MS
+(a job on its JobScheduler).
+
+service() is called from one task only (loop()), the getters from any task.
+*/
+#ifndef TIME_SERVICE_H
+#define TIME_SERVICE_H
+
+#include <Arduino.h>
+#include <RTClib.h>
+
+#define TIME_LOCK_POLL_MS 20    // RTC reads while looking for the tick
+#define TIME_CHECK_MS 1000      // RTC reads once locked
+#define TIME_RELOCK_MS 600000   // look for the tick again every 10 minutes
+#define TIME_TEMP_MS 60000      // temperature reads
+
+class TimeService {
+ public:
+  explicit TimeService(RTC_DS3231 &rtc);
+
+  // Read the RTC once, time is valid (to the second) from here on
+  void begin();
+  // Do whatever RTC reads are due, cheap when none are
+  void service();
+  // Set the RTC (NTP) and start over from the new time
+  void adjust(const DateTime &time);
+
+  // RTC time of a micros() timestamp, optionally with the microseconds into that second
+  uint32_t unixtimeAt(uint32_t micros, uint32_t *usOfSecond = NULL);
+  uint32_t unixtime() { return unixtimeAt(::micros()); }
+  DateTime now() { return DateTime(unixtime()); }
+  DateTime at(uint32_t micros) { return DateTime(unixtimeAt(micros)); }
+
+  // Read the temperature from the RTC, same task as service()
+  void readTemperature();
+  // Temperature in F, as shown on the display
+  int16_t temperature() const { return temp; }
+  bool locked() const { return isLocked; }
+  uint32_t rtcReads() const { return reads; }
+  uint32_t relocks() const { return locks; }
+
+ private:
+  uint32_t readRtc(uint32_t &readMicros);
+  void setAnchor(uint32_t unixtime, uint32_t micros);
+  void unlock();
+
+  RTC_DS3231 &rtc;
+  portMUX_TYPE anchorLock;
+  uint32_t anchorUnixtime;
+  uint32_t anchorMicros;
+  volatile bool isLocked;
+  uint32_t lastSecond;
+  unsigned long lastReadMillis;
+  unsigned long lockedMillis;
+  volatile int16_t temp;
+  uint32_t reads;
+  uint32_t locks;
+};
+
+#endif
@@ -0,0 +1,53 @@
+#include "BinLog.h"
+#include <string.h>
+
+void binLogHeader(BinLogHeader &header, uint32_t created) {
+  memset(&header, 0, sizeof(header));
+  header.magic = BINLOG_MAGIC;
+  header.version = BINLOG_VERSION;
+  header.recordSize = sizeof(BinLogRecord);
+  header.created = created;
+}
+
+bool binLogHeaderValid(const BinLogHeader &header) {
+  return header.magic == BINLOG_MAGIC && header.version == BINLOG_VERSION &&
+         header.recordSize == sizeof(BinLogRecord);
+}
+
+bool BinLogEncoder::needsSync(uint32_t micros) const {
+  // a gap longer than this would not fit the 32 bit delta for long
+  return !started || micros - syncUs >= BINLOG_SYNC_US || micros - lastUs >= BINLOG_SYNC_US;
+}
+
+void BinLogEncoder::sync(BinLogRecord &record, uint32_t micros, uint32_t unixtime, int16_t temp) {
+  memset(&record, 0, sizeof(record));
+  record.type = BINLOG_SYNC;
+  record.deltaUs = started ? micros - lastUs : 0;
+  record.sync.unixtime = unixtime;
+  record.sync.temp = temp;
+  started = true;
+  lastUs = micros;
+  syncUs = micros;
+}
+
+void BinLogEncoder::stamp(BinLogRecord &record, uint32_t micros) {
+  // events come in time order, never let a late one run the chain backwards
+  int32_t delta = (int32_t)(micros - lastUs);
+  if (delta < 0) delta = 0;
+  record.deltaUs = (uint32_t)delta;
+  lastUs += (uint32_t)delta;
+}
+
+void BinLogDecoder::decode(const BinLogRecord &record, BinLogTime &time) {
+  micros += record.deltaUs;
+  if (record.type == BINLOG_SYNC) {
+    synced = true;
+    syncUnix = record.sync.unixtime;
+    sinceSyncUs = 0;
+  } else {
+    sinceSyncUs += record.deltaUs;
+  }
+  time.micros = micros;
+  time.unixtime = synced ? syncUnix + (uint32_t)(sinceSyncUs / 1000000ULL) : 0;
+  time.usOfSecond = synced ? (uint32_t)(sinceSyncUs % 1000000ULL) : 0;
+}
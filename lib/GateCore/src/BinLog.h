@@ -0,0 +1,120 @@
+/*
+Binary event log (GateLog.bin).
+
+File = BinLogHeader followed by 16 byte BinLogRecords. Each record carries
+the micros since the record before it, so times stay exact to the
+microsecond without storing a full timestamp. A SYNC record anchors the
+stream to the RTC (unixtime as the RTC keeps it, local time) at the start
+of every session, after long quiet spells and at least once an hour.
+
+Everything is little endian, the same on the ESP32 and a PC, and records
+are written as plain structs.
+*/
+#ifndef BIN_LOG_H
+#define BIN_LOG_H
+
+#include <stdint.h>
+
+#define BINLOG_MAGIC 0x474F4C47UL  // "GLOG"
+#define BINLOG_VERSION 1
+#define BINLOG_SYNC_US 3600000000UL  // re-anchor at least every hour
+
+enum BinLogType : uint8_t {
+  BINLOG_SYNC = 1,   // anchor to the RTC
+  BINLOG_CAR_START,  // sensor tripped
+  BINLOG_BOUNCE,     // sensor went LOW again
+  BINLOG_CAR,        // car counted
+  BINLOG_TIMEOUT,    // car not counted
+  BINLOG_DAY_RESET,  // daily count reset
+  BINLOG_CONFIRM,    // count stays (CountLedger.h)
+  BINLOG_RETRACT     // count taken back
+};
+
+struct BinLogHeader {
+  uint32_t magic;
+  uint16_t version;
+  uint16_t recordSize;
+  uint32_t created;   // unixtime the file was started
+  uint32_t reserved;
+};
+
+struct BinLogRecord {
+  uint8_t type;      // BinLogType
+  uint8_t level;     // sensor level
+  uint16_t bounces;
+  uint32_t deltaUs;  // micros since the previous record
+  union {
+    struct {
+      uint32_t unixtime;
+      int16_t temp;
+      uint16_t reserved;
+    } sync;
+    struct {  // CAR_START and BOUNCE
+      uint16_t passMs;      // time since the car tripped the sensor
+      uint16_t lastHighMs;  // car time of the last LOW->HIGH edge
+      uint16_t lowGapMs;    // time since the previous LOW edge
+      int16_t carNumber;    // car being counted
+    } bounce;
+    struct {  // CAR, TIMEOUT and DAY_RESET
+      uint16_t passMs;
+      uint16_t noCarMs;     // time the sensor had been HIGH
+      int16_t carNumber;    // totalDailyCars after this car
+      int16_t carsInPark;
+    } car;
+    struct {  // CONFIRM and RETRACT
+      uint32_t seq;         // sequence number of the count
+      int16_t carNumber;    // totalDailyCars after this
+      uint8_t reason;       // CountReason
+      uint8_t reserved;
+    } count;
+  };
+};
+
+static_assert(sizeof(BinLogHeader) == 16, "BinLogHeader must stay 16 bytes");
+static_assert(sizeof(BinLogRecord) == 16, "BinLogRecord must stay 16 bytes");
+
+void binLogHeader(BinLogHeader &header, uint32_t created);
+bool binLogHeaderValid(const BinLogHeader &header);
+
+// Durations are stored in 16 bits, anything longer reads as 65535
+inline uint16_t binLogMs(uint32_t ms) { return ms > 0xFFFF ? 0xFFFF : (uint16_t)ms; }
+
+// Writing side, keeps track of the delta chain
+class BinLogEncoder {
+ public:
+  BinLogEncoder() : started(false), lastUs(0), syncUs(0) {}
+
+  // Start a new chain, e.g. after reopening the file
+  void restart() { started = false; }
+  // A SYNC record has to go in before a record at micros
+  bool needsSync(uint32_t micros) const;
+  void sync(BinLogRecord &record, uint32_t micros, uint32_t unixtime, int16_t temp);
+  // Fill in deltaUs for a record at micros
+  void stamp(BinLogRecord &record, uint32_t micros);
+
+ private:
+  bool started;
+  uint32_t lastUs;
+  uint32_t syncUs;
+};
+
+// Reading side, turns the delta chain back into absolute times
+struct BinLogTime {
+  uint32_t micros;      // device micros() of the record (wraps)
+  uint32_t unixtime;    // RTC time, 0 until the first SYNC
+  uint32_t usOfSecond;  // fraction of the second
+};
+
+class BinLogDecoder {
+ public:
+  BinLogDecoder() : synced(false), micros(0), syncUnix(0), sinceSyncUs(0) {}
+  void decode(const BinLogRecord &record, BinLogTime &time);
+
+ private:
+  bool synced;
+  uint32_t micros;
+  uint32_t syncUnix;
+  uint64_t sinceSyncUs;
+};
+
+#endif
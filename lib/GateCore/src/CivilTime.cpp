@@ -0,0 +1,63 @@
+#include "CivilTime.h"
+
+// Days since 1970-01-01 to year/month/day and back, proleptic Gregorian
+// (H. Hinnant's days_from_civil / civil_from_days)
+static void fromDays(int32_t days, uint16_t &year, uint8_t &month, uint8_t &day) {
+  days += 719468;
+  int32_t era = (days >= 0 ? days : days - 146096) / 146097;
+  uint32_t dayOfEra = days - era * 146097;
+  uint32_t yearOfEra = (dayOfEra - dayOfEra / 1460 + dayOfEra / 36524 - dayOfEra / 146096) / 365;
+  uint32_t dayOfYear = dayOfEra - (365 * yearOfEra + yearOfEra / 4 - yearOfEra / 100);
+  uint32_t mp = (5 * dayOfYear + 2) / 153;
+  day = dayOfYear - (153 * mp + 2) / 5 + 1;
+  month = mp < 10 ? mp + 3 : mp - 9;
+  year = yearOfEra + era * 400 + (month <= 2);
+}
+
+static int32_t toDays(uint16_t y, uint8_t m, uint8_t d) {
+  int32_t year = y - (m <= 2);
+  int32_t era = (year >= 0 ? year : year - 399) / 400;
+  uint32_t yearOfEra = year - era * 400;
+  uint32_t dayOfYear = (153 * (m > 2 ? m - 3 : m + 9) + 2) / 5 + d - 1;
+  uint32_t dayOfEra = yearOfEra * 365 + yearOfEra / 4 - yearOfEra / 100 + dayOfYear;
+  return era * 146097 + (int32_t)dayOfEra - 719468;
+}
+
+void civilTime(uint32_t unixtime, CivilTime &time) {
+  uint32_t days = unixtime / 86400;
+  uint32_t seconds = unixtime % 86400;
+  fromDays(days, time.year, time.month, time.day);
+  time.hour = seconds / 3600;
+  time.minute = seconds / 60 % 60;
+  time.second = seconds % 60;
+  time.dayOfWeek = (days + 4) % 7;  // 1970-01-01 was a Thursday
+}
+
+uint32_t civilUnixtime(const CivilTime &time) {
+  return toDays(time.year, time.month, time.day) * 86400UL + time.hour * 3600UL + time.minute * 60UL +
+         time.second;
+}
+
+static char *twoDigits(char *out, uint8_t value) {
+  out[0] = '0' + value / 10;
+  out[1] = '0' + value % 10;
+  return out + 2;
+}
+
+void formatTimestamp(uint32_t unixtime, char *out) {
+  CivilTime t;
+  civilTime(unixtime, t);
+  out = twoDigits(out, t.year / 100);
+  out = twoDigits(out, t.year % 100);
+  *out++ = '-';
+  out = twoDigits(out, t.month);
+  *out++ = '-';
+  out = twoDigits(out, t.day);
+  *out++ = ' ';
+  out = twoDigits(out, t.hour);
+  *out++ = ':';
+  out = twoDigits(out, t.minute);
+  *out++ = ':';
+  out = twoDigits(out, t.second);
+  *out = '\0';
+}
@@ -0,0 +1,30 @@
+/*
+Calendar time from a unixtime, without RTClib.
+
+The RTC and the logs run on local time already (the RTC is set from NTP
+with the gate's offset), so there is no time zone here, just the date
+arithmetic DateTime does. Used where the gate code has to run off the
+ESP32 too (GateApp, the host tools).
+*/
+#ifndef CIVIL_TIME_H
+#define CIVIL_TIME_H
+
+#include <stdint.h>
+
+struct CivilTime {
+  uint16_t year;
+  uint8_t month;      // 1-12
+  uint8_t day;        // 1-31
+  uint8_t hour;
+  uint8_t minute;
+  uint8_t second;
+  uint8_t dayOfWeek;  // 0 = Sunday, like DateTime::dayOfTheWeek()
+};
+
+void civilTime(uint32_t unixtime, CivilTime &time);
+uint32_t civilUnixtime(const CivilTime &time);  // dayOfWeek is ignored
+
+// "YYYY-MM-DD hh:mm:ss", out has room for 20 chars
+void formatTimestamp(uint32_t unixtime, char *out);
+
+#endif
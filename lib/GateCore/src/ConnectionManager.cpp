@@ -0,0 +1,104 @@
+#include "ConnectionManager.h"
+
+#include <stdio.h>
+#include <string.h>
+
+ConnectionManager::ConnectionManager(uint32_t minMs, uint32_t maxMs, uint32_t seed)
+    : minMs(minMs), maxMs(maxMs), random(seed ? seed : 1), up(false), started(false), everUp(false),
+      failuresInRow(0), nextMs(0), attemptStartMs(0), firstAttemptMs(0), changedMs(0), upMs(0) {
+  memset(&counters, 0, sizeof(counters));
+}
+
+void ConnectionManager::seed(uint32_t seed) {
+  random = seed ? seed : 1;
+}
+
+bool ConnectionManager::due(uint32_t nowMs) const {
+  return !up && (int32_t)(nowMs - nextMs) >= 0;
+}
+
+void ConnectionManager::attempt(uint32_t nowMs) {
+  if (!started) {
+    started = true;
+    firstAttemptMs = nowMs;
+    changedMs = nowMs;
+  }
+  attemptStartMs = nowMs;
+  counters.attempts++;
+}
+
+void ConnectionManager::connected(uint32_t nowMs) {
+  counters.lastAttemptMs = nowMs - attemptStartMs;
+  if (counters.lastAttemptMs > counters.maxAttemptMs) counters.maxAttemptMs = counters.lastAttemptMs;
+  counters.connects++;
+  if (everUp && nowMs - changedMs > counters.longestOutageMs) counters.longestOutageMs = nowMs - changedMs;
+  up = true;
+  everUp = true;
+  changedMs = nowMs;
+  failuresInRow = 0;
+}
+
+void ConnectionManager::failed(uint32_t nowMs, int16_t error) {
+  counters.lastAttemptMs = nowMs - attemptStartMs;
+  if (counters.lastAttemptMs > counters.maxAttemptMs) counters.maxAttemptMs = counters.lastAttemptMs;
+  counters.failures++;
+  counters.lastError = error;
+  // minMs << 16 is past any sensible maxMs, stop counting there so the shift can't overflow
+  if (failuresInRow < 16) failuresInRow++;
+  uint32_t waitMs = minMs << (failuresInRow - 1);
+  if (waitMs > maxMs || waitMs < minMs) waitMs = maxMs;
+  waitFrom(nowMs, waitMs);
+}
+
+void ConnectionManager::lost(uint32_t nowMs) {
+  if (!up) return;
+  counters.drops++;
+  upMs += nowMs - changedMs;
+  up = false;
+  changedMs = nowMs;
+  failuresInRow = 0;
+  waitFrom(nowMs, minMs);
+}
+
+void ConnectionManager::retryNow(uint32_t nowMs) {
+  failuresInRow = 0;
+  if (!up) nextMs = nowMs;
+}
+
+uint32_t ConnectionManager::retryInMs(uint32_t nowMs) const {
+  return due(nowMs) || up ? 0 : nextMs - nowMs;
+}
+
+uint8_t ConnectionManager::upPercent(uint32_t nowMs) const {
+  if (!started || nowMs == firstAttemptMs) return up ? 100 : 0;
+  uint64_t total = upMs + (up ? nowMs - changedMs : 0);
+  return total * 100 / (nowMs - firstAttemptMs);
+}
+
+size_t ConnectionManager::json(char *out, size_t size, uint32_t nowMs) const {
+  int length = snprintf(out, size,
+                        "{\"up\":%s,\"attempts\":%u,\"connects\":%u,\"failures\":%u,\"drops\":%u,\"up_pct\":%u,"
+                        "\"attempt_ms\":%u,\"max_attempt_ms\":%u,\"longest_outage_s\":%u,\"error\":%d}",
+                        up ? "true" : "false", (unsigned)counters.attempts, (unsigned)counters.connects,
+                        (unsigned)counters.failures, (unsigned)counters.drops, (unsigned)upPercent(nowMs),
+                        (unsigned)counters.lastAttemptMs, (unsigned)counters.maxAttemptMs,
+                        (unsigned)(counters.longestOutageMs / 1000), (int)counters.lastError);
+  if (length < 0 || (size_t)length >= size) {
+    if (size) out[0] = '\0';
+    return 0;
+  }
+  return length;
+}
+
+// Half to all of waitMs, xorshift32 is plenty for spreading retries
+uint32_t ConnectionManager::jittered(uint32_t waitMs) {
+  random ^= random << 13;
+  random ^= random >> 17;
+  random ^= random << 5;
+  uint32_t half = waitMs / 2;
+  return half + random % (waitMs - half + 1);
+}
+
+void ConnectionManager::waitFrom(uint32_t nowMs, uint32_t waitMs) {
+  nextMs = nowMs + jittered(waitMs);
+}
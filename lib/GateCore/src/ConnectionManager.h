@@ -0,0 +1,82 @@
+/*
+When to try a link again (WiFi, NTP, the MQTT broker), and how well it has been doing.
+
+The owner runs the actual connecting and tells the manager how it went:
+
+    if (link.due(now)) {
+      link.attempt(now);
+      if (connect()) link.connected(millis()); else link.failed(millis(), rc);
+    }
+    ...
+    if (link.isUp() && !stillConnected()) link.lost(now);
+
+After a failure the next try waits minMs, doubling with every failure in a
+row up to maxMs. Each wait is jittered to between half and all of that, so
+a gate and the broker coming back from the same power cut don't keep
+meeting at the same moment. A link that drops after being up is tried
+again after a short (jittered) minMs. The counters are kept from boot.
+
+No Arduino calls, the owner passes millis() in. All calls come from one task.
+*/
+#ifndef CONNECTION_MANAGER_H
+#define CONNECTION_MANAGER_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+struct ConnectionStats {
+  uint32_t attempts;
+  uint32_t connects;
+  uint32_t failures;         // attempts that didn't connect
+  uint32_t drops;            // connections lost after being up
+  uint32_t lastAttemptMs;    // how long the last attempt took
+  uint32_t maxAttemptMs;
+  uint32_t longestOutageMs;  // longest time down, not counting before the first connect
+  int16_t lastError;         // what the last failed attempt gave back
+};
+
+class ConnectionManager {
+ public:
+  ConnectionManager(uint32_t minMs, uint32_t maxMs, uint32_t seed);
+  // New seed for the jitter, for when a real random source is up after construction
+  void seed(uint32_t seed);
+
+  // Time for another attempt
+  bool due(uint32_t nowMs) const;
+  void attempt(uint32_t nowMs);
+  void connected(uint32_t nowMs);
+  void failed(uint32_t nowMs, int16_t error = 0);
+  // Was up and isn't any more
+  void lost(uint32_t nowMs);
+  // Start over at minMs, for when something underneath (WiFi) has just come back
+  void retryNow(uint32_t nowMs);
+
+  bool isUp() const { return up; }
+  uint32_t retryInMs(uint32_t nowMs) const;
+  const ConnectionStats &stats() const { return counters; }
+  // Share of the time since the first attempt the link was up, 0..100
+  uint8_t upPercent(uint32_t nowMs) const;
+  // {"up":true,"attempts":..,"connects":..,"failures":..,"drops":..,"up_pct":..,
+  //  "attempt_ms":..,"max_attempt_ms":..,"longest_outage_s":..,"error":..}
+  size_t json(char *out, size_t size, uint32_t nowMs) const;
+
+ private:
+  uint32_t jittered(uint32_t waitMs);
+  void waitFrom(uint32_t nowMs, uint32_t waitMs);
+
+  uint32_t minMs;
+  uint32_t maxMs;
+  uint32_t random;
+  bool up;
+  bool started;         // an attempt has been made
+  bool everUp;
+  uint8_t failuresInRow;
+  uint32_t nextMs;      // no attempt before this
+  uint32_t attemptStartMs;
+  uint32_t firstAttemptMs;
+  uint32_t changedMs;   // last time up turned on or off
+  uint32_t upMs;        // time up, until changedMs
+  ConnectionStats counters;
+};
+
+#endif
@@ -0,0 +1,118 @@
+#include "CountLedger.h"
+
+static const char *eventNames[] = {"car", "confirm", "retract"};
+static const char *reasonNames[COUNT_REASONS] = {"car",     "settled", "exit",  "reversal",
+                                                 "backup",  "timeout", "noise", "full"};
+
+const char *countEventName(uint8_t type) {
+  return type <= COUNT_RETRACTED ? eventNames[type] : "?";
+}
+
+const char *countReasonName(uint8_t reason) {
+  return reason < COUNT_REASONS ? reasonNames[reason] : "?";
+}
+
+CountLedger::CountLedger()
+    : listener(0), listenerContext(0), confirmUs(0), reversalUs(0), heldSeq(0), nextSeq(1), confirmedTotal(0), retracted(0),
+      first(0), used(0) {}
+
+void CountLedger::setListener(Listener l, void *context) {
+  listener = l;
+  listenerContext = context;
+}
+
+void CountLedger::setTotal(int32_t total, uint32_t micros) {
+  while (used) confirm(entries[first].seq, micros, COUNT_REASON_SETTLED);
+  confirmedTotal = total;
+}
+
+void CountLedger::resume(int32_t total, uint32_t lastSeq) {
+  confirmedTotal = total;
+  if (lastSeq >= nextSeq) nextSeq = lastSeq + 1;
+}
+
+uint32_t CountLedger::provisional(uint32_t micros, uint8_t reason) {
+  if (used == COUNT_PENDING_MAX) {
+    Entry &oldest = entries[first];
+    confirm(oldest.seq, micros, COUNT_REASON_FULL);
+  }
+  heldSeq = 0;  // the car on the sensor was the next one, not a backup
+  Entry &entry = entries[(first + used) % COUNT_PENDING_MAX];
+  entry.seq = nextSeq++;
+  entry.micros = micros;
+  used++;
+  emit(COUNT_PROVISIONAL, reason, entry.seq, micros);
+  return entry.seq;
+}
+
+bool CountLedger::confirm(uint32_t seq, uint32_t micros, uint8_t reason) {
+  int index = find(seq);
+  if (index < 0) return false;
+  if (seq == heldSeq) heldSeq = 0;
+  removeAt(index);
+  confirmedTotal++;
+  emit(COUNT_CONFIRMED, reason, seq, micros);
+  return true;
+}
+
+bool CountLedger::retract(uint32_t seq, uint32_t micros, uint8_t reason) {
+  int index = find(seq);
+  if (index < 0) return false;
+  if (seq == heldSeq) heldSeq = 0;
+  removeAt(index);
+  retracted++;
+  emit(COUNT_RETRACTED, reason, seq, micros);
+  return true;
+}
+
+void CountLedger::poll(uint32_t micros) {
+  if (!confirmUs) return;
+  // oldest first, so stop at the first one that is still young enough
+  while (used && entries[first].seq != heldSeq && micros - entries[first].micros >= confirmUs) {
+    Entry oldest = entries[first];
+    confirm(oldest.seq, oldest.micros + confirmUs, COUNT_REASON_SETTLED);
+  }
+}
+
+void CountLedger::carStart(uint32_t startUs) {
+  if (!reversalUs || !used) return;
+  const Entry &newest = entries[(first + used - 1) % COUNT_PENDING_MAX];
+  // a split on the bounce gap starts the next car on the counting edge, that's a queue
+  if (startUs == newest.micros || startUs - newest.micros > reversalUs) return;
+  heldSeq = newest.seq;
+}
+
+void CountLedger::carTimeout(uint32_t micros) {
+  if (heldSeq) retract(heldSeq, micros, COUNT_REASON_REVERSAL);
+}
+
+int CountLedger::find(uint32_t seq) const {
+  for (uint8_t i = 0; i < used; i++) {
+    uint8_t index = (first + i) % COUNT_PENDING_MAX;
+    if (entries[index].seq == seq) return index;
+  }
+  return -1;
+}
+
+void CountLedger::removeAt(int index) {
+  // close the gap towards the oldest end, usually it is the oldest anyway
+  while (index != first) {
+    int before = (index + COUNT_PENDING_MAX - 1) % COUNT_PENDING_MAX;
+    entries[index] = entries[before];
+    index = before;
+  }
+  first = (first + 1) % COUNT_PENDING_MAX;
+  used--;
+}
+
+void CountLedger::emit(uint8_t type, uint8_t reason, uint32_t seq, uint32_t micros) {
+  if (!listener) return;
+  CountEvent event;
+  event.type = type;
+  event.reason = reason;
+  event.seq = seq;
+  event.micros = micros;
+  event.total = total();
+  event.confirmed = confirmedTotal;
+  listener(event, listenerContext);
+}
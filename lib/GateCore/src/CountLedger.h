@@ -0,0 +1,122 @@
+/*
+Count corrections: provisional counts that are confirmed or retracted later.
+
+A car is counted as soon as it looks like one so the display and MQTT stay
+quick. Each count gets a sequence number and stays pending until
+  - something confirms it (the beams saw it leave), or
+  - it has been pending for confirmMs without anything against it, or
+  - something retracts it (the car backed up onto the sensor again, the
+    beams saw it back out), which takes it off the total.
+A car back over the sensor within reversalMs of the newest count holds that
+count, it doesn't settle while the car is there. If the car is counted too it
+was the next one in the queue and both stay. If it never clears the sensor
+(the detector times out) it was the counted car backing up, and the held
+count is taken back. A car that backs up and clears the sensor again is
+counted twice, it takes the beams to see that.
+Every step is reported through the listener with the sequence number and
+the totals, so whoever keeps a count downstream can correct it one car at
+a time instead of resetting it. Sequence numbers go up for as long as the
+gate is running, resets of the total don't restart them, and resume()
+carries them on across a reboot.
+
+No Arduino calls, same as GateDetector. All calls come from one task.
+*/
+#ifndef COUNT_LEDGER_H
+#define COUNT_LEDGER_H
+
+#include <stdint.h>
+
+#define COUNT_PENDING_MAX 16  // counts waiting at once, the oldest is confirmed when full
+
+enum CountEventType : uint8_t {
+  COUNT_PROVISIONAL,  // counted, may still be taken back
+  COUNT_CONFIRMED,    // stays counted
+  COUNT_RETRACTED     // taken back off the total
+};
+
+enum CountReason : uint8_t {
+  COUNT_REASON_CAR,          // detector counted a car
+  COUNT_REASON_SETTLED,      // pending long enough with nothing against it
+  COUNT_REASON_EXIT,         // beams saw it leave
+  COUNT_REASON_REVERSAL,     // back on the sensor right after and stuck there, car backed up
+  COUNT_REASON_BACKUP,       // beams saw it back out
+  COUNT_REASON_TIMEOUT,      // pass never ended
+  COUNT_REASON_NOISE,        // no vehicle after all
+  COUNT_REASON_FULL          // too many pending, oldest confirmed
+};
+#define COUNT_REASONS 8
+
+struct CountEvent {
+  uint8_t type;       // CountEventType
+  uint8_t reason;     // CountReason
+  uint32_t seq;
+  uint32_t micros;    // when it happened, edge clock
+  int32_t total;      // counted cars including pending ones
+  int32_t confirmed;  // counted cars that can't be taken back any more
+};
+
+const char *countEventName(uint8_t type);
+const char *countReasonName(uint8_t reason);
+
+class CountLedger {
+ public:
+  typedef void (*Listener)(const CountEvent &event, void *context);
+
+  CountLedger();
+
+  void setListener(Listener listener, void *context);
+  // 0 = counts are only confirmed by confirm()
+  void setConfirmMs(uint32_t ms) { confirmUs = ms * 1000UL; }
+  // 0 = a car right after a count holds nothing
+  void setReversalMs(uint32_t ms) { reversalUs = ms * 1000UL; }
+
+  // New total, e.g. the daily reset or a resetcount message. Pending counts
+  // are confirmed first so every sequence number gets its answer.
+  void setTotal(int32_t total, uint32_t micros);
+  // After a reboot: carry on from a restored total, numbering from lastSeq + 1.
+  // Call before the first count.
+  void resume(int32_t total, uint32_t lastSeq);
+
+  // Count a car, returns its sequence number
+  uint32_t provisional(uint32_t micros, uint8_t reason = COUNT_REASON_CAR);
+  // False if seq is no longer pending (confirmed, retracted or never was)
+  bool confirm(uint32_t seq, uint32_t micros, uint8_t reason);
+  bool retract(uint32_t seq, uint32_t micros, uint8_t reason);
+  // Confirm what has been pending for confirmMs, up to a held count
+  void poll(uint32_t micros);
+  // The detector's car start and timeout, for reversals. A count releases the hold.
+  void carStart(uint32_t startUs);
+  void carTimeout(uint32_t micros);
+
+  bool pending(uint32_t seq) const { return find(seq) >= 0; }
+  uint32_t newestPending() const { return used ? entries[(first + used - 1) % COUNT_PENDING_MAX].seq : 0; }
+  uint32_t lastSeq() const { return nextSeq - 1; }
+  int32_t total() const { return confirmedTotal + used; }
+  int32_t confirmed() const { return confirmedTotal; }
+  uint32_t retractions() const { return retracted; }
+  uint32_t held() const { return heldSeq; }
+
+ private:
+  struct Entry {
+    uint32_t seq;
+    uint32_t micros;
+  };
+
+  int find(uint32_t seq) const;
+  void removeAt(int index);
+  void emit(uint8_t type, uint8_t reason, uint32_t seq, uint32_t micros);
+
+  Listener listener;
+  void *listenerContext;
+  uint32_t confirmUs;
+  uint32_t reversalUs;
+  uint32_t heldSeq;  // count a car came back over the sensor right after, 0 for none
+  uint32_t nextSeq;
+  int32_t confirmedTotal;
+  uint32_t retracted;
+  Entry entries[COUNT_PENDING_MAX];  // oldest first, ring
+  uint8_t first;
+  uint8_t used;
+};
+
+#endif
@@ -0,0 +1,77 @@
+#include "CountRollup.h"
+
+#include <stdio.h>
+#include <string.h>
+
+#include "CivilTime.h"
+
+#define SECONDS_PER_DAY 86400
+
+CountRollup::CountRollup(uint8_t dayStartHour) : dayStartHour(dayStartHour) {
+  startDay(0);
+}
+
+uint32_t CountRollup::dayOf(uint32_t unixtime) const {
+  uint32_t offset = dayStartHour * 3600;
+  if (unixtime < offset) return 0;
+  return unixtime - (unixtime - offset) % SECONDS_PER_DAY;
+}
+
+void CountRollup::startDay(uint32_t unixtime) {
+  start = dayOf(unixtime);
+  cars = 0;
+  memset(minutes, 0, sizeof(minutes));
+  memset(quarters, 0, sizeof(quarters));
+  memset(hours, 0, sizeof(hours));
+}
+
+void CountRollup::rebuild() {
+  cars = 0;
+  memset(quarters, 0, sizeof(quarters));
+  memset(hours, 0, sizeof(hours));
+  for (uint16_t index = 0; index < ROLLUP_MINUTES; index++) {
+    quarters[index / 15] += minutes[index];
+    hours[index / 60] += minutes[index];
+    cars += minutes[index];
+  }
+}
+
+uint16_t CountRollup::minuteOf(uint32_t unixtime) const {
+  if (unixtime < start || unixtime - start >= SECONDS_PER_DAY) return ROLLUP_NONE;
+  return (unixtime - start) / 60;
+}
+
+uint16_t CountRollup::add(uint32_t unixtime, int16_t count) {
+  uint16_t index = minuteOf(unixtime);
+  if (index == ROLLUP_NONE) return ROLLUP_NONE;
+  minutes[index] += count;
+  quarters[index / 15] += count;
+  hours[index / 60] += count;
+  cars += count;
+  return index;
+}
+
+size_t CountRollup::json(char *out, size_t size, uint16_t closed) const {
+  size_t length = 0;
+  #define JSON_APPEND(...) \
+    if (length < size) length += snprintf(out + length, size - length, __VA_ARGS__)
+
+  char day[20];
+  formatTimestamp(start, day);
+  JSON_APPEND("{\"day\":\"%s\",\"quarter\":%u,\"minutes\":[", day, (unsigned)closed);
+  for (uint16_t index = closed * 15; index < closed * 15 + 15; index++) {
+    JSON_APPEND("%s%d", index % 15 ? "," : "", minutes[index]);
+  }
+  JSON_APPEND("],\"quarters\":[");
+  for (uint16_t index = 0; index <= closed; index++) JSON_APPEND("%s%d", index ? "," : "", quarters[index]);
+  JSON_APPEND("],\"hours\":[");
+  for (uint16_t index = 0; index <= closed / 4; index++) JSON_APPEND("%s%d", index ? "," : "", hours[index]);
+  JSON_APPEND("],\"total\":%d}", (int)cars);
+  #undef JSON_APPEND
+
+  if (length >= size) {
+    if (size) out[0] = '\0';
+    return 0;
+  }
+  return length;
+}
@@ -0,0 +1,65 @@
+/*
+Exits per minute, per 15 minutes and per hour for the counting day.
+
+The counting day starts at dayStartHour (the daily reset), so an event
+night stays in one day across midnight. Every count adds 1 to its minute,
+quarter and hour and every retraction takes 1 off where it happens, so the
+buckets always add up to the net count. Fixed arrays, nothing allocated.
+
+The minutes are the whole state, minuteData() is what gets stored. After
+a reboot: startDay() on the stored day, read the minutes back into
+minuteData() and rebuild() the quarters and hours from them.
+
+No Arduino calls, times are RTC unixtimes (local time, like the logs).
+All calls come from one task.
+*/
+#ifndef COUNT_ROLLUP_H
+#define COUNT_ROLLUP_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define ROLLUP_MINUTES 1440
+#define ROLLUP_QUARTERS 96
+#define ROLLUP_HOURS 24
+#define ROLLUP_NONE 0xFFFF  // no bucket
+
+class CountRollup {
+ public:
+  explicit CountRollup(uint8_t dayStartHour);
+
+  // The counting day unixtime is in, as the unixtime it started
+  uint32_t dayOf(uint32_t unixtime) const;
+  // Start on the day of unixtime with empty buckets
+  void startDay(uint32_t unixtime);
+  // Quarters, hours and the total again from the minutes
+  void rebuild();
+
+  // count is 1 for a car and -1 for a retraction. The minute it went into,
+  // ROLLUP_NONE if unixtime isn't in the current day.
+  uint16_t add(uint32_t unixtime, int16_t count);
+  // Minute of the current day unixtime falls in, ROLLUP_NONE if it isn't in it
+  uint16_t minuteOf(uint32_t unixtime) const;
+
+  uint32_t dayStart() const { return start; }
+  int16_t minute(uint16_t index) const { return minutes[index]; }
+  int16_t quarter(uint16_t index) const { return quarters[index]; }
+  int16_t hour(uint8_t index) const { return hours[index]; }
+  int32_t total() const { return cars; }
+  int16_t *minuteData() { return minutes; }
+
+  // One closed quarter, with the day so far for anyone catching up:
+  // {"day":"2024-12-14 17:00:00","quarter":14,"minutes":[..15..],"quarters":[..up to 14..],"hours":[..up to its hour..],"total":n}
+  // 0 if it doesn't fit
+  size_t json(char *out, size_t size, uint16_t closed) const;
+
+ private:
+  uint8_t dayStartHour;
+  uint32_t start;
+  int32_t cars;
+  int16_t minutes[ROLLUP_MINUTES];
+  int16_t quarters[ROLLUP_QUARTERS];
+  int16_t hours[ROLLUP_HOURS];
+};
+
+#endif
@@ -0,0 +1,139 @@
+#include "CounterJournal.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "CivilTime.h"
+
+// Bitwise, 28 bytes a car doesn't need a table
+static uint32_t crc32(const void *data, size_t length) {
+  const uint8_t *bytes = (const uint8_t *)data;
+  uint32_t crc = 0xFFFFFFFF;
+  for (size_t i = 0; i < length; i++) {
+    crc ^= bytes[i];
+    for (uint8_t bit = 0; bit < 8; bit++) crc = (crc >> 1) ^ (0xEDB88320 & (0 - (crc & 1)));
+  }
+  return ~crc;
+}
+
+CounterJournal::CounterJournal() : nextSeq(1), sinceCheckpoint(0) {
+  memset(&current, 0, sizeof(current));
+}
+
+bool CounterJournal::valid(const JournalRecord &record, uint16_t slot) {
+  return record.seq != 0 && record.seq % JOURNAL_SLOTS == slot &&
+         (record.type == JOURNAL_CHECKPOINT || record.type == JOURNAL_DELTA) &&
+         record.crc == crc32(&record, offsetof(JournalRecord, crc));
+}
+
+bool CounterJournal::recover(ReadSlot read, void *context, CounterState &state) {
+  // the newest record, and the newest checkpoint
+  uint32_t head = 0, checkpoint = 0;
+  JournalRecord record;
+  for (uint16_t slot = 0; slot < JOURNAL_SLOTS; slot++) {
+    if (!read(slot, record, context) || !valid(record, slot)) continue;
+    if (record.seq > head) head = record.seq;
+    if (record.type == JOURNAL_CHECKPOINT && record.seq > checkpoint) {
+      checkpoint = record.seq;
+      current = record.state;
+    }
+  }
+  nextSeq = head + 1;
+  if (!checkpoint) return false;
+
+  // the deltas after it, up to a gap or a torn record
+  sinceCheckpoint = 0;
+  for (uint32_t seq = checkpoint + 1; seq <= head; seq++) {
+    uint16_t slot = seq % JOURNAL_SLOTS;
+    if (!read(slot, record, context) || !valid(record, slot) || record.seq != seq) break;
+    current.dailyCars += record.cars;
+    current.unixtime = record.state.unixtime;
+    current.countSeq = record.state.countSeq;
+    sinceCheckpoint++;
+  }
+  state = current;
+  return true;
+}
+
+uint16_t CounterJournal::counted(int16_t cars, uint32_t countSeq, uint32_t unixtime, JournalRecord &record) {
+  current.dailyCars += cars;
+  current.unixtime = unixtime;
+  if (countSeq > current.countSeq) current.countSeq = countSeq;
+  return append(sinceCheckpoint + 1 >= JOURNAL_CHECKPOINT_EVERY ? JOURNAL_CHECKPOINT : JOURNAL_DELTA, cars, record);
+}
+
+uint16_t CounterJournal::set(const CounterState &state, JournalRecord &record) {
+  current = state;
+  return append(JOURNAL_CHECKPOINT, 0, record);
+}
+
+uint16_t CounterJournal::append(uint8_t type, int16_t cars, JournalRecord &record) {
+  memset(&record, 0, sizeof(record));
+  record.seq = nextSeq++;
+  record.type = type;
+  record.cars = cars;
+  record.state = current;
+  record.crc = crc32(&record, offsetof(JournalRecord, crc));
+  sinceCheckpoint = type == JOURNAL_CHECKPOINT ? 0 : sinceCheckpoint + 1;
+  return record.seq % JOURNAL_SLOTS;
+}
+
+const char *counterSourceName(uint8_t source) {
+  switch (source) {
+    case COUNTERS_JOURNAL: return "journal";
+    case COUNTERS_CSV:     return "GateCount.csv";
+    default:               return "none";
+  }
+}
+
+static bool sameDay(const CounterState &state, uint32_t dayStart) {
+  return state.unixtime >= dayStart && state.unixtime - dayStart < 86400;
+}
+
+uint8_t restoreCounterState(const CounterState *journal, const CounterState *row, uint32_t dayStart,
+                            CounterState &state) {
+  memset(&state, 0, sizeof(state));
+  // The journal has every count and retraction as it was logged, GateCount.csv gets its row
+  // up to a flush later, so a row the journal hasn't got means the journal write was lost.
+  uint8_t source = COUNTERS_NEW;
+  if (journal && sameDay(*journal, dayStart)) {
+    state = *journal;
+    source = COUNTERS_JOURNAL;
+  }
+  if (row && sameDay(*row, dayStart) && (source == COUNTERS_NEW || row->countSeq > journal->countSeq)) {
+    state = *row;
+    source = COUNTERS_CSV;
+  }
+  if (journal && journal->countSeq > state.countSeq) state.countSeq = journal->countSeq;
+  if (row && row->countSeq > state.countSeq) state.countSeq = row->countSeq;
+  return source;
+}
+
+bool gateCountRowState(const char *row, CounterState &state) {
+  unsigned year, month, day, hour, minute, second;
+  if (sscanf(row, "%u-%u-%u %u:%u:%u", &year, &month, &day, &hour, &minute, &second) != 6) return false;
+  CivilTime time;
+  memset(&time, 0, sizeof(time));
+  time.year = year;
+  time.month = month;
+  time.day = day;
+  time.hour = hour;
+  time.minute = minute;
+  time.second = second;
+  // Date Time,Pass Timer,NoCar Timer,Bounces,Car#,Cars In Park,Temp,Last Car Millis, This Car Millis,Bounce Flag,Millis,Seq,Class
+  const char *columns[13];
+  uint8_t count = 0;
+  for (const char *at = row; at && count < 13; at = strchr(at, ',')) {
+    if (*at == ',') at++;
+    columns[count++] = at;
+  }
+  if (count < 12) return false;
+  memset(&state, 0, sizeof(state));
+  state.unixtime = civilUnixtime(time);
+  state.dailyCars = atol(columns[4]);
+  state.carCounterCars = atol(columns[5]) + state.dailyCars;
+  state.countSeq = strtoul(columns[11], NULL, 10);
+  return true;
+}
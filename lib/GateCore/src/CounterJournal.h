@@ -0,0 +1,96 @@
+/*
+The counters, kept where a brownout or an OTA restart can't lose them.
+
+The journal is a ring of JOURNAL_SLOTS fixed size records in a file,
+record n always in slot n % JOURNAL_SLOTS, so every slot is written in
+turn and none of them more than the others. A checkpoint record has the
+whole state, a delta record one car counted (+1) or taken back (-1).
+Every JOURNAL_CHECKPOINT_EVERY records, and whenever a count is set
+outright (daily reset, resetcount, the Car Counter), a checkpoint is
+written instead, so the ring always holds one and recovery plays at most
+that many deltas on top of it.
+
+Each record has a CRC. A record torn by a reset mid-write fails it and
+recovery stops just before, with everything up to the car before.
+
+  recover()  at boot, reads every slot once through the caller's ReadSlot
+  counted()  a car counted or taken back, the record to write and where
+  set()      a checkpoint of a new state, the record to write and where
+
+No Arduino calls, the owner does the reading and writing.
+*/
+#ifndef COUNTER_JOURNAL_H
+#define COUNTER_JOURNAL_H
+
+#include <stdint.h>
+
+#define JOURNAL_SLOTS 256
+#define JOURNAL_CHECKPOINT_EVERY 32
+
+enum JournalRecordType : uint8_t {
+  JOURNAL_CHECKPOINT = 1,
+  JOURNAL_DELTA
+};
+
+struct CounterState {
+  uint32_t unixtime;       // RTC time of the last change
+  int32_t dailyCars;       // totalDailyCars
+  int32_t carCounterCars;  // cars counted in by the Car Counter
+  uint32_t countSeq;       // last count sequence number, see CountLedger.h
+};
+
+struct JournalRecord {
+  uint32_t seq;        // journal sequence number, 1 up
+  uint8_t type;        // JournalRecordType
+  uint8_t reserved;
+  int16_t cars;        // delta: +1 counted, -1 taken back
+  CounterState state;  // checkpoint: all of it, delta: unixtime and countSeq
+  uint32_t crc;        // CRC-32 of everything before it
+};
+
+class CounterJournal {
+ public:
+  // Read one slot, false if it can't be read (not written yet)
+  typedef bool (*ReadSlot)(uint16_t slot, JournalRecord &record, void *context);
+
+  CounterJournal();
+
+  // Newest checkpoint with the deltas after it played on top. False when there is
+  // no checkpoint to go from. Writing carries on after the newest record either way.
+  bool recover(ReadSlot read, void *context, CounterState &state);
+
+  // The record to write for a change and the slot it goes in
+  uint16_t counted(int16_t cars, uint32_t countSeq, uint32_t unixtime, JournalRecord &record);
+  uint16_t set(const CounterState &state, JournalRecord &record);
+
+  const CounterState &state() const { return current; }
+  uint32_t recordCount() const { return nextSeq - 1; }
+
+ private:
+  uint16_t append(uint8_t type, int16_t cars, JournalRecord &record);
+  static bool valid(const JournalRecord &record, uint16_t slot);
+
+  CounterState current;
+  uint32_t nextSeq;
+  uint16_t sinceCheckpoint;
+};
+
+// A GateCount.csv row (Date Time, ..., Car#, Cars In Park, ..., Seq) as the state after
+// that car. False for the header, a row cut short or one from before the Seq column.
+bool gateCountRowState(const char *row, CounterState &state);
+
+// Where the counts after a reboot came from
+enum CounterSource : uint8_t {
+  COUNTERS_NEW,      // nothing from today, starting at 0
+  COUNTERS_JOURNAL,  // Counters.jnl
+  COUNTERS_CSV       // the last row of GateCount.csv, newer than the journal
+};
+const char *counterSourceName(uint8_t source);
+
+// The state to start from on the counting day that began at dayStart, from what the
+// journal recovered and the last GateCount.csv row (NULL for either that isn't there).
+// Sequence numbers carry on from the newest of the two even into a new day.
+uint8_t restoreCounterState(const CounterState *journal, const CounterState *row, uint32_t dayStart,
+                            CounterState &state);
+
+#endif
@@ -0,0 +1,56 @@
+/*
+Detector profiles, one set of thresholds per kind of traffic at the gate.
+
+A profile is a plain struct of compile time constants. The firmware picks
+one with -DGATE_PROFILE=<name> (one PlatformIO env per profile) so the
+detector's comparisons are against immediates. The replay tool runs all
+of them side by side with --profiles.
+
+Only NormalExitProfile has been used on the gate so far, the other two
+are starting points to be checked against recorded traces.
+*/
+#ifndef DETECTOR_PROFILES_H
+#define DETECTOR_PROFILES_H
+
+#include <stdint.h>
+
+// Settings used on the gate since 12/23/23
+struct NormalExitProfile {
+  static constexpr const char *name = "normal";
+  static constexpr uint32_t nocarTimeoutMs = 900;   // HIGH this long after bouncing = car has passed
+  static constexpr uint32_t bounceGapMs = 2000;     // LOW edges further apart than this are two cars
+  static constexpr uint32_t stuckTimeoutMs = 10000; // give up on a car that never clears
+  static constexpr uint16_t minBounces = 2;         // LOW edges needed before the no car timer counts
+  static constexpr uint32_t reversalMs = 0;         // car back on the sensor this soon after a count and stuck = backup, 0 = off
+};
+
+// Cars stop on the sensor, back up and turn around. Wait longer before
+// calling a car gone and don't split a slow car into two. A car back over
+// the sensor within 3 s of a count that then times out on it backed up,
+// the count is taken back. One that is counted is the next in the queue,
+// both stay (see CountLedger.h).
+struct BackupProneProfile {
+  static constexpr const char *name = "backup";
+  static constexpr uint32_t nocarTimeoutMs = 1500;
+  static constexpr uint32_t bounceGapMs = 3500;
+  static constexpr uint32_t stuckTimeoutMs = 20000;
+  static constexpr uint16_t minBounces = 3;
+  static constexpr uint32_t reversalMs = 3000;
+};
+
+// Bumper to bumper exit after an event. Cars are close together, so
+// clear quickly and split on shorter gaps.
+struct EventNightProfile {
+  static constexpr const char *name = "event";
+  static constexpr uint32_t nocarTimeoutMs = 700;
+  static constexpr uint32_t bounceGapMs = 1500;
+  static constexpr uint32_t stuckTimeoutMs = 8000;
+  static constexpr uint16_t minBounces = 2;
+  static constexpr uint32_t reversalMs = 0;  // the next car is right behind
+};
+
+#ifndef GATE_PROFILE
+#define GATE_PROFILE NormalExitProfile
+#endif
+
+#endif
@@ -0,0 +1,78 @@
+/*
+Lock-free single-producer / single-consumer ring of timestamped sensor edges.
+
+The producer is the GPIO interrupt (EdgeCapture.cpp), the consumer is the
+detection code. Several pins can share one ring as long as their interrupts
+can't preempt each other, which holds for the ESP32 GPIO interrupts all
+attached from the same core. Head and tail are only ever written by one side each, so no
+lock or critical section is needed and push() is safe to call from an ISR.
+Nothing in here touches Arduino, so the same ring is used by the host tools.
+*/
+#ifndef EDGE_RING_H
+#define EDGE_RING_H
+
+#include <stdint.h>
+#include <atomic>
+
+// Force inlining so push() ends up in IRAM together with the calling ISR
+#define EDGE_RING_INLINE inline __attribute__((always_inline))
+
+// One level change on a sensor input
+struct SensorEdge {
+  uint32_t micros;  // micros() when the interrupt fired
+  uint8_t level;    // pin level after the change, HIGH = no car
+  uint8_t input;    // which sensor, 0 = magnetometer (see EdgeCapture.h)
+  uint8_t reserved[2];
+};
+
+template <uint16_t N>
+class EdgeRing {
+  static_assert(N >= 2 && (N & (N - 1)) == 0, "EdgeRing size must be a power of 2");
+
+ public:
+  EdgeRing() : head(0), tail(0), dropped(0), highWater(0) {}
+
+  // Producer side (ISR). Returns false and counts a drop when full.
+  EDGE_RING_INLINE bool push(uint32_t micros, uint8_t level, uint8_t input = 0) {
+    uint16_t h = head.load(std::memory_order_relaxed);
+    uint16_t used = (uint16_t)(h - tail.load(std::memory_order_acquire));
+    if (used >= N) {
+      dropped.store(dropped.load(std::memory_order_relaxed) + 1, std::memory_order_relaxed);
+      return false;
+    }
+    SensorEdge &e = buf[h & (N - 1)];
+    e.micros = micros;
+    e.level = level;
+    e.input = input;
+    head.store((uint16_t)(h + 1), std::memory_order_release);
+    if (used + 1 > highWater.load(std::memory_order_relaxed)) {
+      highWater.store(used + 1, std::memory_order_relaxed);
+    }
+    return true;
+  }
+
+  // Consumer side. Returns false when there is nothing to read.
+  EDGE_RING_INLINE bool pop(SensorEdge &out) {
+    uint16_t t = tail.load(std::memory_order_relaxed);
+    if (t == head.load(std::memory_order_acquire)) return false;
+    out = buf[t & (N - 1)];
+    tail.store((uint16_t)(t + 1), std::memory_order_release);
+    return true;
+  }
+
+  uint16_t available() const {
+    return (uint16_t)(head.load(std::memory_order_acquire) - tail.load(std::memory_order_relaxed));
+  }
+  uint32_t droppedCount() const { return dropped.load(std::memory_order_relaxed); }
+  uint16_t highWaterMark() const { return highWater.load(std::memory_order_relaxed); }
+  static constexpr uint16_t capacity() { return N; }
+
+ private:
+  SensorEdge buf[N];
+  std::atomic<uint16_t> head;  // written by producer only
+  std::atomic<uint16_t> tail;  // written by consumer only
+  std::atomic<uint32_t> dropped;
+  std::atomic<uint16_t> highWater;
+};
+
+#endif
@@ -0,0 +1,137 @@
+#include "GateDetector.h"
+
+template <class Policy>
+BasicGateDetector<Policy>::BasicGateDetector() : listener(0), listenerContext(0) {
+  reset();
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::setListener(Listener l, void *context) {
+  listener = l;
+  listenerContext = context;
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::reset(uint8_t level) {
+  present = false;
+  sensorLevel = level;
+  lastUs = 0;
+  bounces = 0;
+  carStartUs = 0;
+  nocarTimerUs = 0;
+  lastHighUs = 0;
+  lowUs = 0;
+  lastLowUs = 0;
+  edges = 0;
+  counted = 0;
+  timeouts = 0;
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::onEdge(uint32_t micros, uint8_t level) {
+  // timers that ran out before this edge fire first
+  poll(micros);
+  lastUs = micros;
+  if (level == sensorLevel) return;
+  sensorLevel = level;
+  edges++;
+
+  if (level == SENSOR_LOW) {
+    if (!present) startCar(micros);
+    lowEdge(micros);
+    return;
+  }
+
+  if (!present) return;
+  // LOW to HIGH, start the no car timer
+  lastHighUs = micros - carStartUs;
+  nocarTimerUs = micros;
+  if (micros - carStartUs > this->stuckTimeoutUs()) finishCar(DETECTOR_TIMEOUT, micros);
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::poll(uint32_t micros) {
+  if (!present || sensorLevel != SENSOR_HIGH) return;
+  // an edge newer than this poll has already been seen
+  if ((int32_t)(micros - lastUs) < 0) return;
+  // Both timers are checked with the time they ran out, not the time we got to look
+  if (bounces >= this->minBounces() && micros - nocarTimerUs >= this->nocarTimeoutUs()) {
+    uint32_t clearUs = nocarTimerUs + this->nocarTimeoutUs();
+    if (clearUs - carStartUs <= this->stuckTimeoutUs()) {
+      finishCar(DETECTOR_CAR_COUNTED, clearUs);
+      return;
+    }
+  }
+  if (micros - carStartUs > this->stuckTimeoutUs()) {
+    finishCar(DETECTOR_TIMEOUT, carStartUs + this->stuckTimeoutUs() + 1);
+  }
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::startCar(uint32_t micros) {
+  present = true;
+  bounces = 0;
+  carStartUs = micros;
+  nocarTimerUs = micros;
+  lastHighUs = 0;
+  lowUs = 0;
+  lastLowUs = 0;
+  DetectorEvent event;
+  fill(event, DETECTOR_CAR_START, micros);
+  emit(event);
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::lowEdge(uint32_t micros) {
+  bounces++;
+  lastLowUs = lowUs;
+  lowUs = micros - carStartUs;
+  DetectorEvent event;
+  fill(event, DETECTOR_BOUNCE, micros);
+  emit(event);
+
+  if (lowUs - lastLowUs > this->bounceGapUs()) {
+    // Long gap between bounces, that was the next car. Count this one and
+    // start the new car on this edge.
+    finishCar(DETECTOR_CAR_COUNTED, micros);
+    startCar(micros);
+    lowEdge(micros);
+  }
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::finishCar(uint8_t type, uint32_t micros) {
+  DetectorEvent event;
+  fill(event, type, micros);
+  present = false;
+  if (type == DETECTOR_CAR_COUNTED) {
+    counted++;
+  } else {
+    timeouts++;
+  }
+  emit(event);
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::fill(DetectorEvent &event, uint8_t type, uint32_t micros) const {
+  event.type = type;
+  event.level = sensorLevel;
+  event.bounces = bounces;
+  event.micros = micros;
+  event.carStartUs = carStartUs;
+  event.passMs = (micros - carStartUs) / 1000;
+  event.lastHighMs = lastHighUs / 1000;
+  event.noCarMs = (micros - nocarTimerUs) / 1000;
+  event.lowMs = lowUs / 1000;
+  event.lastLowMs = lastLowUs / 1000;
+}
+
+template <class Policy>
+void BasicGateDetector<Policy>::emit(const DetectorEvent &event) {
+  if (listener) listener(event, listenerContext);
+}
+
+template class BasicGateDetector<RuntimePolicy>;
+template class BasicGateDetector<FixedPolicy<NormalExitProfile> >;
+template class BasicGateDetector<FixedPolicy<BackupProneProfile> >;
+template class BasicGateDetector<FixedPolicy<EventNightProfile> >;
@@ -0,0 +1,159 @@
+/*
+Car detection state machine for the buried magnetometer (vehicle sensor).
+
+This is the counting algorithm that used to live in the body of loop(),
+pulled out with no Arduino, RTC, SD or MQTT calls so recorded traces can be
+replayed through it on the PC. Feed it edges with onEdge() and let time pass
+with poll(); it reports what it sees through the listener.
+
+Sensor is LOW while a car is over it, normally HIGH. A car is counted when
+  - the sensor has bounced at least minBounces times and then stayed HIGH
+    for nocarTimeoutMs, or
+  - two LOW edges are more than bounceGapMs apart (the next car already
+    tripped the sensor), in which case the new car starts on that edge.
+If the sensor is HIGH and the car has been present for more than
+stuckTimeoutMs the car is dropped with a timeout instead.
+
+The thresholds come from the policy the detector is built with: a profile
+fixed at compile time (see DetectorProfiles.h) or RuntimePolicy, which
+takes a DetectorConfig.
+*/
+#ifndef GATE_DETECTOR_H
+#define GATE_DETECTOR_H
+
+#include <stdint.h>
+
+#include "DetectorProfiles.h"
+
+#define SENSOR_LOW 0
+#define SENSOR_HIGH 1
+
+struct DetectorConfig {
+  uint32_t nocarTimeoutMs;  // HIGH this long after bouncing = car has passed
+  uint32_t bounceGapMs;     // LOW edges further apart than this are two cars
+  uint32_t stuckTimeoutMs;  // give up on a car that never clears
+  uint16_t minBounces;      // LOW edges needed before the no car timer counts
+};
+
+#define DETECTOR_PROFILE_CONFIG(profile) \
+  {profile::nocarTimeoutMs, profile::bounceGapMs, profile::stuckTimeoutMs, profile::minBounces}
+#define DETECTOR_DEFAULT_CONFIG DETECTOR_PROFILE_CONFIG(NormalExitProfile)
+
+enum DetectorEventType : uint8_t {
+  DETECTOR_CAR_START,    // sensor tripped with no car present
+  DETECTOR_BOUNCE,       // sensor went LOW (1st one is the car start)
+  DETECTOR_CAR_COUNTED,  // car cleared the sensor
+  DETECTOR_TIMEOUT       // car never cleared, not counted
+};
+
+struct DetectorEvent {
+  uint8_t type;          // DetectorEventType
+  uint8_t level;         // sensor level after the event
+  uint16_t bounces;      // LOW edges seen for this car
+  uint32_t micros;       // when it happened, same clock as the edges
+  uint32_t carStartUs;   // when this car tripped the sensor
+  uint32_t passMs;       // time since car start (whileMillis)
+  uint32_t lastHighMs;   // car time of the last LOW->HIGH edge (lastwhileMillis)
+  uint32_t noCarMs;      // time the sensor has been HIGH
+  uint32_t lowMs;        // car time of this LOW edge (detectorStateLowMillis)
+  uint32_t lastLowMs;    // car time of the previous LOW edge
+};
+
+// Thresholds fixed at compile time from a profile, they compile to immediates
+template <class Profile>
+class FixedPolicy {
+ public:
+  static constexpr const char *profileName() { return Profile::name; }
+  static constexpr uint32_t nocarTimeoutUs() { return Profile::nocarTimeoutMs * 1000UL; }
+  static constexpr uint32_t bounceGapUs() { return Profile::bounceGapMs * 1000UL; }
+  static constexpr uint32_t stuckTimeoutUs() { return Profile::stuckTimeoutMs * 1000UL; }
+  static constexpr uint16_t minBounces() { return Profile::minBounces; }
+  DetectorConfig config() const { return DETECTOR_PROFILE_CONFIG(Profile); }
+};
+
+// Thresholds that can be changed while running (replay sweeps)
+class RuntimePolicy {
+ public:
+  RuntimePolicy() {
+    DetectorConfig defaults = DETECTOR_DEFAULT_CONFIG;
+    setConfig(defaults);
+  }
+  static constexpr const char *profileName() { return "runtime"; }
+  void setConfig(const DetectorConfig &config) {
+    cfg = config;
+    nocarUs = cfg.nocarTimeoutMs * 1000UL;
+    gapUs = cfg.bounceGapMs * 1000UL;
+    stuckUs = cfg.stuckTimeoutMs * 1000UL;
+  }
+  const DetectorConfig &config() const { return cfg; }
+  uint32_t nocarTimeoutUs() const { return nocarUs; }
+  uint32_t bounceGapUs() const { return gapUs; }
+  uint32_t stuckTimeoutUs() const { return stuckUs; }
+  uint16_t minBounces() const { return cfg.minBounces; }
+
+ private:
+  DetectorConfig cfg;
+  uint32_t nocarUs;
+  uint32_t gapUs;
+  uint32_t stuckUs;
+};
+
+// The policy is a base class, so config() (and setConfig() for RuntimePolicy) come from it
+template <class Policy>
+class BasicGateDetector : public Policy {
+ public:
+  typedef void (*Listener)(const DetectorEvent &event, void *context);
+
+  BasicGateDetector();
+
+  void setListener(Listener listener, void *context);
+
+  // Forget any car in progress, clear the counters and assume the sensor is at level
+  void reset(uint8_t level = SENSOR_HIGH);
+
+  // Sensor changed to level at time micros. Repeated levels are ignored.
+  void onEdge(uint32_t micros, uint8_t level);
+  // Let time pass without an edge, fires the no car and stuck timers
+  void poll(uint32_t micros);
+
+  bool carPresent() const { return present; }
+  uint8_t level() const { return sensorLevel; }
+
+  uint32_t edgeCount() const { return edges; }
+  uint32_t carsCounted() const { return counted; }
+  uint32_t timeoutCount() const { return timeouts; }
+
+ private:
+  void startCar(uint32_t micros);
+  void lowEdge(uint32_t micros);
+  void finishCar(uint8_t type, uint32_t micros);
+  void fill(DetectorEvent &event, uint8_t type, uint32_t micros) const;
+  void emit(const DetectorEvent &event);
+
+  Listener listener;
+  void *listenerContext;
+
+  bool present;
+  uint8_t sensorLevel;
+  uint16_t bounces;
+  uint32_t carStartUs;
+  uint32_t nocarTimerUs;  // when the sensor last went HIGH
+  uint32_t lastHighUs;    // car time of the last HIGH edge
+  uint32_t lowUs;         // car time of the last LOW edge
+  uint32_t lastLowUs;     // car time of the LOW edge before that
+  uint32_t lastUs;        // time of the newest edge
+
+  uint32_t edges;
+  uint32_t counted;
+  uint32_t timeouts;
+};
+
+// Member functions are in GateDetector.cpp, instantiated there for these
+typedef BasicGateDetector<RuntimePolicy> GateDetector;
+typedef BasicGateDetector<FixedPolicy<NormalExitProfile> > NormalExitDetector;
+typedef BasicGateDetector<FixedPolicy<BackupProneProfile> > BackupProneDetector;
+typedef BasicGateDetector<FixedPolicy<EventNightProfile> > EventNightDetector;
+// The profile the firmware was built with
+typedef BasicGateDetector<FixedPolicy<GATE_PROFILE> > GateProfileDetector;
+
+#endif
@@ -0,0 +1,176 @@
+#include "GateFusion.h"
+
+#include <string.h>
+
+static const char *passNames[] = {"exit", "backup", "turnaround", "noise", "timeout", "crossing"};
+
+const char *fusionPassName(uint8_t type) {
+  return type <= FUSION_CROSSING ? passNames[type] : "?";
+}
+
+GateFusion::GateFusion() : listener(0), listenerContext(0) {
+  FusionConfig gate = FUSION_GATE_CONFIG;
+  setConfig(gate);
+}
+
+bool GateFusion::setConfig(const FusionConfig &config) {
+  if (config.inputs > FUSION_MAX_INPUTS) return false;
+  uint8_t inner = 0xFF;
+  uint8_t outerBeam = 0;
+  bool magnetometer = false;
+  for (uint8_t i = 0; i < config.inputs; i++) {
+    const FusionInput &input = config.input[i];
+    if (input.kind == FUSION_MAGNETOMETER) {
+      magnetometer = true;
+      continue;
+    }
+    if (input.position < inner) inner = input.position;
+    if (input.position > outerBeam) outerBeam = input.position;
+  }
+  // direction needs a beam on each side
+  if (inner == 0xFF || inner == outerBeam) return false;
+  cfg = config;
+  outer = outerBeam;
+  hasMagnetometer = magnetometer;
+  for (uint8_t i = 0; i < FUSION_MAX_INPUTS; i++) {
+    holdUs[i] = i < cfg.inputs ? cfg.input[i].holdMs * 1000UL : 0;
+  }
+  reset();
+  return true;
+}
+
+void GateFusion::setListener(Listener l, void *context) {
+  listener = l;
+  listenerContext = context;
+}
+
+void GateFusion::reset() {
+  memset(state, 0, sizeof(state));
+  memset(&pass, 0, sizeof(pass));
+  open = false;
+  leftSeen = false;
+  lastUs = 0;
+  edges = 0;
+  memset(passes, 0, sizeof(passes));
+}
+
+void GateFusion::onEdge(uint32_t micros, uint8_t input, uint8_t level) {
+  if (input >= cfg.inputs) return;
+  // holds and the pass timeout that ran out before this edge go first
+  poll(micros);
+  lastUs = micros;
+  InputState &s = state[input];
+  bool active = level == cfg.input[input].activeLevel;
+  if (active == s.active) return;
+  s.active = active;
+  edges++;
+  if (open) {
+    pass.edges++;
+    pass.visited |= 1 << input;
+  }
+
+  if (!active) {
+    s.clearUs = micros;
+    s.stuck = false;
+    return;
+  }
+  if (s.stuck || s.occupied) return;
+  s.occupied = true;
+  occupy(input, micros);
+}
+
+void GateFusion::poll(uint32_t micros) {
+  // an edge newer than this poll has already been seen
+  if ((int32_t)(micros - lastUs) < 0) return;
+  bool beamOccupied = false;
+  for (uint8_t i = 0; i < cfg.inputs; i++) {
+    InputState &s = state[i];
+    if (s.occupied && !s.active && micros - s.clearUs >= holdUs[i]) release(i);
+    if (s.occupied && cfg.input[i].kind == FUSION_BEAM) beamOccupied = true;
+  }
+  if (!open) return;
+  if (!beamOccupied) {
+    finishPass(false);
+    return;
+  }
+  if (micros - pass.startUs > cfg.maxPassMs * 1000UL) {
+    pass.endUs = micros;
+    for (uint8_t i = 0; i < cfg.inputs; i++) {
+      // whatever is still blocked has to clear before it can start a pass again
+      if (state[i].active) state[i].stuck = true;
+      state[i].occupied = false;
+    }
+    finishPass(true);
+  }
+}
+
+void GateFusion::occupy(uint8_t input, uint32_t micros) {
+  const FusionInput &in = cfg.input[input];
+  if (in.kind == FUSION_MAGNETOMETER) {
+    if (open) {
+      pass.vehicle = true;
+      checkCrossing(micros);
+    }
+    return;
+  }
+  if (!open) {
+    open = true;
+    leftSeen = false;
+    memset(&pass, 0, sizeof(pass));
+    pass.startUs = micros;
+    pass.entered = in.position;
+    pass.reached = in.position;
+    pass.edges = 1;
+    pass.visited = 1 << input;
+    // the car may have been over the magnetometer before it broke a beam
+    for (uint8_t i = 0; i < cfg.inputs; i++) {
+      if (cfg.input[i].kind == FUSION_MAGNETOMETER && state[i].occupied) pass.vehicle = true;
+    }
+  }
+  // furthest from where the car came in
+  if (pass.entered < outer ? in.position > pass.reached : in.position < pass.reached) {
+    pass.reached = in.position;
+  }
+  checkCrossing(micros);
+}
+
+void GateFusion::checkCrossing(uint32_t micros) {
+  if (pass.crossed || pass.entered == outer || pass.reached != outer) return;
+  if (hasMagnetometer && !pass.vehicle) return;
+  pass.crossed = true;
+  if (!listener) return;
+  FusionPass crossing = pass;
+  crossing.type = FUSION_CROSSING;
+  crossing.endUs = micros;
+  crossing.passMs = (micros - pass.startUs) / 1000;
+  listener(crossing, listenerContext);
+}
+
+void GateFusion::release(uint8_t input) {
+  InputState &s = state[input];
+  s.occupied = false;
+  if (!open || cfg.input[input].kind != FUSION_BEAM) return;
+  // holds differ per input, so go by when the beam really cleared, not when it was released
+  if (!leftSeen || (int32_t)(s.clearUs - pass.endUs) >= 0) {
+    leftSeen = true;
+    pass.left = cfg.input[input].position;
+    pass.endUs = s.clearUs;
+  }
+}
+
+uint8_t GateFusion::classify() const {
+  if (pass.passMs < cfg.minPassMs) return FUSION_NOISE;
+  if (hasMagnetometer && !pass.vehicle) return FUSION_NOISE;
+  bool fromPark = pass.entered < outer;
+  if (fromPark && pass.left == outer) return FUSION_EXIT;
+  if (fromPark ? pass.reached == outer : pass.left < outer) return FUSION_BACKUP;
+  return FUSION_TURN_AROUND;
+}
+
+void GateFusion::finishPass(bool timedOut) {
+  open = false;
+  pass.passMs = (pass.endUs - pass.startUs) / 1000;
+  pass.type = timedOut ? (uint8_t)FUSION_TIMEOUT : classify();
+  passes[pass.type]++;
+  if (listener) listener(pass, listenerContext);
+}
@@ -0,0 +1,154 @@
+/*
+Sensor fusion for the exit lane: the magnetometer plus optical beams.
+
+The magnetometer alone can't tell which way a car is going, so a car that
+backs up or turns around in front of the gate gets counted (see README).
+Two or more beams across the lane, one on each side of the magnetometer,
+give the direction. Every input is one EdgeCapture input:
+
+  park side                                            road side
+     |  beam position 0  |  magnetometer  |  beam position 1  |
+       --- exit --->
+
+A beam is occupied from its first active edge until it has been inactive
+for holdMs, which rides over gaps like the one between a car and its
+trailer hitch or a flickering beam. A pass starts when the first beam is
+occupied and ends when every beam has been released. It is then classed by
+the beam that was occupied first (entered), the furthest beam it reached
+and the beam that cleared last (left):
+
+  EXIT         entered on the park side and left on the road side
+  BACKUP       reached the road side beam but left on the park side
+               (also a car coming in the exit the wrong way)
+  TURN_AROUND  never reached the road side beam, or came from the road
+               and went back out
+  NOISE        shorter than minPassMs, or no magnetometer during the pass
+               when there is one (a person or a deer in the beams)
+  TIMEOUT      still going after maxPassMs, the inputs that are still
+               active are ignored until they clear
+
+Only EXIT is a counted car. While a pass is still going the listener is
+also called once with CROSSING when a vehicle from the park side reaches
+the road side beam, so it can be counted before the pass is classed (see
+CountLedger.h). Like GateDetector there are no Arduino calls:
+feed it edges with onEdge(), let time pass with poll() and it reports each
+pass through the listener. The cost of an edge or a poll is a pass over
+the inputs, at most FUSION_MAX_INPUTS.
+*/
+#ifndef GATE_FUSION_H
+#define GATE_FUSION_H
+
+#include <stdint.h>
+
+#include "GateDetector.h"
+
+#define FUSION_MAX_INPUTS 4
+
+enum FusionInputKind : uint8_t {
+  FUSION_BEAM,         // optical beam, gives position and direction
+  FUSION_MAGNETOMETER  // confirms there is metal, i.e. a vehicle, in the pass
+};
+
+struct FusionInput {
+  uint8_t kind;         // FusionInputKind
+  uint8_t position;     // beams only, order along the lane, 0 = park side
+  uint8_t activeLevel;  // pin level while something is in front of it
+  uint16_t holdMs;      // stays occupied this long after it went inactive
+};
+
+struct FusionConfig {
+  uint8_t inputs;  // used entries of input[], index = EdgeCapture input
+  FusionInput input[FUSION_MAX_INPUTS];
+  uint32_t minPassMs;  // shorter passes are noise
+  uint32_t maxPassMs;  // give up on a pass that never ends
+};
+
+// The gate: magnetometer on input 0, beams on inputs 1 (park side) and 2 (road side).
+// Both beams pull LOW when broken, like the magnetometer.
+#define FUSION_GATE_CONFIG                                                                  \
+  {3,                                                                                       \
+   {{FUSION_MAGNETOMETER, 0, SENSOR_LOW, 500}, {FUSION_BEAM, 0, SENSOR_LOW, 150},         \
+    {FUSION_BEAM, 1, SENSOR_LOW, 150}},                                                     \
+   400, 60000}
+
+enum FusionPassType : uint8_t {
+  FUSION_EXIT,
+  FUSION_BACKUP,
+  FUSION_TURN_AROUND,
+  FUSION_NOISE,
+  FUSION_TIMEOUT,
+  FUSION_CROSSING  // pass in progress reached the road side, not a finished pass
+};
+#define FUSION_PASS_TYPES 5  // finished passes, CROSSING is not counted
+
+struct FusionPass {
+  uint8_t type;     // FusionPassType
+  uint8_t entered;  // position of the first beam occupied
+  uint8_t reached;  // furthest position occupied
+  uint8_t left;     // position of the last beam to clear
+  uint8_t visited;  // bit per input seen during the pass
+  bool vehicle;     // magnetometer was occupied during the pass
+  bool crossed;     // CROSSING was reported for this pass
+  uint16_t edges;   // edges on all inputs during the pass
+  uint32_t startUs;
+  uint32_t endUs;   // when the last beam cleared
+  uint32_t passMs;
+};
+
+const char *fusionPassName(uint8_t type);
+
+class GateFusion {
+ public:
+  typedef void (*Listener)(const FusionPass &pass, void *context);
+
+  GateFusion();
+
+  // False if the config has no road side beam to give a direction, or too many inputs
+  bool setConfig(const FusionConfig &config);
+  const FusionConfig &config() const { return cfg; }
+  void setListener(Listener listener, void *context);
+
+  // Forget the pass in progress and the counters, every input inactive
+  void reset();
+
+  // Input changed to level at time micros. Repeated levels are ignored.
+  void onEdge(uint32_t micros, uint8_t input, uint8_t level);
+  // Let time pass without an edge, releases beams and ends passes
+  void poll(uint32_t micros);
+
+  bool passActive() const { return open; }
+  uint32_t edgeCount() const { return edges; }
+  uint32_t passCount(uint8_t type) const { return type < FUSION_PASS_TYPES ? passes[type] : 0; }
+
+ private:
+  struct InputState {
+    bool active;    // level is the active level
+    bool occupied;  // active, or inactive for less than holdMs
+    bool stuck;     // still active when the pass timed out, ignored until it clears
+    uint32_t clearUs;  // when it last went inactive
+  };
+
+  void occupy(uint8_t input, uint32_t micros);
+  void checkCrossing(uint32_t micros);
+  void release(uint8_t input);
+  void finishPass(bool timedOut);
+  uint8_t classify() const;
+
+  FusionConfig cfg;
+  uint32_t holdUs[FUSION_MAX_INPUTS];
+  uint8_t outer;     // road side beam position
+  bool hasMagnetometer;
+  Listener listener;
+  void *listenerContext;
+
+  InputState state[FUSION_MAX_INPUTS];
+  bool open;
+  bool leftSeen;
+  FusionPass pass;
+  uint32_t lastUs;
+
+  uint32_t edges;
+  uint32_t passes[FUSION_PASS_TYPES];
+};
+
+#endif
@@ -0,0 +1,91 @@
+#include "JobScheduler.h"
+
+JobScheduler::JobScheduler() : used(0), lastNow(0), ran(0), late(0), maxLate(0) {}
+
+bool JobScheduler::every(uint32_t first, uint32_t period, Job job, void *context, const char *name) {
+  if (used == JOB_MAX || period == 0) return false;
+  Entry &entry = jobs[used];
+  entry.due = first;
+  entry.period = period;
+  entry.job = job;
+  entry.context = context;
+  entry.name = name;
+  entry.hasRun = false;
+  siftUp(used++);
+  return true;
+}
+
+bool JobScheduler::daily(uint32_t now, uint8_t hour, uint8_t minute, uint8_t second, Job job, void *context,
+                         const char *name) {
+  uint32_t first = now - now % JOB_DAY + hour * 3600UL + minute * 60UL + second;
+  if (first <= now) first += JOB_DAY;
+  return every(first, JOB_DAY, job, context, name);
+}
+
+// The first of due + n * period that is after now
+uint32_t JobScheduler::nextAfter(uint32_t due, uint32_t period, uint32_t now) {
+  if (due > now) return due;
+  return due + ((now - due) / period + 1) * period;
+}
+
+uint8_t JobScheduler::run(uint32_t now) {
+  if (now < lastNow) clockSetBack(now);
+  lastNow = now;
+  uint8_t count = 0;
+  // each job at most once a pass, one that isn't done waits for the next
+  for (uint8_t i = 0; i < used && jobs[0].due <= now; i++) {
+    Entry &entry = jobs[0];
+    uint32_t due = entry.due;
+    if (!entry.job(due, entry.context)) break;
+    entry.hasRun = true;
+    ran++;
+    count++;
+    if (now > due) late++;
+    if (now - due > maxLate) maxLate = now - due;
+    entry.due = nextAfter(due, entry.period, now);
+    siftDown(0);
+  }
+  return count;
+}
+
+// Back by whole periods, so a job stays on its time of day. One that ran did the run
+// nearest to when it really ran, a small correction doesn't run it twice (a reset at
+// 17:00 on a fast RTC, then NTP sets it back). One that never ran is due next after now.
+void JobScheduler::clockSetBack(uint32_t now) {
+  uint32_t lost = lastNow - now;
+  for (uint8_t i = 0; i < used; i++) {
+    Entry &entry = jobs[i];
+    if (entry.hasRun) {
+      entry.due -= (lost + entry.period / 2) / entry.period * entry.period;
+    } else {
+      entry.due -= lost / entry.period * entry.period;
+      while (entry.due > now && entry.due - now > entry.period) entry.due -= entry.period;
+    }
+  }
+  for (uint8_t i = used / 2; i-- > 0;) siftDown(i);
+}
+
+void JobScheduler::siftUp(uint8_t index) {
+  while (index) {
+    uint8_t parent = (index - 1) / 2;
+    if (jobs[parent].due <= jobs[index].due) break;
+    Entry swap = jobs[parent];
+    jobs[parent] = jobs[index];
+    jobs[index] = swap;
+    index = parent;
+  }
+}
+
+void JobScheduler::siftDown(uint8_t index) {
+  for (;;) {
+    uint8_t smallest = index;
+    uint8_t left = 2 * index + 1, right = left + 1;
+    if (left < used && jobs[left].due < jobs[smallest].due) smallest = left;
+    if (right < used && jobs[right].due < jobs[smallest].due) smallest = right;
+    if (smallest == index) return;
+    Entry swap = jobs[smallest];
+    jobs[smallest] = jobs[index];
+    jobs[index] = swap;
+    index = smallest;
+  }
+}
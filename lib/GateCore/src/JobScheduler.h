@@ -0,0 +1,75 @@
+/*
+Timed jobs for one task: the daily reset, the temperature read, the NTP
+resync, the link counters.
+
+Jobs are kept in a min-heap on when they are due, so a pass with nothing
+due looks at the earliest one and is done. A job runs on the first pass
+at or after its time, however late that is: a loop() held up across
+17:00:00 still resets the count, a few seconds late. It then moves on to
+its next time after now, so a job that missed several runs runs once, not
+once for each.
+
+Times are RTC unixtimes in seconds (local time, like the logs), from the
+cached clock. If the clock is set back (NTP, a wrong RTC at boot) each
+job keeps its time of day. One that has run moves back by the periods
+the clock lost, rounded to the nearest, so a small correction doesn't
+run it a second time. One that hasn't run yet moves back to its first
+time after now, so an RTC that was a day or more ahead at boot doesn't
+skip today's reset.
+
+No Arduino calls. All calls come from one task.
+*/
+#ifndef JOB_SCHEDULER_H
+#define JOB_SCHEDULER_H
+
+#include <stdint.h>
+
+#define JOB_MAX 8
+#define JOB_DAY 86400UL
+
+class JobScheduler {
+ public:
+  // due is when it should have run. False to be run again on the next pass.
+  typedef bool (*Job)(uint32_t due, void *context);
+
+  JobScheduler();
+
+  // Every period s from first, false when there is no room
+  bool every(uint32_t first, uint32_t period, Job job, void *context, const char *name);
+  // Every day at hour:minute:second, the first time the next one after now
+  bool daily(uint32_t now, uint8_t hour, uint8_t minute, uint8_t second, Job job, void *context, const char *name);
+
+  // Runs whatever is due, returns how many ran
+  uint8_t run(uint32_t now);
+
+  uint8_t count() const { return used; }
+  uint32_t nextDue() const { return used ? jobs[0].due : 0; }
+  const char *nextName() const { return used ? jobs[0].name : ""; }
+  uint32_t runs() const { return ran; }
+  uint32_t lateRuns() const { return late; }  // ran a second or more after due
+  uint32_t maxLateS() const { return maxLate; }
+
+ private:
+  struct Entry {
+    uint32_t due;
+    uint32_t period;
+    Job job;
+    void *context;
+    const char *name;
+    bool hasRun;
+  };
+
+  static uint32_t nextAfter(uint32_t due, uint32_t period, uint32_t now);
+  void siftUp(uint8_t index);
+  void siftDown(uint8_t index);
+  void clockSetBack(uint32_t now);
+
+  Entry jobs[JOB_MAX];  // heap, earliest first
+  uint8_t used;
+  uint32_t lastNow;
+  uint32_t ran;
+  uint32_t late;
+  uint32_t maxLate;
+};
+
+#endif
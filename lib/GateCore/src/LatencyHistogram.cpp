@@ -0,0 +1,37 @@
+#include "LatencyHistogram.h"
+
+#include <string.h>
+
+void LatencyHistogram::reset() {
+  memset(buckets, 0, sizeof(buckets));
+  total = 0;
+  minimum = 0;
+  maximum = 0;
+}
+
+uint32_t LatencyHistogram::bucketTop(uint8_t bucket) {
+  if (bucket < LATENCY_LINEAR) return bucket;
+  uint8_t exponent = (bucket - LATENCY_LINEAR) / 4 + 3;
+  uint32_t step = 1UL << (exponent - 2);
+  uint32_t bottom = (4 + (bucket - LATENCY_LINEAR) % 4) * step;
+  return bottom + (step - 1);
+}
+
+uint32_t LatencyHistogram::percentile(uint8_t percent) const {
+  if (total == 0) return 0;
+  // rank of the value we want, rounded up
+  uint32_t rank = ((uint64_t)total * percent + 99) / 100;
+  if (rank == 0) rank = 1;
+  uint32_t seen = 0;
+  for (uint8_t bucket = 0; bucket < LATENCY_BUCKETS; bucket++) {
+    seen += buckets[bucket];
+    if (seen >= rank) {
+      uint32_t top = bucketTop(bucket);
+      // the bucket can be wider than what was actually recorded
+      if (top > maximum) top = maximum;
+      if (top < minimum) top = minimum;
+      return top;
+    }
+  }
+  return maximum;
+}
@@ -0,0 +1,50 @@
+/*
+Fixed bucket latency histogram.
+
+Values (microseconds) go into log2 buckets split in 4, so a percentile is
+good to 25% from a few microseconds up to over an hour, in 500 bytes and
+with no floating point. Min and max are exact. record() is a handful of
+instructions and is meant to be called from one task; reading it from
+another task while it records just gives a slightly stale answer.
+*/
+#ifndef LATENCY_HISTOGRAM_H
+#define LATENCY_HISTOGRAM_H
+
+#include <stdint.h>
+
+#define LATENCY_LINEAR 8                                  // 0..7 us get a bucket each
+#define LATENCY_BUCKETS (LATENCY_LINEAR + (32 - 3) * 4)   // 124
+
+class LatencyHistogram {
+ public:
+  LatencyHistogram() { reset(); }
+
+  void record(uint32_t us) {
+    buckets[bucketOf(us)]++;
+    if (total == 0 || us < minimum) minimum = us;
+    if (us > maximum) maximum = us;
+    total++;
+  }
+  void reset();
+
+  uint32_t count() const { return total; }
+  uint32_t min() const { return total ? minimum : 0; }
+  uint32_t max() const { return maximum; }
+  // Smallest bucket bound that percent of the values are at or below
+  uint32_t percentile(uint8_t percent) const;
+
+  static uint8_t bucketOf(uint32_t us) {
+    if (us < LATENCY_LINEAR) return us;
+    uint8_t exponent = 31 - __builtin_clz(us);
+    return LATENCY_LINEAR + (exponent - 3) * 4 + ((us >> (exponent - 2)) & 3);
+  }
+  static uint32_t bucketTop(uint8_t bucket);
+
+ private:
+  uint32_t buckets[LATENCY_BUCKETS];
+  uint32_t total;
+  uint32_t minimum;
+  uint32_t maximum;
+};
+
+#endif
@@ -0,0 +1,184 @@
+#include "Outbox.h"
+
+#include <string.h>
+
+// Each message in a segment: marker, topic length, payload length, topic, payload
+#define OUTBOX_MARKER 0xA5
+struct OutboxRecordHeader {
+  uint8_t marker;
+  uint8_t topicLength;
+  uint16_t payloadLength;
+};
+
+struct OutboxCursor {
+  uint32_t segment;
+  uint32_t offset;
+};
+
+Outbox::Outbox()
+    : files(NULL), firstSegment(1), lastSegment(1), readOffset(0), writeOffset(0), pendingCount(0),
+      sinceCursor(0), tokens(OUTBOX_BURST), lastReplayMillis(0), delivered(0), dropped(0) {}
+
+void Outbox::begin(OutboxFiles *outboxFiles) {
+  files = outboxFiles;
+  firstSegment = lastSegment = 1;
+  readOffset = writeOffset = 0;
+  pendingCount = 0;
+  sinceCursor = 0;
+  uint32_t low, high;
+  if (!files->segments(low, high)) return;
+
+  // new messages go in a fresh segment, the last one may end in a torn record
+  firstSegment = low;
+  lastSegment = high + 1;
+  OutboxCursor cursor;
+  if (files->readCursor(&cursor, sizeof(cursor)) && cursor.segment >= low && cursor.segment <= high) {
+    // a reset between saving the cursor and removing the segment it left
+    while (firstSegment < cursor.segment) files->remove(firstSegment++);
+    readOffset = cursor.offset;
+  }
+  for (uint32_t s = firstSegment; s < lastSegment; s++) {
+    pendingCount += countMessages(s, s == firstSegment ? readOffset : 0);
+  }
+  // nothing left to send, only torn records
+  while (pendingCount == 0 && firstSegment < lastSegment) finishReadSegment();
+}
+
+void Outbox::saveCursor() {
+  OutboxCursor cursor = {firstSegment, readOffset};
+  files->writeCursor(&cursor, sizeof(cursor));
+  sinceCursor = 0;
+}
+
+uint32_t Outbox::countMessages(uint32_t segment, uint32_t fromOffset) {
+  uint32_t count = 0;
+  uint32_t size = files->size(segment);
+  uint32_t offset = fromOffset;
+  OutboxRecordHeader header;
+  while (offset + sizeof(header) <= size && files->read(segment, offset, &header, sizeof(header)) &&
+         header.marker == OUTBOX_MARKER) {
+    offset += sizeof(header) + header.topicLength + header.payloadLength;
+    if (offset > size) break;  // torn write at power loss
+    count++;
+  }
+  return count;
+}
+
+bool Outbox::enqueue(const char *topic, const char *payload) {
+  OutboxRecordHeader header;
+  size_t topicLength = strlen(topic);
+  size_t payloadLength = strlen(payload);
+  if (!files || topicLength > OUTBOX_MAX_TOPIC || payloadLength > OUTBOX_MAX_PAYLOAD) {
+    dropped++;
+    return false;
+  }
+  if (writeOffset >= OUTBOX_SEGMENT_BYTES) {
+    // start the next segment
+    lastSegment++;
+    writeOffset = 0;
+    if (lastSegment - firstSegment >= OUTBOX_MAX_SEGMENTS) dropOldestSegment();
+  }
+  header.marker = OUTBOX_MARKER;
+  header.topicLength = topicLength;
+  header.payloadLength = payloadLength;
+  size_t length = sizeof(header) + topicLength + payloadLength;
+  uint8_t record[sizeof(header) + OUTBOX_MAX_TOPIC + OUTBOX_MAX_PAYLOAD];
+  memcpy(record, &header, sizeof(header));
+  memcpy(record + sizeof(header), topic, topicLength);
+  memcpy(record + sizeof(header) + topicLength, payload, payloadLength);
+  if (!files->append(lastSegment, record, length)) {
+    // part of it landed, that ends the segment in a torn record, go on in the next one
+    if (files->size(lastSegment) > writeOffset) {
+      lastSegment++;
+      writeOffset = 0;
+    }
+    dropped++;
+    return false;
+  }
+  writeOffset += length;
+  pendingCount++;
+  return true;
+}
+
+// Outbox is over its size limit, give up on the oldest messages
+void Outbox::dropOldestSegment() {
+  uint32_t lost = countMessages(firstSegment, readOffset);
+  uint32_t segment = firstSegment++;
+  readOffset = 0;
+  saveCursor();
+  files->remove(segment);
+  pendingCount -= lost < pendingCount ? lost : pendingCount;
+  dropped += lost;
+}
+
+// Read the message at the read position, false at the end of the segment
+bool Outbox::readMessage(char *topic, char *payload, uint32_t &next) {
+  OutboxRecordHeader header;
+  uint32_t offset = readOffset;
+  if (!files->read(firstSegment, offset, &header, sizeof(header))) return false;
+  if (header.marker != OUTBOX_MARKER || header.topicLength > OUTBOX_MAX_TOPIC ||
+      header.payloadLength > OUTBOX_MAX_PAYLOAD) {
+    return false;
+  }
+  offset += sizeof(header);
+  if (!files->read(firstSegment, offset, topic, header.topicLength)) return false;
+  offset += header.topicLength;
+  if (!files->read(firstSegment, offset, payload, header.payloadLength)) return false;
+  topic[header.topicLength] = 0;
+  payload[header.payloadLength] = 0;
+  next = offset + header.payloadLength;
+  return true;
+}
+
+// Everything in the oldest segment went out, remove it
+void Outbox::finishReadSegment() {
+  uint32_t segment = firstSegment;
+  if (firstSegment == lastSegment) {
+    // caught up, start over with an empty segment
+    firstSegment = ++lastSegment;
+    writeOffset = 0;
+    pendingCount = 0;
+  } else {
+    firstSegment++;
+  }
+  readOffset = 0;
+  saveCursor();
+  files->remove(segment);
+}
+
+uint16_t Outbox::replay(Publisher publish, void *context, uint32_t nowMillis) {
+  // token bucket, OUTBOX_RATE_PER_SEC with bursts of OUTBOX_BURST
+  tokens += (nowMillis - lastReplayMillis) * OUTBOX_RATE_PER_SEC / 1000.0f;
+  if (tokens > OUTBOX_BURST) tokens = OUTBOX_BURST;
+  lastReplayMillis = nowMillis;
+  if (pendingCount == 0 || !files) return 0;
+
+  static char topic[OUTBOX_MAX_TOPIC + 1];
+  static char payload[OUTBOX_MAX_PAYLOAD + 1];
+  uint16_t sent = 0;
+  while (tokens >= 1 && pendingCount > 0) {
+    uint32_t next;
+    if (!readMessage(topic, payload, next)) {
+      if (firstSegment == lastSegment) {
+        // past the last message, or it isn't readable yet, try again next time
+        if (readOffset >= writeOffset) finishReadSegment();
+        return sent;
+      }
+      // end of an older segment, or a record torn by a power cut
+      finishReadSegment();
+      continue;
+    }
+    if (!publish(topic, payload, context)) return sent;  // the same message next time
+    readOffset = next;
+    pendingCount--;
+    delivered++;
+    sent++;
+    tokens -= 1;
+    if (++sinceCursor >= OUTBOX_CURSOR_EVERY) saveCursor();
+  }
+  if (pendingCount == 0) {
+    while (firstSegment < lastSegment) finishReadSegment();
+    finishReadSegment();
+  }
+  return sent;
+}
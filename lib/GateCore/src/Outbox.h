@@ -0,0 +1,90 @@
+/*
+Store and forward queue for MQTT messages, over numbered segment files.
+
+Messages that can't be published (WiFi or broker down) are appended to
+numbered segments, and published again in the same order once the broker
+is back, no faster than OUTBOX_RATE_PER_SEC so a long outage does not flood
+the broker. A message counts as delivered when publish() hands it to the
+connection (QoS 0). Segments are removed once every message in them is
+delivered, and the read position (the cursor) is saved every
+OUTBOX_CURSOR_EVERY messages, so a reboot repeats at most that many.
+The cursor goes to the files before a finished segment is removed, and
+begin() removes any segment the cursor is already past.
+The publish function is passed in, so any broker (or a stand-in) can be used.
+
+The files are behind OutboxFiles, the gate keeps them on the SD card
+(include/MqttOutbox.h), src/host/outboxtest keeps them in memory.
+
+No Arduino calls, the owner passes millis() in. All calls come from one task.
+*/
+#ifndef OUTBOX_H
+#define OUTBOX_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#define OUTBOX_SEGMENT_BYTES 16384
+#define OUTBOX_MAX_SEGMENTS 256      // 4 MB, oldest segment is dropped past this
+#define OUTBOX_RATE_PER_SEC 10
+#define OUTBOX_BURST 5
+#define OUTBOX_CURSOR_EVERY 16       // save the read position every n messages
+#define OUTBOX_MAX_TOPIC 64
+#define OUTBOX_MAX_PAYLOAD 512      // room for a full MSG_BUFFER_SIZE batch of cars
+
+// Segments are numbered from 1, a segment that isn't there reads as empty
+class OutboxFiles {
+ public:
+  virtual ~OutboxFiles() {}
+  // Lowest and highest segment there, false if there are none
+  virtual bool segments(uint32_t &first, uint32_t &last) = 0;
+  virtual uint32_t size(uint32_t segment) = 0;
+  // False if it can't all be read
+  virtual bool read(uint32_t segment, uint32_t offset, void *data, size_t length) = 0;
+  // Add to the end, creating the segment, and keep it there before returning
+  virtual bool append(uint32_t segment, const void *data, size_t length) = 0;
+  virtual bool remove(uint32_t segment) = 0;
+  // The cursor is a few bytes written over in place, all of it or none of it lands
+  virtual bool readCursor(void *data, size_t length) = 0;
+  virtual bool writeCursor(const void *data, size_t length) = 0;
+};
+
+class Outbox {
+ public:
+  typedef bool (*Publisher)(const char *topic, const char *payload, void *context);
+
+  Outbox();
+
+  // Pick up whatever was left in the files before a reboot
+  void begin(OutboxFiles *files);
+  bool empty() const { return pendingCount == 0; }
+  uint32_t pending() const { return pendingCount; }
+
+  bool enqueue(const char *topic, const char *payload);
+  // Publish queued messages in order within the rate limit, returns how many went out.
+  // Stops at the first message publish() refuses.
+  uint16_t replay(Publisher publish, void *context, uint32_t nowMillis);
+
+  uint32_t deliveredCount() const { return delivered; }
+  uint32_t droppedCount() const { return dropped; }
+
+ private:
+  bool readMessage(char *topic, char *payload, uint32_t &next);
+  void finishReadSegment();
+  void saveCursor();
+  uint32_t countMessages(uint32_t segment, uint32_t fromOffset);
+  void dropOldestSegment();
+
+  OutboxFiles *files;
+  uint32_t firstSegment;  // oldest segment, where reading happens
+  uint32_t lastSegment;   // segment being appended to
+  uint32_t readOffset;
+  uint32_t writeOffset;
+  uint32_t pendingCount;
+  uint16_t sinceCursor;
+  float tokens;
+  uint32_t lastReplayMillis;
+  uint32_t delivered;
+  uint32_t dropped;
+};
+
+#endif
@@ -0,0 +1,30 @@
+#include "PassClassifier.h"
+
+#include <string.h>
+
+#include "PassTree.h"
+
+static const char *classNames[PASS_CLASSES] = {"car", "trailer", "bus", "noise"};
+
+const char *passClassName(uint8_t label) {
+  return label < PASS_CLASSES ? classNames[label] : "?";
+}
+
+uint8_t passClassFromName(const char *name) {
+  for (uint8_t label = 0; label < PASS_CLASSES; label++) {
+    if (strcmp(name, classNames[label]) == 0) return label;
+  }
+  return PASS_CLASSES;
+}
+
+uint8_t classifyPass(const PassFeatures &features) {
+  return classifyPass(passTree, features);
+}
+
+uint8_t classifyPass(const PassTreeNode *tree, const PassFeatures &features) {
+  const PassTreeNode *node = tree;
+  while (node->feature >= 0) {
+    node = tree + (features.value[node->feature] <= node->threshold ? node->below : node->above);
+  }
+  return node->label;
+}
@@ -0,0 +1,43 @@
+/*
+What went over the magnetometer: car, car with a trailer, bus or noise.
+
+A small decision tree over the PassFeatures of a pass. Each node compares
+one feature with a whole number threshold, so a pass is classed in at most
+PASS_TREE_DEPTH compares, well under a microsecond on the ESP32. The tree
+the firmware uses is in PassTree.h, written by the classify host tool
+(src/host/classify) from labelled passes, don't edit it by hand.
+
+No Arduino calls, same as GateDetector.
+*/
+#ifndef PASS_CLASSIFIER_H
+#define PASS_CLASSIFIER_H
+
+#include <stdint.h>
+
+#include "PassFeatures.h"
+
+enum PassClass : uint8_t {
+  PASS_CAR,
+  PASS_TRAILER,  // car or truck towing something
+  PASS_BUS,      // bus, RV, anything long
+  PASS_NOISE     // not a vehicle
+};
+#define PASS_CLASSES 4
+
+// feature < 0 is a leaf with label, otherwise value <= threshold goes to below, the rest to above
+struct PassTreeNode {
+  int8_t feature;   // PassFeature
+  uint8_t below;    // node index
+  uint8_t above;
+  uint8_t label;    // PassClass, leaves only
+  int32_t threshold;
+};
+
+const char *passClassName(uint8_t label);
+uint8_t passClassFromName(const char *name);  // PASS_CLASSES if unknown
+
+// With the tree in PassTree.h
+uint8_t classifyPass(const PassFeatures &features);
+uint8_t classifyPass(const PassTreeNode *tree, const PassFeatures &features);
+
+#endif
@@ -0,0 +1,67 @@
+#include "PassFeatures.h"
+
+#include <string.h>
+
+#include "GateDetector.h"
+
+static const char *featureNames[PASS_FEATURES] = {"pulses",      "duration",   "duty",
+                                                  "longest_low", "longest_gap", "gaps_short",
+                                                  "gaps_medium", "gaps_long"};
+
+const char *passFeatureName(uint8_t feature) {
+  return feature < PASS_FEATURES ? featureNames[feature] : "?";
+}
+
+PassFeatureExtractor::PassFeatureExtractor() : open(false) {}
+
+void PassFeatureExtractor::begin(uint32_t carStartUs) {
+  open = true;
+  low = false;
+  startUs = carStartUs;
+  changeUs = carStartUs;
+  lastHighUs = carStartUs;
+  lowUs = 0;
+  longestLowUs = 0;
+  longestGapUs = 0;
+  pulses = 0;
+  memset(gaps, 0, sizeof(gaps));
+}
+
+void PassFeatureExtractor::onEdge(uint32_t micros, uint8_t level) {
+  bool nowLow = level == SENSOR_LOW;
+  if (!open || nowLow == low) return;
+  uint32_t length = micros - changeUs;
+  if (nowLow) {
+    // a HIGH stretch between two LOWs of the same car
+    if (pulses) {
+      if (length > longestGapUs) longestGapUs = length;
+      uint32_t ms = length / 1000;
+      gaps[ms < PASS_GAP_SHORT_MS ? 0 : ms < PASS_GAP_MEDIUM_MS ? 1 : 2]++;
+    }
+    pulses++;
+  } else {
+    lowUs += length;
+    if (length > longestLowUs) longestLowUs = length;
+    lastHighUs = micros;
+  }
+  low = nowLow;
+  changeUs = micros;
+}
+
+bool PassFeatureExtractor::finish(uint32_t micros, PassFeatures &features) {
+  if (!open) return false;
+  open = false;
+  // dropped while still LOW, the car ends now
+  if (low) onEdge(micros, SENSOR_HIGH);
+  uint32_t durationUs = lastHighUs - startUs;
+  int32_t *f = features.value;
+  f[FEATURE_PULSES] = pulses;
+  f[FEATURE_DURATION_MS] = durationUs / 1000;
+  f[FEATURE_DUTY_Q8] = durationUs ? (int32_t)(((uint64_t)lowUs << 8) / durationUs) : 0;
+  f[FEATURE_LONGEST_LOW_MS] = longestLowUs / 1000;
+  f[FEATURE_LONGEST_GAP_MS] = longestGapUs / 1000;
+  f[FEATURE_GAPS_SHORT] = gaps[0];
+  f[FEATURE_GAPS_MEDIUM] = gaps[1];
+  f[FEATURE_GAPS_LONG] = gaps[2];
+  return true;
+}
@@ -0,0 +1,70 @@
+/*
+What a pass looked like on the magnetometer, boiled down to a few numbers.
+
+The features are worked out as the edges arrive, so there is nothing to
+keep per edge and nothing to add up when the car is counted:
+
+  begin(carStartUs)     detector saw the car start
+  onEdge(micros, level) every magnetometer edge of the car, the starting
+                        LOW edge included
+  finish(micros)        car counted or dropped
+
+Everything is a whole number (ms, counts, duty in 1/256), so the classifier
+only compares integers. Gaps are the HIGH stretches inside a car (bounces),
+sorted into a histogram by length. The HIGH after the last bounce is not a
+gap, the car is gone by then, so the duration ends at the last HIGH edge.
+
+No Arduino calls, same as GateDetector. All calls come from one task.
+*/
+#ifndef PASS_FEATURES_H
+#define PASS_FEATURES_H
+
+#include <stdint.h>
+
+enum PassFeature : uint8_t {
+  FEATURE_PULSES,       // LOW edges
+  FEATURE_DURATION_MS,  // car start to the last HIGH edge
+  FEATURE_DUTY_Q8,      // time LOW over duration, 256 = LOW the whole time
+  FEATURE_LONGEST_LOW_MS,
+  FEATURE_LONGEST_GAP_MS,
+  FEATURE_GAPS_SHORT,   // gaps under PASS_GAP_SHORT_MS
+  FEATURE_GAPS_MEDIUM,  // gaps under PASS_GAP_MEDIUM_MS
+  FEATURE_GAPS_LONG,    // longer gaps, e.g. between a car and its trailer
+  PASS_FEATURES
+};
+
+#define PASS_GAP_SHORT_MS 60
+#define PASS_GAP_MEDIUM_MS 250
+
+struct PassFeatures {
+  int32_t value[PASS_FEATURES];
+};
+
+const char *passFeatureName(uint8_t feature);
+
+class PassFeatureExtractor {
+ public:
+  PassFeatureExtractor();
+
+  void begin(uint32_t carStartUs);
+  // Repeated levels and edges outside a car are ignored
+  void onEdge(uint32_t micros, uint8_t level);
+  // Close the car at micros, false if there was none
+  bool finish(uint32_t micros, PassFeatures &features);
+
+  bool active() const { return open; }
+
+ private:
+  bool open;
+  bool low;          // sensor is LOW
+  uint32_t startUs;
+  uint32_t changeUs; // last edge
+  uint32_t lastHighUs;
+  uint32_t lowUs;    // total LOW time
+  uint32_t longestLowUs;
+  uint32_t longestGapUs;
+  uint16_t pulses;
+  uint16_t gaps[3];  // short, medium, long
+};
+
+#endif
@@ -0,0 +1,24 @@
+// Written by the classify host tool, don't edit (see PassClassifier.h)
+// Trained on 4943 passes from 5000 synthetic vehicles, seed 1
+#ifndef PASS_TREE_H
+#define PASS_TREE_H
+
+#include "PassClassifier.h"
+
+#define PASS_TREE_DEPTH 5
+
+static const PassTreeNode passTree[] = {
+  {FEATURE_LONGEST_LOW_MS, 1, 2, PASS_CAR, 40},  // 0
+  {-1, 0, 0, PASS_NOISE, 0},  // 1
+  {FEATURE_LONGEST_GAP_MS, 3, 10, PASS_CAR, 400},  // 2
+  {FEATURE_LONGEST_LOW_MS, 4, 9, PASS_CAR, 707},  // 3
+  {FEATURE_LONGEST_GAP_MS, 5, 6, PASS_CAR, 279},  // 4
+  {-1, 0, 0, PASS_CAR, 0},  // 5
+  {FEATURE_GAPS_LONG, 7, 8, PASS_CAR, 1},  // 6
+  {-1, 0, 0, PASS_TRAILER, 0},  // 7
+  {-1, 0, 0, PASS_CAR, 0},  // 8
+  {-1, 0, 0, PASS_BUS, 0},  // 9
+  {-1, 0, 0, PASS_TRAILER, 0},  // 10
+};
+
+#endif
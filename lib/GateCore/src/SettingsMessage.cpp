@@ -0,0 +1,98 @@
+#include "SettingsMessage.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// Find "key": <number> in a flat JSON object. Returns false if the key is not there,
+// sets bad if it is there but not a whole number.
+static bool jsonNumber(const char *json, const char *key, long &value, bool &bad) {
+  char quoted[24];
+  snprintf(quoted, sizeof(quoted), "\"%s\"", key);
+  const char *at = strstr(json, quoted);
+  if (!at) return false;
+  at += strlen(quoted);
+  while (*at == ' ' || *at == '\t') at++;
+  if (*at != ':') {
+    bad = true;
+    return true;
+  }
+  at++;
+  while (*at == ' ' || *at == '\t') at++;
+  char *end;
+  value = strtol(at, &end, 10);
+  // "true" for the defaults flag
+  if (end == at && strncmp(at, "true", 4) == 0) {
+    value = 1;
+    return true;
+  }
+  if (end == at || *end == '.') bad = true;
+  return true;
+}
+
+const char *settingsCheck(const GateSettings &settings) {
+  const DetectorConfig &c = settings.detector;
+  if (c.nocarTimeoutMs < NOCAR_MIN_MS || c.nocarTimeoutMs > NOCAR_MAX_MS) return "nocar out of range";
+  if (c.bounceGapMs < GAP_MIN_MS || c.bounceGapMs > GAP_MAX_MS) return "gap out of range";
+  if (c.stuckTimeoutMs < STUCK_MIN_MS || c.stuckTimeoutMs > STUCK_MAX_MS) return "stuck out of range";
+  if (c.stuckTimeoutMs <= c.nocarTimeoutMs) return "stuck must be longer than nocar";
+  if (c.minBounces < 1 || c.minBounces > BOUNCES_MAX) return "bounces out of range";
+  if (settings.verbosity > LOG_VERBOSE_BOUNCES) return "verbosity out of range";
+  return NULL;
+}
+
+const char *settingsParse(const char *json, GateSettings &settings, bool &defaults) {
+  GateSettings updated = settings;
+  long value;
+  bool bad = false;
+  bool any = false;
+  defaults = false;
+  if (!strchr(json, '{')) return "not a JSON object";
+
+  if (jsonNumber(json, "defaults", value, bad)) {
+    defaults = value != 0;
+    any = true;
+  }
+  if (jsonNumber(json, "nocar", value, bad)) {
+    updated.detector.nocarTimeoutMs = value < 0 ? 0 : value;
+    any = true;
+  }
+  if (jsonNumber(json, "gap", value, bad)) {
+    updated.detector.bounceGapMs = value < 0 ? 0 : value;
+    any = true;
+  }
+  if (jsonNumber(json, "stuck", value, bad)) {
+    updated.detector.stuckTimeoutMs = value < 0 ? 0 : value;
+    any = true;
+  }
+  if (jsonNumber(json, "bounces", value, bad)) {
+    updated.detector.minBounces = value < 0 || value > 0xFFFF ? 0 : value;
+    any = true;
+  }
+  if (jsonNumber(json, "verbosity", value, bad)) {
+    updated.verbosity = value < 0 || value > 0xFF ? 0xFF : value;
+    any = true;
+  }
+  if (bad) return "values must be whole numbers";
+  if (!any) return "no known settings";
+  if (defaults) return NULL;  // the caller puts the profile back
+
+  const char *error = settingsCheck(updated);
+  if (error) return error;
+  settings = updated;
+  return NULL;
+}
+
+size_t settingsJson(const GateSettings &settings, const char *profile, const char *error,
+                    char *out, size_t size) {
+  int length = snprintf(out, size,
+      "{\"profile\":\"%s\",\"nocar\":%u,\"gap\":%u,\"stuck\":%u,\"bounces\":%u,\"verbosity\":%u",
+      profile, (unsigned)settings.detector.nocarTimeoutMs, (unsigned)settings.detector.bounceGapMs,
+      (unsigned)settings.detector.stuckTimeoutMs, (unsigned)settings.detector.minBounces,
+      (unsigned)settings.verbosity);
+  if (length > 0 && (size_t)length < size && error) {
+    length += snprintf(out + length, size - length, ",\"error\":\"%s\"", error);
+  }
+  if (length > 0 && (size_t)length < size) length += snprintf(out + length, size - length, "}");
+  return length > 0 && (size_t)length < size ? length : 0;
+}
@@ -0,0 +1,48 @@
+/*
+The settings that can be changed over MQTT and the messages that change
+them, see include/GateSettings.h for where they are kept.
+
+  {"nocar":900,"gap":2000,"stuck":10000,"bounces":2,"verbosity":1}
+  {"defaults":1}
+
+Parsing and checking only, so the limits can be tested on the PC. No
+Arduino calls.
+*/
+#ifndef SETTINGS_MESSAGE_H
+#define SETTINGS_MESSAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+#include "GateDetector.h"
+
+// Serial dump levels
+#define LOG_VERBOSE_OFF 0
+#define LOG_VERBOSE_CARS 1
+#define LOG_VERBOSE_BOUNCES 2
+
+// Limits a config message has to stay within
+#define NOCAR_MIN_MS 100
+#define NOCAR_MAX_MS 10000
+#define GAP_MIN_MS 200
+#define GAP_MAX_MS 30000
+#define STUCK_MIN_MS 1000
+#define STUCK_MAX_MS 120000
+#define BOUNCES_MAX 50
+
+struct GateSettings {
+  DetectorConfig detector;
+  uint8_t verbosity;
+};
+
+// Apply a config message to settings. Returns NULL if it was good, otherwise
+// what was wrong with it and settings are left alone. defaults is set when
+// the message asked for {"defaults":1}.
+const char *settingsParse(const char *json, GateSettings &settings, bool &defaults);
+const char *settingsCheck(const GateSettings &settings);
+
+// {"profile":"normal","nocar":900,...} plus "error" when one is given
+size_t settingsJson(const GateSettings &settings, const char *profile, const char *error,
+                    char *out, size_t size);
+
+#endif
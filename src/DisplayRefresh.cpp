@@ -0,0 +1,65 @@
+#include "DisplayRefresh.h"
+
+DisplayRefresh::DisplayRefresh(Adafruit_SSD1306 &oled, TwoWire &bus, uint8_t i2cAddress)
+    : display(oled), wire(bus), address(i2cAddress), stale(true), pushes(0), pages(0), bytes(0) {
+  memset(shown, 0, sizeof(shown));
+}
+
+void DisplayRefresh::command(const uint8_t *commands, uint8_t count) {
+  wire.beginTransmission(address);
+  wire.write((uint8_t)0x00);  // Co = 0, D/C = 0: command stream
+  wire.write(commands, count);
+  wire.endTransmission();
+}
+
+void DisplayRefresh::data(const uint8_t *buffer, uint16_t count) {
+  while (count > 0) {
+    uint16_t chunk = count < DISPLAY_I2C_CHUNK - 1 ? count : DISPLAY_I2C_CHUNK - 1;
+    wire.beginTransmission(address);
+    wire.write((uint8_t)0x40);  // D/C = 1: display data
+    wire.write(buffer, chunk);
+    wire.endTransmission();
+    buffer += chunk;
+    count -= chunk;
+  }
+}
+
+void DisplayRefresh::push() {
+  uint8_t *buffer = display.getBuffer();
+  if (!buffer) return;
+  pushes++;
+
+  if (stale) {
+    // someone else drew on the panel, send the lot
+    stale = false;
+    display.display();
+    memcpy(shown, buffer, sizeof(shown));
+    pages += DISPLAY_PAGES;
+    bytes += sizeof(shown);
+    return;
+  }
+
+  bool clockRaised = false;
+  for (uint8_t page = 0; page < DISPLAY_PAGES; page++) {
+    const uint8_t *now = buffer + page * DISPLAY_WIDTH;
+    uint8_t *before = shown + page * DISPLAY_WIDTH;
+    uint8_t first = 0;
+    while (first < DISPLAY_WIDTH && now[first] == before[first]) first++;
+    if (first == DISPLAY_WIDTH) continue;
+    uint8_t last = DISPLAY_WIDTH - 1;
+    while (now[last] == before[last]) last--;
+
+    if (!clockRaised) {
+      wire.setClock(DISPLAY_I2C_CLOCK);
+      clockRaised = true;
+    }
+    // horizontal addressing mode (set by Adafruit begin()), window is one page high
+    const uint8_t window[] = {SSD1306_PAGEADDR, page, page, SSD1306_COLUMNADDR, first, last};
+    command(window, sizeof(window));
+    data(now + first, last - first + 1);
+    memcpy(before + first, now + first, last - first + 1);
+    pages++;
+    bytes += last - first + 1;
+  }
+  if (clockRaised) wire.setClock(DISPLAY_I2C_CLOCK_AFTER);
+}
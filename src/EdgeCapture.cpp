@@ -0,0 +1,53 @@
+#include "EdgeCapture.h"
+
+struct EdgeInput {
+  uint8_t pin;
+  uint8_t input;
+};
+
+static EdgeRing<EDGE_RING_SIZE> edgeRing;
+static EdgeInput edgeInputs[EDGE_MAX_INPUTS];
+static TaskHandle_t notifyTask = NULL;
+
+void IRAM_ATTR onSensorEdge(void *arg) {
+  const EdgeInput *in = (const EdgeInput *)arg;
+  edgeRing.push(micros(), digitalRead(in->pin), in->input);
+  if (notifyTask) {
+    BaseType_t woken = pdFALSE;
+    vTaskNotifyGiveFromISR(notifyTask, &woken);
+    if (woken) portYIELD_FROM_ISR();
+  }
+}
+
+void edgeCaptureBegin(uint8_t pin, uint8_t input) {
+  if (input >= EDGE_MAX_INPUTS) return;
+  edgeInputs[input].pin = pin;
+  edgeInputs[input].input = input;
+  pinMode(pin, INPUT_PULLUP);
+  attachInterruptArg(digitalPinToInterrupt(pin), onSensorEdge, &edgeInputs[input], CHANGE);
+}
+
+void edgeCaptureNotify(TaskHandle_t task) {
+  notifyTask = task;
+}
+
+bool edgeCapturePop(SensorEdge &edge) {
+  return edgeRing.pop(edge);
+}
+
+uint16_t edgeCaptureAvailable() {
+  return edgeRing.available();
+}
+
+uint32_t edgeCaptureDropped() {
+  return edgeRing.droppedCount();
+}
+
+uint16_t edgeCaptureHighWater() {
+  return edgeRing.highWaterMark();
+}
+
+unsigned long microsToMillis(uint32_t edgeMicros) {
+  // age of the edge in micros is always small, so unsigned math survives both wraps
+  return millis() - (micros() - edgeMicros) / 1000;
+}
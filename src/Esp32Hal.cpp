@@ -0,0 +1,158 @@
+#include "Esp32Hal.h"
+#include "EdgeCapture.h"
+#include "Profiler.h"
+
+// main screen rows
+static const int line1 = 0;
+static const int line2 = 9;
+static const int line3 = 20;
+static const int line5 = 42;
+
+static const char days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+bool EspSensors::pop(SensorEdge &edge) {
+  return edgeCapturePop(edge);
+}
+
+uint8_t EspSensors::read(uint8_t input) {
+  if (input >= count) return HIGH;
+  return digitalRead(pins[input]);
+}
+
+EspDisplay::EspDisplay(Adafruit_SSD1306 &oled, DisplayRefresh &displayRefresh)
+    : display(oled), refresh(displayRefresh) {
+  memset(&shown, 0, sizeof(shown));
+}
+
+void EspDisplay::show(const DisplayValues &values) {
+  if (!refresh.isStale() && memcmp(&values, &shown, sizeof(values)) == 0) return;
+  memcpy(&shown, &values, sizeof(values));
+  uint32_t start = profileStart();
+  drawMainScreen(values);
+  refresh.push();
+  profileEnd(STAGE_DISPLAY, start);
+}
+
+void EspDisplay::drawMainScreen(const DisplayValues &values) {
+      display.clearDisplay();
+      display.setTextSize(1);
+      display.setCursor(0, line1);
+      //  display Day of Week
+      display.print(days[values.dayOfWeek]);
+
+      //  Display Date
+      display.print(" ");
+      display.print(months[values.month - 1]);
+      display.print(" ");
+      display.print(values.day, DEC);
+      display.print(", ");
+      display.println(values.year, DEC);
+
+      // Convert 24 hour clock to 12 hours
+      const char *ampm = values.hour >= 12 ? "PM" : "AM";
+      int currentHour = values.hour % 12;
+      if (currentHour == 0) currentHour = 12;
+
+      //Display Time
+      //add leading 0 to Hours & display Hours
+      display.setTextSize(1);
+
+      if (currentHour < 10){
+        display.setCursor(0, line2);
+        display.print("0");
+        display.println(currentHour, DEC);
+      }else{
+        display.setCursor(0, line2);
+        display.println(currentHour, DEC);
+      }
+
+      display.setCursor(14, line2);
+      display.println(":");
+
+      //Add leading 0 To Mintes & display Minutes
+      if (values.minute < 10) {
+        display.setCursor(20, line2);
+        display.print("0");
+        display.println(values.minute, DEC);
+      }else{
+        display.setCursor(21, line2);
+        display.println(values.minute, DEC);
+      }
+
+      display.setCursor(34, line2);
+      display.println(":");
+
+      //Add leading 0 To Seconds & display Seconds
+      if (values.second < 10){
+        display.setCursor(41, line2);
+        display.print("0");
+        display.println(values.second, DEC);
+      }else{
+        display.setCursor(41, line2);
+        display.println(values.second, DEC);
+      }
+
+      // Display AM-PM
+      display.setCursor(56, line2);
+      display.println(ampm);
+
+      // Display Temp
+      display.setCursor(73, line2);
+      display.print("Temp: " );
+      display.println(values.temp);
+
+      // Display Gate Count
+      display.setTextSize(1);
+      display.setCursor(0, line3);
+      display.print("Exiting: ");
+      display.setTextSize(2);
+
+      display.setCursor(50, line3);
+      display.println(values.exiting);
+      display.setTextSize(1);
+      display.setCursor(0, line5);
+      display.print("In Park: ");
+      display.setTextSize(2);
+      display.setCursor(50, line5);
+      display.println(values.inPark);
+}
+
+bool EspMqtt::publishToBroker(const char *topic, const char *payload, void *context) {
+  PubSubClient *client = (PubSubClient *)context;
+  return client->connected() && client->publish(topic, payload);
+}
+
+bool EspMqtt::publish(const char *topic, const char *payload, bool retained) {
+  if (retained) return client.connected() && client.publish(topic, payload, true);
+  if (outbox.empty() && publishToBroker(topic, payload, &client)) return true;
+  return outbox.enqueue(topic, payload);
+}
+
+uint16_t EspMqtt::replay(unsigned long nowMillis) {
+  return outbox.replay(publishToBroker, &client, nowMillis);
+}
+
+bool EspFileStore::begin(fs::FS &fs) {
+  if (!fs.exists(path)) {
+    File created = fs.open(path, FILE_WRITE);
+    if (!created) return false;
+    created.close();
+  }
+  file = fs.open(path, "r+");
+  return file;
+}
+
+bool EspFileStore::read(uint32_t offset, void *data, size_t length) {
+  return file && file.seek(offset) && file.read((uint8_t *)data, length) == length;
+}
+
+bool EspFileStore::write(uint32_t offset, const void *data, size_t length) {
+  return file && file.seek(offset) && file.write((const uint8_t *)data, length) == length;
+}
+
+bool EspFileStore::flush() {
+  if (!file) return false;
+  file.flush();
+  return true;
+}
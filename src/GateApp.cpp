@@ -0,0 +1,638 @@
+#include "GateApp.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "CivilTime.h"
+#include "EventFormat.h"
+#include "PassClassifier.h"
+#include "Profiler.h"
+
+GateApp::GateApp(const GateHal &gateHal)
+    : hal(gateHal), edgeObserver(NULL), eventObserver(NULL),
+#if FUSION_ENABLED
+      fusionSeq(0),
+#endif
+      detectorConfigPending(false), totalDailyCars(0), carCounterCars(0), sensorBounceFlag(false),
+      carDetectedMillis(0), lastcarDetectedMillis(0), lastCountSeq(0),
+      logDrops(0), netDrops(0), msgLength(0), rollup(DAILY_RESET_HOUR), rollupMinute(ROLLUP_NONE),
+      rollupClosed(ROLLUP_NONE), rollupDirty(false) {
+  memset(&activeDetectorConfig, 0, sizeof(activeDetectorConfig));
+  memset(&pendingDetectorConfig, 0, sizeof(pendingDetectorConfig));
+}
+
+//###############################################################################################################
+// setup(), counts from before a reboot
+
+uint8_t GateApp::restoreCounters(const char *gateCountTail) {
+  uint32_t now = hal.clock->unixtimeAt(hal.clock->micros());
+  uint32_t today = rollup.dayOf(now);
+  CounterState journalState, rowState, state;
+  bool journal = hal.counterStore && counterJournal.recover(readJournalSlot, this, journalState);
+  bool row = gateCountTail && gateCountRowState(gateCountTail, rowState);
+  uint8_t source = restoreCounterState(journal ? &journalState : NULL, row ? &rowState : NULL, today, state);
+
+  totalDailyCars = state.dailyCars;
+  carCounterCars = state.carCounterCars;
+  countLedger.resume(state.dailyCars, state.countSeq);
+
+  // what we start from, the journal carries on after it
+  if (hal.counterStore) {
+    state.unixtime = now;
+    JournalRecord record;
+    writeJournal(counterJournal.set(state, record), record);
+  }
+  return source;
+}
+
+//###############################################################################################################
+// Sensing task, owns the detector and the counters
+
+void GateApp::queueGateEvent(HalQueue<GateEvent> *queue, const GateEvent &event, uint32_t &drops) {
+  // never wait here, a full queue must not hold up detection
+  if (!queue->send(event)) drops++;
+}
+
+// Time, temperature and park count, the same for every event
+void GateApp::stampGateEvent(GateEvent &gateEvent, uint32_t eventMicros) {
+  gateEvent.carsInPark = carCounterCars-totalDailyCars;
+  gateEvent.temp = hal.clock->temperature();
+  gateEvent.millis = hal.clock->millis();
+  gateEvent.micros = eventMicros;
+  gateEvent.unixtime = hal.clock->unixtimeAt(eventMicros); // time of the edge, no I2C
+  formatTimestamp(gateEvent.unixtime, gateEvent.timestamp);
+}
+
+// An edge timestamp on the millis() timeline, the age of an edge is always small so
+// unsigned math survives both wraps
+static uint32_t edgeMillis(HalClock *clock, uint32_t edgeMicros) {
+  return clock->millis() - (clock->micros() - edgeMicros) / 1000;
+}
+
+void GateApp::onCountEvent(const CountEvent &event, void *context) {
+  ((GateApp *)context)->countEvent(event);
+}
+
+// Confirms and retracts go to the SD card and MQTT, a new count goes out with its car.
+// A count confirmed as it is counted (COUNT_REASON_CAR) is final in the car event already.
+void GateApp::countEvent(const CountEvent &event) {
+  totalDailyCars = event.total;
+  if (event.type == COUNT_PROVISIONAL) return;
+  if (event.type == COUNT_CONFIRMED && event.reason == COUNT_REASON_CAR) return;
+  GateEvent gateEvent;
+  memset(&gateEvent, 0, sizeof(gateEvent));
+  gateEvent.type = (event.type == COUNT_CONFIRMED) ? GATE_COUNT_CONFIRMED : GATE_COUNT_RETRACTED;
+  gateEvent.reason = event.reason;
+  gateEvent.seq = event.seq;
+  gateEvent.carNumber = event.total;
+  stampGateEvent(gateEvent, event.micros);
+  queueGateEvent(hal.logQueue, gateEvent, logDrops);
+  queueGateEvent(hal.netQueue, gateEvent, netDrops);
+  if (eventObserver) eventObserver(gateEvent);
+}
+
+#if COUNT_CLASSIFY
+// Features of the car that just ended, classed. PASS_CLASSES when there was no car.
+uint8_t GateApp::classifyCar(uint32_t endUs) {
+  uint32_t start = profileStart();
+  PassFeatures features;
+  uint8_t vehicle = PASS_CLASSES;
+  if (passFeatures.finish(endUs, features)) vehicle = classifyPass(features);
+  profileEnd(STAGE_CLASSIFY, start);
+  return vehicle;
+}
+#endif
+
+void GateApp::onDetectorEvent(const DetectorEvent &event, void *context) {
+  ((GateApp *)context)->detectorEvent(event);
+}
+
+void GateApp::detectorEvent(const DetectorEvent &event) {
+  uint8_t vehicle = PASS_CLASSES;  // not classed
+#if COUNT_CLASSIFY
+  if (event.type == DETECTOR_CAR_START) passFeatures.begin(event.carStartUs);
+  if (event.type == DETECTOR_CAR_COUNTED) vehicle = classifyCar(event.micros);
+  if (event.type == DETECTOR_TIMEOUT) classifyCar(event.micros);  // close the features, no count to class
+#endif
+#if FUSION_ENABLED
+  // the beams decide what is counted, the detector only feeds the bounce log
+  if (event.type == DETECTOR_CAR_COUNTED || event.type == DETECTOR_TIMEOUT) return;
+#endif
+  GateEvent gateEvent;
+  memset(&gateEvent, 0, sizeof(gateEvent));
+  switch (event.type) {
+    case DETECTOR_CAR_START:
+      carDetectedMillis = edgeMillis(hal.clock, event.carStartUs); // Freeze time when car was detected
+      profileMilestone(BOOT_FIRST_CAR, carDetectedMillis);
+      countLedger.carStart(event.carStartUs);  // holds the last count if it is right after it
+      gateEvent.type = GATE_CAR_START;
+      break;
+    case DETECTOR_BOUNCE:
+      gateEvent.type = GATE_BOUNCE;
+      break;
+    case DETECTOR_CAR_COUNTED:
+      lastCountSeq = countLedger.provisional(event.micros); // totalDailyCars ++
+      gateEvent.type = GATE_CAR_COUNTED;
+      break;
+    default:
+      countLedger.carTimeout(event.micros);  // a held count backed up onto the sensor
+      gateEvent.type = GATE_TIMEOUT;
+      break;
+  }
+  gateEvent.level = event.level;
+  gateEvent.bounces = event.bounces;
+  //add 1 to total daily cars so car being detected is synced
+  gateEvent.carNumber = (event.type == DETECTOR_CAR_COUNTED) ? totalDailyCars : totalDailyCars+1;
+  gateEvent.pass = (event.type == DETECTOR_TIMEOUT) ? FUSION_TIMEOUT : FUSION_EXIT;
+  gateEvent.reason = COUNT_REASON_CAR;
+  gateEvent.seq = (event.type == DETECTOR_CAR_COUNTED) ? lastCountSeq : 0;
+  gateEvent.vehicle = vehicle;
+  gateEvent.passMs = event.passMs;
+  gateEvent.lastHighMs = event.lastHighMs;
+  gateEvent.noCarMs = event.noCarMs;
+  gateEvent.lowMs = event.lowMs;
+  gateEvent.lastLowMs = event.lastLowMs;
+  gateEvent.carDetectedMillis = carDetectedMillis;
+  gateEvent.lastCarDetectedMillis = lastcarDetectedMillis;
+  stampGateEvent(gateEvent, event.micros);
+
+  queueGateEvent(hal.logQueue, gateEvent, logDrops);
+  if (eventObserver) eventObserver(gateEvent);
+  if (event.type == DETECTOR_CAR_COUNTED || event.type == DETECTOR_TIMEOUT) {
+    queueGateEvent(hal.netQueue, gateEvent, netDrops);
+  }
+  if (event.type == DETECTOR_CAR_COUNTED) {
+    sensorBounceFlag = 0;
+    lastcarDetectedMillis=carDetectedMillis;
+    if (COUNT_RETRACT_NOISE && vehicle == PASS_NOISE) {
+      countLedger.retract(lastCountSeq, event.micros, COUNT_REASON_NOISE);
+    } else if (COUNT_REVERSAL_MS == 0) {
+      // nothing can take it back any more, no confirm message 15 s later
+      countLedger.confirm(lastCountSeq, event.micros, COUNT_REASON_CAR);
+    }
+  }
+}
+
+#if FUSION_ENABLED
+void GateApp::queuePassEvent(const FusionPass &pass, uint8_t type, uint32_t seq) {
+  GateEvent gateEvent;
+  memset(&gateEvent, 0, sizeof(gateEvent));
+  gateEvent.type = type;
+  gateEvent.pass = pass.type;
+  gateEvent.seq = seq;
+  gateEvent.vehicle = PASS_CLASSES;  // the magnetometer pass is classed on its own, not matched to the beams
+  gateEvent.level = pass.vehicle;
+  gateEvent.bounces = pass.edges;
+  gateEvent.carNumber = totalDailyCars;
+  gateEvent.passMs = pass.passMs;
+  gateEvent.carDetectedMillis = edgeMillis(hal.clock, pass.startUs);
+  gateEvent.lastCarDetectedMillis = lastcarDetectedMillis;
+  stampGateEvent(gateEvent, pass.endUs);
+
+  queueGateEvent(hal.logQueue, gateEvent, logDrops);
+  if (eventObserver) eventObserver(gateEvent);
+  // people and deer in the beams only go to the logs
+  if (pass.type != FUSION_NOISE) queueGateEvent(hal.netQueue, gateEvent, netDrops);
+}
+
+void GateApp::onFusionPass(const FusionPass &pass, void *context) {
+  ((GateApp *)context)->fusionPass(pass);
+}
+
+// The beams count a car as soon as it reaches the road side and confirm it or
+// take it back once the pass is over. Only an exit stays counted.
+void GateApp::fusionPass(const FusionPass &pass) {
+  if (pass.type == FUSION_CROSSING || (pass.type == FUSION_EXIT && !pass.crossed)) {
+    fusionSeq = countLedger.provisional(pass.endUs);
+    queuePassEvent(pass, GATE_CAR_COUNTED, fusionSeq);
+    if (pass.type == FUSION_CROSSING) return;
+  }
+  if (pass.type == FUSION_EXIT) {
+    countLedger.confirm(fusionSeq, pass.endUs, COUNT_REASON_EXIT);
+    sensorBounceFlag = 0;
+    lastcarDetectedMillis = edgeMillis(hal.clock, pass.startUs);
+    return;
+  }
+  if (pass.crossed) {
+    uint8_t reason = COUNT_REASON_NOISE;
+    if (pass.type == FUSION_BACKUP) reason = COUNT_REASON_BACKUP;
+    if (pass.type == FUSION_TIMEOUT) reason = COUNT_REASON_TIMEOUT;
+    countLedger.retract(fusionSeq, pass.endUs, reason);
+  }
+  queuePassEvent(pass, GATE_TIMEOUT, 0);
+}
+#endif
+
+// Hand every captured edge to the detector and run its timers
+void GateApp::feedDetector() {
+  uint32_t nowMicros = hal.clock->micros(); // read before draining so no edge is older than the poll
+  SensorEdge sensorEdge;
+  while (hal.sensors->pop(sensorEdge)) {
+    profileRecord(STAGE_EDGE_LATENCY, nowMicros - sensorEdge.micros);
+    profileCount(COUNT_EDGES);
+#if FUSION_ENABLED
+    gateFusion.onEdge(sensorEdge.micros, sensorEdge.input, sensorEdge.level);
+#endif
+    if (sensorEdge.input != SENSOR_INPUT_MAGNETOMETER) continue;
+    if (edgeObserver) edgeObserver(sensorEdge.micros, sensorEdge.level);
+    gateDetector.onEdge(sensorEdge.micros, sensorEdge.level);
+#if COUNT_CLASSIFY
+    // after the detector, a car that starts on this edge has begun and gets it
+    passFeatures.onEdge(sensorEdge.micros, sensorEdge.level);
+#endif
+  }
+  gateDetector.poll(nowMicros);
+#if FUSION_ENABLED
+  gateFusion.poll(nowMicros);
+#endif
+  countLedger.poll(nowMicros);
+}
+
+void GateApp::applyDetectorConfig(const DetectorConfig &config) {
+#if !DETECTOR_FIXED
+  gateDetector.setConfig(config);
+#else
+  (void)config;
+#endif
+  activeDetectorConfig = gateDetector.config();
+}
+
+void GateApp::applyGateCommands() {
+  GateCommand command;
+  while (hal.commandQueue->receive(command, 0)) {
+    if (command.type == GATE_SET_DETECTOR) {
+      pendingDetectorConfig = command.config;
+      detectorConfigPending = true;
+    }
+    // whatever is still pending is confirmed first so every count gets its answer
+    if (command.type == GATE_SET_DAILY_COUNT) {
+      countLedger.setTotal(command.value, hal.clock->micros());
+      totalDailyCars = command.value;
+      queueCountersSet();
+    }
+    if (command.type == GATE_DAILY_RESET) {
+      countLedger.setTotal(0, hal.clock->micros());
+      totalDailyCars = 0;
+      GateEvent event;
+      memset(&event, 0, sizeof(event));
+      event.type = GATE_DAY_RESET;
+      event.millis = hal.clock->millis();
+      event.micros = hal.clock->micros();
+      event.unixtime = hal.clock->unixtimeAt(event.micros);
+      queueGateEvent(hal.logQueue, event, logDrops);
+    }
+    // the Car Counter sends its count with every car in, only a change goes in the journal
+    if (command.type == GATE_SET_CAR_COUNTER && command.value != carCounterCars) {
+      carCounterCars = command.value;
+      queueCountersSet();
+    }
+  }
+  // never change thresholds under a car, wait until it has been counted or dropped
+  if (detectorConfigPending && !gateDetector.carPresent()) {
+    detectorConfigPending = false;
+    applyDetectorConfig(pendingDetectorConfig);
+    GateEvent event;
+    memset(&event, 0, sizeof(event));
+    event.type = GATE_CONFIG_APPLIED;
+    queueGateEvent(hal.netQueue, event, netDrops);
+  }
+}
+
+// A count set outright, for the journal (logging task)
+void GateApp::queueCountersSet() {
+  GateEvent event;
+  memset(&event, 0, sizeof(event));
+  event.type = GATE_COUNTERS_SET;
+  stampGateEvent(event, hal.clock->micros());
+  event.carNumber = totalDailyCars;
+  event.seq = countLedger.lastSeq();
+  queueGateEvent(hal.logQueue, event, logDrops);
+}
+
+void GateApp::sensingBegin(const DetectorConfig &config) {
+  applyDetectorConfig(config);
+  gateDetector.setListener(onDetectorEvent, this);
+  countLedger.setListener(onCountEvent, this);
+#if !FUSION_ENABLED
+  countLedger.setConfirmMs(COUNT_CONFIRM_MS);
+  countLedger.setReversalMs(COUNT_REVERSAL_MS);
+#endif
+  gateDetector.reset(hal.sensors->read(SENSOR_INPUT_MAGNETOMETER));
+#if FUSION_ENABLED
+  // a beam that is broken at boot has to clear before it can start a pass
+  gateFusion.setListener(onFusionPass, this);
+#endif
+}
+
+void GateApp::sensingPass() {
+  uint32_t start = profileStart();
+  applyGateCommands();
+  feedDetector();
+  profileEnd(STAGE_DETECT, start);
+  profileCount(COUNT_SENSING);
+}
+
+bool GateApp::sendCommand(uint8_t type, int32_t value) {
+  GateCommand command;
+  memset(&command, 0, sizeof(command));
+  command.type = type;
+  command.value = value;
+  return hal.commandQueue->send(command);
+}
+
+bool GateApp::sendDetectorConfig(const DetectorConfig &config) {
+  GateCommand command;
+  memset(&command, 0, sizeof(command));
+  command.type = GATE_SET_DETECTOR;
+  command.config = config;
+  return hal.commandQueue->send(command);
+}
+
+bool GateApp::handleMessage(const char *topic, const char *payload) {
+  // Counters belong to the sensing task, hand the new values over
+  if (strcmp(topic, MQTT_SUB_TOPIC0) == 0) {
+    sendCommand(GATE_SET_CAR_COUNTER, atoi(payload));
+    return true;
+  }
+  if (strcmp(topic, MQTT_SUB_TOPIC1) == 0) {
+    sendCommand(GATE_SET_DAILY_COUNT, atoi(payload));
+    return true;
+  }
+  return false;
+}
+
+//###############################################################################################################
+// Logging task, owns the SD card
+
+// Sensor went LOW while a car is present, record the bounce
+void GateApp::recordBounce(const GateEvent &event) {
+#if LOG_BOUNCES_CSV
+  //T("DateTime\t\t\tPassing Time\tLast High\tDiff\tLow Millis\tLast Low\tDiff\tBounce #\tCurent State\tCar#" )
+  hal.bounceLog->indexDay(event.unixtime / 86400);
+  hal.bounceLog->printf(BOUNCE_ROW_FORMAT, BOUNCE_ROW_ARGS(event));
+#else
+  (void)event;
+#endif
+}
+
+// Car cleared the sensor, save it
+void GateApp::recordCar(const GateEvent &event) {
+  // buffer the row for GateCount.csv
+  //"Date Time,Pass Timer,NoCar Timer,TotalExitCars,CarsInPark,Temp"
+  hal.gateCountLog->indexDay(event.unixtime / 86400);
+  hal.gateCountLog->printf(GATE_COUNT_ROW_FORMAT, GATE_COUNT_ROW_ARGS(event, sensorBounceFlag));
+}
+
+// An earlier count was confirmed or taken back, GateCorrections.csv
+void GateApp::recordCorrection(const GateEvent &event) {
+  hal.correctionLog->indexDay(event.unixtime / 86400);
+  hal.correctionLog->printf(CORRECTION_ROW_FORMAT, CORRECTION_ROW_ARGS(event));
+}
+
+// Every event also goes to GateLog.bin as one 16 byte record
+void GateApp::recordBinary(const GateEvent &event) {
+  BinLogRecord record;
+  if (binLogEncoder.needsSync(event.micros)) {
+    binLogEncoder.sync(record, event.micros, event.unixtime, event.temp);
+    hal.binLog->append(&record, sizeof(record));
+  }
+  binLogEventRecord(record, event);
+  binLogEncoder.stamp(record, event.micros);
+  hal.binLog->append(&record, sizeof(record));
+}
+
+void GateApp::logEvent(const GateEvent &event) {
+  uint32_t start = profileStart();
+  journalEvent(event);
+  if (event.type != GATE_COUNTERS_SET) recordBinary(event);
+  switch (event.type) {
+    case GATE_BOUNCE:      recordBounce(event);  break;
+    case GATE_CAR_COUNTED: recordCar(event);     break;
+    case GATE_DAY_RESET:   flushLogs();          break;
+    case GATE_COUNT_CONFIRMED:
+    case GATE_COUNT_RETRACTED: recordCorrection(event); break;
+  }
+  profileEnd(STAGE_LOG_EVENT, start);
+}
+
+// Counters.jnl, one JournalRecord per slot (lib/GateCore/src/CounterJournal.h)
+bool GateApp::readJournalSlot(uint16_t slot, JournalRecord &record, void *context) {
+  HalStore *store = ((GateApp *)context)->hal.counterStore;
+  return store->read((uint32_t)slot * sizeof(record), &record, sizeof(record));
+}
+
+void GateApp::writeJournal(uint16_t slot, const JournalRecord &record) {
+  hal.counterStore->write((uint32_t)slot * sizeof(record), &record, sizeof(record));
+  hal.counterStore->flush();  // one record, it has to be on the card before the next car
+}
+
+// Every change to the counts, as it is logged
+void GateApp::journalEvent(const GateEvent &event) {
+  if (!hal.counterStore) return;
+  JournalRecord record;
+  uint16_t slot;
+  if (event.type == GATE_CAR_COUNTED || event.type == GATE_COUNT_RETRACTED) {
+    slot = counterJournal.counted(event.type == GATE_CAR_COUNTED ? 1 : -1, event.seq, event.unixtime, record);
+  } else if (event.type == GATE_DAY_RESET || event.type == GATE_COUNTERS_SET) {
+    CounterState state = counterJournal.state();
+    state.unixtime = event.unixtime;
+    state.dailyCars = event.carNumber;  // 0 for the daily reset
+    if (event.type == GATE_COUNTERS_SET) {
+      state.carCounterCars = event.carsInPark + event.carNumber;
+      state.countSeq = event.seq;
+    }
+    slot = counterJournal.set(state, record);
+  } else {
+    return;
+  }
+  writeJournal(slot, record);
+}
+
+void GateApp::serviceLogs(unsigned long nowMillis) {
+  uint32_t start = profileStart();
+  hal.gateCountLog->service(nowMillis);
+  hal.correctionLog->service(nowMillis);
+#if LOG_BOUNCES_CSV
+  hal.bounceLog->service(nowMillis);
+#endif
+  hal.binLog->service(nowMillis);
+  profileEnd(STAGE_LOG_SERVICE, start);
+}
+
+// Daily reset and before a restart (OTA), get the buffered rows onto the card
+void GateApp::flushLogs() {
+  hal.gateCountLog->flush();
+  hal.correctionLog->flush();
+#if LOG_BOUNCES_CSV
+  hal.bounceLog->flush();
+#endif
+  hal.binLog->flush();
+}
+
+//###############################################################################################################
+// Network task, owns MQTT
+
+#if MQTT_LEGACY_TOPICS
+void GateApp::publishLegacyTopics(const GateEvent &event) {
+  char value[12];
+  if (event.type == GATE_CAR_COUNTED) {
+    snprintf(value, sizeof(value), "%d", event.temp);
+    hal.mqtt->publish(MQTT_PUB_TOPIC1, value);
+    hal.mqtt->publish(MQTT_PUB_TOPIC2, event.timestamp);
+    snprintf(value, sizeof(value), "%d", (int)event.carNumber);
+    hal.mqtt->publish(MQTT_PUB_TOPIC3, value);
+    snprintf(value, sizeof(value), "%d", (int)event.carsInPark);
+    hal.mqtt->publish(MQTT_PUB_TOPIC4, value);
+  } else if (event.type == GATE_TIMEOUT) {
+    snprintf(value, sizeof(value), "%d", (int)event.carNumber);
+    hal.mqtt->publish(MQTT_PUB_TOPIC5, value);
+  } else if (event.type == GATE_COUNT_RETRACTED) {
+    snprintf(value, sizeof(value), "%d", (int)event.carNumber);
+    hal.mqtt->publish(MQTT_PUB_TOPIC3, value);
+  }
+}
+#endif
+
+// Events are collected into msg[] as a JSON array, e.g.
+// [{"event":"car","seq":310,"class":"car","count":125,"inpark":40,"temp":71,"time":"2024-05-04 17:02:11"},
+//  {"event":"retract","seq":310,"reason":"backup","count":124,"inpark":41,"time":"2024-05-04 17:02:15"}]
+void GateApp::publishEvents() {
+  if (msgLength == 0) return;
+  msg[msgLength++] = ']';
+  msg[msgLength] = '\0';
+  hal.mqtt->publish(MQTT_PUB_TOPIC6, msg);
+  msgLength = 0;
+}
+
+void GateApp::publishGateEvent(const GateEvent &event) {
+  rollupEvent(event);
+  bool correction = event.type == GATE_COUNT_CONFIRMED || event.type == GATE_COUNT_RETRACTED;
+  if (event.type != GATE_CAR_COUNTED && event.type != GATE_TIMEOUT && !correction) return;
+#if MQTT_LEGACY_TOPICS
+  publishLegacyTopics(event);
+#endif
+  for (;;) {
+    // leave room for the leading '[' or ',' and the closing ']'
+    size_t room = MSG_BUFFER_SIZE - msgLength - 2;
+    int length = formatEventJson(msg + msgLength + 1, room, event);
+    if (length > 0 && (size_t)length < room) {
+      msg[msgLength] = msgLength == 0 ? '[' : ',';
+      msgLength += length + 1;
+      break;
+    }
+    if (msgLength == 0) return;  // can't happen, one event always fits
+    publishEvents();             // buffer full, send what we have and start again
+  }
+#if !MQTT_COALESCE_EVENTS
+  publishEvents();
+#endif
+}
+
+// Rollup.bin: the day it is for, then the minutes as CountRollup keeps them
+#define ROLLUP_MAGIC 0x31505552  // "RUP1"
+#define ROLLUP_HEADER_SIZE 8
+
+void GateApp::rollupBegin() {
+  uint32_t now = hal.clock->unixtimeAt(hal.clock->micros());
+  uint32_t header[2];
+  bool today = hal.rollupStore && hal.rollupStore->read(0, header, sizeof(header)) && header[0] == ROLLUP_MAGIC &&
+               header[1] == rollup.dayOf(now);
+  // rebooted during the day, carry on with it
+  rollup.startDay(now);
+  if (today && hal.rollupStore->read(ROLLUP_HEADER_SIZE, rollup.minuteData(), ROLLUP_MINUTES * sizeof(int16_t))) {
+    rollup.rebuild();
+  } else {
+    startRollupDay(now);
+  }
+  rollupMinute = rollup.minuteOf(now);
+  rollupClosed = rollupMinute >= 15 ? rollupMinute / 15 - 1 : ROLLUP_NONE;
+}
+
+void GateApp::startRollupDay(uint32_t unixtime) {
+  rollup.startDay(unixtime);
+  rollupClosed = ROLLUP_NONE;
+  if (!hal.rollupStore) return;
+  uint32_t header[2] = {ROLLUP_MAGIC, rollup.dayStart()};
+  hal.rollupStore->write(0, header, sizeof(header));
+  hal.rollupStore->write(ROLLUP_HEADER_SIZE, rollup.minuteData(), ROLLUP_MINUTES * sizeof(int16_t));
+  hal.rollupStore->flush();
+  rollupDirty = false;
+}
+
+// Counts and retractions into the minute they happened in, straight into the store
+void GateApp::rollupEvent(const GateEvent &event) {
+  int16_t count = 0;
+  if (event.type == GATE_CAR_COUNTED) count = 1;
+  if (event.type == GATE_COUNT_RETRACTED) count = -1;
+  if (!count) return;
+  uint16_t index = rollup.add(event.unixtime, count);
+  if (index == ROLLUP_NONE || !hal.rollupStore) return;
+  hal.rollupStore->write(ROLLUP_HEADER_SIZE + index * sizeof(int16_t), &rollup.minuteData()[index], sizeof(int16_t));
+  rollupDirty = true;
+}
+
+void GateApp::serviceRollup() {
+  uint32_t now = hal.clock->unixtimeAt(hal.clock->micros());
+  uint16_t minute = rollup.minuteOf(now);
+  if (minute == rollupMinute) return;
+
+  // a minute closed, onto the card with it
+  if (rollupDirty && hal.rollupStore) {
+    hal.rollupStore->flush();
+    rollupDirty = false;
+  }
+  // and a quarter with it, or the day
+  if (rollupMinute != ROLLUP_NONE && (minute == ROLLUP_NONE || minute / 15 != rollupMinute / 15)) {
+    rollupClosed = rollupMinute / 15;
+    publishRollup(rollupClosed);
+  }
+  if (minute == ROLLUP_NONE) {
+    startRollupDay(now);
+    minute = rollup.minuteOf(now);
+  }
+  rollupMinute = minute;
+}
+
+void GateApp::publishRollup() {
+  if (rollupClosed != ROLLUP_NONE) publishRollup(rollupClosed);
+}
+
+// Retained, the latest one has the whole day so far
+void GateApp::publishRollup(uint16_t quarter) {
+  if (rollup.json(rollupMsg, sizeof(rollupMsg), quarter)) hal.mqtt->publish(MQTT_PUB_TOPIC9, rollupMsg, true);
+}
+
+//###############################################################################################################
+// Display, loop()
+
+//Reset Gate Counter at 5:00:00 pm, late rather than never if loop() was held up
+void GateApp::scheduleBegin() {
+  loopJobs.daily(hal.clock->unixtimeAt(hal.clock->micros()), DAILY_RESET_HOUR, 0, 0, dailyResetJob, this, "daily reset");
+}
+
+// The sensing task resets the count, tried again on the next pass if its queue is full
+bool GateApp::dailyResetJob(uint32_t /*due*/, void *context) {
+  return ((GateApp *)context)->sendCommand(GATE_DAILY_RESET, 0);
+}
+
+void GateApp::displayPass() {
+  uint32_t unixtime = hal.clock->unixtimeAt(hal.clock->micros());
+  loopJobs.run(unixtime);
+
+  CivilTime now;
+  civilTime(unixtime, now);
+
+  DisplayValues values;
+  memset(&values, 0, sizeof(values));
+  values.dayOfWeek = now.dayOfWeek;
+  values.month = now.month;
+  values.day = now.day;
+  values.hour = now.hour;
+  values.minute = now.minute;
+  values.second = now.second;
+  values.year = now.year;
+  values.temp = hal.clock->temperature();
+  values.exiting = totalDailyCars;
+  values.inPark = carCounterCars - totalDailyCars;
+  hal.display->show(values);
+}
@@ -0,0 +1,43 @@
+#include "GateSettings.h"
+#include <Preferences.h>
+
+#define SETTINGS_NAMESPACE "gate"
+
+void settingsLoad(GateSettings &settings, const DetectorConfig &defaults, uint8_t defaultVerbosity) {
+  settings.detector = defaults;
+  settings.verbosity = defaultVerbosity;
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, true)) return;  // nothing saved yet
+  GateSettings saved;
+  saved.detector.nocarTimeoutMs = prefs.getUInt("nocar", defaults.nocarTimeoutMs);
+  saved.detector.bounceGapMs = prefs.getUInt("gap", defaults.bounceGapMs);
+  saved.detector.stuckTimeoutMs = prefs.getUInt("stuck", defaults.stuckTimeoutMs);
+  saved.detector.minBounces = prefs.getUInt("bounces", defaults.minBounces);
+  saved.verbosity = prefs.getUChar("verbosity", defaultVerbosity);
+  prefs.end();
+  // limits may have changed since they were saved
+  if (settingsCheck(saved) == NULL) {
+    settings = saved;
+  } else {
+    Serial.println("Saved settings out of range, using the profile");
+  }
+}
+
+bool settingsSave(const GateSettings &settings) {
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, false)) return false;
+  bool ok = prefs.putUInt("nocar", settings.detector.nocarTimeoutMs) &&
+            prefs.putUInt("gap", settings.detector.bounceGapMs) &&
+            prefs.putUInt("stuck", settings.detector.stuckTimeoutMs) &&
+            prefs.putUInt("bounces", settings.detector.minBounces) &&
+            prefs.putUChar("verbosity", settings.verbosity);
+  prefs.end();
+  return ok;
+}
+
+void settingsClear() {
+  Preferences prefs;
+  if (!prefs.begin(SETTINGS_NAMESPACE, false)) return;
+  prefs.clear();
+  prefs.end();
+}
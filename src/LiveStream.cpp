@@ -0,0 +1,125 @@
+#include "LiveStream.h"
+#include "EdgeRing.h"
+
+struct LiveEvent {
+  uint8_t type;  // GateEventType
+  uint8_t level;
+  uint16_t bounces;
+  int32_t carNumber;
+  int32_t carsInPark;
+  uint32_t micros;
+};
+
+static AsyncEventSource liveEvents("/live");
+static EdgeRing<LIVE_EDGE_RING_SIZE> liveEdges;
+static QueueHandle_t liveQueue = NULL;
+static volatile bool liveWatched = false;
+static uint32_t liveEventDrops = 0;
+static char liveMsg[512];
+
+static const char livePage[] PROGMEM = R"rawliteral(<!DOCTYPE html>
+<html><head><title>Gate Counter Live</title></head>
+<body style="font-family:monospace">
+<h3>Exiting: <span id="count">-</span> &nbsp; In Park: <span id="inpark">-</span> &nbsp; Sensor: <span id="level">-</span></h3>
+<pre id="log"></pre>
+<script>
+var log = document.getElementById('log'), lines = [];
+function add(text) { lines.unshift(text); lines.length = Math.min(lines.length, 200); log.textContent = lines.join('\n'); }
+var source = new EventSource('/live');
+source.addEventListener('edges', function(e) {
+  var data = JSON.parse(e.data);
+  data.edges.forEach(function(edge) {
+    document.getElementById('level').textContent = edge[1] ? 'HIGH' : 'LOW';
+    add(edge[0] + ' us  ' + (edge[1] ? 'HIGH' : 'LOW'));
+  });
+  if (data.dropped) add('dropped ' + data.dropped + ' edges');
+});
+source.addEventListener('event', function(e) {
+  var data = JSON.parse(e.data);
+  if (data.event == 'car') {
+    document.getElementById('count').textContent = data.count;
+    document.getElementById('inpark').textContent = data.inpark;
+  }
+  add(data.micros + ' us  ' + data.event + '  car ' + data.count + '  bounces ' + data.bounces);
+});
+</script></body></html>
+)rawliteral";
+
+void liveStreamBegin(AsyncWebServer &server) {
+  liveQueue = xQueueCreate(LIVE_EVENT_QUEUE_LENGTH, sizeof(LiveEvent));
+  server.addHandler(&liveEvents);
+  server.on("/live.html", HTTP_GET, [](AsyncWebServerRequest *request) {
+    request->send_P(200, "text/html", livePage);
+  });
+}
+
+void liveStreamEdge(uint32_t micros, uint8_t level) {
+  if (liveWatched) liveEdges.push(micros, level);
+}
+
+void liveStreamEvent(const GateEvent &event) {
+  if (!liveWatched || !liveQueue) return;
+  LiveEvent live;
+  live.type = event.type;
+  live.level = event.level;
+  live.bounces = event.bounces;
+  live.carNumber = event.carNumber;
+  live.carsInPark = event.carsInPark;
+  live.micros = event.micros;
+  if (xQueueSend(liveQueue, &live, 0) != pdTRUE) liveEventDrops++;
+}
+
+uint32_t liveStreamDropped() {
+  return liveEdges.droppedCount() + liveEventDrops;
+}
+
+static void sendEdges() {
+  static uint32_t reportedDrops = 0;
+  SensorEdge edge;
+  while (liveEdges.available()) {
+    size_t length = snprintf(liveMsg, sizeof(liveMsg), "{\"edges\":[");
+    // leave room for the closing part
+    while (length < sizeof(liveMsg) - 48 && liveEdges.pop(edge)) {
+      length += snprintf(liveMsg + length, sizeof(liveMsg) - length, "%s[%u,%u]",
+                         liveMsg[length - 1] == '[' ? "" : ",", (unsigned)edge.micros, (unsigned)edge.level);
+    }
+    uint32_t drops = liveEdges.droppedCount();
+    snprintf(liveMsg + length, sizeof(liveMsg) - length, "],\"dropped\":%u}", (unsigned)(drops - reportedDrops));
+    reportedDrops = drops;
+    liveEvents.send(liveMsg, "edges");
+  }
+}
+
+static void sendEvents() {
+  static const char *names[] = {"start",  "bounce",  "car",     "timeout", "reset",
+                                 "config", "confirm", "retract", "counters"};
+  static_assert(sizeof(names) / sizeof(names[0]) == GATE_EVENT_TYPES, "a name for every GateEventType");
+  LiveEvent live;
+  while (xQueueReceive(liveQueue, &live, 0) == pdTRUE) {
+    snprintf(liveMsg, sizeof(liveMsg),
+             "{\"event\":\"%s\",\"count\":%d,\"inpark\":%d,\"bounces\":%u,\"level\":%u,\"micros\":%u}",
+             live.type < GATE_EVENT_TYPES ? names[live.type] : "?", (int)live.carNumber, (int)live.carsInPark,
+             (unsigned)live.bounces, (unsigned)live.level, (unsigned)live.micros);
+    liveEvents.send(liveMsg, "event");
+  }
+}
+
+void liveStreamService() {
+  bool watched = liveEvents.count() > 0;
+  if (!watched) {
+    if (liveWatched) {
+      // last browser went away, throw away what was collected for it
+      liveWatched = false;
+      SensorEdge edge;
+      while (liveEdges.pop(edge)) {}
+      if (liveQueue) xQueueReset(liveQueue);
+    }
+    return;
+  }
+  liveWatched = true;
+  // a slow browser must not pile up memory, wait for it to catch up
+  // (the ring drops and counts new edges once it is full)
+  if (liveEvents.avgPacketsWaiting() >= LIVE_MAX_WAITING) return;
+  sendEdges();
+  sendEvents();
+}
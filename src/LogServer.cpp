@@ -0,0 +1,162 @@
+#include "LogServer.h"
+#include "LogWriter.h"
+#include "CivilTime.h"
+
+static fs::FS *logFs = NULL;
+
+uint32_t logDayNumber(const char *date) {
+  int year, month, day;
+  if (!date || sscanf(date, "%d-%d-%d", &year, &month, &day) != 3) return 0;
+  if (year < 1970 || year > 2105 || month < 1 || month > 12 || day < 1 || day > 31) return 0;
+  CivilTime time;
+  memset(&time, 0, sizeof(time));
+  time.year = year;
+  time.month = month;
+  time.day = day;
+  return civilUnixtime(time) / 86400;
+}
+
+bool logDayRange(fs::FS &fs, const char *indexPath, uint32_t fromDay, uint32_t toDay,
+                 uint32_t fileSize, uint32_t &start, uint32_t &end) {
+  File index = fs.open(indexPath, FILE_READ);
+  if (!index) return false;
+  // one entry per day, a season is a few KB
+  LogDayIndex entry;
+  bool first = true;
+  start = fileSize;
+  end = fileSize;
+  while (index.read((uint8_t *)&entry, sizeof(entry)) == sizeof(entry)) {
+    if (first && entry.day > fromDay) start = 0;  // asking for days older than the index
+    first = false;
+    if (start == fileSize && entry.day >= fromDay) start = entry.offset;
+    if (entry.day > toDay) {
+      end = entry.offset;
+      break;
+    }
+  }
+  index.close();
+  if (start > end) start = end;
+  return !first;
+}
+
+static bool logNameAllowed(const String &name) {
+  if (name.length() == 0 || name.indexOf('/') >= 0 || name.indexOf("..") >= 0) return false;
+  return name.endsWith(".csv") || name.endsWith(".bin");
+}
+
+static void listLogs(AsyncWebServerRequest *request) {
+  AsyncResponseStream *response = request->beginResponseStream("application/json");
+  response->print("[");
+  File root = logFs->open("/");
+  bool firstFile = true;
+  File entry;
+  while (root && (entry = root.openNextFile())) {
+    const char *name = strrchr(entry.name(), '/');
+    name = name ? name + 1 : entry.name();
+    if (!entry.isDirectory() && logNameAllowed(name)) {
+      response->printf("%s{\"name\":\"%s\",\"size\":%u}", firstFile ? "" : ",", name,
+                       (unsigned)entry.size());
+      firstFile = false;
+    }
+    entry.close();
+  }
+  response->print("]");
+  request->send(response);
+}
+
+// "bytes=a-b", "bytes=a-" or "bytes=-n" within a body of length bytes
+static bool parseRange(const String &header, uint32_t length, uint32_t &first, uint32_t &last) {
+  if (!header.startsWith("bytes=") || header.indexOf(',') >= 0) return false;
+  int dash = header.indexOf('-');
+  if (dash < 0) return false;
+  String from = header.substring(6, dash);
+  String to = header.substring(dash + 1);
+  if (from.length() == 0) {
+    // the last n bytes
+    uint32_t count = to.toInt();
+    if (count == 0 || length == 0) return false;
+    first = count >= length ? 0 : length - count;
+    last = length - 1;
+    return true;
+  }
+  first = from.toInt();
+  last = to.length() ? (uint32_t)to.toInt() : length - 1;
+  if (last >= length) last = length - 1;
+  return first < length && first <= last;
+}
+
+static void sendLog(AsyncWebServerRequest *request) {
+  String name = request->url().substring(strlen("/logs/"));
+  if (!logNameAllowed(name)) {
+    request->send(404, "text/plain", "No such log");
+    return;
+  }
+  String path = "/" + name;
+  File file = logFs->open(path, FILE_READ);
+  if (!file || file.isDirectory()) {
+    request->send(404, "text/plain", "No such log");
+    return;
+  }
+  uint32_t fileSize = file.size();
+  uint32_t start = 0, end = fileSize;
+
+  if (request->hasParam("from")) {
+    uint32_t fromDay = logDayNumber(request->getParam("from")->value().c_str());
+    uint32_t toDay = request->hasParam("to")
+        ? logDayNumber(request->getParam("to")->value().c_str()) : fromDay;
+    String indexPath = path.substring(0, path.lastIndexOf('.')) + ".idx";
+    if (fromDay == 0 || toDay < fromDay) {
+      request->send(400, "text/plain", "from / to must be YYYY-MM-DD");
+      return;
+    }
+    if (!logDayRange(*logFs, indexPath.c_str(), fromDay, toDay, fileSize, start, end)) {
+      request->send(404, "text/plain", "This log has no day index");
+      return;
+    }
+  }
+
+  uint32_t length = end - start;
+  int code = 200;
+  char contentRange[40];
+  if (request->hasHeader("Range")) {
+    uint32_t first, last;
+    if (!parseRange(request->getHeader("Range")->value(), length, first, last)) {
+      AsyncWebServerResponse *response = request->beginResponse(416, "text/plain", "Bad range");
+      snprintf(contentRange, sizeof(contentRange), "bytes */%u", (unsigned)length);
+      response->addHeader("Content-Range", contentRange);
+      request->send(response);
+      return;
+    }
+    snprintf(contentRange, sizeof(contentRange), "bytes %u-%u/%u", (unsigned)first, (unsigned)last,
+             (unsigned)length);
+    start += first;
+    length = last - first + 1;
+    code = 206;
+  }
+
+  const char *type = name.endsWith(".csv") ? "text/csv" : "application/octet-stream";
+  // the filler reads from the card straight into the outgoing TCP buffer
+  AsyncWebServerResponse *response = request->beginResponse(type, length,
+      [file, start, length](uint8_t *buffer, size_t maxLen, size_t index) mutable -> size_t {
+        if (index >= length) return 0;
+        if (index == 0) file.seek(start);  // the only seek, the rest reads on
+        size_t count = length - index < maxLen ? length - index : maxLen;
+        return file.read(buffer, count);
+      });
+  response->setCode(code);
+  response->addHeader("Accept-Ranges", "bytes");
+  if (code == 206) response->addHeader("Content-Range", contentRange);
+  request->send(response);
+}
+
+void logServerBegin(AsyncWebServer &server, fs::FS &fs) {
+  logFs = &fs;
+  // "/logs" also matches "/logs/<name>"
+  server.on("/logs", HTTP_GET, [](AsyncWebServerRequest *request) {
+    if (request->url() == "/logs" || request->url() == "/logs/") {
+      listLogs(request);
+    } else {
+      sendLog(request);
+    }
+  });
+}
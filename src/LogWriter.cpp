@@ -0,0 +1,182 @@
+#include "LogWriter.h"
+#include <stdarg.h>
+
+LogWriter::LogWriter(const char *path, const char *headerLine)
+    : fs(NULL), filePath(path), header((const uint8_t *)headerLine), headerLength(strlen(headerLine)),
+      textHeader(true), dayIndexPath(NULL), indexedDay(0), lock(NULL), fileSize(0), used(0),
+      oldestMillis(0), written(0), flushes(0), dropped(0) {}
+
+LogWriter::LogWriter(const char *path, const void *headerData, size_t length)
+    : fs(NULL), filePath(path), header((const uint8_t *)headerData), headerLength(length),
+      textHeader(false), dayIndexPath(NULL), indexedDay(0), lock(NULL), fileSize(0), used(0),
+      oldestMillis(0), written(0), flushes(0), dropped(0) {}
+
+// First line of the file is the header this firmware writes
+bool LogWriter::headerMatches() {
+  File existing = fs->open(filePath, FILE_READ);
+  if (!existing) return false;
+  bool same = existing.size() > headerLength;
+  for (size_t i = 0; same && i < headerLength; i++) same = existing.read() == header[i];
+  if (same) {
+    int end = existing.read();
+    same = end == '\r' || end == '\n';
+  }
+  existing.close();
+  return same;
+}
+
+bool LogWriter::begin(fs::FS &sd) {
+  fs = &sd;
+  if (!lock) lock = xSemaphoreCreateMutex();
+  bool created = !fs->exists(filePath);
+  if (!created && textHeader && !headerMatches()) {
+    // written by a firmware with other columns, keep it (e.g. /GateCount.csv.1) and start over
+    char oldPath[48];
+    for (unsigned n = 1; n < 100; n++) {
+      snprintf(oldPath, sizeof(oldPath), "%s.%u", filePath, n);
+      if (!fs->exists(oldPath)) break;
+    }
+    Serial.print(filePath);
+    Serial.print(F(" has other columns, moved to "));
+    Serial.println(oldPath);
+    created = fs->rename(filePath, oldPath);
+  }
+  if (created) {
+    Serial.print(filePath);
+    Serial.println(F(" doesn't exist. Creating file and writing header..."));
+    File newFile = fs->open(filePath, FILE_WRITE);
+    if (!newFile) {
+      Serial.print(filePath);
+      Serial.println(F(" could not be created on SD Card."));
+      return false;
+    }
+    newFile.write(header, headerLength);
+    if (textHeader) newFile.println();
+    newFile.close();
+  }
+  if (!open()) return false;
+  loadDayIndex(created);
+  return true;
+}
+
+void LogWriter::loadDayIndex(bool created) {
+  if (!dayIndexPath) return;
+  indexedDay = 0;
+  // an index left over from a deleted log points into nothing
+  if (created && fs->exists(dayIndexPath)) fs->remove(dayIndexPath);
+  File index = fs->open(dayIndexPath, FILE_READ);
+  if (!index) return;
+  LogDayIndex last;
+  size_t size = index.size();
+  bool valid = size % sizeof(last) == 0;  // a torn entry from a power cut spoils the rest
+  if (valid && size >= sizeof(last) && index.seek(size - sizeof(last)) &&
+      index.read((uint8_t *)&last, sizeof(last)) == sizeof(last)) {
+    // the log was replaced under us if the index points past its end
+    valid = last.offset <= fileSize;
+    if (valid) indexedDay = last.day;
+  }
+  index.close();
+  if (!valid) fs->remove(dayIndexPath);
+}
+
+void LogWriter::indexDay(uint32_t day) {
+  if (!dayIndexPath || !fs || day <= indexedDay) return;
+  if (xSemaphoreTake(lock, portMAX_DELAY) != pdTRUE) return;
+  LogDayIndex entry = {day, (uint32_t)(fileSize + used)};
+  File index = fs->open(dayIndexPath, FILE_APPEND);
+  if (index) {
+    // once a day, so open and close it each time
+    if (index.write((const uint8_t *)&entry, sizeof(entry)) == sizeof(entry)) indexedDay = day;
+    index.close();
+  }
+  xSemaphoreGive(lock);
+}
+
+bool LogWriter::open() {
+  file = fs->open(filePath, FILE_APPEND);
+  if (!file) {
+    Serial.print(F("SD Card: Issue encountered while attempting to open the file "));
+    Serial.println(filePath);
+    return false;
+  }
+  fileSize = file.size();
+  return true;
+}
+
+bool LogWriter::vprintf(const char *format, va_list args) {
+  if (xSemaphoreTake(lock, portMAX_DELAY) != pdTRUE) return false;
+  int length = vsnprintf(buffer + used, sizeof(buffer) - used, format, args);
+  if (length < 0 || used + length >= sizeof(buffer)) {
+    // buffer full, SD card must be gone. Drop the row rather than block.
+    dropped++;
+    xSemaphoreGive(lock);
+    return false;
+  }
+  if (used == 0) oldestMillis = millis();
+  used += length;
+  xSemaphoreGive(lock);
+  return true;
+}
+
+bool LogWriter::append(const void *data, size_t length) {
+  if (xSemaphoreTake(lock, portMAX_DELAY) != pdTRUE) return false;
+  if (used + length > sizeof(buffer)) {
+    dropped++;
+    xSemaphoreGive(lock);
+    return false;
+  }
+  if (used == 0) oldestMillis = millis();
+  memcpy(buffer + used, data, length);
+  used += length;
+  xSemaphoreGive(lock);
+  return true;
+}
+
+// Write the first count bytes of the buffer and keep the rest
+bool LogWriter::writeOut(size_t count) {
+  if (!file && !open()) return false;
+  size_t done = file.write((const uint8_t *)buffer, count);
+  if (done != count) {
+    // card pulled or full, reopen on the next try
+    file.close();
+    file = File();
+    return false;
+  }
+  written += count;
+  fileSize += count;
+  used -= count;
+  memmove(buffer, buffer + count, used);
+  return true;
+}
+
+void LogWriter::service(unsigned long nowMillis) {
+  if (used == 0) return;
+  if (nowMillis - oldestMillis >= LOG_FLUSH_INTERVAL_MS) {
+    flush();
+    return;
+  }
+  if (used < LOG_BUFFER_SIZE / 2) return;
+  if (xSemaphoreTake(lock, portMAX_DELAY) != pdTRUE) return;
+  // write up to the next sector boundary of the file so every write fills whole sectors
+  size_t count = used - (fileSize + used) % LOG_SECTOR_SIZE;
+  if (count > 0) writeOut(count);
+  xSemaphoreGive(lock);
+}
+
+bool LogWriter::flush() {
+  if (!lock || xSemaphoreTake(lock, pdMS_TO_TICKS(1000)) != pdTRUE) return false;
+  bool ok = true;
+  if (used > 0) ok = writeOut(used);
+  if (ok && file) {
+    file.flush();
+    flushes++;
+  }
+  oldestMillis = millis();
+  xSemaphoreGive(lock);
+  return ok;
+}
+
+void LogWriter::close() {
+  flush();
+  if (file) file.close();
+}
@@ -0,0 +1,137 @@
+#include "MqttOutbox.h"
+
+SdOutboxFiles::SdOutboxFiles(const char *directory)
+    : fs(NULL), dir(directory), writeSegment(0), readSegment(0) {}
+
+void SdOutboxFiles::segmentPath(uint32_t segment, char *path, size_t size) const {
+  snprintf(path, size, "%s/%08u.seg", dir, (unsigned)segment);
+}
+
+void SdOutboxFiles::begin(fs::FS &sd) {
+  fs = &sd;
+  if (!fs->exists(dir)) fs->mkdir(dir);
+}
+
+bool SdOutboxFiles::segments(uint32_t &first, uint32_t &last) {
+  uint32_t low = 0, high = 0;
+  File root = fs->open(dir);
+  if (root) {
+    File entry;
+    while ((entry = root.openNextFile())) {
+      const char *name = strrchr(entry.name(), '/');
+      name = name ? name + 1 : entry.name();
+      uint32_t number = strtoul(name, NULL, 10);
+      if (number > 0 && strstr(name, ".seg")) {
+        if (low == 0 || number < low) low = number;
+        if (number > high) high = number;
+      }
+      entry.close();
+    }
+    root.close();
+  }
+  first = low;
+  last = high;
+  return low != 0;
+}
+
+uint32_t SdOutboxFiles::size(uint32_t segment) {
+  if (segment == writeSegment && writeFile) return writeFile.size();
+  char path[32];
+  segmentPath(segment, path, sizeof(path));
+  File f = fs->open(path, FILE_READ);
+  if (!f) return 0;
+  uint32_t bytes = f.size();
+  f.close();
+  return bytes;
+}
+
+bool SdOutboxFiles::read(uint32_t segment, uint32_t offset, void *data, size_t length) {
+  if (length == 0) return true;
+  if (segment != readSegment || !readFile) {
+    if (readFile) readFile.close();
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    readFile = fs->open(path, FILE_READ);
+    readSegment = readFile ? segment : 0;
+    if (!readFile) return false;
+  }
+  if ((readFile.position() == offset || readFile.seek(offset)) &&
+      readFile.read((uint8_t *)data, length) == length) {
+    return true;
+  }
+  // written by the other handle but not visible yet, reopen next time
+  readFile.close();
+  readFile = File();
+  readSegment = 0;
+  return false;
+}
+
+bool SdOutboxFiles::append(uint32_t segment, const void *data, size_t length) {
+  if (segment != writeSegment || !writeFile) {
+    if (writeFile) writeFile.close();
+    char path[32];
+    segmentPath(segment, path, sizeof(path));
+    writeFile = fs->open(path, FILE_APPEND);
+    writeSegment = writeFile ? segment : 0;
+    if (!writeFile) {
+      Serial.print(F("SD Card: Issue encountered while attempting to open the file "));
+      Serial.println(path);
+      return false;
+    }
+  }
+  if (writeFile.write((const uint8_t *)data, length) != length) {
+    writeFile.close();
+    writeFile = File();
+    writeSegment = 0;
+    return false;
+  }
+  writeFile.flush();  // one write per car, keep it on the card
+  return true;
+}
+
+bool SdOutboxFiles::remove(uint32_t segment) {
+  if (segment == readSegment) {
+    readFile.close();
+    readFile = File();
+    readSegment = 0;
+  }
+  if (segment == writeSegment) {
+    writeFile.close();
+    writeFile = File();
+    writeSegment = 0;
+  }
+  char path[32];
+  segmentPath(segment, path, sizeof(path));
+  return fs->remove(path);
+}
+
+bool SdOutboxFiles::readCursor(void *data, size_t length) {
+  char path[32];
+  snprintf(path, sizeof(path), "%s/cursor", dir);
+  File f = fs->open(path, FILE_READ);
+  if (!f) return false;
+  bool ok = f.read((uint8_t *)data, length) == length;
+  f.close();
+  return ok;
+}
+
+// Written over in place, a reset can't leave it empty the way truncating would
+bool SdOutboxFiles::writeCursor(const void *data, size_t length) {
+  char path[32];
+  snprintf(path, sizeof(path), "%s/cursor", dir);
+  File f = fs->open(path, fs->exists(path) ? "r+" : FILE_WRITE);
+  if (!f) return false;
+  bool ok = f.write((const uint8_t *)data, length) == length;
+  f.close();
+  return ok;
+}
+
+void MqttOutbox::begin(fs::FS &sd) {
+  files.begin(sd);
+  Outbox::begin(&files);
+  if (!empty()) {
+    Serial.print("MQTT outbox: ");
+    Serial.print(pending());
+    Serial.println(" messages waiting from before the restart");
+  }
+}
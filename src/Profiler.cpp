@@ -0,0 +1,83 @@
+#include "Profiler.h"
+
+#if PROFILE_ENABLED
+static const char *stageNames[STAGE_COUNT] = {
+  "edge_latency", "detect", "log_event", "log_service", "wifi_run", "mqtt_connect",
+  "mqtt_loop", "mqtt_publish", "outbox_replay", "time_service", "display",
+  "classify"
+};
+static const char *counterNames[COUNTER_COUNT] = {
+  "loop", "sensing", "logging", "network", "edges"
+};
+static const char *milestoneNames[MILESTONE_COUNT] = {
+  "counting", "first_car", "wifi", "ntp", "mqtt"
+};
+
+LatencyHistogram profileStages[STAGE_COUNT];
+uint32_t profileCounters[COUNTER_COUNT];
+uint32_t profileCyclesPerUs = 240;
+uint32_t profileMilestones[MILESTONE_COUNT];
+
+static uint32_t lastCounters[COUNTER_COUNT];
+static unsigned long lastJsonMillis = 0;
+
+void profileBegin() {
+  profileCyclesPerUs = ESP.getCpuFreqMHz();
+  lastJsonMillis = millis();
+}
+
+void profileReset() {
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) profileStages[stage].reset();
+}
+
+size_t profileJson(char *out, size_t size) {
+  unsigned long now = millis();
+  unsigned long window = now - lastJsonMillis;
+  lastJsonMillis = now;
+  size_t length = 0;
+
+  // appends and keeps length within the buffer
+  #define JSON_APPEND(...) \
+    if (length < size) length += snprintf(out + length, size - length, __VA_ARGS__)
+
+  JSON_APPEND("{\"uptime_ms\":%lu,\"window_ms\":%lu,\"stages\":{", now, window);
+  for (uint8_t stage = 0; stage < STAGE_COUNT; stage++) {
+    const LatencyHistogram &h = profileStages[stage];
+    JSON_APPEND("%s\"%s\":{\"n\":%u,\"min\":%u,\"p50\":%u,\"p99\":%u,\"max\":%u}",
+                stage ? "," : "", stageNames[stage], (unsigned)h.count(), (unsigned)h.min(),
+                (unsigned)h.percentile(50), (unsigned)h.percentile(99), (unsigned)h.max());
+  }
+  JSON_APPEND("},\"per_second\":{");
+  for (uint8_t counter = 0; counter < COUNTER_COUNT; counter++) {
+    uint32_t passes = profileCounters[counter] - lastCounters[counter];
+    lastCounters[counter] += passes;
+    uint32_t rate = window ? (uint64_t)passes * 1000 / window : 0;
+    JSON_APPEND("%s\"%s\":%u", counter ? "," : "", counterNames[counter], (unsigned)rate);
+  }
+  JSON_APPEND("},\"boot_ms\":{");
+  for (uint8_t milestone = 0; milestone < MILESTONE_COUNT; milestone++) {
+    JSON_APPEND("%s\"%s\":", milestone ? "," : "", milestoneNames[milestone]);
+    if (profileMilestones[milestone]) {
+      JSON_APPEND("%u", (unsigned)profileMilestones[milestone]);
+    } else {
+      JSON_APPEND("null");
+    }
+  }
+  JSON_APPEND("}}");
+  #undef JSON_APPEND
+
+  if (length >= size) {
+    // cut short, rather send nothing than broken JSON
+    if (size) out[0] = '\0';
+    return 0;
+  }
+  return length;
+}
+#else
+void profileBegin() {}
+void profileReset() {}
+size_t profileJson(char *out, size_t size) {
+  if (size) snprintf(out, size, "{\"enabled\":false}");
+  return size ? strlen(out) : 0;
+}
+#endif
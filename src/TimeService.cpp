@@ -0,0 +1,113 @@
+#include "TimeService.h"
+
+TimeService::TimeService(RTC_DS3231 &clock)
+    : rtc(clock), anchorLock(portMUX_INITIALIZER_UNLOCKED), anchorUnixtime(0), anchorMicros(0),
+      isLocked(false), lastSecond(0), lastReadMillis(0), lockedMillis(0),
+      temp(0), reads(0), locks(0) {}
+
+uint32_t TimeService::readRtc(uint32_t &readMicros) {
+  uint32_t unixtime = rtc.now().unixtime();
+  readMicros = micros();
+  reads++;
+  return unixtime;
+}
+
+void TimeService::readTemperature() {
+  temp = (rtc.getTemperature() * 9 / 5) + 32;
+}
+
+void TimeService::setAnchor(uint32_t unixtime, uint32_t micros) {
+  portENTER_CRITICAL(&anchorLock);
+  anchorUnixtime = unixtime;
+  anchorMicros = micros;
+  portEXIT_CRITICAL(&anchorLock);
+}
+
+void TimeService::begin() {
+  uint32_t readMicros;
+  uint32_t unixtime = readRtc(readMicros);
+  // good to the second until the tick is found
+  setAnchor(unixtime, readMicros);
+  lastSecond = unixtime;
+  isLocked = false;
+  lastReadMillis = millis();
+  readTemperature();
+}
+
+void TimeService::adjust(const DateTime &time) {
+  rtc.adjust(time);
+  setAnchor(time.unixtime(), micros());
+  unlock();
+}
+
+void TimeService::unlock() {
+  isLocked = false;
+  lastSecond = 0;
+}
+
+uint32_t TimeService::unixtimeAt(uint32_t micros, uint32_t *usOfSecond) {
+  portENTER_CRITICAL(&anchorLock);
+  uint32_t unixtime = anchorUnixtime;
+  uint32_t start = anchorMicros;
+  portEXIT_CRITICAL(&anchorLock);
+
+  // events can be a little older than the anchor, so signed
+  int32_t elapsed = (int32_t)(micros - start);
+  int32_t seconds = elapsed / 1000000;
+  int32_t rest = elapsed % 1000000;
+  if (rest < 0) {
+    seconds--;
+    rest += 1000000;
+  }
+  if (usOfSecond) *usOfSecond = rest;
+  return unixtime + seconds;
+}
+
+void TimeService::service() {
+  unsigned long now = millis();
+  uint32_t readMicros;
+
+  if (!isLocked) {
+    if (now - lastReadMillis < TIME_LOCK_POLL_MS) return;
+    lastReadMillis = now;
+    uint32_t unixtime = readRtc(readMicros);
+    // lastSecond is 0 after unlocking, the first read only tells us which second we're in
+    if (lastSecond != 0 && unixtime != lastSecond) {
+      // the second just started, anchor here
+      setAnchor(unixtime, readMicros);
+      isLocked = true;
+      locks++;
+      lockedMillis = now;
+      // next check half way into a second
+      lastReadMillis = now - TIME_CHECK_MS / 2;
+    }
+    lastSecond = unixtime;
+    return;
+  }
+
+  if (now - lockedMillis >= TIME_RELOCK_MS) {
+    unlock();
+    return;
+  }
+  if (now - lastReadMillis < TIME_CHECK_MS) return;
+  if (now - lastReadMillis >= 2 * TIME_CHECK_MS) {
+    // loop() was held up and we lost track of mid second
+    unlock();
+    return;
+  }
+  lastReadMillis += TIME_CHECK_MS;  // keep the checks mid second
+
+  uint32_t unixtime = readRtc(readMicros);
+  uint32_t expected = unixtimeAt(readMicros);
+  if (unixtime != expected) {
+    // drifted too far or someone set the RTC, find the tick again
+    unlock();
+    if (unixtime + 1 != expected && unixtime != expected + 1) setAnchor(unixtime, readMicros);
+    return;
+  }
+  // move the anchor up by whole seconds so the micros() difference stays small
+  portENTER_CRITICAL(&anchorLock);
+  anchorMicros += (unixtime - anchorUnixtime) * 1000000UL;
+  anchorUnixtime = unixtime;
+  portEXIT_CRITICAL(&anchorLock);
+}
@@ -0,0 +1,348 @@
+/*
+Benchmarks for the hot paths of the gate counter, run on the PC.
+
+  pio run -e bench
+  .pio/build/bench/program --baseline src/host/bench/baseline.csv
+  .pio/build/bench/program --trace SensorBounces.csv GateCount.csv
+  .pio/build/bench/program --save src/host/bench/baseline.csv
+
+  detect_*     GateDetector alone, per edge (synthetic traffic, --trace a log)
+  sense_*      what the sensing task does per edge, GateApp::sensingPass() on
+               the sim's HAL (src/host/sim/SimHal.h)
+  csv_*        one GateCount.csv or SensorBounces.csv row (EventFormat.h)
+  bin_record   one GateLog.bin record, the same events as csv_*
+  mqtt_*       one entry of the events topic JSON (EventFormat.h)
+
+Every benchmark runs --rounds times and the fastest round counts, in ns per
+edge, row or message. With --baseline each result is compared to the
+stored one and anything more than --tolerance percent slower is a
+regression, the exit code is then 1. The numbers only compare on the same
+machine, --save writes a new baseline after a change that is meant to be
+slower or when the machine changes.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "EventFormat.h"
+#include "GateApp.h"
+#include "GateDetector.h"
+#include "SimHal.h"
+#include "TraceFile.h"
+
+#define MAX_RESULTS 16
+#define ROUND_SECONDS 0.05  // a round repeats the work for at least this long
+#define RETRIES 2           // a benchmark that looks slower is run again this often before it counts
+
+static void usage() {
+  fprintf(stderr,
+          "usage: bench [options]\n"
+          "  --trace file [GateCount.csv]  also time the detector on a recorded trace\n"
+          "  --cars n          synthetic cars (default 20000)\n"
+          "  --rounds n        runs of each benchmark, the fastest counts (default 5)\n"
+          "  --baseline file   compare with a stored baseline\n"
+          "  --tolerance pct   slower than the baseline by more than this is a regression (default 25)\n"
+          "  --save file       write the results as the new baseline\n");
+}
+
+typedef uint32_t (*BenchFunction)(const void *data);  // returns operations done
+
+struct Result {
+  const char *name;
+  BenchFunction function;
+  const void *data;
+  double ns;      // per operation, fastest round
+  double perSecond;
+};
+
+static Result results[MAX_RESULTS];
+static size_t resultCount = 0;
+static uint32_t rounds = 5;
+static volatile uint32_t sink;  // keeps the work from being optimised away
+
+// ns per operation of the fastest of the rounds
+static double timeRounds(BenchFunction function, const void *data) {
+  double best = 0;
+  function(data);  // warm up the caches
+  for (uint32_t r = 0; r < rounds; r++) {
+    std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+    double seconds = 0;
+    uint64_t ops = 0;
+    while (seconds < ROUND_SECONDS) {
+      ops += function(data);
+      seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    }
+    double ns = ops ? seconds * 1e9 / ops : 0;
+    if (r == 0 || ns < best) best = ns;
+  }
+  return best;
+}
+
+static void bench(const char *name, BenchFunction function, const void *data) {
+  if (resultCount == MAX_RESULTS) return;
+  Result &result = results[resultCount++];
+  result.name = name;
+  result.function = function;
+  result.data = data;
+  result.ns = timeRounds(function, data);
+  result.perSecond = result.ns > 0 ? 1e9 / result.ns : 0;
+}
+
+//###############################################################################################################
+// Detection
+
+static uint32_t detect(const void *data) {
+  const Trace &trace = *(const Trace *)data;
+  GateDetector detector;
+  detector.reset();
+  for (size_t i = 0; i < trace.edges.size(); i++) {
+    if (trace.edges[i].input == 0) detector.onEdge(trace.edges[i].micros, trace.edges[i].level);
+  }
+  sink += detector.carsCounted();
+  return trace.edges.size();
+}
+
+// What the sensing task runs, GateApp::sensingPass() in src/GateApp.cpp, on the sim's HAL.
+// A pass per edge, the way the edge interrupt wakes the task, with the queues drained after it.
+static uint32_t sense(const void *data) {
+  const std::vector<SimEdge> &script = *(const std::vector<SimEdge> *)data;
+  SimClock clock(1714842131, 71);
+  ScriptedSensors sensors(clock);
+  sensors.load(script);
+  RingQueue<GateEvent, 64> logQueue;
+  RingQueue<GateEvent, 16> netQueue;
+  RingQueue<GateCommand, 8> commandQueue;
+  GateHal hal = {&clock, &sensors, NULL, NULL, NULL, NULL, NULL, NULL, NULL, NULL, &logQueue, &netQueue, &commandQueue};
+  GateApp *gate = new GateApp(hal);  // too big for the stack
+  DetectorConfig config = DETECTOR_PROFILE_CONFIG(GATE_PROFILE);
+  gate->sensingBegin(config);
+  GateEvent event;
+  while (!sensors.done()) {
+    clock.set(sensors.nextUs());
+    gate->sensingPass();
+    while (logQueue.receive(event, 0)) sink += event.type;
+    while (netQueue.receive(event, 0)) sink += event.type;
+  }
+  sink += gate->dailyCars();
+  delete gate;
+  return script.size();
+}
+
+//###############################################################################################################
+// Logging and MQTT, on GateEvents made from a detector run
+
+struct EventSet {
+  std::vector<GateEvent> bounces;  // CAR_START and BOUNCE
+  std::vector<GateEvent> cars;     // CAR_COUNTED and TIMEOUT
+  std::vector<GateEvent> corrections;
+};
+
+static void onFormatEvent(const DetectorEvent &event, void *context) {
+  EventSet &set = *(EventSet *)context;
+  GateEvent gateEvent;
+  memset(&gateEvent, 0, sizeof(gateEvent));
+  static const uint8_t types[] = {GATE_CAR_START, GATE_BOUNCE, GATE_CAR_COUNTED, GATE_TIMEOUT};
+  gateEvent.type = types[event.type];
+  gateEvent.level = event.level;
+  gateEvent.bounces = event.bounces;
+  gateEvent.carNumber = set.cars.size() + 1;
+  gateEvent.carsInPark = 250 - (int32_t)(set.cars.size() % 250);
+  gateEvent.temp = 71;
+  gateEvent.passMs = event.passMs;
+  gateEvent.lastHighMs = event.lastHighMs;
+  gateEvent.noCarMs = event.noCarMs;
+  gateEvent.lowMs = event.lowMs;
+  gateEvent.lastLowMs = event.lastLowMs;
+  gateEvent.carDetectedMillis = event.carStartUs / 1000;
+  gateEvent.millis = event.micros / 1000;
+  gateEvent.micros = event.micros;
+  gateEvent.unixtime = 1714842131 + event.micros / 1000000;
+  uint32_t seconds = gateEvent.unixtime % 86400;
+  snprintf(gateEvent.timestamp, sizeof(gateEvent.timestamp), "2024-05-04 %02u:%02u:%02u", seconds / 3600,
+           seconds / 60 % 60, seconds % 60);
+  gateEvent.seq = set.cars.size() + 1;
+  gateEvent.vehicle = (uint8_t)(gateEvent.seq % PASS_CLASSES);
+  if (event.type == DETECTOR_CAR_COUNTED || event.type == DETECTOR_TIMEOUT) {
+    set.cars.push_back(gateEvent);
+    gateEvent.type = (gateEvent.seq % 8) ? GATE_COUNT_CONFIRMED : GATE_COUNT_RETRACTED;
+    gateEvent.reason = (gateEvent.seq % 8) ? COUNT_REASON_SETTLED : COUNT_REASON_REVERSAL;
+    set.corrections.push_back(gateEvent);
+  } else {
+    set.bounces.push_back(gateEvent);
+  }
+}
+
+static uint32_t csvRows(const std::vector<GateEvent> &events, bool car) {
+  char row[256];
+  for (size_t i = 0; i < events.size(); i++) {
+    const GateEvent &event = events[i];
+    sink += car ? snprintf(row, sizeof(row), GATE_COUNT_ROW_FORMAT, GATE_COUNT_ROW_ARGS(event, 0))
+                : snprintf(row, sizeof(row), BOUNCE_ROW_FORMAT, BOUNCE_ROW_ARGS(event));
+  }
+  return events.size();
+}
+
+static uint32_t csvCar(const void *data) { return csvRows(((const EventSet *)data)->cars, true); }
+static uint32_t csvBounce(const void *data) { return csvRows(((const EventSet *)data)->bounces, false); }
+
+// Same as GateApp::recordBinary in src/GateApp.cpp, without the SD card
+static uint32_t binRecord(const void *data) {
+  const EventSet &set = *(const EventSet *)data;
+  BinLogEncoder encoder;
+  BinLogRecord record;
+  const std::vector<GateEvent> *lists[] = {&set.bounces, &set.cars};
+  uint32_t ops = 0;
+  for (size_t l = 0; l < 2; l++) {
+    encoder.restart();
+    const std::vector<GateEvent> &events = *lists[l];
+    for (size_t i = 0; i < events.size(); i++) {
+      const GateEvent &event = events[i];
+      if (encoder.needsSync(event.micros)) encoder.sync(record, event.micros, event.unixtime, event.temp);
+      binLogEventRecord(record, event);
+      encoder.stamp(record, event.micros);
+      sink += record.deltaUs;
+    }
+    ops += events.size();
+  }
+  return ops;
+}
+
+static uint32_t jsonEvents(const std::vector<GateEvent> &events) {
+  char json[256];
+  for (size_t i = 0; i < events.size(); i++) sink += formatEventJson(json, sizeof(json), events[i]);
+  return events.size();
+}
+
+static uint32_t mqttCar(const void *data) { return jsonEvents(((const EventSet *)data)->cars); }
+static uint32_t mqttCorrection(const void *data) { return jsonEvents(((const EventSet *)data)->corrections); }
+
+//###############################################################################################################
+// Baseline
+
+static bool saveBaseline(const char *path) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "can't write %s\n", path);
+    return false;
+  }
+  fprintf(f, "# ns per edge, row or message, written by the bench host tool (src/host/bench)\n");
+  fprintf(f, "benchmark,ns\n");
+  for (size_t i = 0; i < resultCount; i++) fprintf(f, "%s,%.1f\n", results[i].name, results[i].ns);
+  fclose(f);
+  return true;
+}
+
+// Missing benchmarks are left out of the comparison, false if the file can't be read
+static bool loadBaseline(const char *path, double *baseline) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "can't open %s\n", path);
+    return false;
+  }
+  for (size_t i = 0; i < resultCount; i++) baseline[i] = 0;
+  char line[128];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#') continue;
+    char *comma = strchr(line, ',');
+    if (!comma) continue;
+    *comma = '\0';
+    double ns = strtod(comma + 1, NULL);
+    for (size_t i = 0; i < resultCount; i++) {
+      if (strcmp(line, results[i].name) == 0) baseline[i] = ns;
+    }
+  }
+  fclose(f);
+  return true;
+}
+
+int main(int argc, char **argv) {
+  uint32_t cars = 20000;
+  double tolerance = 25;
+  const char *tracePath = NULL;
+  const char *gateCountPath = NULL;
+  const char *baselinePath = NULL;
+  const char *savePath = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--trace") == 0 && hasValue) {
+      tracePath = argv[++i];
+      if (i + 1 < argc && argv[i + 1][0] != '-') gateCountPath = argv[++i];
+    } else if (strcmp(arg, "--cars") == 0 && hasValue) {
+      cars = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--rounds") == 0 && hasValue) {
+      rounds = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--baseline") == 0 && hasValue) {
+      baselinePath = argv[++i];
+    } else if (strcmp(arg, "--tolerance") == 0 && hasValue) {
+      tolerance = strtod(argv[++i], NULL);
+    } else if (strcmp(arg, "--save") == 0 && hasValue) {
+      savePath = argv[++i];
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (!rounds) rounds = 1;
+
+  Trace synthetic;
+  makeSyntheticTrace(cars, 1, synthetic);
+  bench("detect_synthetic", detect, &synthetic);
+  std::vector<SimEdge> script;
+  scriptFromTrace(synthetic, 5000000, script);
+  bench("sense_synthetic", sense, &script);
+  Trace recorded;
+  if (tracePath) {
+    if (!loadTrace(tracePath, gateCountPath, recorded)) return 1;
+    bench("detect_trace", detect, &recorded);
+    scriptFromTrace(recorded, 5000000, script);
+    bench("sense_trace", sense, &script);
+  }
+
+  EventSet events;
+  GateDetector detector;
+  detector.setListener(onFormatEvent, &events);
+  detector.reset();
+  for (size_t i = 0; i < synthetic.edges.size(); i++) detector.onEdge(synthetic.edges[i].micros, synthetic.edges[i].level);
+  bench("csv_car_row", csvCar, &events);
+  bench("csv_bounce_row", csvBounce, &events);
+  bench("bin_record", binRecord, &events);
+  bench("mqtt_car_event", mqttCar, &events);
+  bench("mqtt_correction", mqttCorrection, &events);
+
+  double baseline[MAX_RESULTS];
+  bool compare = baselinePath && loadBaseline(baselinePath, baseline);
+  if (baselinePath && !compare) return 1;
+  uint32_t regressions = 0;
+  printf("%-18s %10s %14s", "benchmark", "ns", "per second");
+  if (compare) printf(" %10s %8s", "baseline", "change");
+  printf("\n");
+  for (size_t i = 0; i < resultCount; i++) {
+    Result &r = results[i];
+    // other programs on the PC can slow a run down, it has to be slower every time
+    for (uint32_t retry = 0; compare && baseline[i] > 0 && retry < RETRIES && r.ns > baseline[i] * (1 + tolerance / 100); retry++) {
+      double ns = timeRounds(r.function, r.data);
+      if (ns < r.ns) r.ns = ns;
+      r.perSecond = 1e9 / r.ns;
+    }
+    printf("%-18s %10.1f %14.0f", r.name, r.ns, r.perSecond);
+    if (compare && baseline[i] > 0) {
+      double change = 100.0 * (r.ns - baseline[i]) / baseline[i];
+      bool slower = change > tolerance;
+      regressions += slower;
+      printf(" %10.1f %+7.1f%%%s", baseline[i], change, slower ? "  REGRESSION" : "");
+    } else if (compare) {
+      printf(" %10s", "-");
+    }
+    printf("\n");
+  }
+  if (savePath && !saveBaseline(savePath)) return 1;
+  if (regressions) {
+    fflush(stdout);
+    fprintf(stderr, "%u benchmark(s) more than %.0f%% slower than %s\n", regressions, tolerance, baselinePath);
+    return 1;
+  }
+  return 0;
+}
@@ -0,0 +1,461 @@
+/*
+Train and check the pass classifier (lib/GateCore/src/PassClassifier.h) on the PC.
+
+  pio run -e classify
+  .pio/build/classify/program --synthetic 5000
+  .pio/build/classify/program --synthetic 5000 --emit lib/GateCore/src/PassTree.h
+  .pio/build/classify/program --labels labels.txt SensorBounces.csv GateCount.csv
+  .pio/build/classify/program --check --labels labels.txt SensorBounces.csv GateCount.csv
+
+The trace goes through the GateDetector with the default thresholds and
+the PassFeatureExtractor, wired the same way as the firmware, so the tree
+learns from the features the gate will really see. Every counted car needs
+a label:
+  --synthetic  made up vehicles with known labels, tested on a second set
+               made with the next seed
+  --labels     a text file with one label per counted car of the trace, in
+               order (car, trailer, bus, noise, or - to leave a car out),
+               e.g. written while watching the camera. Every 4th car is
+               kept back to test the tree.
+It prints the confusion table on the test passes and the time one pass
+takes to classify. --emit writes the tree as PassTree.h for the firmware,
+--check tests the tree that is compiled in instead of training one.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <chrono>
+#include <vector>
+
+#include "GateDetector.h"
+#include "PassClassifier.h"
+#include "PassFeatures.h"
+#include "PassTree.h"  // the tree the firmware has, for --check
+#include "TraceFile.h"
+
+#define MAX_DEPTH 7  // node indexes are a byte
+
+static void usage() {
+  fprintf(stderr,
+          "usage: classify [options] --labels <labels.txt> <trace.csv> [GateCount.csv]\n"
+          "       classify [options] --synthetic <vehicles>\n"
+          "  --seed n      seed for --synthetic\n"
+          "  --depth n     deepest the tree may go (default 5, at most 7)\n"
+          "  --leaf n      fewest passes in a leaf (default 5)\n"
+          "  --check       test the compiled in tree (PassTree.h), don't train\n"
+          "  --emit file   write the trained tree as PassTree.h\n");
+}
+
+static const char *featureEnums[PASS_FEATURES] = {
+    "FEATURE_PULSES",         "FEATURE_DURATION_MS", "FEATURE_DUTY_Q8",     "FEATURE_LONGEST_LOW_MS",
+    "FEATURE_LONGEST_GAP_MS", "FEATURE_GAPS_SHORT",  "FEATURE_GAPS_MEDIUM", "FEATURE_GAPS_LONG"};
+static const char *classEnums[PASS_CLASSES] = {"PASS_CAR", "PASS_TRAILER", "PASS_BUS", "PASS_NOISE"};
+
+struct Sample {
+  PassFeatures features;
+  uint32_t startUs;
+  uint8_t label;
+};
+
+//###############################################################################################################
+// Features of every counted car, the same calls as the sensing task
+
+struct Collector {
+  PassFeatureExtractor extractor;
+  std::vector<Sample> passes;
+};
+
+static void onDetectorEvent(const DetectorEvent &event, void *context) {
+  Collector &c = *(Collector *)context;
+  Sample sample;
+  if (event.type == DETECTOR_CAR_START) c.extractor.begin(event.carStartUs);
+  if (event.type == DETECTOR_TIMEOUT) c.extractor.finish(event.micros, sample.features);
+  if (event.type != DETECTOR_CAR_COUNTED) return;
+  if (!c.extractor.finish(event.micros, sample.features)) return;
+  sample.startUs = event.carStartUs;
+  sample.label = PASS_CLASSES;
+  c.passes.push_back(sample);
+}
+
+static void collect(const Trace &trace, std::vector<Sample> &passes) {
+  GateDetector detector;
+  Collector c;
+  detector.setListener(onDetectorEvent, &c);
+  detector.reset();
+  for (size_t i = 0; i < trace.edges.size(); i++) {
+    const SensorEdge &e = trace.edges[i];
+    if (e.input != 0) continue;
+    detector.onEdge(e.micros, e.level);
+    c.extractor.onEdge(e.micros, e.level);
+  }
+  if (!trace.edges.empty()) detector.poll(trace.edges.back().micros + 20000000U);
+  passes.swap(c.passes);
+}
+
+//###############################################################################################################
+// Made up vehicles, one magnetometer pass each, far enough apart to never run together
+
+struct Vehicle {
+  uint32_t startUs;
+  uint32_t endUs;
+  uint8_t label;
+};
+
+static void edge(Trace &trace, uint32_t micros, uint8_t level) {
+  SensorEdge e;
+  memset(&e, 0, sizeof(e));
+  e.micros = micros;
+  e.level = level;
+  trace.edges.push_back(e);
+}
+
+// LOW pulses of lowMin..lowMax ms with HIGH gaps of gapMin..gapMax ms, returns the time after the last
+static uint32_t pulses(Trace &trace, uint32_t &state, uint32_t t, uint32_t count, uint32_t lowMin,
+                       uint32_t lowMax, uint32_t gapMin, uint32_t gapMax) {
+  for (uint32_t p = 0; p < count; p++) {
+    if (p) t += traceRandom(state, gapMin, gapMax) * 1000U;
+    edge(trace, t, SENSOR_LOW);
+    t += traceRandom(state, lowMin, lowMax) * 1000U;
+    edge(trace, t, SENSOR_HIGH);
+  }
+  return t;
+}
+
+static void makeVehicles(uint32_t count, uint32_t seed, Trace &trace, std::vector<Vehicle> &vehicles) {
+  trace.edges.clear();
+  trace.loggedCars = 0;
+  trace.loggedTimeouts = 0;
+  vehicles.clear();
+  uint32_t state = seed ? seed : 1;
+  uint32_t t = 1000000;
+  for (uint32_t v = 0; v < count; v++) {
+    uint32_t pick = traceRandom(state, 0, 99);
+    Vehicle vehicle;
+    vehicle.startUs = t;
+    if (pick < 60) {
+      // car, the odd slow one with a long bounce in it
+      vehicle.label = PASS_CAR;
+      t = pulses(trace, state, t, traceRandom(state, 2, 9), 20, pick < 5 ? 700 : 450, 15, pick < 10 ? 400 : 250);
+    } else if (pick < 78) {
+      // car, the hitch (a long gap) and the trailer bouncing on its own
+      vehicle.label = PASS_TRAILER;
+      t = pulses(trace, state, t, traceRandom(state, 2, 8), 20, 450, 15, 250);
+      t += traceRandom(state, 280, 800) * 1000U;
+      t = pulses(trace, state, t, traceRandom(state, 1, 4), 30, 350, 15, 250);
+    } else if (pick < 88) {
+      // long body over the coil, long LOWs
+      vehicle.label = PASS_BUS;
+      t = pulses(trace, state, t, traceRandom(state, 3, 9), 300, 1500, 15, 300);
+    } else {
+      // a person with keys, a bike or interference, quick spikes
+      vehicle.label = PASS_NOISE;
+      t = pulses(trace, state, t, traceRandom(state, 2, 4), 2, 40, 5, 500);
+    }
+    vehicle.endUs = t;
+    vehicles.push_back(vehicle);
+    t += traceRandom(state, 3000, 15000) * 1000U;
+  }
+}
+
+// A counted car gets the label of the vehicle it started in. Both are in
+// time order and micros wraps on a long run, so compare differences.
+static void labelFromVehicles(std::vector<Sample> &passes, const std::vector<Vehicle> &vehicles) {
+  size_t v = 0;
+  for (size_t i = 0; i < passes.size(); i++) {
+    uint32_t start = passes[i].startUs;
+    while (v < vehicles.size() && (int32_t)(start - vehicles[v].endUs) > 0) v++;
+    if (v < vehicles.size() && (int32_t)(start - vehicles[v].startUs) >= 0) passes[i].label = vehicles[v].label;
+  }
+}
+
+//###############################################################################################################
+// Labels written by hand, one per counted car
+
+static bool labelFromFile(const char *path, std::vector<Sample> &passes) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "can't open %s\n", path);
+    return false;
+  }
+  char line[64];
+  size_t i = 0;
+  int lineNumber = 0;
+  bool ok = true;
+  while (fgets(line, sizeof(line), f)) {
+    lineNumber++;
+    line[strcspn(line, " \t\r\n#")] = '\0';
+    if (line[0] == '\0') continue;
+    if (i >= passes.size()) {
+      fprintf(stderr, "%s: more labels than the %zu counted cars\n", path, passes.size());
+      ok = false;
+      break;
+    }
+    uint8_t label = strcmp(line, "-") == 0 ? PASS_CLASSES : passClassFromName(line);
+    if (label == PASS_CLASSES && strcmp(line, "-") != 0) {
+      fprintf(stderr, "%s:%d: unknown label %s\n", path, lineNumber, line);
+      ok = false;
+      break;
+    }
+    passes[i++].label = label;
+  }
+  fclose(f);
+  if (ok && i < passes.size()) fprintf(stderr, "%s: only %zu labels for %zu counted cars\n", path, i, passes.size());
+  return ok;
+}
+
+//###############################################################################################################
+// Decision tree, split on the feature and threshold that leaves the purest halves (Gini)
+
+struct TreeBuilder {
+  std::vector<PassTreeNode> nodes;
+  uint32_t maxDepth;
+  uint32_t minLeaf;
+};
+
+static double gini(const uint32_t *counts, uint32_t total) {
+  if (!total) return 0;
+  double impurity = 1;
+  for (uint8_t c = 0; c < PASS_CLASSES; c++) {
+    double p = (double)counts[c] / total;
+    impurity -= p * p;
+  }
+  return impurity;
+}
+
+static uint8_t majority(const std::vector<const Sample *> &set) {
+  uint32_t counts[PASS_CLASSES] = {0};
+  for (size_t i = 0; i < set.size(); i++) counts[set[i]->label]++;
+  uint8_t best = 0;
+  for (uint8_t c = 1; c < PASS_CLASSES; c++) {
+    if (counts[c] > counts[best]) best = c;
+  }
+  return best;
+}
+
+static uint8_t build(TreeBuilder &tree, std::vector<const Sample *> &set, uint32_t depth) {
+  uint8_t index = tree.nodes.size();
+  PassTreeNode node;
+  memset(&node, 0, sizeof(node));
+  node.feature = -1;
+  node.label = majority(set);
+  tree.nodes.push_back(node);
+
+  uint32_t total[PASS_CLASSES] = {0};
+  for (size_t i = 0; i < set.size(); i++) total[set[i]->label]++;
+  double parent = gini(total, set.size());
+  if (depth >= tree.maxDepth || parent == 0 || set.size() < 2 * tree.minLeaf) return index;
+
+  double bestScore = parent;
+  int bestFeature = -1;
+  int32_t bestThreshold = 0;
+  for (uint8_t f = 0; f < PASS_FEATURES; f++) {
+    std::sort(set.begin(), set.end(), [f](const Sample *a, const Sample *b) {
+      return a->features.value[f] < b->features.value[f];
+    });
+    uint32_t below[PASS_CLASSES] = {0};
+    uint32_t above[PASS_CLASSES];
+    memcpy(above, total, sizeof(above));
+    for (size_t i = 0; i + 1 < set.size(); i++) {
+      below[set[i]->label]++;
+      above[set[i]->label]--;
+      int32_t value = set[i]->features.value[f];
+      if (value == set[i + 1]->features.value[f]) continue;
+      uint32_t left = i + 1, right = set.size() - left;
+      if (left < tree.minLeaf || right < tree.minLeaf) continue;
+      double score = (gini(below, left) * left + gini(above, right) * right) / set.size();
+      if (score < bestScore - 1e-9) {
+        bestScore = score;
+        bestFeature = f;
+        // halfway, so a pass between the two seen values goes to the nearer side
+        bestThreshold = value + (set[i + 1]->features.value[f] - value) / 2;
+      }
+    }
+  }
+  if (bestFeature < 0) return index;
+
+  std::vector<const Sample *> low, high;
+  for (size_t i = 0; i < set.size(); i++) {
+    (set[i]->features.value[bestFeature] <= bestThreshold ? low : high).push_back(set[i]);
+  }
+  uint8_t below = build(tree, low, depth + 1);
+  uint8_t above = build(tree, high, depth + 1);
+  // both halves ended up the same, a leaf does as well
+  const PassTreeNode &b = tree.nodes[below], &a = tree.nodes[above];
+  if (b.feature < 0 && a.feature < 0 && b.label == a.label) {
+    tree.nodes.resize(index + 1);
+    return index;
+  }
+  PassTreeNode &n = tree.nodes[index];
+  n.feature = bestFeature;
+  n.threshold = bestThreshold;
+  n.below = below;
+  n.above = above;
+  return index;
+}
+
+static uint32_t treeDepth(const PassTreeNode *tree, uint8_t index) {
+  const PassTreeNode &n = tree[index];
+  if (n.feature < 0) return 0;
+  return 1 + std::max(treeDepth(tree, n.below), treeDepth(tree, n.above));
+}
+
+static bool emitTree(const char *path, const std::vector<PassTreeNode> &nodes, size_t trained,
+                     const char *source) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "can't write %s\n", path);
+    return false;
+  }
+  fprintf(f, "// Written by the classify host tool, don't edit (see PassClassifier.h)\n");
+  fprintf(f, "// Trained on %zu passes from %s\n", trained, source);
+  fprintf(f, "#ifndef PASS_TREE_H\n#define PASS_TREE_H\n\n#include \"PassClassifier.h\"\n\n");
+  fprintf(f, "#define PASS_TREE_DEPTH %u\n\n", treeDepth(nodes.data(), 0));
+  fprintf(f, "static const PassTreeNode passTree[] = {\n");
+  for (size_t i = 0; i < nodes.size(); i++) {
+    const PassTreeNode &n = nodes[i];
+    if (n.feature < 0) {
+      fprintf(f, "  {-1, 0, 0, %s, 0},  // %zu\n", classEnums[n.label], i);
+    } else {
+      fprintf(f, "  {%s, %u, %u, %s, %d},  // %zu\n", featureEnums[n.feature], n.below, n.above,
+              classEnums[n.label], n.threshold, i);
+    }
+  }
+  fprintf(f, "};\n\n#endif\n");
+  fclose(f);
+  return true;
+}
+
+//###############################################################################################################
+
+static void report(const PassTreeNode *tree, const std::vector<Sample> &test) {
+  uint32_t table[PASS_CLASSES][PASS_CLASSES];
+  memset(table, 0, sizeof(table));
+  uint32_t right = 0;
+  for (size_t i = 0; i < test.size(); i++) {
+    uint8_t got = classifyPass(tree, test[i].features);
+    table[test[i].label][got]++;
+    right += got == test[i].label;
+  }
+  printf("%-8s", "truth");
+  for (uint8_t c = 0; c < PASS_CLASSES; c++) printf("%9s", passClassName(c));
+  printf("%9s\n", "right");
+  for (uint8_t t = 0; t < PASS_CLASSES; t++) {
+    uint32_t n = 0;
+    printf("%-8s", passClassName(t));
+    for (uint8_t c = 0; c < PASS_CLASSES; c++) {
+      printf("%9u", table[t][c]);
+      n += table[t][c];
+    }
+    printf("%8.1f%%\n", n ? 100.0 * table[t][t] / n : 0.0);
+  }
+  printf("%zu test passes, %.1f%% right\n", test.size(), test.empty() ? 0.0 : 100.0 * right / test.size());
+
+  if (test.empty()) return;
+  volatile uint32_t sink = 0;
+  uint32_t rounds = 2000000 / test.size() + 1;
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (uint32_t r = 0; r < rounds; r++) {
+    for (size_t i = 0; i < test.size(); i++) sink += classifyPass(tree, test[i].features);
+  }
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  printf("%.1f ns to classify a pass on this PC, depth %u\n", seconds * 1e9 / (rounds * test.size()),
+         treeDepth(tree, 0));
+}
+
+// Drop the cars without a label
+static void keepLabelled(std::vector<Sample> &passes) {
+  size_t kept = 0;
+  for (size_t i = 0; i < passes.size(); i++) {
+    if (passes[i].label < PASS_CLASSES) passes[kept++] = passes[i];
+  }
+  passes.resize(kept);
+}
+
+int main(int argc, char **argv) {
+  uint32_t synthetic = 0;
+  uint32_t seed = 1;
+  TreeBuilder tree;
+  tree.maxDepth = 5;
+  tree.minLeaf = 5;
+  bool check = false;
+  const char *labelsPath = NULL;
+  const char *emitPath = NULL;
+  const char *path = NULL;
+  const char *gateCountPath = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--synthetic") == 0 && hasValue) {
+      synthetic = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--depth") == 0 && hasValue) {
+      tree.maxDepth = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--leaf") == 0 && hasValue) {
+      tree.minLeaf = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--labels") == 0 && hasValue) {
+      labelsPath = argv[++i];
+    } else if (strcmp(arg, "--emit") == 0 && hasValue) {
+      emitPath = argv[++i];
+    } else if (strcmp(arg, "--check") == 0) {
+      check = true;
+    } else if (arg[0] != '-' && !path) {
+      path = arg;
+    } else if (arg[0] != '-' && !gateCountPath) {
+      gateCountPath = arg;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (tree.maxDepth > MAX_DEPTH) tree.maxDepth = MAX_DEPTH;
+  if (!tree.minLeaf) tree.minLeaf = 1;
+
+  std::vector<Sample> train, test;
+  char source[128];
+  if (synthetic) {
+    Trace trace;
+    std::vector<Vehicle> vehicles;
+    makeVehicles(synthetic, seed, trace, vehicles);
+    collect(trace, train);
+    labelFromVehicles(train, vehicles);
+    makeVehicles(synthetic, seed + 1, trace, vehicles);
+    collect(trace, test);
+    labelFromVehicles(test, vehicles);
+    snprintf(source, sizeof(source), "%u synthetic vehicles, seed %u", synthetic, seed);
+  } else {
+    if (!path || !labelsPath) {
+      usage();
+      return 1;
+    }
+    Trace trace;
+    std::vector<Sample> passes;
+    if (!loadTrace(path, gateCountPath, trace)) return 1;
+    collect(trace, passes);
+    if (!labelFromFile(labelsPath, passes)) return 1;
+    keepLabelled(passes);
+    for (size_t i = 0; i < passes.size(); i++) (i % 4 == 3 ? test : train).push_back(passes[i]);
+    snprintf(source, sizeof(source), "%s", path);
+  }
+  keepLabelled(train);
+  keepLabelled(test);
+
+  if (check) {
+    // nothing was trained on the labelled passes, so all of them can test it
+    if (!synthetic) test.insert(test.end(), train.begin(), train.end());
+    report(passTree, test);
+    return 0;
+  }
+  std::vector<const Sample *> set;
+  for (size_t i = 0; i < train.size(); i++) set.push_back(&train[i]);
+  if (set.empty()) {
+    fprintf(stderr, "no labelled passes to train on\n");
+    return 1;
+  }
+  build(tree, set, 0);
+  printf("%zu training passes, %zu nodes\n", train.size(), tree.nodes.size());
+  report(tree.nodes.data(), test);
+  if (emitPath && !emitTree(emitPath, tree.nodes, train.size(), source)) return 1;
+  return 0;
+}
@@ -0,0 +1,41 @@
+#include "BinLogFile.h"
+
+#include <stdio.h>
+
+static const size_t READ_RECORDS = 4096;
+
+bool isBinLog(const char *path) {
+  FILE *f = fopen(path, "rb");
+  if (!f) return false;
+  BinLogHeader header;
+  bool ok = fread(&header, sizeof(header), 1, f) == 1 && binLogHeaderValid(header);
+  fclose(f);
+  return ok;
+}
+
+bool readBinLog(const char *path, BinLogVisitor visitor, void *context) {
+  FILE *f = fopen(path, "rb");
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return false;
+  }
+  BinLogHeader header;
+  if (fread(&header, sizeof(header), 1, f) != 1 || !binLogHeaderValid(header)) {
+    fprintf(stderr, "%s is not a gate log (bad magic or version)\n", path);
+    fclose(f);
+    return false;
+  }
+  static BinLogRecord records[READ_RECORDS];
+  BinLogDecoder decoder;
+  BinLogTime time;
+  size_t count;
+  bool going = true;
+  while (going && (count = fread(records, sizeof(BinLogRecord), READ_RECORDS, f)) > 0) {
+    for (size_t i = 0; i < count && going; i++) {
+      decoder.decode(records[i], time);
+      going = visitor(records[i], time, context);
+    }
+  }
+  fclose(f);
+  return true;
+}
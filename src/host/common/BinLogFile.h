@@ -0,0 +1,16 @@
+/*
+Read GateLog.bin on the PC, see lib/GateCore/src/BinLog.h for the format.
+*/
+#ifndef BIN_LOG_FILE_H
+#define BIN_LOG_FILE_H
+
+#include "BinLog.h"
+
+// Called for every record with its absolute time, return false to stop
+typedef bool (*BinLogVisitor)(const BinLogRecord &record, const BinLogTime &time, void *context);
+
+// Returns false if the file can't be read or is not a GateLog.bin
+bool readBinLog(const char *path, BinLogVisitor visitor, void *context);
+bool isBinLog(const char *path);
+
+#endif
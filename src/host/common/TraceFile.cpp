@@ -0,0 +1,268 @@
+#include "TraceFile.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <map>
+
+#include "BinLogFile.h"
+#include "GateDetector.h"
+
+static const int MAX_FIELDS = 16;
+
+// Split a CSV line in place, returns number of fields
+static int splitCsv(char *line, char *fields[], int maxFields) {
+  int n = 0;
+  char *p = line;
+  while (n < maxFields) {
+    while (*p == ' ' || *p == '\t') p++;
+    fields[n++] = p;
+    char *comma = strchr(p, ',');
+    if (!comma) break;
+    *comma = 0;
+    p = comma + 1;
+  }
+  return n;
+}
+
+static void pushEdge(Trace &trace, uint32_t micros, uint8_t level, uint8_t input = 0) {
+  SensorEdge edge;
+  memset(&edge, 0, sizeof(edge));
+  edge.micros = micros;
+  edge.level = level;
+  edge.input = input;
+  trace.edges.push_back(edge);
+}
+
+static bool loadEdgeFile(FILE *f, Trace &trace) {
+  char line[256];
+  while (fgets(line, sizeof(line), f)) {
+    if (line[0] == '#' || line[0] == '\n' || line[0] == '\r') continue;
+    char *fields[MAX_FIELDS];
+    int count = splitCsv(line, fields, MAX_FIELDS);
+    if (count < 2) continue;
+    char *end;
+    unsigned long micros = strtoul(fields[0], &end, 10);
+    if (end == fields[0]) continue;  // header
+    pushEdge(trace, (uint32_t)micros, (uint8_t)atoi(fields[1]), count > 2 ? (uint8_t)atoi(fields[2]) : 0);
+  }
+  return true;
+}
+
+// GateCount.csv: This Car Millis -> millis when the sensor last went HIGH
+static void loadCarEnds(const char *path, std::map<uint32_t, uint32_t> &carEnds) {
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return;
+  }
+  char line[512];
+  while (fgets(line, sizeof(line), f)) {
+    char *fields[MAX_FIELDS];
+    if (splitCsv(line, fields, MAX_FIELDS) < 9) continue;
+    char *end;
+    uint32_t pass = strtoul(fields[1], &end, 10);
+    if (end == fields[1]) continue;  // header
+    uint32_t nocar = strtoul(fields[2], NULL, 10);
+    uint32_t carMillis = strtoul(fields[8], NULL, 10);
+    carEnds[carMillis] = carMillis + pass - nocar;
+  }
+  fclose(f);
+}
+
+struct BounceRow {
+  uint32_t lastHighMs;
+  uint32_t lowMs;
+};
+
+static void addCar(Trace &trace, uint32_t carMillis, const std::vector<BounceRow> &rows,
+                   const std::map<uint32_t, uint32_t> &carEnds) {
+  uint32_t lowTotal = 0;
+  uint32_t lowCount = 0;
+  uint32_t lastLowMs = 0;
+  for (size_t i = 0; i < rows.size(); i++) {
+    const BounceRow &row = rows[i];
+    if (i > 0 && row.lastHighMs > lastLowMs && row.lastHighMs <= row.lowMs) {
+      pushEdge(trace, (carMillis + row.lastHighMs) * 1000U, SENSOR_HIGH);
+      lowTotal += row.lastHighMs - lastLowMs;
+      lowCount++;
+    }
+    pushEdge(trace, (carMillis + row.lowMs) * 1000U, SENSOR_LOW);
+    lastLowMs = row.lowMs;
+  }
+  std::map<uint32_t, uint32_t>::const_iterator end = carEnds.find(carMillis);
+  uint32_t endMillis;
+  if (end != carEnds.end() && end->second >= carMillis + lastLowMs) {
+    endMillis = end->second;
+  } else {
+    endMillis = carMillis + lastLowMs + (lowCount ? lowTotal / lowCount : 1);
+    trace.loggedTimeouts++;
+  }
+  if (endMillis == carMillis + lastLowMs) endMillis++;
+  pushEdge(trace, endMillis * 1000U, SENSOR_HIGH);
+}
+
+// SensorBounces.csv columns
+// Time,Pass Timer,Last High,Diff,No Car Timer,Low Millis,Last Low,Diff,Bounce#,Curent State,Car#,Last Car Millis,Car Millis,Millis
+static bool loadBounceLog(FILE *f, const char *gateCountPath, Trace &trace) {
+  std::map<uint32_t, uint32_t> carEnds;
+  if (gateCountPath) loadCarEnds(gateCountPath, carEnds);
+  trace.loggedCars = carEnds.size();
+
+  char line[512];
+  std::vector<BounceRow> rows;
+  uint32_t carMillis = 0;
+  bool haveCar = false;
+  while (fgets(line, sizeof(line), f)) {
+    char *fields[MAX_FIELDS];
+    if (splitCsv(line, fields, MAX_FIELDS) < 13) continue;
+    char *end;
+    BounceRow row;
+    row.lastHighMs = strtoul(fields[2], &end, 10);
+    if (end == fields[2]) continue;  // header
+    row.lowMs = strtoul(fields[5], NULL, 10);
+    uint32_t rowCarMillis = strtoul(fields[12], NULL, 10);
+    if (haveCar && rowCarMillis != carMillis) {
+      addCar(trace, carMillis, rows, carEnds);
+      rows.clear();
+    }
+    carMillis = rowCarMillis;
+    haveCar = true;
+    rows.push_back(row);
+  }
+  if (haveCar) addCar(trace, carMillis, rows, carEnds);
+  return true;
+}
+
+struct BinLogTrace {
+  Trace *trace;
+  uint8_t level;
+};
+
+// Only add edges that change the level and move time forward
+static void pushLoggedEdge(BinLogTrace &b, uint32_t micros, uint8_t level) {
+  if (level == b.level) return;
+  if (!b.trace->edges.empty() && (int32_t)(micros - b.trace->edges.back().micros) <= 0) return;
+  pushEdge(*b.trace, micros, level);
+  b.level = level;
+}
+
+static bool visitBinLog(const BinLogRecord &r, const BinLogTime &t, void *context) {
+  BinLogTrace &b = *(BinLogTrace *)context;
+  switch (r.type) {
+    case BINLOG_CAR_START:
+    case BINLOG_BOUNCE: {
+      if (r.bounces > 1) {
+        uint32_t carStart = t.micros - r.bounce.passMs * 1000U;
+        pushLoggedEdge(b, carStart + r.bounce.lastHighMs * 1000U, SENSOR_HIGH);
+      }
+      pushLoggedEdge(b, t.micros, SENSOR_LOW);
+      break;
+    }
+    case BINLOG_CAR:
+    case BINLOG_TIMEOUT:
+      if (r.type == BINLOG_CAR) b.trace->loggedCars++;
+      else b.trace->loggedTimeouts++;
+      pushLoggedEdge(b, t.micros - r.car.noCarMs * 1000U, SENSOR_HIGH);
+      break;
+    case BINLOG_RETRACT:
+      // the gate took that count back
+      if (b.trace->loggedCars) b.trace->loggedCars--;
+      break;
+  }
+  return true;
+}
+
+bool loadTrace(const char *path, const char *gateCountPath, Trace &trace) {
+  trace.edges.clear();
+  trace.loggedCars = 0;
+  trace.loggedTimeouts = 0;
+  if (isBinLog(path)) {
+    BinLogTrace b = {&trace, SENSOR_HIGH};
+    return readBinLog(path, visitBinLog, &b);
+  }
+  FILE *f = fopen(path, "r");
+  if (!f) {
+    fprintf(stderr, "Can't open %s\n", path);
+    return false;
+  }
+  char first[512] = "";
+  if (!fgets(first, sizeof(first), f)) first[0] = 0;
+  bool bounceLog = strncmp(first, "Time,Pass Timer", 15) == 0;
+  rewind(f);
+  bool ok = bounceLog ? loadBounceLog(f, gateCountPath, trace) : loadEdgeFile(f, trace);
+  fclose(f);
+  return ok;
+}
+
+bool saveEdgeTrace(const char *path, const Trace &trace) {
+  FILE *f = fopen(path, "w");
+  if (!f) {
+    fprintf(stderr, "Can't write %s\n", path);
+    return false;
+  }
+  fprintf(f, "micros,level,input\n");
+  for (size_t i = 0; i < trace.edges.size(); i++) {
+    fprintf(f, "%u,%u,%u\n", trace.edges[i].micros, trace.edges[i].level, trace.edges[i].input);
+  }
+  fclose(f);
+  return true;
+}
+
+// xorshift, same sequence on every platform
+static uint32_t nextRandom(uint32_t &state) {
+  state ^= state << 13;
+  state ^= state >> 17;
+  state ^= state << 5;
+  return state;
+}
+
+uint32_t traceRandom(uint32_t &state, uint32_t low, uint32_t high) {
+  return low + nextRandom(state) % (high - low + 1);
+}
+
+void makeSyntheticTrace(uint32_t cars, uint32_t seed, Trace &trace) {
+  trace.edges.clear();
+  trace.loggedCars = 0;
+  trace.loggedTimeouts = 0;
+  uint32_t state = seed ? seed : 1;
+  uint32_t t = 1000000;
+  for (uint32_t car = 0; car < cars; car++) {
+    uint32_t kind = traceRandom(state, 0, 99);
+    if (kind < 3) {
+      // noise spike, too short to be a car
+      pushEdge(trace, t, SENSOR_LOW);
+      t += traceRandom(state, 200, 2000);
+      pushEdge(trace, t, SENSOR_HIGH);
+    } else {
+      uint32_t bounces = traceRandom(state, 2, 9);
+      for (uint32_t b = 0; b < bounces; b++) {
+        pushEdge(trace, t, SENSOR_LOW);
+        // car parked over the sensor now and then
+        t += (kind < 6 && b == 0) ? traceRandom(state, 8000, 14000) * 1000U
+                                  : traceRandom(state, 20, 450) * 1000U;
+        pushEdge(trace, t, SENSOR_HIGH);
+        t += traceRandom(state, 15, 400) * 1000U;
+      }
+    }
+    // queue of cars leaves back to back, otherwise a few seconds apart
+    t += (kind < 30) ? traceRandom(state, 300, 900) * 1000U
+                     : traceRandom(state, 1500, 20000) * 1000U;
+  }
+}
+
+void repeatTrace(const Trace &in, uint32_t times, Trace &out) {
+  out.edges.clear();
+  out.loggedCars = in.loggedCars * times;
+  out.loggedTimeouts = in.loggedTimeouts * times;
+  if (in.edges.empty()) return;
+  out.edges.reserve(in.edges.size() * times);
+  uint32_t span = in.edges.back().micros - in.edges.front().micros + 60000000U;
+  for (uint32_t r = 0; r < times; r++) {
+    for (size_t i = 0; i < in.edges.size(); i++) {
+      SensorEdge edge = in.edges[i];
+      edge.micros += r * span;
+      out.edges.push_back(edge);
+    }
+  }
+}
@@ -0,0 +1,41 @@
+/*
+Sensor traces for the host tools.
+
+A trace is a list of edges in time order. It can be loaded from
+  - an edge file, one "micros,level" or "micros,level,input" line per edge
+    (# starts a comment, input 0 is the magnetometer, the default)
+  - SensorBounces.csv from the SD card, optionally with GateCount.csv.
+    The bounce log only has a row per LOW edge, the HIGH edges are rebuilt
+    from the Last High column and the end of each car from the matching
+    GateCount.csv row. Without GateCount.csv the last HIGH edge of a car is
+    estimated from its average LOW time.
+  - GateLog.bin, edges rebuilt from the bounce and car records
+or generated with makeSyntheticTrace().
+*/
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <stdint.h>
+#include <vector>
+#include "EdgeRing.h"
+
+struct Trace {
+  std::vector<SensorEdge> edges;
+  uint32_t loggedCars;      // cars the gate counted when the log was written, 0 if unknown
+  uint32_t loggedTimeouts;  // cars in the bounce log without a GateCount.csv row
+};
+
+bool loadTrace(const char *path, const char *gateCountPath, Trace &trace);
+bool saveEdgeTrace(const char *path, const Trace &trace);
+
+// Traffic that looks like a busy exit: bouncy cars, some back to back,
+// some stuck over the sensor and a few noise spikes
+void makeSyntheticTrace(uint32_t cars, uint32_t seed, Trace &trace);
+
+// Random numbers for the generators, the same sequence on every platform
+uint32_t traceRandom(uint32_t &state, uint32_t low, uint32_t high);
+
+// Same trace repeated, time shifted so the edges keep going forward
+void repeatTrace(const Trace &in, uint32_t times, Trace &out);
+
+#endif
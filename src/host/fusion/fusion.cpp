@@ -0,0 +1,367 @@
+/*
+Run the magnetometer + optical beam fusion (lib/GateCore/src/GateFusion.h) on the PC.
+
+  pio run -e fusion
+  .pio/build/fusion/program --synthetic 2000
+  .pio/build/fusion/program --synthetic 2000 --save lane.csv
+  .pio/build/fusion/program lane.csv
+
+--synthetic drives made up vehicles through a model of the exit lane (the
+beams, the magnetometer between them) and checks every pass against what
+the vehicle really did: exits, queues of exits, backups, turn-arounds and
+people or birds in the beams. It prints how each kind was classed and what
+the magnetometer alone would have counted. A file argument is an edge
+file with an input column (see TraceFile.h), each pass is printed.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "GateDetector.h"
+#include "GateFusion.h"
+#include "TraceFile.h"
+
+// Lane model, metres from the park side beam towards the road
+#define BEAM_PARK_X 0.0
+#define BEAM_ROAD_X 1.2
+#define COIL_X 0.5
+#define COIL_REACH 0.3  // metal has to be this far over the coil to trip it
+#define STEP_US 1000
+
+static void usage() {
+  fprintf(stderr,
+          "usage: fusion [options] <edges.csv>\n"
+          "       fusion [options] --synthetic <vehicles>\n"
+          "  --seed n      seed for --synthetic\n"
+          "  --save file   write the synthetic trace as an edge file\n");
+}
+
+enum Scenario { SCENE_EXIT, SCENE_QUEUE, SCENE_BACKUP, SCENE_TURN_AROUND, SCENE_NOISE, SCENES };
+static const char *sceneNames[SCENES] = {"exit", "queue", "backup", "turnaround", "noise"};
+
+// One thing moving along the lane. It drives to each stop in turn.
+struct Mover {
+  double front;     // position of the front, the rear is front - length
+  double length;
+  double speed;     // m/s
+  bool metal;       // trips the magnetometer
+  uint32_t startUs; // starts moving then
+  uint32_t pauseUs; // waits this long at every stop
+  std::vector<double> stops;
+  size_t next;
+  uint32_t waitUntil;
+};
+
+struct Lane {
+  Trace trace;
+  uint32_t t;
+  uint8_t level[3];  // last level written per input
+  uint32_t state;    // random state
+  // magnetometer bouncing while metal is over the coil
+  bool overCoil;
+  uint32_t nextToggle;
+};
+
+static void edge(Lane &lane, uint8_t input, uint8_t level) {
+  if (lane.level[input] == level) return;
+  lane.level[input] = level;
+  SensorEdge e;
+  memset(&e, 0, sizeof(e));
+  e.micros = lane.t;
+  e.level = level;
+  e.input = input;
+  lane.trace.edges.push_back(e);
+}
+
+static bool covers(const Mover &m, double x) {
+  return m.front >= x && m.front - m.length <= x;
+}
+
+// Move everything until it has all gone through its stops
+static void simulate(Lane &lane, std::vector<Mover> &movers) {
+  uint32_t begin = lane.t;
+  for (size_t i = 0; i < movers.size(); i++) movers[i].waitUntil = begin;
+  for (;;) {
+    bool moving = false;
+    bool parkBeam = false, roadBeam = false, coil = false;
+    for (size_t i = 0; i < movers.size(); i++) {
+      Mover &m = movers[i];
+      if (m.next < m.stops.size()) moving = true;
+      if (lane.t - begin >= m.startUs && m.next < m.stops.size() &&
+          (int32_t)(lane.t - m.waitUntil) >= 0) {
+        double target = m.stops[m.next];
+        double step = m.speed * STEP_US / 1e6;
+        if (m.front < target - step) {
+          m.front += step;
+        } else if (m.front > target + step) {
+          m.front -= step;
+        } else {
+          m.front = target;
+          m.next++;
+          m.waitUntil = lane.t + m.pauseUs;
+        }
+      }
+      parkBeam |= covers(m, BEAM_PARK_X);
+      roadBeam |= covers(m, BEAM_ROAD_X);
+      coil |= m.metal && m.front >= COIL_X + COIL_REACH && m.front - m.length <= COIL_X - COIL_REACH;
+    }
+    edge(lane, 1, parkBeam ? SENSOR_LOW : SENSOR_HIGH);
+    edge(lane, 2, roadBeam ? SENSOR_LOW : SENSOR_HIGH);
+
+    // the magnetometer bounces the whole time a car is over it, like the real one
+    if (coil && !lane.overCoil) {
+      lane.overCoil = true;
+      lane.nextToggle = lane.t;
+    }
+    if (coil && (int32_t)(lane.t - lane.nextToggle) >= 0) {
+      bool low = lane.level[0] == SENSOR_HIGH;
+      edge(lane, 0, low ? SENSOR_LOW : SENSOR_HIGH);
+      lane.nextToggle = lane.t + (low ? traceRandom(lane.state, 20, 450) : traceRandom(lane.state, 15, 300)) * 1000U;
+    }
+    if (!coil && lane.overCoil) {
+      lane.overCoil = false;
+      edge(lane, 0, SENSOR_HIGH);
+    }
+    if (!moving) break;
+    lane.t += STEP_US;
+  }
+}
+
+static Mover vehicle(Lane &lane, double front) {
+  Mover m;
+  m.front = front;
+  m.length = traceRandom(lane.state, 38, 56) / 10.0;
+  m.speed = traceRandom(lane.state, 15, 40) / 10.0;
+  m.metal = true;
+  m.startUs = 0;
+  m.pauseUs = traceRandom(lane.state, 300, 3000) * 1000U;
+  m.next = 0;
+  return m;
+}
+
+// Adds one scenario to the lane, returns the passes it should give
+static std::vector<uint8_t> addScene(Lane &lane, int scene) {
+  std::vector<Mover> movers;
+  std::vector<uint8_t> expected;
+  double start = BEAM_PARK_X - 1.0;
+  Mover m = vehicle(lane, start);
+  switch (scene) {
+    case SCENE_EXIT:
+      m.stops.push_back(BEAM_ROAD_X + m.length + 2.0);
+      movers.push_back(m);
+      expected.push_back(FUSION_EXIT);
+      break;
+    case SCENE_QUEUE: {
+      // back to back at the same speed, 2 to 8 m apart
+      uint32_t cars = traceRandom(lane.state, 2, 5);
+      uint32_t delayUs = 0;
+      for (uint32_t c = 0; c < cars; c++) {
+        Mover q = m;
+        q.length = traceRandom(lane.state, 38, 56) / 10.0;
+        q.startUs = delayUs;
+        q.stops.push_back(BEAM_ROAD_X + q.length + 2.0);
+        movers.push_back(q);
+        expected.push_back(FUSION_EXIT);
+        double gap = traceRandom(lane.state, 20, 80) / 10.0;
+        delayUs += (uint32_t)((q.length + gap) / m.speed * 1e6);
+      }
+      break;
+    }
+    case SCENE_BACKUP:
+      // nose through the road side beam, then all the way back
+      m.stops.push_back(BEAM_ROAD_X + traceRandom(lane.state, 2, 30) / 10.0);
+      m.stops.push_back(start);
+      movers.push_back(m);
+      expected.push_back(FUSION_BACKUP);
+      break;
+    case SCENE_TURN_AROUND:
+      // pull up to the gate, over the coil but short of the road side beam, and go back
+      m.stops.push_back(COIL_X + COIL_REACH + traceRandom(lane.state, 0, 35) / 100.0);
+      m.stops.push_back(start);
+      movers.push_back(m);
+      expected.push_back(FUSION_TURN_AROUND);
+      break;
+    default:
+      if (traceRandom(lane.state, 0, 1)) {
+        // somebody walking out through the beams
+        m.length = 0.4;
+        m.speed = 1.2;
+        m.metal = false;
+        m.stops.push_back(BEAM_ROAD_X + 2.0);
+        movers.push_back(m);
+      } else {
+        // bird or a leaf through one beam
+        uint32_t flicker = traceRandom(lane.state, 20, 200) * 1000U;
+        uint8_t input = (uint8_t)traceRandom(lane.state, 1, 2);
+        edge(lane, input, SENSOR_LOW);
+        lane.t += flicker;
+        edge(lane, input, SENSOR_HIGH);
+      }
+      expected.push_back(FUSION_NOISE);
+      break;
+  }
+  simulate(lane, movers);
+  // quiet lane before the next one
+  lane.t += traceRandom(lane.state, 3000, 20000) * 1000U;
+  return expected;
+}
+
+struct Result {
+  std::vector<uint8_t> passes;
+  uint32_t crossings;  // counted early, before the pass was classed
+};
+
+static void collect(const FusionPass &pass, void *context) {
+  Result &result = *(Result *)context;
+  if (pass.type == FUSION_CROSSING) {
+    result.crossings++;
+  } else {
+    result.passes.push_back(pass.type);
+  }
+}
+
+// Somebody walking through breaks one beam after the other, any number of noise passes will do
+static bool matches(const std::vector<uint8_t> &passes, const std::vector<uint8_t> &expected) {
+  if (expected.size() != 1 || expected[0] != FUSION_NOISE) return passes == expected;
+  for (size_t p = 0; p < passes.size(); p++) {
+    if (passes[p] != FUSION_NOISE) return false;
+  }
+  return true;
+}
+
+static void printPass(const FusionPass &pass, void *) {
+  printf("%s,%u,%u,%u,%u,%u,%u,%u\n", fusionPassName(pass.type), pass.startUs, pass.passMs,
+         pass.entered, pass.reached, pass.left, pass.vehicle, pass.edges);
+}
+
+static void countCar(const DetectorEvent &event, void *context) {
+  if (event.type == DETECTOR_CAR_COUNTED) (*(uint32_t *)context)++;
+}
+
+// Magnetometer only, what the gate counts today
+static uint32_t detectorCount(const Trace &trace) {
+  GateDetector detector;
+  uint32_t cars = 0;
+  detector.setListener(countCar, &cars);
+  for (size_t i = 0; i < trace.edges.size(); i++) {
+    if (trace.edges[i].input == 0) detector.onEdge(trace.edges[i].micros, trace.edges[i].level);
+  }
+  if (!trace.edges.empty()) detector.poll(trace.edges.back().micros + 60000000U);
+  return cars;
+}
+
+// Run the whole trace, returns edges per second
+static double runFusion(GateFusion &fusion, const Trace &trace) {
+  const SensorEdge *edges = trace.edges.data();
+  size_t count = trace.edges.size();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    fusion.onEdge(edges[i].micros, edges[i].input, edges[i].level);
+  }
+  if (count) fusion.poll(edges[count - 1].micros + fusion.config().maxPassMs * 1000U);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return seconds > 0 ? count / seconds : 0;
+}
+
+int main(int argc, char **argv) {
+  uint32_t synthetic = 0;
+  uint32_t seed = 1;
+  const char *savePath = NULL;
+  const char *path = NULL;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--synthetic") == 0 && hasValue) {
+      synthetic = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--save") == 0 && hasValue) {
+      savePath = argv[++i];
+    } else if (arg[0] != '-' && !path) {
+      path = arg;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  GateFusion fusion;
+  if (!synthetic) {
+    Trace trace;
+    if (!path) {
+      usage();
+      return 1;
+    }
+    if (!loadTrace(path, NULL, trace)) return 1;
+    printf("pass,start us,ms,entered,reached,left,vehicle,edges\n");
+    fusion.setListener(printPass, NULL);
+    double rate = runFusion(fusion, trace);
+    fprintf(stderr, "%zu edges, %u exits, magnetometer only %u cars, %.0f edges/s\n",
+            trace.edges.size(), fusion.passCount(FUSION_EXIT), detectorCount(trace), rate);
+    return 0;
+  }
+
+  // every vehicle is its own scenario so the passes can be matched up afterwards
+  Lane lane;
+  memset(lane.level, SENSOR_HIGH, sizeof(lane.level));
+  lane.trace.loggedCars = 0;
+  lane.trace.loggedTimeouts = 0;
+  lane.t = 1000000;
+  lane.state = seed ? seed : 1;
+  lane.overCoil = false;
+  lane.nextToggle = 0;
+  std::vector<int> scenes;
+  std::vector<size_t> sceneEnd;  // edges up to here belong to the scene
+  std::vector<std::vector<uint8_t> > expected;
+  uint32_t trueExits = 0;
+  for (uint32_t v = 0; v < synthetic; v++) {
+    uint32_t pick = traceRandom(lane.state, 0, 99);
+    int scene = pick < 45 ? SCENE_EXIT : pick < 60 ? SCENE_QUEUE : pick < 75 ? SCENE_BACKUP
+              : pick < 90 ? SCENE_TURN_AROUND : SCENE_NOISE;
+    scenes.push_back(scene);
+    expected.push_back(addScene(lane, scene));
+    sceneEnd.push_back(lane.trace.edges.size());
+    for (size_t p = 0; p < expected.back().size(); p++) trueExits += expected.back()[p] == FUSION_EXIT;
+  }
+  if (savePath && !saveEdgeTrace(savePath, lane.trace)) return 1;
+
+  // the scenes are far enough apart that every pass is over before the next scene starts
+  Result result;
+  uint32_t right[SCENES] = {0}, runs[SCENES] = {0}, early[SCENES] = {0};
+  uint32_t classed[SCENES][FUSION_PASS_TYPES];
+  memset(classed, 0, sizeof(classed));
+  fusion.setListener(collect, &result);
+  double rate = runFusion(fusion, lane.trace);
+  fusion.reset();
+  size_t from = 0;
+  for (size_t s = 0; s < scenes.size(); s++) {
+    result.passes.clear();
+    result.crossings = 0;
+    for (size_t i = from; i < sceneEnd[s]; i++) {
+      const SensorEdge &e = lane.trace.edges[i];
+      fusion.onEdge(e.micros, e.input, e.level);
+    }
+    if (sceneEnd[s] > from) fusion.poll(lane.trace.edges[sceneEnd[s] - 1].micros + 2900000U);
+    from = sceneEnd[s];
+    runs[scenes[s]]++;
+    early[scenes[s]] += result.crossings;
+    if (matches(result.passes, expected[s])) right[scenes[s]]++;
+    for (size_t p = 0; p < result.passes.size(); p++) classed[scenes[s]][result.passes[p]]++;
+  }
+
+  // provisional = counted when it reached the road side beam, retracted unless it was an exit
+  printf("scene,runs,right,provisional");
+  for (int t = 0; t < FUSION_PASS_TYPES; t++) printf(",%s", fusionPassName(t));
+  printf("\n");
+  for (int s = 0; s < SCENES; s++) {
+    printf("%s,%u,%u,%u", sceneNames[s], runs[s], right[s], early[s]);
+    for (int t = 0; t < FUSION_PASS_TYPES; t++) printf(",%u", classed[s][t]);
+    printf("\n");
+  }
+  fprintf(stderr, "%zu edges, %u real exits, fusion counted %u, magnetometer only %u, %.0f edges/s\n",
+          lane.trace.edges.size(), trueExits, fusion.passCount(FUSION_EXIT),
+          detectorCount(lane.trace), rate);
+  return 0;
+}
@@ -0,0 +1,190 @@
+/*
+Run the broker ConnectionManager (lib/GateCore/src/ConnectionManager.h) against a broker that drops on purpose.
+
+  pio run -e linktest
+  .pio/build/linktest/program
+  .pio/build/linktest/program --hours 24 --drops 6 --refuse 20 --seed 7
+
+The broker goes away --drops times an hour at random, for 1 s up to
+--outage s, and refuses a share (--refuse %) of the connects it gets while
+it is up. Connecting goes the way the network task does it (mqttService()
+in main.cpp): an attempt takes a TLS handshake when the broker is there
+and the socket timeout when it isn't, and the manager decides when to try
+again. Checked at the end, exit code 1 if any fails:
+  - after every outage the gate is back within the longest backoff plus
+    one attempt, and another of each for every connect refused on the way
+  - no attempt follows the last one sooner than half the shortest backoff
+  - the counters add up (attempts, connects, failures, drops)
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <vector>
+
+#include "ConnectionManager.h"
+#include "TraceFile.h"
+
+// Same as main.cpp
+#define RETRY_MIN_MS 2000
+#define RETRY_MAX_MS 60000
+#define MQTT_SOCKET_TIMEOUT_S 5
+#define HANDSHAKE_MS 900  // full TLS handshake to HiveMQ Cloud and CONNACK
+#define STEP_MS 20        // a network task pass
+
+struct Outage {
+  uint64_t startMs;
+  uint64_t endMs;
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: linktest [options]\n"
+          "  --hours n     how long to run, default 24\n"
+          "  --drops n     outages an hour, default 4\n"
+          "  --outage s    longest outage in seconds, default 600\n"
+          "  --refuse pct  connects refused while the broker is up, default 10\n"
+          "  --seed n\n");
+}
+
+static uint32_t percentile(std::vector<uint32_t> values, uint32_t pct) {
+  if (values.empty()) return 0;
+  std::sort(values.begin(), values.end());
+  return values[(values.size() - 1) * pct / 100];
+}
+
+int main(int argc, char **argv) {
+  uint32_t hours = 24;
+  uint32_t dropsPerHour = 4;
+  uint32_t longestOutageS = 600;
+  uint32_t refusePct = 10;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--hours") == 0 && hasValue) {
+      hours = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--drops") == 0 && hasValue) {
+      dropsPerHour = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--outage") == 0 && hasValue) {
+      longestOutageS = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--refuse") == 0 && hasValue) {
+      refusePct = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (hours < 1 || longestOutageS < 1 || refusePct > 100) {
+    usage();
+    return 1;
+  }
+
+  // lay out the outages first, they don't depend on what the gate does
+  uint32_t state = seed ? seed : 1;
+  const uint64_t endMs = hours * 3600000ULL;
+  std::vector<Outage> outages;
+  if (dropsPerHour) {
+    uint64_t t = 0;
+    for (;;) {
+      t += traceRandom(state, 1, 2 * 3600000 / dropsPerHour);  // average 1/dropsPerHour h apart
+      if (t >= endMs) break;
+      Outage outage;
+      outage.startMs = t;
+      outage.endMs = t + traceRandom(state, 1000, longestOutageS * 1000);
+      outages.push_back(outage);
+      t = outage.endMs;
+    }
+  }
+
+  ConnectionManager link(RETRY_MIN_MS, RETRY_MAX_MS, seed);
+  size_t nextOutage = 0;
+  uint64_t now = 0;
+  uint64_t lastAttemptEndMs = 0;
+  bool attempted = false;
+  uint32_t closestAttemptsMs = UINT32_MAX;
+  uint32_t dropsExpected = 0;
+  uint32_t failures = 0;
+  std::vector<uint32_t> recoveryMs;
+  bool waitingRecovery = false;
+  uint64_t outageEndMs = 0;
+  uint32_t refusedSinceBack = 0;
+  uint32_t slowRecoveries = 0;
+  uint32_t slowestOverMs = 0;
+
+  while (now < endMs) {
+    while (nextOutage < outages.size() && outages[nextOutage].endMs <= now) {
+      outageEndMs = outages[nextOutage].endMs;
+      refusedSinceBack = 0;
+      nextOutage++;
+    }
+    bool brokerUp = nextOutage >= outages.size() || now < outages[nextOutage].startMs;
+
+    if (link.isUp() && !brokerUp) {
+      link.lost((uint32_t)now);
+      dropsExpected++;
+      waitingRecovery = true;
+    }
+    if (!link.isUp() && link.due((uint32_t)now)) {
+      if (attempted && now - lastAttemptEndMs < closestAttemptsMs) closestAttemptsMs = now - lastAttemptEndMs;
+      attempted = true;
+      link.attempt((uint32_t)now);
+      bool refused = traceRandom(state, 0, 99) < refusePct;
+      if (brokerUp && !refused) {
+        now += HANDSHAKE_MS;
+        link.connected((uint32_t)now);
+        if (waitingRecovery) {
+          // the longest wait, plus the attempt that was under way when the broker came back
+          // and the one that gets in, and a wait and an attempt more for every refusal
+          uint32_t took = now - outageEndMs;
+          uint32_t limit = (1 + refusedSinceBack) * (RETRY_MAX_MS + HANDSHAKE_MS) + MQTT_SOCKET_TIMEOUT_S * 1000 + 2 * STEP_MS;
+          recoveryMs.push_back(took);
+          if (took > limit) {
+            slowRecoveries++;
+            if (took - limit > slowestOverMs) slowestOverMs = took - limit;
+          }
+        }
+        waitingRecovery = false;
+      } else {
+        now += brokerUp ? HANDSHAKE_MS : MQTT_SOCKET_TIMEOUT_S * 1000;
+        link.failed((uint32_t)now, brokerUp ? 5 : -2);  // not authorised / connect failed, as PubSubClient says
+        failures++;
+        if (brokerUp) refusedSinceBack++;
+      }
+      lastAttemptEndMs = now;
+    }
+    now += STEP_MS;
+  }
+
+  const ConnectionStats &stats = link.stats();
+  char json[256];
+  link.json(json, sizeof(json), (uint32_t)now);
+  printf("%u h, %zu outages, %u%% of connects refused, seed %u\n\n", hours, outages.size(), refusePct, seed);
+  printf("  %s\n\n", json);
+  printf("  reconnected after an outage   p50 %.1f s, p99 %.1f s, max %.1f s (%zu)\n",
+         percentile(recoveryMs, 50) / 1000.0, percentile(recoveryMs, 99) / 1000.0,
+         percentile(recoveryMs, 100) / 1000.0, recoveryMs.size());
+  printf("  closest attempts              %.1f s apart\n\n", closestAttemptsMs == UINT32_MAX ? 0 : closestAttemptsMs / 1000.0);
+
+  bool ok = true;
+  if (slowRecoveries) {
+    printf("FAIL %u outages took longer than the backoff allows to reconnect, up to %.1f s longer\n", slowRecoveries,
+           slowestOverMs / 1000.0);
+    ok = false;
+  }
+  if (attempted && closestAttemptsMs < RETRY_MIN_MS / 2) {
+    printf("FAIL attempts %.1f s apart, the backoff should keep them %.1f s apart\n", closestAttemptsMs / 1000.0,
+           RETRY_MIN_MS / 2000.0);
+    ok = false;
+  }
+  if (stats.attempts != stats.connects + stats.failures || stats.failures != failures ||
+      stats.drops != dropsExpected || stats.connects - stats.drops != (link.isUp() ? 1u : 0u)) {
+    printf("FAIL counters don't add up: %u attempts, %u connects, %u failures (%u), %u drops (%u)\n", stats.attempts,
+           stats.connects, stats.failures, failures, stats.drops, dropsExpected);
+    ok = false;
+  }
+  printf(ok ? "all checks OK\n" : "checks FAILED\n");
+  return ok ? 0 : 1;
+}
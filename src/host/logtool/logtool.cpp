@@ -0,0 +1,163 @@
+/*
+Convert and query GateLog.bin from the SD card.
+
+  pio run -e logtool
+  .pio/build/logtool/program cars GateLog.bin > GateCount.csv
+  .pio/build/logtool/program bounces GateLog.bin --from 2024-12-20 --to 2024-12-21
+  .pio/build/logtool/program daily GateLog.bin
+
+cars    one row per counted car or timeout, like GateCount.csv
+bounces one row per bounce, like SensorBounces.csv
+daily   cars, timeouts, retracted counts and bounces per day, cars without the retracted ones
+events  every record as it is stored
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "BinLogFile.h"
+#include "CountLedger.h"
+
+struct Query {
+  const char *command;
+  uint32_t from;  // unixtime, inclusive
+  uint32_t to;    // unixtime, exclusive
+  // daily totals
+  uint32_t day;
+  uint32_t cars;
+  uint32_t timeouts;
+  uint32_t retracted;
+  uint32_t bounces;
+  int lastCount;
+  char firstCar[9];
+  char lastCar[9];
+};
+
+static const char *typeNames[] = {"?", "sync", "start", "bounce", "car", "timeout", "reset", "confirm", "retract"};
+
+// RTC keeps local time, so format it as UTC to get the wall clock back
+static void formatTime(uint32_t unixtime, char *out, size_t size, const char *format) {
+  time_t t = unixtime;
+  struct tm parts;
+  gmtime_r(&t, &parts);
+  strftime(out, size, format, &parts);
+}
+
+static bool parseDate(const char *text, uint32_t &unixtime) {
+  struct tm parts;
+  memset(&parts, 0, sizeof(parts));
+  if (sscanf(text, "%d-%d-%d", &parts.tm_year, &parts.tm_mon, &parts.tm_mday) != 3) return false;
+  parts.tm_year -= 1900;
+  parts.tm_mon -= 1;
+  unixtime = (uint32_t)timegm(&parts);
+  return true;
+}
+
+static void printDay(Query &q) {
+  if (q.day == 0) return;
+  char date[11];
+  formatTime(q.day, date, sizeof(date), "%Y-%m-%d");
+  printf("%s,%u,%u,%u,%u,%d,%s,%s\n", date, q.cars - q.retracted, q.timeouts, q.retracted, q.bounces,
+         q.lastCount, q.firstCar, q.lastCar);
+}
+
+static bool visit(const BinLogRecord &r, const BinLogTime &t, void *context) {
+  Query &q = *(Query *)context;
+  if (t.unixtime < q.from) return true;
+  if (q.to && t.unixtime >= q.to) return false;
+
+  char stamp[20];
+  formatTime(t.unixtime, stamp, sizeof(stamp), "%Y-%m-%d %H:%M:%S");
+  const char *command = q.command;
+  if (strcmp(command, "events") == 0) {
+    const char *name = r.type <= BINLOG_RETRACT ? typeNames[r.type] : "?";
+    if (r.type == BINLOG_SYNC) {
+      printf("%s.%06u,%s,%u,temp %d\n", stamp, t.usOfSecond, name, t.micros, r.sync.temp);
+    } else if (r.type == BINLOG_CONFIRM || r.type == BINLOG_RETRACT) {
+      printf("%s.%06u,%s,%u,seq %u,%s,car %d\n", stamp, t.usOfSecond, name, t.micros, r.count.seq,
+             countReasonName(r.count.reason), r.count.carNumber);
+    } else if (r.type == BINLOG_CAR_START || r.type == BINLOG_BOUNCE) {
+      printf("%s.%06u,%s,%u,%u,%u,pass %u,last high %u,low gap %u,car %d\n", stamp, t.usOfSecond, name,
+             t.micros, r.bounces, r.level, r.bounce.passMs, r.bounce.lastHighMs, r.bounce.lowGapMs,
+             r.bounce.carNumber);
+    } else {
+      printf("%s.%06u,%s,%u,%u,%u,pass %u,no car %u,car %d,in park %d\n", stamp, t.usOfSecond, name,
+             t.micros, r.bounces, r.level, r.car.passMs, r.car.noCarMs, r.car.carNumber, r.car.carsInPark);
+    }
+  } else if (strcmp(command, "cars") == 0) {
+    if (r.type == BINLOG_CAR || r.type == BINLOG_TIMEOUT) {
+      printf("%s, %u, %u, %u, %d, %d, %s\n", stamp, r.car.passMs, r.car.noCarMs, r.bounces,
+             r.car.carNumber, r.car.carsInPark, r.type == BINLOG_CAR ? "car" : "timeout");
+    }
+  } else if (strcmp(command, "bounces") == 0) {
+    if (r.type == BINLOG_BOUNCE) {
+      uint32_t pass = r.bounce.passMs;
+      printf("%s, %u, %u, %u, %u, %u, %u , %u , %d\n", stamp, pass, r.bounce.lastHighMs,
+             pass - r.bounce.lastHighMs, pass, pass - r.bounce.lowGapMs, r.bounce.lowGapMs, r.bounces,
+             r.bounce.carNumber);
+    }
+  } else if (r.type != BINLOG_SYNC) {  // daily
+    uint32_t day = t.unixtime - t.unixtime % 86400;
+    if (day != q.day) {
+      printDay(q);
+      q.day = day;
+      q.cars = q.timeouts = q.retracted = q.bounces = 0;
+      q.lastCount = 0;
+      strcpy(q.firstCar, "-");
+      strcpy(q.lastCar, "-");
+    }
+    if (r.type == BINLOG_BOUNCE) q.bounces++;
+    if (r.type == BINLOG_TIMEOUT) q.timeouts++;
+    if (r.type == BINLOG_RETRACT) {
+      q.retracted++;
+      q.lastCount = r.count.carNumber;
+    }
+    if (r.type == BINLOG_CAR) {
+      q.cars++;
+      q.lastCount = r.car.carNumber;
+      formatTime(t.unixtime, q.cars == 1 ? q.firstCar : q.lastCar, 9, "%H:%M:%S");
+      if (q.cars == 1) strcpy(q.lastCar, q.firstCar);
+    }
+  }
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr, "usage: logtool cars|bounces|daily|events GateLog.bin [--from YYYY-MM-DD] [--to YYYY-MM-DD]\n");
+}
+
+int main(int argc, char **argv) {
+  if (argc < 3) {
+    usage();
+    return 1;
+  }
+  Query q;
+  memset(&q, 0, sizeof(q));
+  q.command = argv[1];
+  const char *path = argv[2];
+  for (int i = 3; i < argc; i++) {
+    uint32_t *date = NULL;
+    if (strcmp(argv[i], "--from") == 0) date = &q.from;
+    if (strcmp(argv[i], "--to") == 0) date = &q.to;
+    if (!date || i + 1 >= argc || !parseDate(argv[++i], *date)) {
+      usage();
+      return 1;
+    }
+  }
+  if (q.to) q.to += 86400;  // whole day
+
+  if (strcmp(q.command, "cars") == 0) {
+    printf("Date Time,Pass Timer,NoCar Timer,Bounces,Car#,Cars In Park,Result\n");
+  } else if (strcmp(q.command, "bounces") == 0) {
+    printf("Time,Pass Timer,Last High,Diff,Low Millis,Last Low,Diff,Bounce#,Car#\n");
+  } else if (strcmp(q.command, "daily") == 0) {
+    printf("Date,Cars,Timeouts,Retracted,Bounces,Last Count,First Car,Last Car\n");
+  } else if (strcmp(q.command, "events") != 0) {
+    usage();
+    return 1;
+  }
+  if (!readBinLog(path, visit, &q)) return 1;
+  if (strcmp(q.command, "daily") == 0) printDay(q);
+  return 0;
+}
@@ -0,0 +1,338 @@
+/*
+Run the MQTT outbox (lib/GateCore/src/Outbox.h) through broker outages and power cuts.
+
+  pio run -e outboxtest
+  .pio/build/outboxtest/program
+  .pio/build/outboxtest/program --hours 24 --drops 4 --cuts 6 --seed 7
+
+The segment files are kept in memory. Cars come in every 0.5 to 8 s and go
+out the way EspMqtt::publish() does it: straight to the broker when the
+outbox is empty, into the outbox otherwise, and the network task replays
+the outbox on every pass. The broker goes away --drops times an hour for up
+to --outage s, and is also killed part way through a replay now and then.
+--cuts times an hour the power goes a few file operations later, tearing
+an append if that is where it lands, and the gate reboots with a new
+outbox over the same files. At the end the broker stays up until the
+outbox is empty. Checked, exit code 1 if any fails:
+  - every message the gate took is delivered, in order
+  - a message is only delivered again after a power cut, from no further
+    back than OUTBOX_CURSOR_EVERY messages
+  - replay keeps to OUTBOX_RATE_PER_SEC with bursts of OUTBOX_BURST
+  - every segment is removed once it has gone out, none are left
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <deque>
+#include <map>
+#include <vector>
+
+#include "Outbox.h"
+#include "TraceFile.h"
+
+#define STEP_MS 20  // a network task pass
+#define TOPIC "msb/traffic/exit/event"
+
+// The SD card, in memory. Once the power is cut every operation fails until reboot().
+class MemoryFiles : public OutboxFiles {
+ public:
+  explicit MemoryFiles(uint32_t &randomState)
+      : random(randomState), opsLeft(0), cut(false), cutNow(false), removed(0), most(0) {}
+
+  bool segments(uint32_t &first, uint32_t &last) override {
+    if (!operation() || files.empty()) return false;
+    first = files.begin()->first;
+    last = files.rbegin()->first;
+    return true;
+  }
+  uint32_t size(uint32_t segment) override {
+    if (!operation() || !files.count(segment)) return 0;
+    return files[segment].size();
+  }
+  bool read(uint32_t segment, uint32_t offset, void *data, size_t length) override {
+    if (!operation() || !files.count(segment)) return false;
+    const std::vector<uint8_t> &file = files[segment];
+    if (offset + length > file.size()) return false;
+    memcpy(data, file.data() + offset, length);
+    return true;
+  }
+  bool append(uint32_t segment, const void *data, size_t length) override {
+    bool powered = operation();
+    if (!powered && !cutNow) return false;
+    std::vector<uint8_t> &file = files[segment];
+    // the power went during this write, some of it is on the card
+    size_t written = powered ? length : traceRandom(random, 0, length - 1);
+    file.insert(file.end(), (const uint8_t *)data, (const uint8_t *)data + written);
+    if (files.size() > most) most = files.size();
+    return powered;
+  }
+  bool remove(uint32_t segment) override {
+    if (!operation()) return false;
+    removed += files.erase(segment);
+    return true;
+  }
+  bool readCursor(void *data, size_t length) override {
+    if (!operation() || cursor.size() != length) return false;
+    memcpy(data, cursor.data(), length);
+    return true;
+  }
+  bool writeCursor(const void *data, size_t length) override {
+    if (!operation()) return false;
+    cursor.assign((const uint8_t *)data, (const uint8_t *)data + length);
+    return true;
+  }
+
+  // Power goes in the middle of the n-th file operation from now
+  void cutAfter(uint32_t operations) { opsLeft = operations; }
+  bool isCut() const { return cut; }
+  void reboot() {
+    cut = false;
+    opsLeft = 0;
+  }
+  size_t count() const { return files.size(); }
+  uint32_t removedCount() const { return removed; }
+  size_t mostSegments() const { return most; }
+
+ private:
+  bool operation() {
+    cutNow = false;
+    if (cut) return false;
+    if (opsLeft && --opsLeft == 0) {
+      cut = cutNow = true;
+      return false;
+    }
+    return true;
+  }
+
+  uint32_t &random;
+  std::map<uint32_t, std::vector<uint8_t>> files;
+  std::vector<uint8_t> cursor;
+  uint32_t opsLeft;
+  bool cut;
+  bool cutNow;  // the operation that just failed was the one the power went in
+  uint32_t removed;
+  size_t most;
+};
+
+struct Broker {
+  uint64_t now;
+  uint64_t downUntil;
+  int32_t killAfter;  // accept this many more then go away, -1 for no kill coming
+  uint32_t kills;
+  std::vector<uint32_t> received;
+  uint32_t &random;
+};
+
+static bool publishToBroker(const char *topic, const char *payload, void *context) {
+  Broker *broker = (Broker *)context;
+  if (broker->now < broker->downUntil) return false;
+  if (broker->killAfter == 0) {
+    broker->downUntil = broker->now + traceRandom(broker->random, 1000, 60000);
+    broker->killAfter = -1;
+    broker->kills++;
+    return false;
+  }
+  if (broker->killAfter > 0) broker->killAfter--;
+  if (strcmp(topic, TOPIC) != 0) return false;
+  broker->received.push_back(strtoul(payload + strlen("{\"seq\":"), NULL, 10));
+  return true;
+}
+
+static void usage() {
+  fprintf(stderr,
+          "usage: outboxtest [options]\n"
+          "  --hours n     how long to run, default 12\n"
+          "  --drops n     broker outages an hour, default 3\n"
+          "  --outage s    longest outage in seconds, default 1800\n"
+          "  --cuts n      power cuts an hour, default 4\n"
+          "  --seed n\n");
+}
+
+int main(int argc, char **argv) {
+  uint32_t hours = 12;
+  uint32_t dropsPerHour = 3;
+  uint32_t longestOutageS = 1800;
+  uint32_t cutsPerHour = 4;
+  uint32_t seed = 1;
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--hours") == 0 && hasValue) {
+      hours = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--drops") == 0 && hasValue) {
+      dropsPerHour = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--outage") == 0 && hasValue) {
+      longestOutageS = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--cuts") == 0 && hasValue) {
+      cutsPerHour = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else {
+      usage();
+      return 1;
+    }
+  }
+  if (hours < 1 || longestOutageS < 1) {
+    usage();
+    return 1;
+  }
+
+  uint32_t state = seed ? seed : 1;
+  const uint64_t endMs = hours * 3600000ULL;
+  MemoryFiles files(state);
+  Broker broker = {0, 0, -1, 0, std::vector<uint32_t>(), state};
+  Outbox *outbox = new Outbox();
+  outbox->begin(&files);
+
+  uint64_t nextCarMs = traceRandom(state, 500, 8000);
+  uint64_t nextDropMs = dropsPerHour ? traceRandom(state, 1, 2 * 3600000 / dropsPerHour) : UINT64_MAX;
+  uint64_t nextCutMs = cutsPerHour ? traceRandom(state, 1, 2 * 3600000 / cutsPerHour) : UINT64_MAX;
+  uint32_t taken = 0;      // messages the gate took, by publishing or queueing them, numbered from 1
+  uint32_t refused = 0;    // enqueue() said no, only ever in a power cut
+  uint32_t direct = 0;
+  uint32_t reboots = 0;
+  uint32_t rebootsBefore = 0;  // reboots before the message last received
+  uint32_t replayed = 0;
+  uint32_t dropped = 0;
+  size_t checked = 0;      // received messages looked at so far
+  uint32_t last = 0;       // seq of the message last received
+  uint32_t highest = 0;
+  uint32_t repeats = 0;
+  uint32_t furthestBack = 0;
+  uint32_t orderErrors = 0;
+  uint32_t rateErrors = 0;
+  uint32_t mostInSecond = 0;
+  std::deque<uint64_t> replayTimes;  // when each message replayed in the last second went out
+  char payload[OUTBOX_MAX_PAYLOAD + 1];
+
+  // the broker stays up for the catch up at the end, at most a message a tenth of a second
+  uint64_t drainUntil = 0;
+  for (broker.now = 0;; broker.now += STEP_MS) {
+    uint64_t now = broker.now;
+    bool running = now < endMs;
+    if (!running) {
+      if (!drainUntil) drainUntil = now + 100ULL * (outbox->pending() + taken) + 60000;
+      if (outbox->empty() || now >= drainUntil) break;
+      broker.downUntil = 0;
+      broker.killAfter = -1;
+    }
+
+    if (files.isCut()) {
+      // the gate comes back with only what is on the card
+      dropped += outbox->droppedCount();
+      delete outbox;
+      files.reboot();
+      outbox = new Outbox();
+      outbox->begin(&files);
+      reboots++;
+      replayTimes.clear();
+    }
+    if (running && now >= nextDropMs) {
+      broker.downUntil = now + traceRandom(state, 1000, longestOutageS * 1000);
+      nextDropMs = broker.downUntil + traceRandom(state, 1, 2 * 3600000 / dropsPerHour);
+    }
+    if (running && now >= nextCutMs) {
+      files.cutAfter(traceRandom(state, 1, 8));
+      nextCutMs = now + traceRandom(state, 1, 2 * 3600000 / cutsPerHour);
+    }
+
+    if (running && now >= nextCarMs) {
+      // a car, or a batch of them
+      uint32_t seq = taken + 1;
+      int length = snprintf(payload, sizeof(payload), "{\"seq\":%u,\"cars\":[", seq);
+      uint32_t size = traceRandom(state, 40, 400);
+      while (length < (int)size) length += snprintf(payload + length, sizeof(payload) - length, "1,");
+      snprintf(payload + length - 1, sizeof(payload) - length + 1, "]}");
+      if (outbox->empty() && publishToBroker(TOPIC, payload, &broker)) {
+        taken++;
+        direct++;
+      } else if (outbox->enqueue(TOPIC, payload)) {
+        taken++;
+      } else {
+        refused++;  // never taken, the same seq goes to the next car
+      }
+      nextCarMs = now + traceRandom(state, 500, 8000);
+    }
+
+    if (!outbox->empty()) {
+      // now and then the broker is killed part way through catching up
+      if (broker.killAfter < 0 && now >= broker.downUntil && traceRandom(state, 0, 999) == 0) {
+        broker.killAfter = traceRandom(state, 0, 30);
+      }
+      size_t before = broker.received.size();
+      uint16_t sent = outbox->replay(publishToBroker, &broker, (uint32_t)now);
+      replayed += sent;
+      for (uint16_t i = 0; i < sent; i++) replayTimes.push_back(now);
+      while (!replayTimes.empty() && replayTimes.front() + 1000 <= now) replayTimes.pop_front();
+      if (replayTimes.size() > mostInSecond) mostInSecond = replayTimes.size();
+      if (replayTimes.size() > OUTBOX_RATE_PER_SEC + OUTBOX_BURST) rateErrors++;
+      if (broker.received.size() - before != sent) orderErrors++;
+    }
+
+    // every message is the one after the last, or a repeat just after a reboot
+    for (; checked < broker.received.size(); checked++) {
+      uint32_t seq = broker.received[checked];
+      if (seq == last + 1) {
+        last = seq;
+      } else if (seq <= last && reboots > rebootsBefore && highest - seq < OUTBOX_CURSOR_EVERY) {
+        if (highest + 1 - seq > furthestBack) furthestBack = highest + 1 - seq;
+        last = seq;
+      } else {
+        if (orderErrors < 5) printf("  message %u received after %u\n", seq, last);
+        orderErrors++;
+        last = seq;
+      }
+      if (seq <= highest) repeats++;
+      if (seq > highest) highest = seq;
+      rebootsBefore = reboots;
+    }
+  }
+  dropped += outbox->droppedCount();
+
+  std::vector<bool> got(taken + 1, false);
+  uint32_t missing = 0;
+  for (uint32_t seq : broker.received) {
+    if (seq <= taken) got[seq] = true;
+  }
+  for (uint32_t seq = 1; seq <= taken; seq++) {
+    if (!got[seq]) missing++;
+  }
+
+  printf("%u h, seed %u\n\n", hours, seed);
+  printf("  messages          %u taken, %u sent straight away, %u replayed, %u refused in a power cut\n", taken,
+         direct, replayed, refused);
+  printf("  broker            %u kills part way through a replay\n", broker.kills);
+  printf("  power cuts        %u, %u messages repeated, up to %u back\n", reboots, repeats, furthestBack);
+  printf("  segments          %u removed, at most %zu at once, %zu left\n", files.removedCount(),
+         files.mostSegments(), files.count());
+  printf("  replay rate       at most %u in a second\n\n", mostInSecond);
+
+  bool ok = true;
+  if (missing || !outbox->empty()) {
+    printf("FAIL %u of %u messages never delivered, %u still in the outbox\n", missing, taken, outbox->pending());
+    ok = false;
+  }
+  if (orderErrors) {
+    printf("FAIL %u messages out of order\n", orderErrors);
+    ok = false;
+  }
+  if (repeats > reboots * OUTBOX_CURSOR_EVERY) {
+    printf("FAIL %u repeats after %u power cuts, at most %u each\n", repeats, reboots, OUTBOX_CURSOR_EVERY);
+    ok = false;
+  }
+  if (rateErrors) {
+    printf("FAIL replay went over %u in a second %u times\n", OUTBOX_RATE_PER_SEC + OUTBOX_BURST, rateErrors);
+    ok = false;
+  }
+  if (files.count() || (replayed && !files.removedCount())) {
+    printf("FAIL %zu segments left after catching up\n", files.count());
+    ok = false;
+  }
+  if (dropped > refused) {
+    printf("FAIL %u messages dropped\n", dropped - refused);
+    ok = false;
+  }
+  delete outbox;
+  printf(ok ? "all checks OK\n" : "checks FAILED\n");
+  return ok ? 0 : 1;
+}
@@ -0,0 +1,211 @@
+/*
+Replay recorded sensor traces through the GateDetector on the PC.
+
+  pio run -e replay
+  .pio/build/replay/program SensorBounces.csv GateCount.csv
+  .pio/build/replay/program --sweep nocar=500:1500:100 --sweep gap=1500:3000:500 SensorBounces.csv GateCount.csv
+  .pio/build/replay/program --synthetic 100000
+  .pio/build/replay/program --profiles SensorBounces.csv GateCount.csv
+
+Every combination of the --sweep ranges is run over the same trace and
+printed as one CSV row, so a season of logs can be used to tune the
+thresholds without going near the gate. --profiles runs the compiled in
+profiles (normal, backup, event) instead, each with its fixed thresholds.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <chrono>
+#include <vector>
+
+#include "GateDetector.h"
+#include "TraceFile.h"
+
+struct Sweep {
+  const char *name;
+  uint32_t from;
+  uint32_t to;
+  uint32_t step;
+};
+
+static void usage() {
+  fprintf(stderr,
+          "usage: replay [options] <trace.csv> [GateCount.csv]\n"
+          "       replay [options] --synthetic <cars>\n"
+          "  --nocar ms        no car timeout (default 900)\n"
+          "  --gap ms          bounce gap between cars (default 2000)\n"
+          "  --stuck ms        stuck car timeout (default 10000)\n"
+          "  --bounces n       bounces before the no car timer counts (default 2)\n"
+          "  --sweep p=a:b:s   run p from a to b in steps of s, p = nocar|gap|stuck|bounces\n"
+          "  --profiles        run every detector profile instead of the options above\n"
+          "  --events          print every detector event\n"
+          "  --repeat n        run the trace n times back to back\n"
+          "  --seed n          seed for --synthetic\n"
+          "  --save file       write the loaded trace as an edge file\n");
+}
+
+static uint32_t *parameter(DetectorConfig &config, const char *name, uint32_t &bounces) {
+  if (strcmp(name, "nocar") == 0) return &config.nocarTimeoutMs;
+  if (strcmp(name, "gap") == 0) return &config.bounceGapMs;
+  if (strcmp(name, "stuck") == 0) return &config.stuckTimeoutMs;
+  if (strcmp(name, "bounces") == 0) return &bounces;
+  return NULL;
+}
+
+static const char *eventNames[] = {"start", "bounce", "car", "timeout"};
+
+static void printEvent(const DetectorEvent &event, void *) {
+  printf("%s,%u,%u,%u,%u,%u,%u,%u,%u,%u\n", eventNames[event.type], event.micros,
+         event.carStartUs, event.bounces, event.level, event.passMs, event.lastHighMs,
+         event.noCarMs, event.lowMs, event.lastLowMs);
+}
+
+// Run the detector over the trace, returns edges per second
+template <class Detector>
+static double run(const Trace &trace, bool events, Detector &detector) {
+  DetectorConfig config = detector.config();
+  detector.setListener(events ? printEvent : NULL, NULL);
+  detector.reset();
+  if (events) printf("event,micros,car start,bounces,level,pass ms,last high ms,no car ms,low ms,last low ms\n");
+
+  const SensorEdge *edges = trace.edges.data();
+  size_t count = trace.edges.size();
+  std::chrono::steady_clock::time_point start = std::chrono::steady_clock::now();
+  for (size_t i = 0; i < count; i++) {
+    // the detector only sees the magnetometer, beam edges are for the fusion tool
+    if (edges[i].input == 0) detector.onEdge(edges[i].micros, edges[i].level);
+  }
+  if (count) detector.poll(edges[count - 1].micros + (config.stuckTimeoutMs + config.nocarTimeoutMs) * 1000U);
+  double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+  return seconds > 0 ? count / seconds : 0;
+}
+
+static void printResult(const char *profile, const DetectorConfig &config, uint32_t cars,
+                        uint32_t timeouts, double rate) {
+  printf("%s,%u,%u,%u,%u,%u,%u,%.0f\n", profile, config.nocarTimeoutMs, config.bounceGapMs,
+         config.stuckTimeoutMs, config.minBounces, cars, timeouts, rate);
+}
+
+// One of the compiled in profiles, thresholds are constants
+template <class Detector>
+static void runProfile(const Trace &trace, bool events) {
+  Detector detector;
+  double rate = run(trace, events, detector);
+  if (!events) {
+    printResult(detector.profileName(), detector.config(), detector.carsCounted(),
+                detector.timeoutCount(), rate);
+  }
+}
+
+int main(int argc, char **argv) {
+  DetectorConfig config = DETECTOR_DEFAULT_CONFIG;
+  uint32_t bounces = config.minBounces;
+  std::vector<Sweep> sweeps;
+  bool events = false;
+  bool profiles = false;
+  uint32_t repeat = 1;
+  uint32_t synthetic = 0;
+  uint32_t seed = 1;
+  const char *savePath = NULL;
+  const char *paths[2] = {NULL, NULL};
+  int pathCount = 0;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    uint32_t *value = NULL;
+    if (arg[0] == '-' && arg[1] == '-') value = parameter(config, arg + 2, bounces);
+    if (value && hasValue) {
+      *value = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--sweep") == 0 && hasValue) {
+      char *spec = argv[++i];
+      char *eq = strchr(spec, '=');
+      Sweep sweep;
+      if (!eq || sscanf(eq + 1, "%u:%u:%u", &sweep.from, &sweep.to, &sweep.step) != 3 || sweep.step == 0) {
+        usage();
+        return 1;
+      }
+      *eq = 0;
+      sweep.name = spec;
+      if (!parameter(config, sweep.name, bounces)) {
+        fprintf(stderr, "Unknown parameter %s\n", sweep.name);
+        return 1;
+      }
+      sweeps.push_back(sweep);
+    } else if (strcmp(arg, "--profiles") == 0) {
+      profiles = true;
+    } else if (strcmp(arg, "--events") == 0) {
+      events = true;
+    } else if (strcmp(arg, "--repeat") == 0 && hasValue) {
+      repeat = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--synthetic") == 0 && hasValue) {
+      synthetic = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--save") == 0 && hasValue) {
+      savePath = argv[++i];
+    } else if (arg[0] != '-' && pathCount < 2) {
+      paths[pathCount++] = arg;
+    } else {
+      usage();
+      return 1;
+    }
+  }
+
+  Trace loaded;
+  if (synthetic) {
+    makeSyntheticTrace(synthetic, seed, loaded);
+  } else if (!paths[0]) {
+    usage();
+    return 1;
+  } else if (!loadTrace(paths[0], paths[1], loaded)) {
+    return 1;
+  }
+  if (savePath && !saveEdgeTrace(savePath, loaded)) return 1;
+
+  Trace repeated;
+  const Trace *trace = &loaded;
+  if (repeat > 1) {
+    repeatTrace(loaded, repeat, repeated);
+    trace = &repeated;
+  }
+
+  fprintf(stderr, "%zu edges", trace->edges.size());
+  if (trace->loggedCars) fprintf(stderr, ", %u cars counted by the gate", trace->loggedCars);
+  if (trace->loggedTimeouts) fprintf(stderr, ", %u cars without a count", trace->loggedTimeouts);
+  fprintf(stderr, "\n");
+
+  if (!events) printf("profile,nocar,gap,stuck,bounces,cars,timeouts,edges/s\n");
+  if (profiles) {
+    runProfile<NormalExitDetector>(*trace, events);
+    runProfile<BackupProneDetector>(*trace, events);
+    runProfile<EventNightDetector>(*trace, events);
+    return 0;
+  }
+
+  GateDetector detector;
+
+  // walk every combination of the sweep ranges like an odometer
+  for (size_t s = 0; s < sweeps.size(); s++) *parameter(config, sweeps[s].name, bounces) = sweeps[s].from;
+  while (true) {
+    config.minBounces = (uint16_t)bounces;
+    detector.setConfig(config);
+    double rate = run(*trace, events, detector);
+    if (!events) {
+      printResult(detector.profileName(), config, detector.carsCounted(), detector.timeoutCount(),
+                  rate);
+    }
+
+    size_t s = 0;
+    for (; s < sweeps.size(); s++) {
+      uint32_t *value = parameter(config, sweeps[s].name, bounces);
+      if (*value + sweeps[s].step <= sweeps[s].to) {
+        *value += sweeps[s].step;
+        break;
+      }
+      *value = sweeps[s].from;
+    }
+    if (s == sweeps.size()) break;
+  }
+  return 0;
+}
@@ -0,0 +1,245 @@
+#include "SimHal.h"
+
+#include <math.h>
+#include <stdarg.h>
+#include <string.h>
+
+#define SIM_FLUSH_INTERVAL_MS 5000  // LOG_FLUSH_INTERVAL_MS, the SD card durability window
+
+uint32_t SimClock::unixtimeAt(uint32_t micros) {
+  // the timestamp is from the last 71 minutes, unsigned math finds how long ago
+  uint32_t age = (uint32_t)nowUs - micros;
+  uint64_t at = nowUs >= age ? nowUs - age : 0;
+  return startUnixtime + (uint32_t)(at / 1000000);
+}
+
+ScriptedSensors::ScriptedSensors(SimClock &simClock) : clock(simClock), next(0) {
+  for (uint8_t input = 0; input < SIM_INPUTS; input++) levels[input] = SENSOR_HIGH;
+}
+
+void ScriptedSensors::load(const std::vector<SimEdge> &edges) {
+  script = edges;
+  next = 0;
+  for (uint8_t input = 0; input < SIM_INPUTS; input++) levels[input] = SENSOR_HIGH;
+}
+
+bool ScriptedSensors::pop(SensorEdge &edge) {
+  if (done() || script[next].us > clock.now()) return false;
+  const SimEdge &due = script[next++];
+  memset(&edge, 0, sizeof(edge));
+  edge.micros = (uint32_t)due.us;
+  edge.level = due.level;
+  edge.input = due.input;
+  if (due.input < SIM_INPUTS) levels[due.input] = due.level;
+  return true;
+}
+
+uint8_t ScriptedSensors::read(uint8_t input) {
+  return input < SIM_INPUTS ? levels[input] : SENSOR_HIGH;
+}
+
+static void pushEdge(std::vector<SimEdge> &script, uint64_t us, uint8_t level) {
+  SimEdge edge;
+  edge.us = us;
+  edge.level = level;
+  edge.input = 0;
+  script.push_back(edge);
+}
+
+// 0..1, from the 32 bit generator in TraceFile
+static double uniform(uint32_t &state) {
+  return (traceRandom(state, 0, 999999) + 0.5) / 1000000.0;
+}
+
+void makeEventNight(uint32_t hours, uint32_t peakPerHour, uint32_t seed, std::vector<SimEdge> &script) {
+  script.clear();
+  uint32_t state = seed ? seed : 1;
+  const double nightUs = hours * 3600.0 * 1000000.0;
+  uint64_t t = 5000000;  // give the gate a few seconds after boot
+  while (t < nightUs) {
+    // quiet at opening and closing, busiest half way through
+    double phase = sin(M_PI * t / nightUs);
+    double perHour = peakPerHour * (0.15 + 0.85 * phase * phase);
+    if (perHour < 1) perHour = 1;
+
+    uint32_t kind = traceRandom(state, 0, 99);
+    if (kind < 3) {
+      // noise spike, too short to be a car
+      pushEdge(script, t, SENSOR_LOW);
+      t += traceRandom(state, 200, 2000);
+      pushEdge(script, t, SENSOR_HIGH);
+    } else {
+      uint32_t bounces = traceRandom(state, 2, 9);
+      for (uint32_t b = 0; b < bounces; b++) {
+        pushEdge(script, t, SENSOR_LOW);
+        // car parked over the sensor now and then
+        t += (kind < 6 && b == 0) ? traceRandom(state, 8000, 14000) * 1000ULL
+                                  : traceRandom(state, 20, 450) * 1000ULL;
+        pushEdge(script, t, SENSOR_HIGH);
+        t += traceRandom(state, 15, 400) * 1000ULL;
+      }
+    }
+    // arrivals are random at the hour's rate, but a car can't follow closer than a queue does
+    double gapUs = -log(uniform(state)) * 3600.0 * 1000000.0 / perHour;
+    double queueUs = traceRandom(state, 300, 900) * 1000.0;
+    t += (uint64_t)(gapUs > queueUs ? gapUs : queueUs);
+  }
+}
+
+void scriptFromTrace(const Trace &trace, uint64_t startUs, std::vector<SimEdge> &script) {
+  script.clear();
+  if (trace.edges.empty()) return;
+  uint64_t t = startUs;
+  uint32_t last = trace.edges[0].micros;
+  for (size_t i = 0; i < trace.edges.size(); i++) {
+    t += trace.edges[i].micros - last;  // wraps in the trace unwrap here
+    last = trace.edges[i].micros;
+    SimEdge edge;
+    edge.us = t;
+    edge.level = trace.edges[i].level;
+    edge.input = trace.edges[i].input;
+    script.push_back(edge);
+  }
+}
+
+FileLog::~FileLog() {
+  if (file) fclose(file);
+}
+
+bool FileLog::open(const char *dir, const char *name, const char *header) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  file = fopen(path, "wb");
+  if (!file) return false;
+  if (header) fprintf(file, "%s\r\n", header);
+  return true;
+}
+
+bool FileLog::vprintf(const char *format, va_list args) {
+  if (!file) return false;
+  int length = vfprintf(file, format, args);
+  if (length < 0) return false;
+  rows++;
+  bytes += length;
+  return true;
+}
+
+bool FileLog::append(const void *data, size_t length) {
+  if (!file || fwrite(data, 1, length, file) != length) return false;
+  bytes += length;
+  return true;
+}
+
+void FileLog::service(unsigned long nowMillis) {
+  if (nowMillis - lastFlushMillis < SIM_FLUSH_INTERVAL_MS) return;
+  lastFlushMillis = nowMillis;
+  flush();
+}
+
+bool FileLog::flush() {
+  return file && fflush(file) == 0;
+}
+
+FileStore::~FileStore() {
+  if (file) fclose(file);
+}
+
+bool FileStore::open(const char *dir, const char *name) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/%s", dir, name);
+  file = fopen(path, "r+b");
+  if (!file) file = fopen(path, "w+b");
+  return file != NULL;
+}
+
+bool FileStore::read(uint32_t offset, void *data, size_t length) {
+  return file && fseek(file, offset, SEEK_SET) == 0 && fread(data, 1, length, file) == length;
+}
+
+bool FileStore::write(uint32_t offset, const void *data, size_t length) {
+  if (!file || fseek(file, offset, SEEK_SET) != 0 || fwrite(data, 1, length, file) != length) return false;
+  writes++;
+  return true;
+}
+
+bool FileStore::flush() {
+  return file && fflush(file) == 0;
+}
+
+static const char *dayNames[7] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
+static const char *monthNames[12] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+
+TextDisplay::TextDisplay() : redraws(0) {
+  memset(&shown, 0, sizeof(shown));
+  for (uint8_t row = 0; row < TEXT_ROWS; row++) print(row, "");
+}
+
+void TextDisplay::print(uint8_t row, const char *text) {
+  // what doesn't fit runs off the edge, like on the panel
+  size_t length = strlen(text);
+  if (length > TEXT_COLUMNS) length = TEXT_COLUMNS;
+  memset(screen[row], ' ', TEXT_COLUMNS);
+  memcpy(screen[row], text, length);
+  screen[row][TEXT_COLUMNS] = '\0';
+}
+
+// Same layout as EspDisplay, the counts are in the big font there
+void TextDisplay::show(const DisplayValues &values) {
+  if (redraws && memcmp(&values, &shown, sizeof(values)) == 0) return;
+  memcpy(&shown, &values, sizeof(values));
+  redraws++;
+  char line[64];
+  snprintf(line, sizeof(line), "%s %s %u, %u", dayNames[values.dayOfWeek % 7], monthNames[(values.month + 11) % 12],
+           values.day, values.year);
+  print(0, line);
+  unsigned hour = values.hour % 12 ? values.hour % 12 : 12;
+  snprintf(line, sizeof(line), "%02u:%02u:%02u %s Temp: %d", hour, values.minute, values.second,
+           values.hour >= 12 ? "PM" : "AM", values.temp);
+  print(1, line);
+  snprintf(line, sizeof(line), "Exiting:  %d", values.exiting);
+  print(2, line);
+  print(3, "");
+  print(4, "");
+  snprintf(line, sizeof(line), "In Park:  %d", values.inPark);
+  print(5, line);
+}
+
+bool TextDisplay::dump(const char *path) const {
+  FILE *out = fopen(path, "w");
+  if (!out) return false;
+  fprintf(out, "+%.*s+\n", TEXT_COLUMNS, "---------------------");
+  for (uint8_t row = 0; row < TEXT_ROWS; row++) fprintf(out, "|%s|\n", screen[row]);
+  fprintf(out, "+%.*s+\n", TEXT_COLUMNS, "---------------------");
+  fclose(out);
+  return true;
+}
+
+BrokerStub::~BrokerStub() {
+  if (log) fclose(log);
+}
+
+bool BrokerStub::open(const char *dir) {
+  char path[512];
+  snprintf(path, sizeof(path), "%s/mqtt.log", dir);
+  log = fopen(path, "wb");
+  return log != NULL;
+}
+
+static uint32_t occurrences(const char *text, const char *word) {
+  uint32_t count = 0;
+  size_t length = strlen(word);
+  for (const char *at = strstr(text, word); at; at = strstr(at + length, word)) count++;
+  return count;
+}
+
+bool BrokerStub::publish(const char *topic, const char *payload, bool retained) {
+  messages++;
+  bytes += strlen(topic) + strlen(payload);
+  if (log) fprintf(log, "%llu.%06llu %s%s %s\n", (unsigned long long)(clock.now() / 1000000),
+                   (unsigned long long)(clock.now() % 1000000), topic, retained ? " (retained)" : "", payload);
+  cars += occurrences(payload, "\"event\":\"car\"");
+  retracts += occurrences(payload, "\"event\":\"retract\"");
+  confirms += occurrences(payload, "\"event\":\"confirm\"");
+  if (strstr(topic, "/rollup")) rollups++;
+  return true;
+}
@@ -0,0 +1,193 @@
+/*
+The host side of Hal.h, for running GateApp on the PC.
+
+  SimClock          virtual time, the simulator moves it forward
+  ScriptedSensors   edges from a script that come due as the clock passes them
+  FileLog           a log file in the output directory
+  FileStore         a file in the output directory, updated in place
+  TextDisplay       the main screen as 21x8 characters, dumped to a file
+  BrokerStub        writes every publish to mqtt.log and keeps score
+  RingQueue         fixed size queue, never waits
+
+Script times are 64 bit so a whole night can be laid out ahead; the gate
+only sees the low 32 bits, like micros() on the ESP32, and wraps every
+71.6 minutes the same way.
+*/
+#ifndef SIM_HAL_H
+#define SIM_HAL_H
+
+#include <stdint.h>
+#include <stdio.h>
+#include <vector>
+
+#include "Hal.h"
+#include "TraceFile.h"
+
+#define SIM_INPUTS 3
+#define TEXT_COLUMNS 21  // 128 x 64 pixels in the 6 x 8 font
+#define TEXT_ROWS 8
+
+class SimClock : public HalClock {
+ public:
+  SimClock(uint32_t startUnixtime, int16_t temp) : nowUs(0), startUnixtime(startUnixtime), temp(temp) {}
+  uint32_t micros() { return (uint32_t)nowUs; }
+  uint32_t millis() { return (uint32_t)(nowUs / 1000); }
+  uint32_t unixtimeAt(uint32_t micros);
+  int16_t temperature() { return temp; }
+
+  void set(uint64_t us) { nowUs = us; }
+  uint64_t now() const { return nowUs; }
+  uint32_t unixtime() const { return startUnixtime + (uint32_t)(nowUs / 1000000); }
+
+ private:
+  uint64_t nowUs;
+  uint32_t startUnixtime;
+  int16_t temp;
+};
+
+struct SimEdge {
+  uint64_t us;
+  uint8_t level;
+  uint8_t input;
+};
+
+class ScriptedSensors : public HalSensors {
+ public:
+  explicit ScriptedSensors(SimClock &clock);
+  // Edges in time order
+  void load(const std::vector<SimEdge> &script);
+  bool pop(SensorEdge &edge);
+  uint8_t read(uint8_t input);
+
+  bool done() const { return next >= script.size(); }
+  // Time of the next edge, the interrupt would wake the sensing task then
+  uint64_t nextUs() const { return done() ? UINT64_MAX : script[next].us; }
+  uint64_t lastUs() const { return script.empty() ? 0 : script.back().us; }
+  const std::vector<SimEdge> &edges() const { return script; }
+
+ private:
+  SimClock &clock;
+  std::vector<SimEdge> script;
+  size_t next;
+  uint8_t levels[SIM_INPUTS];
+};
+
+// A busy event night: the exit opens quiet, fills to peakPerHour cars an hour around the
+// middle and tails off, with queues, bouncy cars, cars parked over the sensor and noise
+void makeEventNight(uint32_t hours, uint32_t peakPerHour, uint32_t seed, std::vector<SimEdge> &script);
+// A recorded trace, unwrapped onto the 64 bit timeline and started at startUs
+void scriptFromTrace(const Trace &trace, uint64_t startUs, std::vector<SimEdge> &script);
+
+class FileLog : public HalLog {
+ public:
+  FileLog() : file(NULL), lastFlushMillis(0), rows(0), bytes(0) {}
+  ~FileLog();
+  bool open(const char *dir, const char *name, const char *header);
+  void indexDay(uint32_t day) { (void)day; }
+  bool vprintf(const char *format, va_list args);
+  bool append(const void *data, size_t length);
+  void service(unsigned long nowMillis);
+  bool flush();
+
+  uint32_t rowCount() const { return rows; }
+  uint64_t byteCount() const { return bytes; }
+
+ private:
+  FILE *file;
+  unsigned long lastFlushMillis;
+  uint32_t rows;
+  uint64_t bytes;
+};
+
+class FileStore : public HalStore {
+ public:
+  FileStore() : file(NULL), writes(0) {}
+  ~FileStore();
+  // Keeps what is there, like the SD card across a reboot
+  bool open(const char *dir, const char *name);
+  bool read(uint32_t offset, void *data, size_t length);
+  bool write(uint32_t offset, const void *data, size_t length);
+  bool flush();
+
+  uint32_t writeCount() const { return writes; }
+
+ private:
+  FILE *file;
+  uint32_t writes;
+};
+
+class TextDisplay : public HalDisplay {
+ public:
+  TextDisplay();
+  void show(const DisplayValues &values);
+  bool dump(const char *path) const;
+
+  uint32_t redrawCount() const { return redraws; }
+
+ private:
+  void print(uint8_t row, const char *text);
+
+  char screen[TEXT_ROWS][TEXT_COLUMNS + 1];
+  DisplayValues shown;
+  uint32_t redraws;
+};
+
+class BrokerStub : public HalMqtt {
+ public:
+  explicit BrokerStub(SimClock &clock)
+      : clock(clock), log(NULL), messages(0), cars(0), retracts(0), confirms(0), rollups(0), bytes(0) {}
+  ~BrokerStub();
+  bool open(const char *dir);
+  bool publish(const char *topic, const char *payload, bool retained = false);
+
+  uint32_t messageCount() const { return messages; }
+  uint32_t carCount() const { return cars; }
+  uint32_t retractCount() const { return retracts; }
+  uint32_t confirmCount() const { return confirms; }
+  uint32_t rollupCount() const { return rollups; }
+  uint64_t byteCount() const { return bytes; }
+
+ private:
+  SimClock &clock;
+  FILE *log;
+  uint32_t messages;
+  uint32_t cars;      // entries on the events topic
+  uint32_t retracts;
+  uint32_t confirms;
+  uint32_t rollups;   // messages on the rollup topic
+  uint64_t bytes;
+};
+
+// Size is a power of two, like the firmware's queue lengths
+template <class T, uint16_t Size>
+class RingQueue : public HalQueue<T> {
+  static_assert((Size & (Size - 1)) == 0, "RingQueue size must be a power of two");
+
+ public:
+  RingQueue() : head(0), tail(0), highWater(0) {}
+  bool send(const T &item) {
+    if ((uint16_t)(head - tail) >= Size) return false;
+    items[head % Size] = item;
+    head++;
+    if ((uint16_t)(head - tail) > highWater) highWater = head - tail;
+    return true;
+  }
+  // Nothing runs alongside, so there is nothing to wait for
+  bool receive(T &item, uint32_t waitMs) {
+    (void)waitMs;
+    if (head == tail) return false;
+    item = items[tail % Size];
+    tail++;
+    return true;
+  }
+  bool empty() const { return head == tail; }
+  uint16_t highWaterMark() const { return highWater; }
+
+ private:
+  T items[Size];
+  uint16_t head;
+  uint16_t tail;
+  uint16_t highWater;
+};
+
+#endif
@@ -0,0 +1,396 @@
+/*
+Runs the whole gate counter (GateApp) on the PC against a scripted sensor.
+
+  pio run -e sim
+  .pio/build/sim/program                      8 h event night at 100x, about 5 minutes
+  .pio/build/sim/program --fast --hours 8     as fast as it goes
+  .pio/build/sim/program --trace SensorBounces.csv GateCount.csv
+
+The tasks of the firmware are run in turn on a virtual clock at their own
+cadence: sensing on every edge and every SENSING_POLL_MS, logging as soon
+as it has an event and once a second, the network task every 20 ms and the
+display every DISPLAY_REFRESH_MS. From the start and every minute the Car
+Counter's count is sent in on msb/traffic/enter/count. The logs, mqtt.log
+and the last screen (display.txt) go into --out.
+
+At --speed the virtual clock is paced against the wall clock. The report
+has the time each pass took (ns), how far the loop fell behind the paced
+clock, the resident memory across the night and any heap allocations once
+the gate is running. Then the count is checked three ways against a plain
+detector replay of the same edges: the gate's total plus what it took
+back, the GateCount.csv rows and the cars on the events topic less the
+retractions. The rollup has to add up to the total, once more after it is
+read back from Rollup.bin the way a reboot would, and one rollup has to
+have gone out per quarter hour. Last a reboot: a second GateApp on the
+same files restores the counts from Counters.jnl and the last GateCount.csv
+row the way setup() does, and has to come up with the gate's. Exit code 1
+when a check fails or a queue dropped events.
+
+The night starts at 17:30 so it never crosses the 17:00 daily reset.
+*/
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <chrono>
+#include <new>
+#include <thread>
+#include <vector>
+
+#include "CivilTime.h"
+#include "EventFormat.h"
+#include "GateApp.h"
+#include "LatencyHistogram.h"
+#include "SimHal.h"
+#include "TraceFile.h"
+
+#define NIGHT_START "2024-12-14 17:30:00"
+#define NIGHT_TEMP 28             // F, December
+#define NETWORK_PASS_MS 20        // network task waits this long for events
+#define LOGGING_PASS_MS 1000      // logging task wakes at least this often
+#define ENTER_COUNT_MS 60000      // Car Counter publishes its count
+#define TAIL_MS 60000             // run on after the last edge so every timer fires
+#define PACE_SLACK_US 1000        // only sleep when this far ahead of the paced clock
+
+// Heap allocations, counted once the night starts
+static bool countAllocations = false;
+static uint64_t allocations = 0;
+
+void *operator new(size_t size) {
+  if (countAllocations) allocations++;
+  void *memory = malloc(size ? size : 1);
+  if (!memory) throw std::bad_alloc();
+  return memory;
+}
+void operator delete(void *memory) noexcept { free(memory); }
+void operator delete(void *memory, size_t) noexcept { free(memory); }
+
+enum SimPass { PASS_SENSING, PASS_LOGGING, PASS_NETWORK, PASS_DISPLAY, PASSES };
+static const char *passNames[PASSES] = {"sensing", "logging", "network", "display"};
+
+typedef std::chrono::steady_clock WallClock;
+
+static void usage() {
+  fprintf(stderr,
+          "usage: sim [options]\n"
+          "  --hours n         length of the night (default 8, at most 23)\n"
+          "  --peak n          cars an hour at the busiest (default 600)\n"
+          "  --seed n          seed for the made up night\n"
+          "  --trace file [GateCount.csv]  run a recorded trace instead\n"
+          "  --speed x         times real time (default 100)\n"
+          "  --fast            don't pace, run as fast as it goes\n"
+          "  --out dir         logs, mqtt.log and display.txt (default sim-out)\n");
+}
+
+// Resident memory now, in KB, 0 where /proc is missing
+static long residentKb() {
+  FILE *statm = fopen("/proc/self/statm", "r");
+  if (!statm) return 0;
+  long pages = 0, resident = 0;
+  if (fscanf(statm, "%ld %ld", &pages, &resident) != 2) resident = 0;
+  fclose(statm);
+  return resident * 4;
+}
+
+static long peakResidentKb() {
+  struct rusage usage;
+  getrusage(RUSAGE_SELF, &usage);
+  return usage.ru_maxrss;
+}
+
+#if !FUSION_ENABLED
+// Cars counted by the detector alone, fed the same edges with nothing around it
+static uint32_t replayCount(const std::vector<SimEdge> &script, const DetectorConfig &config) {
+  GateDetector detector;
+  detector.setConfig(config);
+  detector.reset();
+  for (size_t i = 0; i < script.size(); i++) {
+    if (script[i].input == SENSOR_INPUT_MAGNETOMETER) detector.onEdge((uint32_t)script[i].us, script[i].level);
+  }
+  if (!script.empty()) detector.poll((uint32_t)script.back().us + (config.stuckTimeoutMs + config.nocarTimeoutMs) * 1000U);
+  return detector.carsCounted();
+}
+
+// Lines in a file, less the header
+static uint32_t csvRows(const char *path) {
+  FILE *file = fopen(path, "r");
+  if (!file) return 0;
+  uint32_t lines = 0;
+  int c;
+  while ((c = fgetc(file)) != EOF) if (c == '\n') lines++;
+  fclose(file);
+  return lines ? lines - 1 : 0;
+}
+#endif
+
+// Last complete line of a file, like readLastRow() in main.cpp
+static bool lastRow(const char *path, char *row, size_t size) {
+  FILE *file = fopen(path, "r");
+  if (!file) return false;
+  row[0] = '\0';
+  char line[512];
+  while (fgets(line, sizeof(line), file)) {
+    if (strchr(line, '\n')) snprintf(row, size, "%s", line);
+  }
+  fclose(file);
+  return row[0] != '\0';
+}
+
+static bool check(const char *what, long got, long expected) {
+  bool ok = got == expected;
+  printf("  %-44s %8ld %8ld  %s\n", what, got, expected, ok ? "ok" : "MISMATCH");
+  return ok;
+}
+
+int main(int argc, char **argv) {
+  uint32_t hours = 8;
+  uint32_t peak = 600;
+  uint32_t seed = 1;
+  double speed = 100;
+  bool fast = false;
+  const char *out = "sim-out";
+  const char *tracePath = NULL;
+  const char *gateCountPath = NULL;
+
+  for (int i = 1; i < argc; i++) {
+    const char *arg = argv[i];
+    bool hasValue = i + 1 < argc;
+    if (strcmp(arg, "--hours") == 0 && hasValue) {
+      hours = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--peak") == 0 && hasValue) {
+      peak = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--seed") == 0 && hasValue) {
+      seed = strtoul(argv[++i], NULL, 10);
+    } else if (strcmp(arg, "--speed") == 0 && hasValue) {
+      speed = atof(argv[++i]);
+    } else if (strcmp(arg, "--fast") == 0) {
+      fast = true;
+    } else if (strcmp(arg, "--out") == 0 && hasValue) {
+      out = argv[++i];
+    } else if (strcmp(arg, "--trace") == 0 && hasValue) {
+      tracePath = argv[++i];
+      if (i + 1 < argc && argv[i + 1][0] != '-') gateCountPath = argv[++i];
+    } else {
+      usage();
+      return 2;
+    }
+  }
+  if (hours < 1 || hours > 23 || speed <= 0) {
+    usage();
+    return 2;
+  }
+
+  std::vector<SimEdge> script;
+  if (tracePath) {
+    Trace trace;
+    if (!loadTrace(tracePath, gateCountPath, trace)) {
+      fprintf(stderr, "could not read %s\n", tracePath);
+      return 1;
+    }
+    scriptFromTrace(trace, 5000000, script);
+  } else {
+    makeEventNight(hours, peak, seed, script);
+  }
+
+  mkdir(out, 0755);
+  CivilTime start;
+  memset(&start, 0, sizeof(start));
+  sscanf(NIGHT_START, "%hu-%hhu-%hhu %hhu:%hhu:%hhu", &start.year, &start.month, &start.day, &start.hour,
+         &start.minute, &start.second);
+
+  // The same headers as the LogWriters in main.cpp
+  SimClock clock(civilUnixtime(start), NIGHT_TEMP);
+  ScriptedSensors sensors(clock);
+  sensors.load(script);
+  FileLog gateCountLog, correctionLog, bounceLog, binLog;
+  gateCountLog.open(out, "GateCount.csv", GATE_COUNT_HEADER);
+  correctionLog.open(out, "GateCorrections.csv", CORRECTION_HEADER);
+#if LOG_BOUNCES_CSV
+  bounceLog.open(out, "SensorBounces.csv", BOUNCE_HEADER);
+#endif
+  BinLogHeader header;
+  binLogHeader(header, clock.unixtime());
+  binLog.open(out, "GateLog.bin", NULL);
+  binLog.append(&header, sizeof(header));
+  // a new night, not one carried on from an earlier run
+  char path[512];
+  snprintf(path, sizeof(path), "%s/Rollup.bin", out);
+  remove(path);
+  snprintf(path, sizeof(path), "%s/Counters.jnl", out);
+  remove(path);
+  FileStore rollupStore, counterStore;
+  rollupStore.open(out, "Rollup.bin");
+  counterStore.open(out, "Counters.jnl");
+  TextDisplay display;
+  BrokerStub broker(clock);
+  broker.open(out);
+  RingQueue<GateEvent, 64> logQueue;    // LOG_QUEUE_LENGTH
+  RingQueue<GateEvent, 16> netQueue;    // NET_QUEUE_LENGTH
+  RingQueue<GateCommand, 8> commandQueue;  // COMMAND_QUEUE_LENGTH
+  GateHal hal = {&clock, &sensors, &gateCountLog, &correctionLog, &bounceLog, &binLog, &rollupStore,
+                 &counterStore, &display, &broker, &logQueue, &netQueue, &commandQueue};
+
+  static GateApp gate(hal);  // the firmware's is a global too
+  gate.restoreCounters(NULL);
+  gate.scheduleBegin();
+  DetectorConfig config = DETECTOR_PROFILE_CONFIG(GATE_PROFILE);
+  gate.sensingBegin(config);
+  gate.rollupBegin();
+
+  uint64_t endUs = (uint64_t)hours * 3600 * 1000000;
+  if (sensors.lastUs() + TAIL_MS * 1000ULL > endUs) endUs = sensors.lastUs() + TAIL_MS * 1000ULL;
+  printf("%u edges over %.2f h, profile %s, %s\n", (unsigned)script.size(), endUs / 3600e6, gate.profileName(),
+         fast ? "as fast as it goes" : "paced");
+  if (!fast) printf("%.0fx real time, about %.0f s\n", speed, endUs / 1e6 / speed);
+  fflush(stdout);
+
+  LatencyHistogram passTimes[PASSES];
+  LatencyHistogram lag;  // us behind the paced clock, per wake up
+  long rssByHour[24];
+  memset(rssByHour, 0, sizeof(rssByHour));
+  long rssStart = residentKb();
+  uint64_t nextSensing = 0, nextLogging = 0, nextNetwork = 0, nextDisplay = 0, nextEnter = 0;
+  uint64_t nextHour = 0;
+  uint32_t hour = 0;
+  WallClock::time_point wallStart = WallClock::now();
+  countAllocations = true;
+
+  for (;;) {
+    uint64_t now = nextSensing;
+    if (sensors.nextUs() < now) now = sensors.nextUs();
+    if (nextLogging < now) now = nextLogging;
+    if (nextNetwork < now) now = nextNetwork;
+    if (nextDisplay < now) now = nextDisplay;
+    if (nextEnter < now) now = nextEnter;
+    if (now > endUs) break;
+    clock.set(now);
+
+    if (!fast) {
+      WallClock::time_point due = wallStart + std::chrono::microseconds((uint64_t)(now / speed));
+      WallClock::time_point wall = WallClock::now();
+      if (wall + std::chrono::microseconds(PACE_SLACK_US) < due) {
+        std::this_thread::sleep_until(due);
+      } else if (wall > due) {
+        lag.record((uint32_t)std::chrono::duration_cast<std::chrono::microseconds>(wall - due).count());
+      }
+    }
+    if (now >= nextHour) {
+      if (hour < 24) rssByHour[hour++] = residentKb();
+      nextHour += 3600 * 1000000ULL;
+    }
+
+    if (now >= nextEnter) {
+      // the Car Counter has seen everyone who left plus those still in the park
+      char count[12];
+      snprintf(count, sizeof(count), "%d", gate.dailyCars() + 40);
+      gate.handleMessage(MQTT_SUB_TOPIC0, count);
+      nextEnter = now + ENTER_COUNT_MS * 1000ULL;
+    }
+    if (now >= nextSensing || now >= sensors.nextUs()) {
+      WallClock::time_point begin = WallClock::now();
+      gate.sensingPass();
+      passTimes[PASS_SENSING].record((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - begin).count());
+      nextSensing = now + SENSING_POLL_MS * 1000ULL;
+    }
+    // the logging task is blocked on its queue, it runs as soon as there is an event
+    if (!logQueue.empty() || now >= nextLogging) {
+      WallClock::time_point begin = WallClock::now();
+      GateEvent event;
+      while (logQueue.receive(event, 0)) gate.logEvent(event);
+      gate.serviceLogs(clock.millis());
+      passTimes[PASS_LOGGING].record((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - begin).count());
+      nextLogging = now + LOGGING_PASS_MS * 1000ULL;
+    }
+    if (now >= nextNetwork) {
+      WallClock::time_point begin = WallClock::now();
+      GateEvent event;
+      while (netQueue.receive(event, 0)) gate.publishGateEvent(event);
+      gate.publishEvents();
+      gate.serviceRollup();
+      passTimes[PASS_NETWORK].record((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - begin).count());
+      nextNetwork = now + NETWORK_PASS_MS * 1000ULL;
+    }
+    if (now >= nextDisplay) {
+      WallClock::time_point begin = WallClock::now();
+      gate.displayPass();
+      passTimes[PASS_DISPLAY].record((uint32_t)std::chrono::duration_cast<std::chrono::nanoseconds>(WallClock::now() - begin).count());
+      nextDisplay = now + DISPLAY_REFRESH_MS * 1000ULL;
+    }
+  }
+  countAllocations = false;
+  double wallSeconds = std::chrono::duration<double>(WallClock::now() - wallStart).count();
+  GateEvent event;
+  while (logQueue.receive(event, 0)) gate.logEvent(event);
+  gate.flushLogs();
+
+  snprintf(path, sizeof(path), "%s/display.txt", out);
+  display.dump(path);
+
+  printf("\n%.1f s on the wall clock, %.0fx real time\n", wallSeconds, endUs / 1e6 / wallSeconds);
+  printf("\npass        count      p50 ns      p99 ns      max ns\n");
+  for (uint8_t pass = 0; pass < PASSES; pass++) {
+    const LatencyHistogram &times = passTimes[pass];
+    printf("%-8s %8u %11u %11u %11u\n", passNames[pass], times.count(), times.percentile(50), times.percentile(99), times.max());
+  }
+  if (!fast) {
+    printf("\nlate against the paced clock: %u of the wake ups, p99 %u us, max %u us (wall clock, OS sleeps included)\n",
+           lag.count(), lag.percentile(99), lag.max());
+  }
+
+  printf("\nmemory: GateApp %u bytes, queues %u bytes, resident %ld KB at the start, peak %ld KB\n",
+         (unsigned)sizeof(GateApp), (unsigned)(sizeof(logQueue) + sizeof(netQueue) + sizeof(commandQueue)),
+         rssStart, peakResidentKb());
+  printf("resident by hour (KB):");
+  for (uint32_t h = 0; h < hour; h++) printf(" %ld", rssByHour[h]);
+  printf("\nheap allocations during the night: %llu\n", (unsigned long long)allocations);
+  printf("queue high water: log %u/64, net %u/16, command %u/8\n", logQueue.highWaterMark(),
+         netQueue.highWaterMark(), commandQueue.highWaterMark());
+  printf("log bytes: GateCount.csv %llu, GateCorrections.csv %llu, GateLog.bin %llu\n",
+         (unsigned long long)gateCountLog.byteCount(), (unsigned long long)correctionLog.byteCount(),
+         (unsigned long long)binLog.byteCount());
+  printf("mqtt: %u messages, %llu bytes, display redrawn %u times\n", broker.messageCount(),
+         (unsigned long long)broker.byteCount(), display.redrawCount());
+  printf("rollup: %u published, %u writes to Rollup.bin\n", broker.rollupCount(), rollupStore.writeCount());
+  printf("journal: %u writes to Counters.jnl\n", counterStore.writeCount());
+
+  // read Rollup.bin back like rollupBegin() does after a reboot
+  static CountRollup restored(DAILY_RESET_HOUR);
+  restored.startDay(clock.unixtime());
+  rollupStore.flush();
+  rollupStore.read(8, restored.minuteData(), ROLLUP_MINUTES * sizeof(int16_t));  // after the magic and the day
+  restored.rebuild();
+  uint32_t startMinute = gate.countRollup().minuteOf(civilUnixtime(start));
+
+  // and reboot, restoring the counts the way setup() does
+  static GateApp rebooted(hal);
+  char row[512];
+  snprintf(path, sizeof(path), "%s/GateCount.csv", out);
+  bool hasRow = lastRow(path, row, sizeof(row));
+  WallClock::time_point restoreStart = WallClock::now();
+  uint8_t counterSource = rebooted.restoreCounters(hasRow ? row : NULL);
+  double restoreUs = std::chrono::duration<double, std::micro>(WallClock::now() - restoreStart).count();
+  printf("restored from %s in %.0f us\n", counterSourceName(counterSource), restoreUs);
+  uint32_t endMinute = gate.countRollup().minuteOf(clock.unixtime());
+
+  bool ok = true;
+  printf("\ncheck                                             gate replay\n");
+#if FUSION_ENABLED
+  printf("  the beams count in this build and the script has none, no count checks\n");
+#else
+  uint32_t expected = replayCount(script, config);
+  snprintf(path, sizeof(path), "%s/GateCount.csv", out);
+  ok &= check("cars counted (total + retracted)", gate.dailyCars() + (long)gate.retractions(), expected);
+  ok &= check("GateCount.csv rows", csvRows(path), expected);
+  ok &= check("events topic (cars - retracts) vs total", (long)broker.carCount() - broker.retractCount(), gate.dailyCars());
+  ok &= check("rollup vs total", gate.countRollup().total(), gate.dailyCars());
+#endif
+  ok &= check("Rollup.bin read back vs rollup", restored.total(), gate.countRollup().total());
+  ok &= check("restored after a reboot, Car#", rebooted.dailyCars(), gate.dailyCars());
+  ok &= check("restored after a reboot, Cars In Park", rebooted.carsInPark(), gate.carsInPark());
+  ok &= check("rollups published vs quarters closed", broker.rollupCount(), endMinute / 15 - startMinute / 15);
+  ok &= check("log queue drops", gate.logQueueDrops(), 0);
+  ok &= check("net queue drops", gate.netQueueDrops(), 0);
+  printf("\n%d cars exited, %d in the park, %u counts taken back\n", gate.dailyCars(), gate.carsInPark(), gate.retractions());
+  return ok ? 0 : 1;
+}
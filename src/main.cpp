@@ -6,7 +6,7 @@ Added MQTT to Hive MQTT and Fixed WIFI for Testing at home and on-site7 12/15/23
 
 Purpose: suppliments Car Counter to improve traffic control and determine park capacity
 Counts vehicles as they exit the park
-Connects to WiFi and updates RTC on Boot
+Counts from the RTC straight after boot, WiFi, NTP and MQTT come up in the background
 Uses an Optocoupler to read burried vehicle sensor for Ghost Controls Gate operating at 12V
 DOIT DevKit V1 ESP32 with built-in WiFi & Bluetooth
 SPI Pins
@@ -26,7 +26,6 @@ D23 - MOSI
 #include "NTPClient.h"
 #include "WIFI.h"
 #include "WiFiClientSecure.h"
-#include "WiFiMulti.h"
 #include "secrets.h"
 #include "time.h"
 //#include "FS.h"
@@ -38,11 +37,49 @@ D23 - MOSI
 #include <ESPAsyncWebServer.h>
 #include <AsyncElegantOTA.h>
 //#include <Arduino_JSON.h>
+#include "EdgeCapture.h"
+#include "GateApp.h"
+#include "Esp32Hal.h"
+#include "LogWriter.h"
+#include "BinLog.h"
+#include "EventFormat.h"
+#include "MqttOutbox.h"
+#include "DisplayRefresh.h"
+#include "TimeService.h"
+#include "Profiler.h"
+#include "LiveStream.h"
+#include "LogServer.h"
+#include "GateSettings.h"
+#include "ConnectionManager.h"
+#include "JobScheduler.h"
+#include "esp_system.h"
 
 #define vehicleSensorPin 4
+#define beamParkSidePin 32 // optical beams for the direction, LOW while broken
+#define beamRoadSidePin 33
 #define PIN_SPI_CS 5 // The ESP32 pin GPIO5
 #define MQTT_KEEPALIVE 30
 
+// FreeRTOS tasks, sensing gets core 1 to itself (plus the Arduino loop with the display)
+#define SENSING_CORE 1
+#define SENSING_PRIORITY 5
+#define LOGGING_CORE 0
+#define LOGGING_PRIORITY 2
+#define NETWORK_CORE 0
+#define NETWORK_PRIORITY 3
+#define LOG_QUEUE_LENGTH 64
+#define NET_QUEUE_LENGTH 16
+#define COMMAND_QUEUE_LENGTH 8
+#define GATE_COUNT_TAIL_SIZE 200  // a GateCount.csv row is about 100 chars
+
+// Per car / per bounce dump on Serial, /live.html shows the same without the cost.
+// The level is set at runtime ({"verbosity":n} on the config topic, 0 off, 1 cars, 2 bounces),
+// set SERIAL_DEBUG to 0 (or -DSERIAL_DEBUG=0 in build_flags) to compile the dump out altogether.
+#ifndef SERIAL_DEBUG
+#define SERIAL_DEBUG 1
+#endif
+#define LOG_VERBOSITY_DEFAULT LOG_VERBOSE_OFF
+
 // HiveMQ Cloud Let's Encrypt CA certificate
 static const char *root_ca PROGMEM = R"EOF(
 -----BEGIN CERTIFICATE-----
@@ -84,6 +121,7 @@ AsyncWebServer server(80);
 
 //#include <DS3231.h>
 RTC_DS3231 rtc;
+TimeService timeService(rtc); // all timestamps come from here, not straight from the RTC
 int line1 =0;
 int line2 =9;
 int line3 = 20;
@@ -92,15 +130,25 @@ int line5 = 42;
 int line6 = 50;
 int line7 = 53;
 
-//Create Multiple WIFI Object
+// Known WiFi networks, the strongest one in range is joined
+struct WifiAp {
+  const char *ssid;
+  const char *pass;
+};
+const WifiAp wifiAps[] = {
+  {secret_ssid_AP_1, secret_pass_AP_1},
+  {secret_ssid_AP_2, secret_pass_AP_2},
+  {secret_ssid_AP_3, secret_pass_AP_3},
+  {secret_ssid_AP_4, secret_pass_AP_4},
+  {secret_ssid_AP_5, secret_pass_AP_5},
+};
+#define WIFI_AP_COUNT (sizeof(wifiAps) / sizeof(wifiAps[0]))
 
-WiFiMulti wifiMulti;
 WiFiClientSecure espGateCounter;
 PubSubClient mqtt_client(espGateCounter);
+MqttOutbox mqttOutbox("/outbox"); // messages waiting for WiFi / the broker
 
 unsigned long lastMsg = 0;
-#define MSG_BUFFER_SIZE (500)
-char msg[MSG_BUFFER_SIZE];
 int value = 0;
 
 char mqtt_server[] = mqtt_Server;
@@ -109,20 +157,8 @@ char mqtt_password[] = mqtt_Password;
 const int mqtt_port = mqtt_Port;
 
 #define THIS_MQTT_CLIENT "espGateCounter" // Look at line 90 and set variable for WiFi Client secure & PubSubCLient 12/23/23
-#define MQTT_PUB_TOPIC0  "msb/traffic/exit/hello"
-#define MQTT_PUB_TOPIC1  "msb/traffic/exit/temp"
-#define MQTT_PUB_TOPIC2  "msb/traffic/exit/time"
-#define MQTT_PUB_TOPIC3  "msb/traffic/exit/count"
-#define MQTT_PUB_TOPIC4  "msb/traffic/exit/inpark"
-#define MQTT_PUB_TOPIC5  "msb/traffic/exit/timeout"
-
-#define MQTT_SUB_TOPIC0  "msb/traffic/enter/count"
-#define MQTT_SUB_TOPIC1  "msb/traffic/exit/resetcount"
 
 
-//const uint32_t connectTimeoutMs = 10000;
-uint16_t connectTimeOutPerAP=5000;
-const char* ampm ="AM";
 const char* ntpServer = "pool.ntp.org";
 const long  gmtOffset_sec = -21600;
 const int   daylightOffset_sec = 3600;
@@ -133,56 +169,76 @@ char buf2[25] = "YYYY-MM-DD hh:mm:ss";
 int currentDay = 0;
 int currentHour = 0;
 int currentMin = 0;
-int totalDailyCars = 0;
-int carCounterCars =0;
-int sensorBounceCount=0;
-int sensorBounceRemainder;
-bool sensorBounceFlag;
-
-bool carPresentFlag = 0;
-
-bool nocarTimerFlag = 0;
-unsigned long nocarTimerMillis =0;
-bool detectorState =1;
-bool lastdetectorState =1;
-unsigned long whileMillis; // used for debugging
-unsigned long lastwhileMillis = 0;
-unsigned long detectorStateLowMillis; // used for debugging
-unsigned long lastdetectorStateLowMillis = 0;
-unsigned long detectorStateHighMillis;
-unsigned long lastdetectorStateHighMillis;
-
-//###############################################################################################################
-unsigned long nocarTimeoutMillis = 900; // Time required for High Pin to stay high to reset car in detection zone
-unsigned long carpassingTimoutMillis = 6000; // Time delay to allow car to pass before checking for HIGN pin
-
-//unsigned long highMillis = 0; //Grab the time when the vehicle sensor is high
-unsigned long previousMillis; // Last time sendor pin changed state
-unsigned long currentMillis; // Comparrison time holder
-unsigned long carDetectedMillis;  // Grab the ime when sensor 1st trips
-unsigned long lastcarDetectedMillis;  // Grab the ime when sensor 1st trips
-
-
-unsigned long wifi_lastReconnectAttemptMillis;
-unsigned long wifi_connectioncheckMillis = 5000; // check for connection every 5 sec
-unsigned long mqtt_lastReconnectAttemptMillis;
-unsigned long mqtt_connectionCheckMillis = 5000;
-unsigned long nowwifi;
-unsigned long nowmqtt;
-
-
-
 
+GateSettings gateSettings;              // what was asked for, owned by the network task
+volatile uint8_t logVerbosity = LOG_VERBOSITY_DEFAULT;
+
+// Queues between the tasks, see GateEvent.h
+EspQueue<GateEvent> logQueue;
+EspQueue<GateEvent> netQueue;
+EspQueue<GateCommand> commandQueue;
+TaskHandle_t sensingTaskHandle;
+
+// WiFi, NTP and MQTT come up in the background, each one a small state machine the
+// network task steps on every pass. No step waits: what isn't done yet is looked at
+// again on the next pass. When to try again after a failure is up to the link's
+// ConnectionManager (jittered, doubling from RETRY_MIN_MS up to RETRY_MAX_MS).
+#define WIFI_SCAN_TIMEOUT_MS 10000
+#define WIFI_JOIN_TIMEOUT_MS 15000
+#define NTP_TIMEOUT_MS 15000
+#define NTP_RESYNC_HOUR 12  // SNTP keeps the system clock right, the RTC is set from it daily, between events
+#define RETRY_MIN_MS 2000
+#define RETRY_MAX_MS 60000
+// The broker connect (DNS, TCP, TLS, CONNACK) can't be made non-blocking with
+// WiFiClientSecure, these keep one attempt from holding the network task for long
+#define MQTT_HANDSHAKE_TIMEOUT_S 8
+#define MQTT_SOCKET_TIMEOUT_S 5
+#define LINK_STATS_INTERVAL_S 900  // connection counters on MQTT_PUB_TOPIC8, on the quarter hour
+
+enum WifiState : uint8_t { WIFI_IDLE, WIFI_SCANNING, WIFI_JOINING, WIFI_CONNECTED };
+enum NtpState : uint8_t { NTP_IDLE, NTP_WAITING, NTP_SYNCED };
+
+// seeded in setup() once the radio is on, esp_random() is only pseudo random before that
+ConnectionManager wifiLink(RETRY_MIN_MS, RETRY_MAX_MS, 0);
+ConnectionManager ntpLink(RETRY_MIN_MS, RETRY_MAX_MS, 0);
+ConnectionManager mqttLink(RETRY_MIN_MS, RETRY_MAX_MS, 0);
+WifiState wifiState = WIFI_IDLE;
+unsigned long wifiStateMillis;
+NtpState ntpState = NTP_IDLE;
+unsigned long ntpStateMillis;
+JobScheduler networkJobs;  // NTP resync and the link counters, off the cached clock
+
+// NTP time for loop() to write to the RTC, the I2C bus is the display's as well
+volatile uint32_t ntpUnixtime = 0;
+
+
+
+// Log files on the SD card, kept open and written in batches by the logging task
+LogWriter gateCountLog("/GateCount.csv", GATE_COUNT_HEADER);
+LogWriter correctionLog("/GateCorrections.csv", CORRECTION_HEADER);
+LogWriter bounceLog("/SensorBounces.csv", BOUNCE_HEADER);
+BinLogHeader binLogFileHeader;
+LogWriter binLog("/GateLog.bin", &binLogFileHeader, sizeof(binLogFileHeader));
+EspFileStore rollupStore("/Rollup.bin"); // exits per minute for the day, network task
+EspFileStore counterStore("/Counters.jnl"); // counter journal, logging task
+char gateCountTail[GATE_COUNT_TAIL_SIZE];  // last GateCount.csv row from before the reboot
 
 
-File myFile; //used to write files to SD Card
-File myFile2;
+Adafruit_SSD1306 display = Adafruit_SSD1306(128, 64, &Wire, -1);
+DisplayRefresh displayRefresh(display, Wire, 0x3C);
 
-char days[7][4] = {"Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat"};
-char months[12][4] = {"Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec"};
+unsigned long lastDisplayMillis = 0;
 
+// The hardware the gate logic runs on (include/Esp32Hal.h), and the gate (include/GateApp.h)
+const uint8_t sensorPins[] = {vehicleSensorPin, beamParkSidePin, beamRoadSidePin}; // SENSOR_INPUT_* order
+EspClock espClock(timeService);
+EspSensors espSensors(sensorPins, sizeof(sensorPins));
+EspDisplay espDisplay(display, displayRefresh);
+EspMqtt espMqtt(mqtt_client, mqttOutbox);
+GateHal gateHal = {&espClock, &espSensors, &gateCountLog, &correctionLog, &bounceLog, &binLog, &rollupStore,
+                   &counterStore, &espDisplay, &espMqtt, &logQueue, &netQueue, &commandQueue};
+GateApp gate(gateHal);
 
-Adafruit_SSD1306 display = Adafruit_SSD1306(128, 64, &Wire, -1);
 /*
 unsigned long ota_progress_millis = 0;
 
@@ -213,47 +269,44 @@ void onOTAEnd(bool success) {
 
 
 
-void setup_wifi() {
-    Serial.println("Connecting to WiFi");
-    display.println("Connecting to WiFi..");
-    display.display();
-    while(wifiMulti.run(connectTimeOutPerAP) != WL_CONNECTED) {
-      //Serial.print(".");
-    }
-    Serial.println("Connected to the WiFi network");
-    display.clearDisplay();
-    display.setTextColor(WHITE);
-    display.setTextSize(1);
-    display.display();
-   // print the SSID of the network you're attached to:
-    display.setCursor(0, line1);
-    display.print("SSID: ");
-    display.println(WiFi.SSID());
-
-    Serial.print("SSID: ");
-    Serial.println(WiFi.SSID());
-
-    // print your board's IP address:
-    IPAddress ip = WiFi.localIP();
-    Serial.print("IP: ");
-    Serial.println(ip);
-    display.setCursor(0, line2);
-    display.print("IP: ");
-    display.println(ip);
-
-    // print the received signal strength:
-    long rssi = WiFi.RSSI();
-    Serial.print("signal strength (RSSI):");
-    Serial.print(rssi);
-    Serial.println(" dBm");
-    display.setCursor(0, line3);
-    display.print("signal: ");
-    display.print(rssi);
-    display.println(" dBm");
-    display.display();
-    delay(5000);
+// Settings as the detector uses them, plus what was wrong with the last config message
+void publishActiveConfig(const char *error) {
+  GateSettings active;
+  active.detector = gate.activeConfig();
+  active.verbosity = logVerbosity;
+  char json[192];
+  if (settingsJson(active, gate.profileName(), error, json, sizeof(json))) {
+    espMqtt.publish(MQTT_PUB_TOPIC7, json, true);  // retained, so a dashboard sees it on connect
+  }
 }
 
+void handleConfigMessage(const char *json) {
+  GateSettings updated = gateSettings;
+  bool defaults;
+  const char *error = settingsParse(json, updated, defaults);
+  if (!error && defaults) {
+    settingsClear();
+    DetectorConfig profile = DETECTOR_PROFILE_CONFIG(GATE_PROFILE);
+    settingsLoad(updated, profile, LOG_VERBOSITY_DEFAULT);
+  }
+#if DETECTOR_FIXED
+  if (!error && memcmp(&updated.detector, &gateSettings.detector, sizeof(DetectorConfig)) != 0) {
+    error = "thresholds are fixed in this build";
+  }
+#endif
+  if (error) {
+    Serial.print("Config rejected: ");
+    Serial.println(error);
+    publishActiveConfig(error);
+    return;
+  }
+  gateSettings = updated;
+  if (!defaults && !settingsSave(gateSettings)) Serial.println("Could not save settings to NVS");
+  logVerbosity = gateSettings.verbosity;
+
+  // the sensing task switches over once no car is on the sensor and echoes it then
+  if (!gate.sendDetectorConfig(gateSettings.detector)) publishActiveConfig("busy, try again");
+}
 
 void callback(char* topic, byte* payload, unsigned int length) {
   Serial.print("Message arrived [");
@@ -264,87 +317,451 @@ void callback(char* topic, byte* payload, unsigned int length) {
   }
   payload[length] = '\0';
  
-  if (strcmp(topic, MQTT_SUB_TOPIC0) == 0) {
-     carCounterCars = atoi((char *)payload);
-//     Serial.println(" Car Counter Updated");
-    }
-  
-  if (strcmp(topic, MQTT_SUB_TOPIC1) == 0){
-    totalDailyCars = atoi((char *)payload);
-//    Serial.println(" Gate Counter Updated");
+  // Counters belong to the sensing task, the gate hands the new values over
+  gate.handleMessage(topic, (char *)payload);
+
+  if (strcmp(topic, MQTT_SUB_TOPIC2) == 0) {
+    handleConfigMessage((char *)payload);
   }
   //  Serial.println(carCountCars);
   Serial.println();
 }
 
 
-void reconnect() {
-  // Loop until we’re reconnected
-  while (!mqtt_client.connected()) {
-    Serial.print("Attempting MQTT connection… ");
-    String clientId = THIS_MQTT_CLIENT;
-    // Attempt to connect
-    if (mqtt_client.connect(clientId.c_str(), mqtt_username, mqtt_password)) {
-      Serial.println("connected!");
-      Serial.println("Waiting for Car");
-      // Once connected, publish an announcement…
-      mqtt_client.publish(MQTT_PUB_TOPIC0, "Hello from Gate Counter!");
-      // … and resubscribe
-      mqtt_client.subscribe(MQTT_PUB_TOPIC0);
-    } else {
-      Serial.print("failed, rc = ");
-      Serial.print(mqtt_client.state());
-      Serial.println(" try again in 5 seconds");
-    }
+// One try at the broker, the network task calls again later if it fails
+bool reconnect() {
+  Serial.print("Attempting MQTT connection… ");
+  String clientId = THIS_MQTT_CLIENT;
+  if (!mqtt_client.connect(clientId.c_str(), mqtt_username, mqtt_password)) {
+    Serial.print("failed, rc = ");
+    Serial.println(mqtt_client.state());
+    return false;
   }
+  Serial.println("connected!");
+  // Once connected, publish an announcement…
+  mqtt_client.publish(MQTT_PUB_TOPIC0, "Hello from Gate Counter!");
+  // … and resubscribe
+  mqtt_client.subscribe(MQTT_PUB_TOPIC0);
   mqtt_client.subscribe(MQTT_SUB_TOPIC0);
   mqtt_client.subscribe(MQTT_SUB_TOPIC1);
+  mqtt_client.subscribe(MQTT_SUB_TOPIC2);
+  publishActiveConfig(NULL);
+  return true;
+}
+
+void setWifiState(WifiState state) {
+  wifiState = state;
+  wifiStateMillis = millis();
+}
+
+// error: -1 no known network, -2 the scan failed, otherwise WiFi.status()
+void wifiFailed(unsigned long now, int16_t error) {
+  wifiLink.failed(now, error);
+  Serial.print("WiFi not connected (");
+  Serial.print(error);
+  Serial.print("), trying again in ");
+  Serial.print(wifiLink.retryInMs(now) / 1000);
+  Serial.println(" s");
+  setWifiState(WIFI_IDLE);
 }
 
-void SetLocalTime() {
+// Strongest known network in the scan results, -1 if none of them is in range
+int bestWifiAp(int found) {
+  int best = -1;
+  int32_t bestRssi = -1000;
+  for (int i = 0; i < found; i++) {
+    for (uint8_t ap = 0; ap < WIFI_AP_COUNT; ap++) {
+      if (WiFi.SSID(i) == wifiAps[ap].ssid && WiFi.RSSI(i) > bestRssi) {
+        best = ap;
+        bestRssi = WiFi.RSSI(i);
+      }
+    }
+  }
+  return best;
+}
+
+// Scan in the background, join the strongest known network, start over when it drops
+bool wifiService(unsigned long now) {
+  switch (wifiState) {
+    case WIFI_IDLE:
+      if (!wifiLink.due(now)) break;
+      wifiLink.attempt(now);
+      WiFi.scanNetworks(true);  // async, results come in scanComplete()
+      setWifiState(WIFI_SCANNING);
+      break;
+    case WIFI_SCANNING: {
+      int found = WiFi.scanComplete();
+      if (found == WIFI_SCAN_RUNNING) {
+        if (now - wifiStateMillis > WIFI_SCAN_TIMEOUT_MS) {
+          WiFi.scanDelete();
+          wifiFailed(now, -2);
+        }
+        break;
+      }
+      if (found < 0) {
+        wifiFailed(now, -2);
+        break;
+      }
+      int ap = bestWifiAp(found);
+      WiFi.scanDelete();
+      if (ap < 0) {
+        wifiFailed(now, -1);
+        break;
+      }
+      Serial.print("Connecting to WiFi ");
+      Serial.println(wifiAps[ap].ssid);
+      WiFi.begin(wifiAps[ap].ssid, wifiAps[ap].pass);
+      setWifiState(WIFI_JOINING);
+      break;
+    }
+    case WIFI_JOINING:
+      if (WiFi.status() == WL_CONNECTED) {
+        wifiLink.connected(now);
+        profileMilestone(BOOT_WIFI, now);
+        Serial.print("Connected to the WiFi network ");
+        Serial.print(WiFi.SSID());
+        Serial.print(", IP: ");
+        Serial.print(WiFi.localIP());
+        Serial.print(", signal strength (RSSI): ");
+        Serial.print(WiFi.RSSI());
+        Serial.print(" dBm, ");
+        Serial.print(now);
+        Serial.println(" ms after boot");
+        mqttLink.retryNow(now);  // no point waiting out a backoff from before
+        setWifiState(WIFI_CONNECTED);
+      } else if (now - wifiStateMillis > WIFI_JOIN_TIMEOUT_MS) {
+        int16_t status = WiFi.status();
+        WiFi.disconnect();
+        wifiFailed(now, status);
+      }
+      break;
+    case WIFI_CONNECTED:
+      if (WiFi.status() != WL_CONNECTED) {
+        Serial.println("WiFi connection lost");
+        wifiLink.lost(now);
+        setWifiState(WIFI_IDLE);
+      }
+      break;
+  }
+  return wifiState == WIFI_CONNECTED;
+}
+
+void setNtpState(NtpState state) {
+  ntpState = state;
+  ntpStateMillis = millis();
+}
+
+// NTP time as the RTC keeps it, local time, for loop() to set the RTC with
+void handOverNtpTime(const struct tm &timeinfo) {
+  ntpUnixtime = DateTime(timeinfo.tm_year + 1900, timeinfo.tm_mon + 1, timeinfo.tm_mday, timeinfo.tm_hour,
+                         timeinfo.tm_min, timeinfo.tm_sec).unixtime();
+}
+
+// Start SNTP once WiFi is up and hand the time to loop() for the RTC when it has it
+void ntpService(unsigned long now) {
   struct tm timeinfo;
-  if(!getLocalTime(&timeinfo)){
-    Serial.println("Failed to obtain time. Using Compiled Date");
-    return;
+  switch (ntpState) {
+    case NTP_IDLE:
+      if (!ntpLink.due(now)) break;
+      ntpLink.attempt(now);
+      configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
+      setNtpState(NTP_WAITING);
+      break;
+    case NTP_WAITING:
+      if (getLocalTime(&timeinfo, 0)) {  // 0, just look, don't wait for it
+        ntpLink.connected(now);
+        Serial.print("NTP time ");
+        Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
+        handOverNtpTime(timeinfo);
+        setNtpState(NTP_SYNCED);
+      } else if (now - ntpStateMillis > NTP_TIMEOUT_MS) {
+        ntpLink.failed(now);
+        Serial.println("Failed to obtain NTP time, keeping the RTC time");
+        setNtpState(NTP_IDLE);
+      }
+      break;
+    case NTP_SYNCED:  // ntpResyncJob() does it daily from here
+      break;
   }
-  //Following used for Debugging and can be commented out
-  Serial.println(&timeinfo, "%A, %B %d %Y %H:%M:%S");
-  Serial.print("Day of week: ");
-  Serial.println(&timeinfo, "%A");
-  Serial.print("Month: ");
-  Serial.println(&timeinfo, "%B");
-  Serial.print("Day of Month: ");
-  Serial.println(&timeinfo, "%d");
-  Serial.print("Year: ");
-  Serial.println(&timeinfo, "%Y");
-  Serial.print("Hour: ");
-  Serial.println(&timeinfo, "%H");
-  Serial.print("Hour (12 hour format): ");
-  Serial.println(&timeinfo, "%I");
-  Serial.print("Minute: ");
-  Serial.println(&timeinfo, "%M");
-  Serial.print("Second: ");
-  Serial.println(&timeinfo, "%S");
-
-  Serial.println("Time variables");
-  char timeHour[3];
-  strftime(timeHour,3, "%H", &timeinfo);
-  Serial.println(timeHour);
-  char timeWeekDay[10];
-  strftime(timeWeekDay,10, "%A", &timeinfo);
-  Serial.println(timeWeekDay);
+}
+
+// Daily at NTP_RESYNC_HOUR, the RTC from the system clock SNTP has kept right
+bool ntpResyncJob(uint32_t /*due*/, void * /*context*/) {
+  struct tm timeinfo;
+  if (ntpState == NTP_SYNCED && getLocalTime(&timeinfo, 0)) handOverNtpTime(timeinfo);
+  return true;
+}
+
+// Connection counters for WiFi and the broker, on connect and every LINK_STATS_INTERVAL_S
+void publishLinkStats(unsigned long now) {
+  char wifiJson[200];
+  char mqttJson[200];
+  char json[MSG_BUFFER_SIZE];
+  wifiLink.json(wifiJson, sizeof(wifiJson), now);
+  mqttLink.json(mqttJson, sizeof(mqttJson), now);
+  int length = snprintf(json, sizeof(json), "{\"uptime_s\":%lu,\"rssi\":%d,\"wifi\":%s,\"mqtt\":%s}",
+                        now / 1000, (int)WiFi.RSSI(), wifiJson, mqttJson);
+  // current state only, not worth keeping in the outbox
+  if (length > 0 && length < (int)sizeof(json)) mqtt_client.publish(MQTT_PUB_TOPIC8, json);
+}
+
+// Keep the broker connection up, one bounded attempt when the ConnectionManager says so
+void mqttService(unsigned long now, bool wifiConnected) {
+  if (mqttLink.isUp() && !(wifiConnected && mqtt_client.connected())) {
+    Serial.print("MQTT connection lost, rc = ");
+    Serial.println(mqtt_client.state());
+    mqttLink.lost(now);
+  }
+  if (!wifiConnected) return;
+  if (!mqttLink.isUp()) {
+    if (!mqttLink.due(now)) return;
+    mqttLink.attempt(now);
+    uint32_t start = profileStart();
+    bool connected = reconnect();
+    profileEnd(STAGE_MQTT_CONNECT, start);
+    if (!connected) {
+      mqttLink.failed(millis(), mqtt_client.state());
+      Serial.print("Trying MQTT again in ");
+      Serial.print(mqttLink.retryInMs(millis()) / 1000);
+      Serial.println(" s");
+      return;
+    }
+    mqttLink.connected(millis());
+    profileMilestone(BOOT_MQTT, millis());
+    publishLinkStats(millis());
+    gate.publishRollup();  // retained ones sent while we were offline are gone
+  }
+
+  //keep MQTT client connected when WiFi is connected
+  uint32_t start = profileStart();
+  mqtt_client.loop();
+  profileEnd(STAGE_MQTT_LOOP, start);
+  // catch up on anything that was queued while we were offline
+  if (!mqttOutbox.empty()) {
+    start = profileStart();
+    espMqtt.replay(millis());
+    profileEnd(STAGE_OUTBOX_REPLAY, start);
+  }
+}
+
+bool linkStatsJob(uint32_t /*due*/, void * /*context*/) {
+  if (mqttLink.isUp()) publishLinkStats(millis());
+  return true;
+}
+
+// Temperature from the RTC every TIME_TEMP_MS, loop() owns the I2C bus
+bool temperatureJob(uint32_t /*due*/, void * /*context*/) {
+  timeService.readTemperature();
+  return true;
+}
+
+//###############################################################################################################
+// Logging task, owns the SD card and the Serial debug output
+// The rows themselves are written by the gate (GateApp::logEvent), this is only the Serial dump
+
+// Car was detected, print header for the bounce debug output
+void printCarStart(const GateEvent &event) {
+  if (logVerbosity < LOG_VERBOSE_BOUNCES) return;
+  Serial.print("Car Triggered Detector at = ");
+  Serial.print(event.carDetectedMillis);
+  Serial.print(", Car Number Being Counted = ");         
+  Serial.println (event.carNumber) ;  //add 1 to total daily cars so car being detected is synced
+  Serial.println("DateTime\t\tWhile\tLHigh\tDiff\tnoCar\tLow Millis\tLast LOW\tDiff\tBounce #\tCurent State\tCar#\tMillis" );  
+}
+
+// Sensor went LOW while a car is present
+void printBounce(const GateEvent &event) {
+  if (logVerbosity < LOG_VERBOSE_BOUNCES) return;
+  Serial.print(event.timestamp);
+  Serial.print(" \t\t ");
+  Serial.print(event.passMs);
+  Serial.print(" \t ");
+  Serial.print(event.lastHighMs);
+  Serial.print(" \t ");
+  Serial.print(event.passMs-event.lastHighMs);
+  Serial.print(" \t ");
+  Serial.print(event.noCarMs);  
+  Serial.print(" \t ");
+  Serial.print(event.lowMs);                        
+  Serial.print(" \t\t ");   
+  Serial.print(event.lastLowMs);
+  Serial.print(" \t\t ");   
+  Serial.print(event.lowMs-event.lastLowMs);
+  Serial.print(" \t\t ");   
+  Serial.print(event.bounces);
+  Serial.print(" \t\t ");              
+  Serial.print(event.level);
+  Serial.print(" \t\t ");
+  Serial.print(event.carNumber);
+  Serial.print(" \t\t ");
+  Serial.print(event.millis);
   Serial.println();
+}
+
+// Car cleared the sensor and was saved
+void printCar(const GateEvent &event) {
+  if (logVerbosity < LOG_VERBOSE_CARS) return;
+  Serial.print(event.timestamp);
+  Serial.print(", Millis NoCarTimer = ");
+  Serial.print(event.noCarMs);
+  Serial.print(", Total Millis to pass = ");
+  Serial.println(event.passMs);
+  Serial.print(F("Car Saved to SD Card. Car Number = "));
+  Serial.print(event.carNumber);
+  Serial.print(F(" Cars in Park = "));
+  Serial.println(event.carsInPark);  
+}
+
+void printLogEvent(const GateEvent &event) {
+#if SERIAL_DEBUG
+  switch (event.type) {
+    case GATE_CAR_START:   printCarStart(event); break;
+    case GATE_BOUNCE:      printBounce(event);   break;
+    case GATE_CAR_COUNTED: printCar(event);      break;
+    case GATE_TIMEOUT:
+      if (logVerbosity >= LOG_VERBOSE_CARS) {
+        if (event.pass == FUSION_TIMEOUT) {
+          Serial.println("Timeout! No Car Counted");
+        } else {
+          Serial.print("Not Counted: ");
+          Serial.println(fusionPassName(event.pass));
+        }
+      }
+      break;
+    case GATE_COUNT_RETRACTED:
+      if (logVerbosity >= LOG_VERBOSE_CARS) {
+        Serial.print(F("Count Retracted, Seq = "));
+        Serial.print(event.seq);
+        Serial.print(F(" Reason = "));
+        Serial.print(countReasonName(event.reason));
+        Serial.print(F(" Count = "));
+        Serial.println(event.carNumber);
+      }
+      break;
+  }
+#endif
+}
+
+// Called by esp_restart() (OTA update), get the buffered rows onto the card
+void flushLogsOnShutdown() {
+  gate.flushLogs();
+}
+
+void loggingTask(void *parameter) {
+  GateEvent event;
+  uint32_t lastLogDrops = 0;
+  for (;;) {
+    // wake up at least once a second to write out old rows
+    if (logQueue.receive(event, 1000)) {
+      gate.logEvent(event);
+      printLogEvent(event);
+    }
+    gate.serviceLogs(millis());
+    profileCount(COUNT_LOGGING);
+    if (gate.logQueueDrops() != lastLogDrops) {
+      lastLogDrops = gate.logQueueDrops();
+      Serial.print("Log queue full! Events not logged = ");
+      Serial.println(lastLogDrops);
+    }
+  }
+}
+
+//###############################################################################################################
+// Network task, owns WiFi and the MQTT client
+
+void networkTask(void *parameter) {
+  GateEvent event;
+  gate.rollupBegin();
+  uint32_t unixtime = timeService.unixtime();
+  networkJobs.daily(unixtime, NTP_RESYNC_HOUR, 0, 0, ntpResyncJob, NULL, "ntp resync");
+  networkJobs.every(unixtime - unixtime % LINK_STATS_INTERVAL_S + LINK_STATS_INTERVAL_S, LINK_STATS_INTERVAL_S,
+                    linkStatsJob, NULL, "link stats");
+  for (;;) {
+    // non-blocking WiFi, NTP and MQTT bring-up, counting never waits for any of them
+    unsigned long now = millis();
+    uint32_t start = profileStart();
+    bool wifiConnected = wifiService(now);
+    if (wifiConnected) ntpService(now);
+    profileEnd(STAGE_WIFI_RUN, start);
+    mqttService(now, wifiConnected);
+
+    // wait a little for cars to publish, then take whatever else is queued
+    if (netQueue.receive(event, 20)) {
+      start = profileStart();
+      do {
+        if (event.type == GATE_CONFIG_APPLIED) {
+          publishActiveConfig(NULL);
+        } else {
+          gate.publishGateEvent(event);
+        }
+      } while (netQueue.receive(event, 0));
+      gate.publishEvents();
+      profileEnd(STAGE_MQTT_PUBLISH, start);
+    }
+    // per minute / 15 minute / hour exits, stored and published as each bucket closes
+    gate.serviceRollup();
+    networkJobs.run(timeService.unixtime());
+    // anyone watching /live gets the edges and events collected since the last pass
+    liveStreamService();
+    profileCount(COUNT_NETWORK);
+  }
+}
 
-  // Convert NTP time string to set RTC
-  char timeStringBuff[50]; //50 chars should be enough
-  strftime(timeStringBuff, sizeof(timeStringBuff), "%Y-%m-%d %H:%M:%S", &timeinfo);
-  Serial.println(timeStringBuff);
-  rtc.adjust(DateTime(timeStringBuff));
+//###############################################################################################################
+// Sensing task, runs the gate's detector and counters
+
+void sensingTask(void *parameter) {
+  //Set Input Pin and start capturing edges by interrupt
+  //Attached here so the interrupt is serviced on the sensing core
+  Serial.print("Detector profile: ");
+  Serial.println(gate.profileName());
+  edgeCaptureBegin(vehicleSensorPin, SENSOR_INPUT_MAGNETOMETER);
+#if FUSION_ENABLED
+  edgeCaptureBegin(beamParkSidePin, SENSOR_INPUT_BEAM_PARK);
+  edgeCaptureBegin(beamRoadSidePin, SENSOR_INPUT_BEAM_ROAD);
+#endif
+  gate.setEdgeObserver(liveStreamEdge);
+  gate.setEventObserver(liveStreamEvent);
+  gate.sensingBegin(gateSettings.detector);
+  edgeCaptureNotify(xTaskGetCurrentTaskHandle());
+  profileMilestone(BOOT_COUNTING, millis());
+  Serial.print("Counting ");
+  Serial.print(millis());
+  Serial.println(" ms after boot");
+
+  for (;;) {
+    // sleep until the interrupt has an edge for us, or it is time to check the timers
+    ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SENSING_POLL_MS));
+    gate.sensingPass();
+  }
 }
 
+// Last complete line of a file, empty if there is none. Reads only the end of it.
+void readLastRow(fs::FS &fs, const char *path, char *row, size_t size) {
+  row[0] = '\0';
+  File file = fs.open(path, FILE_READ);
+  if (!file) return;
+  size_t fileSize = file.size();
+  size_t length = fileSize < size - 1 ? fileSize : size - 1;
+  file.seek(fileSize - length);
+  length = file.read((uint8_t *)row, length);
+  file.close();
+  row[length] = '\0';
+  // a row cut short by the reset doesn't count
+  char *end = strrchr(row, '\n');
+  if (!end) {
+    row[0] = '\0';
+    return;
+  }
+  *end = '\0';
+  if (end > row && end[-1] == '\r') end[-1] = '\0';
+  char *start = strrchr(row, '\n');
+  if (start) memmove(row, start + 1, strlen(start + 1) + 1);
+}
 
 void setup() {
   Serial.begin(115200);
+  profileBegin();
   //Initialize Display
   display.begin(SSD1306_SWITCHCAPVCC, 0x3C);
 
@@ -374,78 +791,22 @@ void setup() {
     display.println("SD Card Ready");
     display.display();
  
-  if (!SD.exists("/GateCount.csv")) {
-    Serial.println(F("GateCount.csv doesn't exist. Creating GateCount.csv file..."));
-    // create a new file by opening a new file and immediately close it
-    myFile = SD.open("/GateCount.csv", FILE_WRITE);
-    myFile.close();
-      // recheck if file is created or not & write Header
-  if (SD.exists("/GateCount.csv")){
-    Serial.println(F("GateCount.csv exists on SD Card."));
-    myFile = SD.open("/GateCount.csv", FILE_APPEND);
-    myFile.println("Date Time,Pass Timer,NoCar Timer,Bounces,Car#,Cars In Park,Temp,Last Car Millis, This Car Millis,Bounce Flag,Millis");
-    myFile.close();
-    Serial.println(F("Header Written to GateCount.csv"));
-  }else{
-    Serial.println(F("GateCount.csv doesn't exist on SD Card."));
-  }
-  }
-
-
-  if (!SD.exists("/SensorBounces.csv")) {
-    Serial.println(F("SensorBounces.csv doesn't exist. Creating SensorBounces.csv file..."));
-    // create a new file by opening a new file and immediately close it
-    myFile2 = SD.open("/SensorBounces.csv", FILE_WRITE);
-    myFile2.close();
-   // recheck if file is created or not & write Header
-  if (SD.exists("/SensorBounces.csv")){
-    Serial.println(F("SensorBounces.csv exists on SD Card."));
-    myFile2 = SD.open("/SensorBounces.csv", FILE_APPEND);
-    //("DateTime\t\t\tPassing Time\tLast High\tDiff\tLow Millis\tLast Low\tDiff\tBounce #\tCurent State\tCar#" )
-    myFile2.println("Time,Pass Timer,Last High,Diff,No Car Timer,Low Millis,Last Low,Diff,Bounce#,Curent State,Car#,Millis");
-    myFile2.close();
-    Serial.println(F("Header Written to SensorBounces.csv"));
-  }else{
-    Serial.println(F("SensorBounces.csv doesn't exist on SD Card."));
-  }
- 
-  }
-
-
-
-  WiFi.mode(WIFI_STA); 
-  wifiMulti.addAP(secret_ssid_AP_1,secret_pass_AP_1);
-  wifiMulti.addAP(secret_ssid_AP_2,secret_pass_AP_2);
-  wifiMulti.addAP(secret_ssid_AP_3,secret_pass_AP_3);
-  wifiMulti.addAP(secret_ssid_AP_4,secret_pass_AP_4);
-  wifiMulti.addAP(secret_ssid_AP_5,secret_pass_AP_5);
-  
-  // WiFi.scanNetworks will return the number of networks found
-  int n = WiFi.scanNetworks();
-  Serial.println("scan done");
-  if (n == 0) {
-      Serial.println("no networks found");
-  } 
-  else {
-    Serial.print(n);
-    Serial.println(" networks found");
-    for (int i = 0; i < n; ++i) {
-      // Print SSID and RSSI for each network found
-      Serial.print(i + 1);
-      Serial.print(": ");
-      Serial.print(WiFi.SSID(i));
-      Serial.print(" (");
-      Serial.print(WiFi.RSSI(i));
-      Serial.print(")");
-      Serial.println((WiFi.encryptionType(i) == WIFI_AUTH_OPEN)?" ":"*");
-      delay(10);
-    }
-  }
-  
-  setup_wifi();
-  espGateCounter.setCACert(root_ca);
-  mqtt_client.setServer(mqtt_server, mqtt_port);
-  mqtt_client.setCallback(callback);
+  // Where counting stopped, before the log is opened for more
+  readLastRow(SD, "/GateCount.csv", gateCountTail, sizeof(gateCountTail));
+
+  // Open the logs, writing the headers if the files are new
+  gateCountLog.useDayIndex("/GateCount.idx"); // for /logs/GateCount.csv?from=...&to=...
+  gateCountLog.begin(SD);
+  correctionLog.useDayIndex("/GateCorrections.idx");
+  correctionLog.begin(SD);
+#if LOG_BOUNCES_CSV
+  bounceLog.useDayIndex("/SensorBounces.idx");
+  bounceLog.begin(SD);
+#endif
+  esp_register_shutdown_handler(flushLogsOnShutdown);
+  mqttOutbox.begin(SD);
+  rollupStore.begin(SD);
+  counterStore.begin(SD);
 
   //If RTC not present, stop and check battery
   if (! rtc.begin()) {
@@ -458,19 +819,63 @@ void setup() {
     display.display();
     while (1);
   }
+  // Count on the RTC time, NTP corrects it later if WiFi comes up
+  timeService.begin();
+  // binary log header carries the time the file was started
+  binLogHeader(binLogFileHeader, timeService.unixtime());
+  binLog.begin(SD);
 
-  // Get NTP time from Time Server 
-  configTime(gmtOffset_sec, daylightOffset_sec, ntpServer);
-  SetLocalTime();
-  
-  //Set Input Pin
-  pinMode(vehicleSensorPin, INPUT_PULLUP);
- 
-  display.clearDisplay();
-  display.setTextColor(WHITE);
-  display.setTextSize(2);
-  display.setCursor(0, line4);
-  display.print("GATE Count");
+  Serial.println  ("Initializing Gate Counter");
+    Serial.print("Temperature: ");
+    temp=timeService.temperature();
+    Serial.print(temp);
+    Serial.println(" F");
+
+  // Detector thresholds and log level set over MQTT, kept in NVS across reboots
+  settingsLoad(gateSettings, DETECTOR_PROFILE_CONFIG(GATE_PROFILE), LOG_VERBOSITY_DEFAULT);
+  logVerbosity = gateSettings.verbosity;
+
+  // Today's counts from before the reboot, the journal or GateCount.csv (lib/GateCore/src/CounterJournal.h)
+  unsigned long restoreStart = millis();
+  uint8_t counterSource = gate.restoreCounters(gateCountTail[0] ? gateCountTail : NULL);
+  Serial.print("Counts restored from ");
+  Serial.print(counterSourceName(counterSource));
+  Serial.print(" in ");
+  Serial.print(millis() - restoreStart);
+  Serial.print(" ms, Car# = ");
+  Serial.print(gate.dailyCars());
+  Serial.print(" Cars In Park = ");
+  Serial.println(gate.carsInPark());
+
+  // Timed jobs for loop(), gate.displayPass() runs them: the daily reset and the temperature
+  gate.scheduleBegin();
+  gate.schedule().every(timeService.unixtime() + TIME_TEMP_MS / 1000, TIME_TEMP_MS / 1000, temperatureJob, NULL,
+                        "temperature");
+
+  // Start counting now, sensing never waits on the SD card or the network
+  logQueue.begin(LOG_QUEUE_LENGTH);
+  netQueue.begin(NET_QUEUE_LENGTH);
+  commandQueue.begin(COMMAND_QUEUE_LENGTH);
+  xTaskCreatePinnedToCore(sensingTask, "sensing", 4096, NULL, SENSING_PRIORITY, &sensingTaskHandle, SENSING_CORE);
+  xTaskCreatePinnedToCore(loggingTask, "logging", 6144, NULL, LOGGING_PRIORITY, NULL, LOGGING_CORE);
+
+  // The network task joins WiFi, sets the RTC from NTP and connects to the broker in the background
+  WiFi.mode(WIFI_STA);
+  // RF is on, esp_random() is a true random number now. The MAC keeps two gates
+  // powered up together apart even so.
+  uint64_t mac = ESP.getEfuseMac();
+  uint32_t macSeed = (uint32_t)mac ^ (uint32_t)(mac >> 32);
+  wifiLink.seed(esp_random() ^ macSeed);
+  ntpLink.seed(esp_random() ^ macSeed);
+  mqttLink.seed(esp_random() ^ macSeed);
+  espGateCounter.setCACert(root_ca);
+  espGateCounter.setHandshakeTimeout(MQTT_HANDSHAKE_TIMEOUT_S);
+  mqtt_client.setServer(mqtt_server, mqtt_port);
+  mqtt_client.setCallback(callback);
+  mqtt_client.setKeepAlive(MQTT_KEEPALIVE);
+  mqtt_client.setSocketTimeout(MQTT_SOCKET_TIMEOUT_S);
+  // a full msg[] or rollup plus the topic and header
+  mqtt_client.setBufferSize((MSG_BUFFER_SIZE > ROLLUP_MSG_SIZE ? MSG_BUFFER_SIZE : ROLLUP_MSG_SIZE) + 64);
 
   //SETUP WEB SEVER
   /*
@@ -490,380 +895,51 @@ void setup() {
    server.on("/", HTTP_GET, [](AsyncWebServerRequest *request) {
     request->send(200, "text/plain", "Hi! I am the GATE COUNTER ESP32.");
   });
+  // stage timings, task rates and boot milestones, /stats?reset=1 clears the histograms after reading
+  server.on("/stats", HTTP_GET, [](AsyncWebServerRequest *request) {
+    static char json[1536];
+    profileJson(json, sizeof(json));
+    if (request->hasParam("reset")) profileReset();
+    request->send(200, "application/json", json);
+  });
 
   
   
+  liveStreamBegin(server);           // /live event stream and /live.html
+  logServerBegin(server, SD);        // /logs downloads
   AsyncElegantOTA.begin(&server);    // Start ElegantOTA
   server.begin();
   Serial.println("HTTP server started");
 
-
-  Serial.println  ("Initializing Gate Counter");
-    Serial.print("Temperature: ");
-    temp=((rtc.getTemperature()*9/5)+32);
-    Serial.print(temp);
-    Serial.println(" F");
-  display.display();
-  delay(3000);
+  xTaskCreatePinnedToCore(networkTask, "network", 8192, NULL, NETWORK_PRIORITY, NULL, NETWORK_CORE);
 }
 
 void loop() {
 //  server.handleClient();
 //  ElegantOTA.loop();
-
-    // non-blocking WiFi and MQTT Connectivity Checks
-    if (wifiMulti.run() == WL_CONNECTED) {
-      // Check for MQTT connection only if wifi is connected
-      if (!mqtt_client.connected()){
-        nowmqtt=millis();
-        if(nowmqtt - mqtt_lastReconnectAttemptMillis > mqtt_connectionCheckMillis){
-          mqtt_lastReconnectAttemptMillis = nowmqtt;
-          Serial.println("Attempting MQTT Connection");
-          reconnect();
-        }
-          mqtt_lastReconnectAttemptMillis =0;
-      } else {
-        //keep MQTT client connected when WiFi is connected
-        mqtt_client.loop();
+    // Arduino loop only runs the display now, sensing, logging and network have their own tasks
+
+      profileCount(COUNT_LOOP);
+      // keep the cached clock in step with the RTC
+      uint32_t start = profileStart();
+      if (ntpUnixtime) {
+        // from the network task, set here where the I2C bus is ours
+        timeService.adjust(DateTime(ntpUnixtime));
+        ntpUnixtime = 0;
+        profileMilestone(BOOT_NTP, millis());
       }
-    } else {
-        // Reconnect WiFi if lost, non blocking
-        nowwifi=millis();
-          if ((nowwifi - wifi_lastReconnectAttemptMillis) > wifi_connectioncheckMillis){
-            setup_wifi();
-          }
-        wifi_lastReconnectAttemptMillis = 0;
-    }
-
+      timeService.service();
+      profileEnd(STAGE_TIME_SERVICE, start);
 
-      
-      DateTime now = rtc.now();
-      temp=((rtc.getTemperature()*9/5)+32);
-      //Reset Gate Counter at 5:00:00 pm
-        if ((now.hour() == 17) && (now.minute() == 0) && (now.second() == 0)){
-             totalDailyCars = 0;
-         }
-      display.clearDisplay();
-      display.setTextSize(1);
-      display.setCursor(0, line1);
-      //  display Day of Week
-      display.print(days[now.dayOfTheWeek()]);
-
-      //  Display Date
-      display.print(" ");         
-      display.print(months[now.month(), DEC +1]);
-      display.print(" ");
-      display.print(now.day(), DEC);
-      display.print(", ");
-      display.println(now.year(), DEC);
-      
-      // Convert 24 hour clock to 12 hours
-      currentHour = now.hour();
-
-      if (currentHour - 12 > 0) {
-          ampm ="PM";
-          currentHour = now.hour() - 12;
-      }else{
-          currentHour = now.hour();
-          ampm = "AM";
+      // nothing on screen changes faster than this
+      if (millis() - lastDisplayMillis < DISPLAY_REFRESH_MS) {
+        delay(10);
+        return;
       }
+      lastDisplayMillis = millis();
 
-      //Display Time
-      //add leading 0 to Hours & display Hours
-      display.setTextSize(1);
-
-      if (currentHour < 10){
-        display.setCursor(0, line2);
-        display.print("0");
-        display.println(currentHour, DEC);
-      }else{
-        display.setCursor(0, line2);
-        display.println(currentHour, DEC);
-      }
+      // daily reset at 17:00 and the main screen
+      gate.displayPass();
 
-      display.setCursor(14, line2);
-      display.println(":");
- 
-      //Add leading 0 To Mintes & display Minutes 
-      //  display.setTextSize(1);
-      if (now.minute() < 10) {
-        display.setCursor(20, line2);
-        display.print("0");
-        display.println(now.minute(), DEC);
-      }else{
-        display.setCursor(21, line2);
-        display.println(now.minute(), DEC);
-      }
-
-      display.setCursor(34, line2);
-      display.println(":");
-
-      //Add leading 0 To Seconds & display Seconds
-      //  display.setTextSize(1);
-      if (now.second() < 10){
-        display.setCursor(41, line2);
-        display.print("0");
-        display.println(now.second(), DEC);
-      }else{
-        display.setCursor(41, line2);
-        display.println(now.second(), DEC);   
-      }
-
-      // Display AM-PM
-      display.setCursor(56, line2);
-      display.println(ampm); 
-
-      // Display Temp
-      // display.setTextSize(1);
-      display.setCursor(73, line2);
-      display.print("Temp: " );
-      //display.setCursor(70, 10);
-      display.println(temp, 0);
-
-      // Display Gate Count
-      display.setTextSize(1);
-      display.setCursor(0, line3);
-      display.print("Exiting: ");
-      display.setTextSize(2); 
-      
-      display.setCursor(50, line3);           
-      display.println(totalDailyCars);
-      display.setTextSize(1);
-      display.setCursor(0, line5);
-      display.print("In Park: ");
-      display.setTextSize(2); 
-      display.setCursor(50, line5);
-      display.println(carCounterCars-totalDailyCars);
-
-
-      display.display();
-      detectorState=digitalRead(vehicleSensorPin);
-      // Count Cars Exiting
-      // Sensing Vehicle  
-      // Detector LOW when vehicle sensed, Normally HIGH
-      if (detectorState == LOW) {
-          lastwhileMillis = 0;
-          lastdetectorStateLowMillis=0;
-          nocarTimerMillis=0;
-          sensorBounceCount = 0; //Sensor went low 1st time
-          carPresentFlag = 1; // when detector senses car, set flag car is present.
-          carDetectedMillis = millis(); // Freeze time when car was detected
-          detectorStateHighMillis = 0;
-          detectorStateLowMillis = millis()-carDetectedMillis;
-          lastdetectorState=HIGH;
-          DateTime now = rtc.now();
-          char buf3[] = "YYYY-MM-DD hh:mm:ss"; //time of day when detector was tripped
-          Serial.print("Car Triggered Detector at = ");
-          Serial.print(carDetectedMillis);
-          Serial.print(", Car Number Being Counted = ");         
-          Serial.println (totalDailyCars+1) ;  //add 1 to total daily cars so car being detected is synced
-          Serial.println("DateTime\t\tWhile\tLHigh\tDiff\tnoCar\tLow Millis\tLast LOW\tDiff\tBounce #\tCurent State\tCar#\tMillis" );  
-
-          // When Sensor is tripped, figure out when car clears sensing zone & sensor remains HIGH for period of time
-          // Then Reset Car Present Flag to 0
-          while (carPresentFlag == 1) {
-             detectorState = digitalRead(vehicleSensorPin);
-             currentMillis = millis();
-
-             whileMillis=millis()-carDetectedMillis; //   Record relative time passing         
-                       //if detector state changes from lOW to HIGH a car cleared sensor. If it remains HIGH no car is detected
-                      
-                       if ((detectorState != lastdetectorState)  && (detectorState==HIGH)) {
-                                          lastwhileMillis=whileMillis; 
-                                          nocarTimerMillis = millis();       
-                       }
-
-                       if ((detectorState != lastdetectorState)  && (detectorState==LOW)) {
-                          sensorBounceCount ++;  //count the state changes
-                          //nocarTimerMillis = millis();
-                       //}
-                       
-                       //Record Bounce
-                          DateTime now = rtc.now();
-                          char buf2[] = "YYYY-MM-DD hh:mm:ss";
-                          //Count number of Bounces and check each 4 bounces
-
-                          //start a timer to time how long senstor remains high when it switches states
-                          detectorStateLowMillis=millis()-carDetectedMillis; //
-
-                          
-
-                          //Debugging Code Can be removed  **************************************************************************
-                          Serial.print(now.toString(buf2));
-                          Serial.print(" \t\t ");
-                          Serial.print(whileMillis);
-                          Serial.print(" \t ");
-                          Serial.print(lastwhileMillis);
-                          Serial.print(" \t ");
-                          Serial.print(whileMillis-lastwhileMillis);
-                          Serial.print(" \t ");
-                          Serial.print(millis()-nocarTimerMillis);  
-                          Serial.print(" \t ");
-                          Serial.print(detectorStateLowMillis);                        
-                          Serial.print(" \t\t ");   
-                          Serial.print(lastdetectorStateLowMillis);
-                          Serial.print(" \t\t ");   
-                          Serial.print(detectorStateLowMillis-lastdetectorStateLowMillis);
-                          Serial.print(" \t\t ");   
-                          Serial.print(sensorBounceCount);
-                          Serial.print(" \t\t ");              
-                          Serial.print(detectorState);
-                          //Serial.print(" \t\t ");
-                          //Serial.print(lastdetectorState);
-                          Serial.print(" \t\t ");
-                          Serial.print(totalDailyCars+1);
-                          Serial.print(" \t\t ");
-                          Serial.print(millis());
-                          Serial.println();
-                         
-                         //T("DateTime\t\t\tPassing Time\tLast High\tDiff\tLow Millis\tLast Low\tDiff\tBounce #\tCurent State\tCar#" )
-                          myFile2 = SD.open("/SensorBounces.csv", FILE_APPEND);
-                          if (myFile2) {
-                              myFile2.print(now.toString(buf2));
-                              myFile2.print(", "); 
-                              myFile2.print(whileMillis);
-                              myFile2.print(", "); 
-                              myFile2.print (lastwhileMillis) ; 
-                              myFile2.print(", ");
-                              myFile2.print(whileMillis-lastwhileMillis);
-                              myFile2.print(", ");
-                              myFile2.print(millis()-nocarTimerMillis);
-                              myFile2.print(", ");
-                              myFile2.print(detectorStateLowMillis);
-                              myFile2.print(", ");
-                              myFile2.print(lastdetectorStateLowMillis);
-                              myFile2.print(", ");
-                              myFile2.print(detectorStateLowMillis-lastdetectorStateLowMillis);
-                              myFile2.print(" , ");              
-                              myFile2.print(sensorBounceCount);
-                              myFile2.print(" , ");
-                              myFile2.print(detectorState);
-                              myFile2.print(" , ");
-                              myFile2.print(totalDailyCars+1); //Prints this Car millis
-                              myFile2.print(" , ");
-                              myFile2.print(lastcarDetectedMillis); //Prints Last car millis
-                              myFile2.print(" , ");
-                              myFile2.print(carDetectedMillis); //Prints car number being detected
-                              myFile2.print(" , ");
-                              myFile2.print(millis()); //Prints current millis for debugging
-                              myFile2.println();
-                              myFile2.close();
-                              //Serial.println(F(" Bounce Log Recorded SD Card."));
-                          } else {
-                              Serial.print(F("SD Card: Issue encountered while attempting to open the file GateCount.csv"));
-                          }
-                       
-                           // end of debugging code ********************************************************************************* 
-                           //Detector State is bouncing
-                       } // end of if detector state is bouncing check
-
-          // Dectector is HIGH CHECK CAR HAS CLEARED AND BREAK LOOP #################################################
-
-                      //force count & reset if there is an undetectable car present 12/25/23
-                      
-                      //sensorBounceRemainder = sensorBounceCount % 4;
-                      //if ((sensorBounceRemainder == 0) && (whileMillis-lastwhileMillis>1042)){
-                      //  nocarTimerFlag = 0; 
-                      //  sensorBounceFlag = 1;  
-                      //}else{
-                      
-                            // Check added 12/21/23 to ensure no car is present for x millis
-                            if (detectorState==HIGH)  {
-                                         //lastwhileMillis=whileMillis;  
-                              
-                              // If no car is present and state does not change, then car has passed
-                              if (((millis() - nocarTimerMillis) >= nocarTimeoutMillis) && (sensorBounceCount >=2)) { 
-                                nocarTimerFlag = 0;
-                              } 
-                              //Resets if Loop sticks after 10 seconds and does not record a car.
-                              if (millis() - carDetectedMillis > 10000) {
-                                 Serial.println("Timeout! No Car Counted");
-                        mqtt_client.publish(MQTT_PUB_TOPIC5, String(totalDailyCars+1).c_str());
-                                 carPresentFlag=0;
-                                 break;
-                              }
-
-                            } else {
-                              //nocarTimerMillis = millis();   // Start or Reset Timer when pin goes high
-                              nocarTimerFlag = 1;  // change state to active
-                              }
-                      //}
-
-
-             //allow enough time for a car to pass and then make sure sensor remains high 12/23/23
-             //Conditions that myst be met for a car to be clear and count the car ^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^^
-             //Main Reset car passing timer
-             
-             //if (((currentMillis - carDetectedMillis)>=carpassingTimoutMillis) && (detectorState == HIGH) && (nocarTimerFlag == 0)) {
-               if (((detectorState == HIGH) && (nocarTimerFlag == 0)) || (detectorStateLowMillis-lastdetectorStateLowMillis>2000)) {
-                  Serial.print(now.toString(buf3));
-                  Serial.print(", Millis NoCarTimer = ");
-                  Serial.print(currentMillis-nocarTimerMillis);
-                  Serial.print(", Total Millis to pass = ");
-                  Serial.println(currentMillis-carDetectedMillis);
-                  //Serial.print(", ");
-                  //Serial.print(String("DateTime::TIMESTAMP_FULL:\t")+now.timestamp(DateTime::TIMESTAMP_FULL));
-                  //Serial.print(",1,"); 
-                  totalDailyCars ++;     
-
-                  // open file for writing Car Data
-                  //"Date Time,Pass Timer,NoCar Timer,TotalExitCars,CarsInPark,Temp"
-                  myFile = SD.open("/GateCount.csv", FILE_APPEND);
-                  if (myFile) {
-                      myFile.print(now.toString(buf3));
-                      myFile.print(", ");
-                      myFile.print (currentMillis-carDetectedMillis) ; 
-                      myFile.print(", ");
-                      myFile.print (currentMillis-nocarTimerMillis) ; 
-                      myFile.print(", "); 
-                      myFile.print (sensorBounceCount) ; 
-                      myFile.print(", ");                       
-                      myFile.print (totalDailyCars) ; 
-                      myFile.print(", ");
-                      myFile.print(carCounterCars-totalDailyCars);
-                      myFile.print(", ");
-                      myFile.print(temp);
-                              myFile.print(" , ");
-                              myFile.print(lastcarDetectedMillis); //Prints car number being detected
-                              myFile.print(" , ");
-                              myFile.print(carDetectedMillis); //Prints car number being detected
-                      myFile.print(", ");
-                      myFile.print(sensorBounceFlag);
-                      myFile.print(", ");
-                      myFile.println(millis());
-                      myFile.close();
-                      
-                      Serial.print(F("Car Saved to SD Card. Car Number = "));
-                      Serial.print(totalDailyCars);
-                      Serial.print(F(" Cars in Park = "));
-                      Serial.println(carCounterCars-totalDailyCars);  
-                        mqtt_client.publish(MQTT_PUB_TOPIC1, String(temp).c_str());
-                        mqtt_client.publish(MQTT_PUB_TOPIC2, now.toString(buf3));
-                        mqtt_client.publish(MQTT_PUB_TOPIC3, String(totalDailyCars).c_str());
-                        mqtt_client.publish(MQTT_PUB_TOPIC4, String(carCounterCars-totalDailyCars).c_str());
-                        //snprintf (msg, MSG_BUFFER_SIZE, "Car #%ld,", totalDailyCars);
-                        //Serial.print("Publish message: ");
-                        //Serial.println(msg);
-                        //mqtt_client.publish("msbGateCount", msg);
-                      //}
-                  } else {
-                      Serial.print(F("SD Card: Issue encountered while attempting to open the file GateCount.csv"));
-                  }
-                  carPresentFlag = 0;
-                  sensorBounceFlag = 0;
-                  whileMillis = 0;
-                  lastcarDetectedMillis=carDetectedMillis;
-              }  // end of car passed check
-
-             lastdetectorState=detectorState;
-             lastdetectorStateLowMillis=detectorStateLowMillis;
-             lastdetectorStateHighMillis=detectorStateHighMillis;
-
-
-             //sensorBounceCount =0;
-            
-           } // end of while loop
-      } // Start looking for next lOW on Vehicle sensor
-
-      //loop forever looking for car and update time and counts
-}
\ No newline at end of file
+      //loop forever updating time and counts
+}
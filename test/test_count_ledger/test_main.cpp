@@ -0,0 +1,222 @@
+// Provisional counts, confirms and retracts: pio test -e native -f test_count_ledger
+#include <unity.h>
+
+#include "CountLedger.h"
+
+#define S 1000000UL  // 1 s in micros
+
+static CountEvent events[64];
+static uint8_t eventCount;
+
+static void record(const CountEvent &event, void *) {
+  if (eventCount < 64) events[eventCount++] = event;
+}
+
+static const CountEvent &lastEvent() { return events[eventCount - 1]; }
+
+static CountLedger ledger;
+
+void setUp(void) {
+  ledger = CountLedger();
+  ledger.setListener(record, NULL);
+  eventCount = 0;
+}
+
+void tearDown(void) {}
+
+// A count goes out with the total at once and stays pending
+static void test_provisional(void) {
+  uint32_t seq = ledger.provisional(1 * S);
+  TEST_ASSERT_EQUAL_UINT32(1, seq);
+  TEST_ASSERT_EQUAL(1, eventCount);
+  TEST_ASSERT_EQUAL(COUNT_PROVISIONAL, events[0].type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_CAR, events[0].reason);
+  TEST_ASSERT_EQUAL_INT32(1, events[0].total);
+  TEST_ASSERT_EQUAL_INT32(0, events[0].confirmed);
+  TEST_ASSERT_TRUE(ledger.pending(seq));
+  TEST_ASSERT_EQUAL_UINT32(seq, ledger.newestPending());
+}
+
+static void test_confirm(void) {
+  uint32_t seq = ledger.provisional(1 * S);
+  TEST_ASSERT_TRUE(ledger.confirm(seq, 2 * S, COUNT_REASON_EXIT));
+  TEST_ASSERT_EQUAL(COUNT_CONFIRMED, lastEvent().type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_EXIT, lastEvent().reason);
+  TEST_ASSERT_EQUAL_UINT32(seq, lastEvent().seq);
+  TEST_ASSERT_EQUAL_INT32(1, lastEvent().total);
+  TEST_ASSERT_EQUAL_INT32(1, lastEvent().confirmed);
+  TEST_ASSERT_FALSE(ledger.pending(seq));
+  // every count gets one answer
+  TEST_ASSERT_FALSE(ledger.confirm(seq, 3 * S, COUNT_REASON_EXIT));
+  TEST_ASSERT_FALSE(ledger.retract(seq, 3 * S, COUNT_REASON_BACKUP));
+  TEST_ASSERT_EQUAL(2, eventCount);
+}
+
+static void test_retract(void) {
+  uint32_t first = ledger.provisional(1 * S);
+  uint32_t second = ledger.provisional(2 * S);
+  TEST_ASSERT_TRUE(ledger.retract(first, 3 * S, COUNT_REASON_REVERSAL));
+  TEST_ASSERT_EQUAL(COUNT_RETRACTED, lastEvent().type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_REVERSAL, lastEvent().reason);
+  TEST_ASSERT_EQUAL_INT32(1, lastEvent().total);
+  TEST_ASSERT_EQUAL_INT32(0, lastEvent().confirmed);
+  TEST_ASSERT_EQUAL_UINT32(1, ledger.retractions());
+  TEST_ASSERT_TRUE(ledger.pending(second));
+  TEST_ASSERT_FALSE(ledger.retract(first, 4 * S, COUNT_REASON_REVERSAL));
+  TEST_ASSERT_FALSE(ledger.retract(99, 4 * S, COUNT_REASON_REVERSAL));
+  TEST_ASSERT_EQUAL_UINT32(1, ledger.retractions());
+}
+
+// Settled counts are confirmed oldest first, with the time they settled
+static void test_poll_settles(void) {
+  ledger.setConfirmMs(15000);
+  uint32_t first = ledger.provisional(1 * S);
+  uint32_t second = ledger.provisional(5 * S);
+  ledger.poll(16 * S - 1);
+  TEST_ASSERT_EQUAL(2, eventCount);
+  ledger.poll(17 * S);
+  TEST_ASSERT_EQUAL(3, eventCount);
+  TEST_ASSERT_EQUAL(COUNT_CONFIRMED, lastEvent().type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_SETTLED, lastEvent().reason);
+  TEST_ASSERT_EQUAL_UINT32(first, lastEvent().seq);
+  TEST_ASSERT_EQUAL_UINT32(16 * S, lastEvent().micros);
+  TEST_ASSERT_TRUE(ledger.pending(second));
+  ledger.poll(60 * S);
+  TEST_ASSERT_EQUAL_UINT32(second, lastEvent().seq);
+  TEST_ASSERT_EQUAL_UINT32(20 * S, lastEvent().micros);
+  TEST_ASSERT_EQUAL_INT32(2, ledger.confirmed());
+}
+
+// confirmMs 0, only confirm() confirms
+static void test_poll_off(void) {
+  uint32_t seq = ledger.provisional(1 * S);
+  ledger.poll(3600 * S);
+  TEST_ASSERT_TRUE(ledger.pending(seq));
+}
+
+// Taking one out of the middle keeps the others in order
+static void test_retract_middle(void) {
+  ledger.setConfirmMs(10000);
+  uint32_t a = ledger.provisional(1 * S);
+  uint32_t b = ledger.provisional(2 * S);
+  uint32_t c = ledger.provisional(3 * S);
+  TEST_ASSERT_TRUE(ledger.retract(b, 4 * S, COUNT_REASON_NOISE));
+  ledger.poll(20 * S);
+  TEST_ASSERT_EQUAL(COUNT_CONFIRMED, events[eventCount - 2].type);
+  TEST_ASSERT_EQUAL_UINT32(a, events[eventCount - 2].seq);
+  TEST_ASSERT_EQUAL_UINT32(c, lastEvent().seq);
+  TEST_ASSERT_EQUAL_INT32(2, ledger.total());
+}
+
+// Full, the oldest is confirmed to make room
+static void test_full_confirms_oldest(void) {
+  for (uint8_t i = 0; i < COUNT_PENDING_MAX; i++) ledger.provisional(i * S);
+  TEST_ASSERT_EQUAL(COUNT_PENDING_MAX, eventCount);
+  uint32_t seq = ledger.provisional(100 * S);
+  TEST_ASSERT_EQUAL(COUNT_PENDING_MAX + 2, eventCount);
+  const CountEvent &full = events[COUNT_PENDING_MAX];
+  TEST_ASSERT_EQUAL(COUNT_CONFIRMED, full.type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_FULL, full.reason);
+  TEST_ASSERT_EQUAL_UINT32(1, full.seq);
+  TEST_ASSERT_TRUE(ledger.pending(seq));
+  TEST_ASSERT_FALSE(ledger.pending(1));
+  TEST_ASSERT_EQUAL_INT32(COUNT_PENDING_MAX + 1, ledger.total());
+  TEST_ASSERT_EQUAL_INT32(1, ledger.confirmed());
+}
+
+// A reset confirms what is pending first, sequence numbers carry on
+static void test_set_total(void) {
+  uint32_t first = ledger.provisional(1 * S);
+  uint32_t second = ledger.provisional(2 * S);
+  ledger.setTotal(0, 3 * S);
+  TEST_ASSERT_EQUAL(4, eventCount);
+  TEST_ASSERT_EQUAL_UINT32(first, events[2].seq);
+  TEST_ASSERT_EQUAL_UINT32(second, events[3].seq);
+  TEST_ASSERT_EQUAL(COUNT_REASON_SETTLED, events[3].reason);
+  TEST_ASSERT_EQUAL_INT32(0, ledger.total());
+  TEST_ASSERT_EQUAL_UINT32(3, ledger.provisional(4 * S));
+  TEST_ASSERT_EQUAL_INT32(1, lastEvent().total);
+}
+
+// After a reboot, numbering goes on from the restored seq, never backwards
+static void test_resume(void) {
+  ledger.resume(120, 310);
+  TEST_ASSERT_EQUAL_UINT32(310, ledger.lastSeq());
+  TEST_ASSERT_EQUAL_UINT32(311, ledger.provisional(1 * S));
+  TEST_ASSERT_EQUAL_INT32(121, lastEvent().total);
+  ledger.resume(121, 5);
+  TEST_ASSERT_EQUAL_UINT32(312, ledger.provisional(2 * S));
+}
+
+// Queued cars 1 to 2 s apart at a backup prone exit, every one of them stays
+static void test_queue_kept(void) {
+  ledger.setConfirmMs(15000);
+  ledger.setReversalMs(3000);
+  uint32_t first = ledger.provisional(1 * S);
+  ledger.carStart(2 * S);
+  TEST_ASSERT_EQUAL_UINT32(first, ledger.held());
+  uint32_t second = ledger.provisional(3 * S);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.held());
+  ledger.carStart(4 * S + S / 2);
+  ledger.provisional(5 * S);
+  ledger.poll(60 * S);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.retractions());
+  TEST_ASSERT_EQUAL_INT32(3, ledger.confirmed());
+  TEST_ASSERT_FALSE(ledger.pending(first));
+  TEST_ASSERT_FALSE(ledger.pending(second));
+}
+
+// The counted car backs onto the sensor and the detector gives up on it, the count comes off
+static void test_backup_retracts(void) {
+  ledger.setConfirmMs(15000);
+  ledger.setReversalMs(3000);
+  uint32_t seq = ledger.provisional(1 * S);
+  ledger.carStart(3 * S);
+  // held past confirmMs while the car is on the sensor
+  ledger.poll(20 * S);
+  TEST_ASSERT_TRUE(ledger.pending(seq));
+  ledger.carTimeout(23 * S);
+  TEST_ASSERT_EQUAL(COUNT_RETRACTED, lastEvent().type);
+  TEST_ASSERT_EQUAL(COUNT_REASON_REVERSAL, lastEvent().reason);
+  TEST_ASSERT_EQUAL_UINT32(seq, lastEvent().seq);
+  TEST_ASSERT_EQUAL_INT32(0, ledger.total());
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.held());
+}
+
+// Too late, on the counting edge (a split) or with reversals off, nothing is held
+static void test_no_hold(void) {
+  ledger.setReversalMs(3000);
+  ledger.provisional(1 * S);
+  ledger.carStart(4 * S + 1);
+  ledger.carStart(1 * S);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.held());
+  ledger.carTimeout(30 * S);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.retractions());
+  ledger.setReversalMs(0);
+  ledger.carStart(2 * S);
+  TEST_ASSERT_EQUAL_UINT32(0, ledger.held());
+}
+
+static void test_names(void) {
+  TEST_ASSERT_EQUAL_STRING("retract", countEventName(COUNT_RETRACTED));
+  TEST_ASSERT_EQUAL_STRING("settled", countReasonName(COUNT_REASON_SETTLED));
+  TEST_ASSERT_EQUAL_STRING("?", countReasonName(COUNT_REASONS));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_provisional);
+  RUN_TEST(test_confirm);
+  RUN_TEST(test_retract);
+  RUN_TEST(test_poll_settles);
+  RUN_TEST(test_poll_off);
+  RUN_TEST(test_retract_middle);
+  RUN_TEST(test_full_confirms_oldest);
+  RUN_TEST(test_set_total);
+  RUN_TEST(test_resume);
+  RUN_TEST(test_queue_kept);
+  RUN_TEST(test_backup_retracts);
+  RUN_TEST(test_no_hold);
+  RUN_TEST(test_names);
+  return UNITY_END();
+}
@@ -0,0 +1,137 @@
+// Exits per minute, quarter and hour: pio test -e native -f test_count_rollup
+#include <string.h>
+#include <unity.h>
+
+#include "CountRollup.h"
+
+#define DAY_START 1734195600UL  // 2024-12-14 17:00:00, the daily reset
+
+static CountRollup rollup(17);
+
+void setUp(void) { rollup.startDay(DAY_START + 3600); }
+
+void tearDown(void) {}
+
+// The counting day runs 17:00 to 17:00, across midnight
+static void test_day_of(void) {
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, rollup.dayOf(DAY_START));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, rollup.dayOf(DAY_START + 7 * 3600));  // 00:00 the next date
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, rollup.dayOf(DAY_START + 86399));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START + 86400, rollup.dayOf(DAY_START + 86400));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START - 86400, rollup.dayOf(DAY_START - 1));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START, rollup.dayStart());
+}
+
+static void test_buckets(void) {
+  TEST_ASSERT_EQUAL_UINT16(0, rollup.add(DAY_START, 1));
+  TEST_ASSERT_EQUAL_UINT16(0, rollup.add(DAY_START + 59, 1));
+  TEST_ASSERT_EQUAL_UINT16(14, rollup.add(DAY_START + 14 * 60 + 30, 1));
+  TEST_ASSERT_EQUAL_UINT16(15, rollup.add(DAY_START + 15 * 60, 1));
+  TEST_ASSERT_EQUAL_UINT16(60, rollup.add(DAY_START + 3600, 1));
+  TEST_ASSERT_EQUAL_UINT16(1439, rollup.add(DAY_START + 86399, 1));
+  TEST_ASSERT_EQUAL_INT(2, rollup.minute(0));
+  TEST_ASSERT_EQUAL_INT(3, rollup.quarter(0));
+  TEST_ASSERT_EQUAL_INT(1, rollup.quarter(1));
+  TEST_ASSERT_EQUAL_INT(4, rollup.hour(0));
+  TEST_ASSERT_EQUAL_INT(1, rollup.hour(1));
+  TEST_ASSERT_EQUAL_INT(1, rollup.hour(23));
+  TEST_ASSERT_EQUAL_INT32(6, rollup.total());
+}
+
+// A retraction comes off where it happens, the buckets still add up to the net count
+static void test_retraction(void) {
+  rollup.add(DAY_START + 100, 1);
+  rollup.add(DAY_START + 100, 1);
+  rollup.add(DAY_START + 20 * 60, -1);
+  TEST_ASSERT_EQUAL_INT(2, rollup.minute(1));
+  TEST_ASSERT_EQUAL_INT(-1, rollup.minute(20));
+  TEST_ASSERT_EQUAL_INT(2, rollup.quarter(0));
+  TEST_ASSERT_EQUAL_INT(-1, rollup.quarter(1));
+  TEST_ASSERT_EQUAL_INT(1, rollup.hour(0));
+  TEST_ASSERT_EQUAL_INT32(1, rollup.total());
+}
+
+static void test_outside_day(void) {
+  TEST_ASSERT_EQUAL_UINT16(ROLLUP_NONE, rollup.add(DAY_START - 1, 1));
+  TEST_ASSERT_EQUAL_UINT16(ROLLUP_NONE, rollup.add(DAY_START + 86400, 1));
+  TEST_ASSERT_EQUAL_INT32(0, rollup.total());
+}
+
+// Every minute, quarter and hour sum to the total
+static void test_sums(void) {
+  uint32_t seed = 12345;
+  int32_t expected = 0;
+  for (int i = 0; i < 5000; i++) {
+    seed = seed * 1103515245 + 12345;
+    int16_t count = (seed >> 28) == 0 ? -1 : 1;
+    if (rollup.add(DAY_START + (seed >> 8) % 86400, count) != ROLLUP_NONE) expected += count;
+  }
+  int32_t minutes = 0, quarters = 0, hours = 0;
+  for (uint16_t i = 0; i < ROLLUP_MINUTES; i++) minutes += rollup.minute(i);
+  for (uint16_t i = 0; i < ROLLUP_QUARTERS; i++) {
+    int32_t inQuarter = 0;
+    for (uint16_t m = i * 15; m < i * 15 + 15; m++) inQuarter += rollup.minute(m);
+    TEST_ASSERT_EQUAL_INT32(inQuarter, rollup.quarter(i));
+    quarters += rollup.quarter(i);
+  }
+  for (uint8_t i = 0; i < ROLLUP_HOURS; i++) {
+    TEST_ASSERT_EQUAL_INT32(rollup.quarter(i * 4) + rollup.quarter(i * 4 + 1) + rollup.quarter(i * 4 + 2) +
+                                rollup.quarter(i * 4 + 3),
+                            rollup.hour(i));
+    hours += rollup.hour(i);
+  }
+  TEST_ASSERT_EQUAL_INT32(expected, rollup.total());
+  TEST_ASSERT_EQUAL_INT32(expected, minutes);
+  TEST_ASSERT_EQUAL_INT32(expected, quarters);
+  TEST_ASSERT_EQUAL_INT32(expected, hours);
+}
+
+// After a reboot the minutes are read back and the rest rebuilt from them
+static void test_rebuild(void) {
+  rollup.add(DAY_START + 10, 1);
+  rollup.add(DAY_START + 5000, 1);
+  rollup.add(DAY_START + 5000, -1);
+  rollup.add(DAY_START + 80000, 1);
+  static CountRollup restored(17);
+  restored.startDay(DAY_START + 60);
+  memcpy(restored.minuteData(), rollup.minuteData(), ROLLUP_MINUTES * sizeof(int16_t));
+  restored.rebuild();
+  TEST_ASSERT_EQUAL_INT32(rollup.total(), restored.total());
+  for (uint16_t i = 0; i < ROLLUP_QUARTERS; i++) TEST_ASSERT_EQUAL_INT(rollup.quarter(i), restored.quarter(i));
+  for (uint8_t i = 0; i < ROLLUP_HOURS; i++) TEST_ASSERT_EQUAL_INT(rollup.hour(i), restored.hour(i));
+}
+
+static void test_start_day_clears(void) {
+  rollup.add(DAY_START + 10, 1);
+  rollup.startDay(DAY_START + 86400);
+  TEST_ASSERT_EQUAL_INT32(0, rollup.total());
+  TEST_ASSERT_EQUAL_INT(0, rollup.minute(0));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START + 86400, rollup.dayStart());
+}
+
+static void test_json(void) {
+  rollup.add(DAY_START + 30, 1);
+  rollup.add(DAY_START + 15 * 60 + 90, 1);
+  char out[768];
+  size_t length = rollup.json(out, sizeof(out), 1);
+  TEST_ASSERT_EQUAL(strlen(out), length);
+  TEST_ASSERT_EQUAL_STRING(
+      "{\"day\":\"2024-12-14 17:00:00\",\"quarter\":1,\"minutes\":[0,1,0,0,0,0,0,0,0,0,0,0,0,0,0],"
+      "\"quarters\":[1,1],\"hours\":[2],\"total\":2}",
+      out);
+  TEST_ASSERT_EQUAL(0, rollup.json(out, 40, 1));
+  TEST_ASSERT_EQUAL_STRING("", out);
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_day_of);
+  RUN_TEST(test_buckets);
+  RUN_TEST(test_retraction);
+  RUN_TEST(test_outside_day);
+  RUN_TEST(test_sums);
+  RUN_TEST(test_rebuild);
+  RUN_TEST(test_start_day_clears);
+  RUN_TEST(test_json);
+  return UNITY_END();
+}
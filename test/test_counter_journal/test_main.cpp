@@ -0,0 +1,267 @@
+// Counter journal recovery and the GateCount.csv fallback: pio test -e native -f test_counter_journal
+#include <string.h>
+#include <unity.h>
+
+#include "CounterJournal.h"
+
+#define DAY_START 1734195600UL  // 2024-12-14 17:00:00, the daily reset
+
+// The journal file, one record per slot, unwritten slots can't be read
+static JournalRecord slots[JOURNAL_SLOTS];
+static bool written[JOURNAL_SLOTS];
+
+static bool readSlot(uint16_t slot, JournalRecord &record, void *) {
+  if (!written[slot]) return false;
+  record = slots[slot];
+  return true;
+}
+
+static void write(uint16_t slot, const JournalRecord &record) {
+  slots[slot] = record;
+  written[slot] = true;
+}
+
+// A reset half way through writing it
+static void tear(uint16_t slot) { ((uint8_t *)&slots[slot])[12] ^= 0x5A; }
+
+static CounterJournal journal;
+static uint32_t countSeq;
+
+void setUp(void) {
+  memset(slots, 0, sizeof(slots));
+  memset(written, 0, sizeof(written));
+  journal = CounterJournal();
+  countSeq = 0;
+}
+
+void tearDown(void) {}
+
+static CounterState startState(int32_t dailyCars, int32_t carCounterCars) {
+  CounterState state;
+  memset(&state, 0, sizeof(state));
+  state.unixtime = DAY_START;
+  state.dailyCars = dailyCars;
+  state.carCounterCars = carCounterCars;
+  return state;
+}
+
+static uint16_t count(int16_t cars) {
+  JournalRecord record;
+  if (cars > 0) countSeq++;
+  uint16_t slot = journal.counted(cars, countSeq, DAY_START + countSeq, record);
+  write(slot, record);
+  return slot;
+}
+
+static void assertState(const CounterState &expected, const CounterState &actual) {
+  TEST_ASSERT_EQUAL_UINT32(expected.unixtime, actual.unixtime);
+  TEST_ASSERT_EQUAL_INT32(expected.dailyCars, actual.dailyCars);
+  TEST_ASSERT_EQUAL_INT32(expected.carCounterCars, actual.carCounterCars);
+  TEST_ASSERT_EQUAL_UINT32(expected.countSeq, actual.countSeq);
+}
+
+static void test_empty(void) {
+  CounterState state;
+  TEST_ASSERT_FALSE(journal.recover(readSlot, NULL, state));
+  JournalRecord record;
+  TEST_ASSERT_EQUAL_UINT16(1, journal.set(startState(0, 0), record));
+  TEST_ASSERT_EQUAL_UINT32(1, record.seq);
+}
+
+// A checkpoint with deltas on top, recovered as it was
+static void test_deltas(void) {
+  JournalRecord record;
+  write(journal.set(startState(10, 50), record), record);
+  for (int i = 0; i < 7; i++) count(1);
+  count(-1);
+  CounterState expected = journal.state();
+  TEST_ASSERT_EQUAL_INT32(16, expected.dailyCars);
+
+  CounterJournal rebooted;
+  CounterState state;
+  TEST_ASSERT_TRUE(rebooted.recover(readSlot, NULL, state));
+  assertState(expected, state);
+  TEST_ASSERT_EQUAL_UINT32(journal.recordCount(), rebooted.recordCount());
+}
+
+// Torn newest checkpoint: the checkpoint before it and its deltas, up to the car before
+static void test_torn_checkpoint(void) {
+  JournalRecord record;
+  write(journal.set(startState(0, 0), record), record);
+  CounterState before;
+  uint16_t slot;
+  int checkpoints = 0;
+  for (;;) {
+    before = journal.state();
+    slot = count(1);
+    if (slots[slot].type == JOURNAL_CHECKPOINT && ++checkpoints == 2) break;
+  }
+  TEST_ASSERT_TRUE(journal.recordCount() > JOURNAL_CHECKPOINT_EVERY);
+  tear(slot);
+
+  CounterJournal rebooted;
+  CounterState state;
+  TEST_ASSERT_TRUE(rebooted.recover(readSlot, NULL, state));
+  assertState(before, state);
+  // writing carries on in the torn slot
+  TEST_ASSERT_EQUAL_UINT16(slot, rebooted.counted(1, countSeq + 1, DAY_START + 9999, record));
+}
+
+// Hundreds of cars, the ring has gone round several times
+static void test_ring_wrap(void) {
+  JournalRecord record;
+  write(journal.set(startState(0, 0), record), record);
+  for (int i = 0; i < 1000; i++) count(i % 9 == 8 ? -1 : 1);
+  TEST_ASSERT_TRUE(journal.recordCount() > 3 * JOURNAL_SLOTS);
+  CounterState expected = journal.state();
+
+  CounterJournal rebooted;
+  CounterState state;
+  TEST_ASSERT_TRUE(rebooted.recover(readSlot, NULL, state));
+  assertState(expected, state);
+  TEST_ASSERT_EQUAL_UINT32(journal.recordCount(), rebooted.recordCount());
+
+  // and again after carrying on from there
+  journal = rebooted;
+  for (int i = 0; i < 300; i++) count(1);
+  CounterJournal again;
+  TEST_ASSERT_TRUE(again.recover(readSlot, NULL, state));
+  assertState(journal.state(), state);
+}
+
+// A delta that never made it: recovery stops at the gap, new records go after the newest
+static void test_gap(void) {
+  JournalRecord record;
+  write(journal.set(startState(0, 0), record), record);
+  for (int i = 0; i < 40; i++) count(1);
+  CounterState before = journal.state();
+  uint16_t lost = count(1);
+  for (int i = 0; i < 5; i++) count(1);
+  written[lost] = false;
+  uint32_t newest = journal.recordCount();
+
+  CounterJournal rebooted;
+  CounterState state;
+  TEST_ASSERT_TRUE(rebooted.recover(readSlot, NULL, state));
+  assertState(before, state);
+  TEST_ASSERT_EQUAL_UINT32(newest, rebooted.recordCount());
+
+  // GateApp writes a checkpoint of what it starts from, the next boot goes from there
+  state.dailyCars = 46;
+  write(rebooted.set(state, record), record);
+  CounterJournal again;
+  CounterState recovered;
+  TEST_ASSERT_TRUE(again.recover(readSlot, NULL, recovered));
+  TEST_ASSERT_EQUAL_INT32(46, recovered.dailyCars);
+}
+
+// A write that never reached the card leaves the record from the last time round,
+// which is read as a gap, not as the newest
+static void test_stale_slot(void) {
+  JournalRecord record;
+  write(journal.set(startState(0, 0), record), record);
+  for (int i = 0; i < 4; i++) count(1);
+  JournalRecord stale = slots[5];
+  for (int i = 0; i < JOURNAL_SLOTS - 1; i++) count(1);
+  CounterState before = journal.state();
+  uint16_t lost = count(1);
+  TEST_ASSERT_EQUAL_UINT16(5, lost);
+  TEST_ASSERT_EQUAL(JOURNAL_DELTA, slots[lost].type);
+  for (int i = 0; i < 3; i++) count(1);
+  write(lost, stale);
+
+  CounterJournal rebooted;
+  CounterState state;
+  TEST_ASSERT_TRUE(rebooted.recover(readSlot, NULL, state));
+  assertState(before, state);
+  TEST_ASSERT_EQUAL_UINT32(journal.recordCount(), rebooted.recordCount());
+}
+
+static void test_row_state(void) {
+  CounterState state;
+  TEST_ASSERT_TRUE(gateCountRowState(
+      "2024-12-14 19:29:15, 4383, 900, 8, 132, 37, 28 , 28745496 , 28751119, 0, 28755502, 310, car\r\n", state));
+  TEST_ASSERT_EQUAL_UINT32(DAY_START + 2 * 3600 + 29 * 60 + 15, state.unixtime);
+  TEST_ASSERT_EQUAL_INT32(132, state.dailyCars);
+  TEST_ASSERT_EQUAL_INT32(132 + 37, state.carCounterCars);
+  TEST_ASSERT_EQUAL_UINT32(310, state.countSeq);
+  // empty Class column
+  TEST_ASSERT_TRUE(gateCountRowState("2024-12-14 19:29:15, 4383, 900, 8, 132, 37, 28 , 1 , 2, 0, 3, 311, ", state));
+  TEST_ASSERT_EQUAL_UINT32(311, state.countSeq);
+}
+
+static void test_row_header_or_short(void) {
+  CounterState state;
+  TEST_ASSERT_FALSE(gateCountRowState(
+      "Date Time,Pass Timer,NoCar Timer,Bounces,Car#,Cars In Park,Temp,Last Car Millis, This Car Millis,Bounce "
+      "Flag,Millis,Seq,Class",
+      state));
+  TEST_ASSERT_FALSE(gateCountRowState("2024-12-14 19:29:15, 4383, 900, 8, 132, 37", state));
+  // written before there was a Seq column
+  TEST_ASSERT_FALSE(gateCountRowState("2024-12-14 19:29:15, 4383, 900, 8, 132, 37, 28 , 1 , 2, 0, 3", state));
+  TEST_ASSERT_FALSE(gateCountRowState("", state));
+}
+
+static CounterState at(uint32_t unixtime, int32_t dailyCars, uint32_t seq) {
+  CounterState state = startState(dailyCars, dailyCars + 40);
+  state.unixtime = unixtime;
+  state.countSeq = seq;
+  return state;
+}
+
+// The row has a car the journal hasn't, the journal write was lost
+static void test_restore_row_ahead(void) {
+  CounterState journalState = at(DAY_START + 600, 20, 300), row = at(DAY_START + 610, 21, 301), state;
+  TEST_ASSERT_EQUAL(COUNTERS_CSV, restoreCounterState(&journalState, &row, DAY_START, state));
+  assertState(row, state);
+}
+
+// The journal has a retraction the row can't show, or the row wasn't flushed
+static void test_restore_journal_ahead(void) {
+  CounterState journalState = at(DAY_START + 620, 20, 301), row = at(DAY_START + 610, 21, 301), state;
+  TEST_ASSERT_EQUAL(COUNTERS_JOURNAL, restoreCounterState(&journalState, &row, DAY_START, state));
+  assertState(journalState, state);
+  journalState.countSeq = 305;
+  TEST_ASSERT_EQUAL(COUNTERS_JOURNAL, restoreCounterState(&journalState, &row, DAY_START, state));
+}
+
+static void test_restore_one_source(void) {
+  CounterState journalState = at(DAY_START + 600, 20, 300), state;
+  TEST_ASSERT_EQUAL(COUNTERS_JOURNAL, restoreCounterState(&journalState, NULL, DAY_START, state));
+  assertState(journalState, state);
+  TEST_ASSERT_EQUAL(COUNTERS_CSV, restoreCounterState(NULL, &journalState, DAY_START, state));
+  TEST_ASSERT_EQUAL(COUNTERS_NEW, restoreCounterState(NULL, NULL, DAY_START, state));
+  TEST_ASSERT_EQUAL_INT32(0, state.dailyCars);
+  TEST_ASSERT_EQUAL_UINT32(0, state.countSeq);
+}
+
+// Yesterday's counts are gone after the daily reset, the sequence numbers aren't
+static void test_restore_new_day(void) {
+  CounterState journalState = at(DAY_START - 60, 500, 800), row = at(DAY_START - 30, 501, 801), state;
+  TEST_ASSERT_EQUAL(COUNTERS_NEW, restoreCounterState(&journalState, &row, DAY_START, state));
+  TEST_ASSERT_EQUAL_INT32(0, state.dailyCars);
+  TEST_ASSERT_EQUAL_INT32(0, state.carCounterCars);
+  TEST_ASSERT_EQUAL_UINT32(801, state.countSeq);
+  // a row from yesterday doesn't beat today's journal
+  journalState = at(DAY_START + 5, 0, 800);
+  TEST_ASSERT_EQUAL(COUNTERS_JOURNAL, restoreCounterState(&journalState, &row, DAY_START, state));
+  TEST_ASSERT_EQUAL_UINT32(801, state.countSeq);
+  TEST_ASSERT_EQUAL_STRING("journal", counterSourceName(COUNTERS_JOURNAL));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_empty);
+  RUN_TEST(test_deltas);
+  RUN_TEST(test_torn_checkpoint);
+  RUN_TEST(test_ring_wrap);
+  RUN_TEST(test_gap);
+  RUN_TEST(test_stale_slot);
+  RUN_TEST(test_row_state);
+  RUN_TEST(test_row_header_or_short);
+  RUN_TEST(test_restore_row_ahead);
+  RUN_TEST(test_restore_journal_ahead);
+  RUN_TEST(test_restore_one_source);
+  RUN_TEST(test_restore_new_day);
+  return UNITY_END();
+}
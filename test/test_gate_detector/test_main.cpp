@@ -0,0 +1,240 @@
+// GateDetector edge semantics: pio test -e native -f test_gate_detector
+#include <string.h>
+#include <unity.h>
+
+#include "GateDetector.h"
+
+#define S 1000000UL  // 1 s in micros
+#define MS 1000UL
+
+// Easy numbers: counted 1 s after the last HIGH, two cars on LOWs 2.5 s apart, stuck after 20 s
+static const DetectorConfig config = {1000, 2500, 20000, 2};
+
+static DetectorEvent events[32];
+static uint8_t eventCount;
+
+static void record(const DetectorEvent &event, void *) {
+  if (eventCount < 32) events[eventCount++] = event;
+}
+
+static uint8_t countOf(uint8_t type) {
+  uint8_t count = 0;
+  for (uint8_t i = 0; i < eventCount; i++) count += events[i].type == type;
+  return count;
+}
+
+static const DetectorEvent *last(uint8_t type) {
+  for (uint8_t i = eventCount; i-- > 0;) {
+    if (events[i].type == type) return &events[i];
+  }
+  return NULL;
+}
+
+static GateDetector detector;
+
+void setUp(void) {
+  eventCount = 0;
+  detector.setConfig(config);
+  detector.setListener(record, NULL);
+  detector.reset(SENSOR_HIGH);
+}
+
+void tearDown(void) {}
+
+// Two bounces then HIGH, counted when the no car timer ran out, however late the poll
+static void test_counted_when_no_car_timer_runs_out(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 300 * MS, SENSOR_LOW);
+  detector.onEdge(1 * S + 400 * MS, SENSOR_HIGH);
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_CAR_START));
+  TEST_ASSERT_EQUAL(2, countOf(DETECTOR_BOUNCE));
+  TEST_ASSERT_TRUE(detector.carPresent());
+
+  detector.poll(2 * S + 400 * MS - 1);
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_CAR_COUNTED));
+  detector.poll(5 * S);
+  const DetectorEvent *counted = last(DETECTOR_CAR_COUNTED);
+  TEST_ASSERT_NOT_NULL(counted);
+  TEST_ASSERT_EQUAL_UINT32(2 * S + 400 * MS, counted->micros);
+  TEST_ASSERT_EQUAL_UINT32(1 * S, counted->carStartUs);
+  TEST_ASSERT_EQUAL_UINT16(2, counted->bounces);
+  TEST_ASSERT_EQUAL_UINT32(1400, counted->passMs);
+  TEST_ASSERT_EQUAL_UINT32(400, counted->lastHighMs);
+  TEST_ASSERT_EQUAL_UINT32(1000, counted->noCarMs);
+  TEST_ASSERT_FALSE(detector.carPresent());
+  TEST_ASSERT_EQUAL_UINT32(1, detector.carsCounted());
+}
+
+// An edge after the timer ran out counts the car first, then starts the next one
+static void test_edge_fires_expired_timer_first(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 300 * MS, SENSOR_LOW);
+  detector.onEdge(1 * S + 400 * MS, SENSOR_HIGH);
+  detector.onEdge(3 * S, SENSOR_LOW);
+  TEST_ASSERT_EQUAL(6, eventCount);
+  TEST_ASSERT_EQUAL(DETECTOR_CAR_COUNTED, events[3].type);
+  TEST_ASSERT_EQUAL_UINT32(2 * S + 400 * MS, events[3].micros);
+  TEST_ASSERT_EQUAL(DETECTOR_CAR_START, events[4].type);
+  TEST_ASSERT_EQUAL_UINT32(3 * S, events[4].micros);
+  TEST_ASSERT_EQUAL(DETECTOR_BOUNCE, events[5].type);
+}
+
+// Fewer than minBounces, the no car timer doesn't count and the car times out
+static void test_one_bounce_times_out(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.poll(10 * S);
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_CAR_COUNTED));
+  TEST_ASSERT_TRUE(detector.carPresent());
+  detector.poll(21 * S);  // exactly stuckTimeoutMs isn't stuck yet
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_TIMEOUT));
+  detector.poll(22 * S);
+  const DetectorEvent *timeout = last(DETECTOR_TIMEOUT);
+  TEST_ASSERT_NOT_NULL(timeout);
+  TEST_ASSERT_EQUAL_UINT32(21 * S + 1, timeout->micros);
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_CAR_COUNTED));
+  TEST_ASSERT_EQUAL_UINT32(1, detector.timeoutCount());
+  TEST_ASSERT_FALSE(detector.carPresent());
+}
+
+// Held LOW past the stuck timeout, dropped on the HIGH edge
+static void test_stuck_low_times_out_on_high_edge(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.poll(30 * S);
+  TEST_ASSERT_TRUE(detector.carPresent());
+  detector.onEdge(30 * S, SENSOR_HIGH);
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_TIMEOUT));
+  TEST_ASSERT_EQUAL_UINT32(30 * S, last(DETECTOR_TIMEOUT)->micros);
+  TEST_ASSERT_FALSE(detector.carPresent());
+}
+
+// LOW edges more than bounceGapMs apart are two cars, the second starts on that edge
+static void test_long_gap_splits_two_cars(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 500 * MS, SENSOR_LOW);
+  detector.onEdge(4 * S, SENSOR_HIGH);
+  detector.onEdge(4 * S + 500 * MS, SENSOR_LOW);  // 3 s after the last LOW
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_CAR_COUNTED));
+  const DetectorEvent *counted = last(DETECTOR_CAR_COUNTED);
+  TEST_ASSERT_EQUAL_UINT32(4 * S + 500 * MS, counted->micros);
+  TEST_ASSERT_EQUAL_UINT32(1 * S, counted->carStartUs);
+  TEST_ASSERT_EQUAL_UINT16(3, counted->bounces);
+  // new car, its first bounce on the same edge
+  TEST_ASSERT_EQUAL(DETECTOR_BOUNCE, events[eventCount - 1].type);
+  TEST_ASSERT_EQUAL_UINT16(1, events[eventCount - 1].bounces);
+  TEST_ASSERT_EQUAL_UINT32(4 * S + 500 * MS, events[eventCount - 1].carStartUs);
+  TEST_ASSERT_EQUAL(DETECTOR_CAR_START, events[eventCount - 2].type);
+  TEST_ASSERT_TRUE(detector.carPresent());
+}
+
+// Gaps up to bounceGapMs stay one car
+static void test_gap_at_limit_is_one_car(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 500 * MS, SENSOR_LOW);
+  detector.onEdge(3 * S + 900 * MS, SENSOR_HIGH);
+  detector.onEdge(4 * S, SENSOR_LOW);  // exactly 2.5 s
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_CAR_COUNTED));
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_CAR_START));
+}
+
+// The same level twice is not an edge
+static void test_repeated_level_ignored(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 10 * MS, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 110 * MS, SENSOR_HIGH);
+  TEST_ASSERT_EQUAL_UINT32(2, detector.edgeCount());
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_BOUNCE));
+}
+
+// A HIGH edge with no car present doesn't start one, reset() takes the level as given
+static void test_high_without_car(void) {
+  detector.reset(SENSOR_LOW);
+  detector.onEdge(1 * S, SENSOR_HIGH);
+  TEST_ASSERT_EQUAL(0, eventCount);
+  TEST_ASSERT_FALSE(detector.carPresent());
+  TEST_ASSERT_EQUAL(SENSOR_HIGH, detector.level());
+}
+
+// A poll older than the newest edge does nothing
+static void test_stale_poll_ignored(void) {
+  detector.onEdge(1 * S, SENSOR_LOW);
+  detector.onEdge(1 * S + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(1 * S + 300 * MS, SENSOR_LOW);
+  detector.onEdge(5 * S, SENSOR_HIGH);
+  detector.poll(4 * S);
+  TEST_ASSERT_EQUAL(0, countOf(DETECTOR_CAR_COUNTED));
+  detector.poll(6 * S);
+  TEST_ASSERT_EQUAL(1, countOf(DETECTOR_CAR_COUNTED));
+}
+
+// Counts go on across the micros() wrap at about 71 minutes
+static void test_micros_wrap(void) {
+  uint32_t start = 0xFFFFFFFFUL - 500 * MS;
+  detector.onEdge(start, SENSOR_LOW);
+  detector.onEdge(start + 100 * MS, SENSOR_HIGH);
+  detector.onEdge(start + 300 * MS, SENSOR_LOW);
+  detector.onEdge(start + 400 * MS, SENSOR_HIGH);
+  detector.poll(start + 2 * S);
+  const DetectorEvent *counted = last(DETECTOR_CAR_COUNTED);
+  TEST_ASSERT_NOT_NULL(counted);
+  TEST_ASSERT_EQUAL_UINT32((uint32_t)(start + 1400 * MS), counted->micros);
+  TEST_ASSERT_EQUAL_UINT32(1400, counted->passMs);
+}
+
+// A profile built in counts exactly like the runtime detector set to the same thresholds
+static DetectorEvent fixedEvents[32];
+static uint8_t fixedCount;
+
+static void recordFixed(const DetectorEvent &event, void *) {
+  if (fixedCount < 32) fixedEvents[fixedCount++] = event;
+}
+
+static void test_fixed_profile_matches_runtime(void) {
+  static const uint32_t trace[][2] = {
+      {1000000, 0}, {1050000, 1}, {1200000, 0}, {1300000, 1},                 // car, counted 900 ms later
+      {3000000, 0}, {3100000, 1}, {3400000, 0}, {5700000, 1}, {5750000, 0},   // gap split
+      {5800000, 1}, {8000000, 0},                                             // one bounce, then the next car
+      {30000000, 1}};
+  NormalExitDetector fixed;
+  fixed.setListener(recordFixed, NULL);
+  fixed.reset(SENSOR_HIGH);
+  fixedCount = 0;
+  DetectorConfig normal = DETECTOR_PROFILE_CONFIG(NormalExitProfile);
+  detector.setConfig(normal);
+  for (size_t i = 0; i < sizeof(trace) / sizeof(trace[0]); i++) {
+    detector.onEdge(trace[i][0], trace[i][1]);
+    fixed.onEdge(trace[i][0], trace[i][1]);
+  }
+  detector.poll(60 * S);
+  fixed.poll(60 * S);
+  TEST_ASSERT_EQUAL(eventCount, fixedCount);
+  TEST_ASSERT_TRUE(eventCount > 8);
+  for (uint8_t i = 0; i < eventCount; i++) {
+    TEST_ASSERT_EQUAL(events[i].type, fixedEvents[i].type);
+    TEST_ASSERT_EQUAL_UINT32(events[i].micros, fixedEvents[i].micros);
+    TEST_ASSERT_EQUAL_UINT16(events[i].bounces, fixedEvents[i].bounces);
+  }
+  TEST_ASSERT_EQUAL_UINT32(detector.carsCounted(), fixed.carsCounted());
+  TEST_ASSERT_EQUAL_UINT32(detector.timeoutCount(), fixed.timeoutCount());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_counted_when_no_car_timer_runs_out);
+  RUN_TEST(test_edge_fires_expired_timer_first);
+  RUN_TEST(test_one_bounce_times_out);
+  RUN_TEST(test_stuck_low_times_out_on_high_edge);
+  RUN_TEST(test_long_gap_splits_two_cars);
+  RUN_TEST(test_gap_at_limit_is_one_car);
+  RUN_TEST(test_repeated_level_ignored);
+  RUN_TEST(test_high_without_car);
+  RUN_TEST(test_stale_poll_ignored);
+  RUN_TEST(test_micros_wrap);
+  RUN_TEST(test_fixed_profile_matches_runtime);
+  return UNITY_END();
+}
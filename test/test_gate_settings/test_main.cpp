@@ -0,0 +1,131 @@
+// Config messages from msb/traffic/exit/config: pio test -e native -f test_gate_settings
+#include <string.h>
+#include <unity.h>
+
+#include "SettingsMessage.h"
+
+static GateSettings settings;
+static bool defaults;
+
+void setUp(void) {
+  DetectorConfig normal = DETECTOR_PROFILE_CONFIG(NormalExitProfile);
+  settings.detector = normal;
+  settings.verbosity = LOG_VERBOSE_CARS;
+  defaults = false;
+}
+
+void tearDown(void) {}
+
+static void assertUnchanged(void) {
+  TEST_ASSERT_EQUAL_UINT32(NormalExitProfile::nocarTimeoutMs, settings.detector.nocarTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT32(NormalExitProfile::bounceGapMs, settings.detector.bounceGapMs);
+  TEST_ASSERT_EQUAL_UINT32(NormalExitProfile::stuckTimeoutMs, settings.detector.stuckTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT16(NormalExitProfile::minBounces, settings.detector.minBounces);
+  TEST_ASSERT_EQUAL_UINT8(LOG_VERBOSE_CARS, settings.verbosity);
+}
+
+// Only the keys sent change
+static void test_partial_message(void) {
+  TEST_ASSERT_NULL(settingsParse("{\"nocar\":1000, \"gap\" : 2500}", settings, defaults));
+  TEST_ASSERT_EQUAL_UINT32(1000, settings.detector.nocarTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT32(2500, settings.detector.bounceGapMs);
+  TEST_ASSERT_EQUAL_UINT32(NormalExitProfile::stuckTimeoutMs, settings.detector.stuckTimeoutMs);
+  TEST_ASSERT_FALSE(defaults);
+}
+
+static void test_all_keys(void) {
+  TEST_ASSERT_NULL(settingsParse("{\"nocar\":700,\"gap\":1500,\"stuck\":8000,\"bounces\":3,\"verbosity\":2}",
+                                 settings, defaults));
+  TEST_ASSERT_EQUAL_UINT32(700, settings.detector.nocarTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT32(1500, settings.detector.bounceGapMs);
+  TEST_ASSERT_EQUAL_UINT32(8000, settings.detector.stuckTimeoutMs);
+  TEST_ASSERT_EQUAL_UINT16(3, settings.detector.minBounces);
+  TEST_ASSERT_EQUAL_UINT8(LOG_VERBOSE_BOUNCES, settings.verbosity);
+}
+
+// Every limit at its edge is taken, one past it is not
+static void test_limits(void) {
+  TEST_ASSERT_NULL(settingsParse("{\"nocar\":100}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"nocar\":99}", settings, defaults));
+  TEST_ASSERT_NULL(settingsParse("{\"gap\":200}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"gap\":199}", settings, defaults));
+  TEST_ASSERT_NULL(settingsParse("{\"gap\":30000}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"gap\":30001}", settings, defaults));
+  TEST_ASSERT_NULL(settingsParse("{\"stuck\":120000}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"stuck\":120001}", settings, defaults));
+  TEST_ASSERT_NULL(settingsParse("{\"bounces\":50}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"bounces\":51}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"bounces\":0}", settings, defaults));
+  TEST_ASSERT_NOT_NULL(settingsParse("{\"verbosity\":3}", settings, defaults));
+}
+
+// A bad value anywhere leaves everything as it was, including the good keys
+static void test_rejected_message_changes_nothing(void) {
+  TEST_ASSERT_EQUAL_STRING("nocar out of range", settingsParse("{\"gap\":2500,\"nocar\":50}", settings, defaults));
+  assertUnchanged();
+  TEST_ASSERT_EQUAL_STRING("stuck must be longer than nocar",
+                           settingsParse("{\"nocar\":5000,\"stuck\":5000}", settings, defaults));
+  assertUnchanged();
+  TEST_ASSERT_EQUAL_STRING("nocar out of range", settingsParse("{\"nocar\":-900}", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("bounces out of range", settingsParse("{\"bounces\":65537}", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("verbosity out of range", settingsParse("{\"verbosity\":-1}", settings, defaults));
+  assertUnchanged();
+}
+
+static void test_not_whole_numbers(void) {
+  TEST_ASSERT_EQUAL_STRING("values must be whole numbers", settingsParse("{\"nocar\":900.5}", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("values must be whole numbers", settingsParse("{\"nocar\":\"900\"}", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("values must be whole numbers", settingsParse("{\"gap\" 2500}", settings, defaults));
+  assertUnchanged();
+}
+
+static void test_not_settings(void) {
+  TEST_ASSERT_EQUAL_STRING("not a JSON object", settingsParse("nocar=900", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("no known settings", settingsParse("{\"nocars\":900}", settings, defaults));
+  TEST_ASSERT_EQUAL_STRING("no known settings", settingsParse("{}", settings, defaults));
+  assertUnchanged();
+}
+
+// {"defaults":1} is for the caller, the settings themselves stay
+static void test_defaults(void) {
+  TEST_ASSERT_NULL(settingsParse("{\"defaults\":1}", settings, defaults));
+  TEST_ASSERT_TRUE(defaults);
+  TEST_ASSERT_NULL(settingsParse("{\"defaults\":true}", settings, defaults));
+  TEST_ASSERT_TRUE(defaults);
+  TEST_ASSERT_NULL(settingsParse("{\"defaults\":0,\"nocar\":1200}", settings, defaults));
+  TEST_ASSERT_FALSE(defaults);
+  TEST_ASSERT_EQUAL_UINT32(1200, settings.detector.nocarTimeoutMs);
+}
+
+// Settings saved before a limit was tightened are caught when they are loaded
+static void test_check(void) {
+  TEST_ASSERT_NULL(settingsCheck(settings));
+  settings.detector.stuckTimeoutMs = 200000;
+  TEST_ASSERT_EQUAL_STRING("stuck out of range", settingsCheck(settings));
+}
+
+static void test_json(void) {
+  char out[160];
+  size_t length = settingsJson(settings, "normal", NULL, out, sizeof(out));
+  TEST_ASSERT_EQUAL_STRING("{\"profile\":\"normal\",\"nocar\":900,\"gap\":2000,\"stuck\":10000,\"bounces\":2,\"verbosity\":1}",
+                           out);
+  TEST_ASSERT_EQUAL(strlen(out), length);
+  settingsJson(settings, "normal", "gap out of range", out, sizeof(out));
+  TEST_ASSERT_TRUE(strstr(out, ",\"error\":\"gap out of range\"}") != NULL);
+  // too small for it, nothing rather than half a message
+  TEST_ASSERT_EQUAL(0, settingsJson(settings, "normal", NULL, out, 40));
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_partial_message);
+  RUN_TEST(test_all_keys);
+  RUN_TEST(test_limits);
+  RUN_TEST(test_rejected_message_changes_nothing);
+  RUN_TEST(test_not_whole_numbers);
+  RUN_TEST(test_not_settings);
+  RUN_TEST(test_defaults);
+  RUN_TEST(test_check);
+  RUN_TEST(test_json);
+  return UNITY_END();
+}
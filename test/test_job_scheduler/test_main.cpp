@@ -0,0 +1,163 @@
+// Timed jobs, catch-up and the clock set back: pio test -e native -f test_job_scheduler
+#include <unity.h>
+
+#include "JobScheduler.h"
+
+#define MIDNIGHT 1734134400UL  // 2024-12-14 00:00:00
+#define HOUR 3600UL
+
+struct Runs {
+  uint32_t count;
+  uint32_t lastDue;
+  bool done;  // what the job returns
+};
+
+static bool job(uint32_t due, void *context) {
+  Runs *runs = (Runs *)context;
+  if (!runs->done) return false;
+  runs->count++;
+  runs->lastDue = due;
+  return true;
+}
+
+static JobScheduler scheduler;
+static Runs reset, temp;
+
+void setUp(void) {
+  scheduler = JobScheduler();
+  reset = Runs{0, 0, true};
+  temp = Runs{0, 0, true};
+}
+
+void tearDown(void) {}
+
+// The first daily run is the next one after now, today if it's still to come
+static void test_daily_first(void) {
+  TEST_ASSERT_TRUE(scheduler.daily(MIDNIGHT + 9 * HOUR, 17, 0, 0, job, &reset, "reset"));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 17 * HOUR, scheduler.nextDue());
+  JobScheduler late;
+  late.daily(MIDNIGHT + 17 * HOUR, 17, 0, 0, job, &reset, "reset");
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 41 * HOUR, late.nextDue());
+}
+
+static void test_runs_when_due(void) {
+  scheduler.daily(MIDNIGHT + 9 * HOUR, 17, 0, 0, job, &reset, "reset");
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 17 * HOUR - 1));
+  TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + 17 * HOUR));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 17 * HOUR, reset.lastDue);
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 17 * HOUR + 1));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 41 * HOUR, scheduler.nextDue());
+  TEST_ASSERT_EQUAL_UINT32(0, scheduler.lateRuns());
+}
+
+// loop() held up across 17:00, the reset still runs, once, a few seconds late
+static void test_late_runs_once(void) {
+  scheduler.daily(MIDNIGHT + 9 * HOUR, 17, 0, 0, job, &reset, "reset");
+  TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + 17 * HOUR + 4));
+  TEST_ASSERT_EQUAL_UINT32(1, scheduler.lateRuns());
+  TEST_ASSERT_EQUAL_UINT32(4, scheduler.maxLateS());
+}
+
+// Missed several periods (the gate was off), runs once and goes on from now
+static void test_catch_up_once(void) {
+  scheduler.every(MIDNIGHT, 60, job, &temp, "temp");
+  TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + 3 * HOUR + 30));
+  TEST_ASSERT_EQUAL_UINT32(1, temp.count);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT, temp.lastDue);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 3 * HOUR + 60, scheduler.nextDue());
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 3 * HOUR + 59));
+  TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + 3 * HOUR + 60));
+}
+
+// A job that isn't done is run again on the next pass, at the same due time
+static void test_not_done_retried(void) {
+  scheduler.every(MIDNIGHT, 60, job, &temp, "temp");
+  temp.done = false;
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT));
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 5));
+  temp.done = true;
+  TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + 10));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT, temp.lastDue);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 60, scheduler.nextDue());
+}
+
+// Earliest first, whatever order they went in
+static void test_heap_order(void) {
+  static Runs runs[JOB_MAX];
+  static const uint32_t offsets[JOB_MAX] = {700, 100, 500, 300, 800, 200, 600, 400};
+  for (uint8_t i = 0; i < JOB_MAX; i++) {
+    runs[i] = Runs{0, 0, true};
+    TEST_ASSERT_TRUE(scheduler.every(MIDNIGHT + offsets[i], HOUR, job, &runs[i], "job"));
+  }
+  TEST_ASSERT_FALSE(scheduler.every(MIDNIGHT, 60, job, &temp, "one too many"));
+  TEST_ASSERT_FALSE(JobScheduler().every(MIDNIGHT, 0, job, &temp, "no period"));
+  for (uint32_t t = 100; t <= 800; t += 100) {
+    TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + t, scheduler.nextDue());
+    TEST_ASSERT_EQUAL(1, scheduler.run(MIDNIGHT + t));
+  }
+  for (uint8_t i = 0; i < JOB_MAX; i++) TEST_ASSERT_EQUAL_UINT32(1, runs[i].count);
+  TEST_ASSERT_EQUAL_UINT32(JOB_MAX, scheduler.runs());
+}
+
+// A fast RTC reset at 17:00 and NTP then sets it back 30 s: no second reset today
+static void test_small_set_back_keeps_day(void) {
+  scheduler.daily(MIDNIGHT + 9 * HOUR, 17, 0, 0, job, &reset, "reset");
+  scheduler.run(MIDNIGHT + 17 * HOUR);
+  TEST_ASSERT_EQUAL_UINT32(1, reset.count);
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 17 * HOUR - 30));
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 17 * HOUR + 10));
+  TEST_ASSERT_EQUAL_UINT32(1, reset.count);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 41 * HOUR, scheduler.nextDue());
+}
+
+// An RTC a day and a half ahead at boot, set right by NTP: the reset comes back to
+// today's 17:00 instead of waiting a day
+static void test_set_back_whole_days(void) {
+  scheduler.daily(MIDNIGHT + 9 * HOUR + 36 * HOUR, 17, 0, 0, job, &reset, "reset");
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 65 * HOUR, scheduler.nextDue());
+  scheduler.every(MIDNIGHT + 45 * HOUR + 60, 60, job, &temp, "temp");
+  scheduler.run(MIDNIGHT + 45 * HOUR);
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT + 9 * HOUR));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 9 * HOUR + 60, scheduler.nextDue());
+  TEST_ASSERT_EQUAL_STRING("temp", scheduler.nextName());
+  scheduler.run(MIDNIGHT + 17 * HOUR - 1);
+  TEST_ASSERT_EQUAL_UINT32(0, reset.count);
+  scheduler.run(MIDNIGHT + 17 * HOUR);
+  TEST_ASSERT_EQUAL_UINT32(1, reset.count);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 17 * HOUR, reset.lastDue);
+}
+
+// The reset ran at 17:00 on an RTC 42 hours ahead, really 23:00 last night.
+// Set right, it resets again at 17:00 today.
+static void test_set_back_after_run(void) {
+  scheduler.daily(MIDNIGHT + 40 * HOUR, 17, 0, 0, job, &reset, "reset");
+  scheduler.run(MIDNIGHT + 41 * HOUR);
+  TEST_ASSERT_EQUAL_UINT32(1, reset.count);
+  TEST_ASSERT_EQUAL(0, scheduler.run(MIDNIGHT - HOUR));
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 17 * HOUR, scheduler.nextDue());
+  scheduler.run(MIDNIGHT + 17 * HOUR);
+  TEST_ASSERT_EQUAL_UINT32(2, reset.count);
+}
+
+// A few seconds back before the first run, nothing moves
+static void test_small_set_back_before_run(void) {
+  scheduler.daily(MIDNIGHT + 9 * HOUR, 17, 0, 0, job, &reset, "reset");
+  scheduler.run(MIDNIGHT + 9 * HOUR);
+  scheduler.run(MIDNIGHT + 9 * HOUR - 20);
+  TEST_ASSERT_EQUAL_UINT32(MIDNIGHT + 17 * HOUR, scheduler.nextDue());
+}
+
+int main() {
+  UNITY_BEGIN();
+  RUN_TEST(test_daily_first);
+  RUN_TEST(test_runs_when_due);
+  RUN_TEST(test_late_runs_once);
+  RUN_TEST(test_catch_up_once);
+  RUN_TEST(test_not_done_retried);
+  RUN_TEST(test_heap_order);
+  RUN_TEST(test_small_set_back_keeps_day);
+  RUN_TEST(test_set_back_whole_days);
+  RUN_TEST(test_set_back_after_run);
+  RUN_TEST(test_small_set_back_before_run);
+  return UNITY_END();
+}